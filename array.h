@@ -36,6 +36,42 @@ before you include this file in *one* C/C++ file to create the implementation.
 #define array_find( array, item ) internal_array_find( (struct internal_array_t*) (array), (void*) (item) )
 #define array_item( array, index ) ARRAY_CAST( internal_array_item( (struct internal_array_t*) (array), (index) ) )
 
+// Structure-of-arrays variant: a set of columns (one per field) sharing a single count, so that loops over one field
+// don't stride over the others. Columns are added/removed in lockstep, and each column starts on an ARRAY_SOA_ALIGNMENT
+// boundary (which must be a power of two). Column capacity is always a multiple of ARRAY_SOA_ALIGNMENT items, so a vectorized kernel may process
+// `array_soa_count` rounded up to the vector width without reading outside the column.
+//      float* x = array_soa_column( particles, 0 ); float* vx = array_soa_column( particles, 1 );
+//      for( int i = 0; i < array_soa_count( particles ); ++i ) x[ i ] += vx[ i ] * dt;
+//
+#define array_soa_create( column_count, column_sizes ) internal_array_soa_create( (column_count), (column_sizes), NULL )
+#define array_soa_create_memctx( column_count, column_sizes, memctx ) internal_array_soa_create( (column_count), (column_sizes), (memctx) )
+#define array_soa_destroy( soa ) internal_array_soa_destroy( (soa) )
+#define array_soa_add( soa, items ) internal_array_soa_add( (soa), (void const* const*) (items) )
+#define array_soa_remove( soa, index ) internal_array_soa_remove( (soa), (index) )
+#define array_soa_remove_ordered( soa, index ) internal_array_soa_remove_ordered( (soa), (index) )
+#define array_soa_clear( soa ) internal_array_soa_clear( (soa) )
+#define array_soa_count( soa ) internal_array_soa_count( (soa) )
+#define array_soa_column( soa, column ) ARRAY_CAST( internal_array_soa_column( (soa), (column) ) )
+#define array_soa_item( soa, column, index ) ARRAY_CAST( internal_array_soa_item( (soa), (column), (index) ) )
+
+#ifndef ARRAY_SOA_ALIGNMENT
+    #define ARRAY_SOA_ALIGNMENT 64
+#endif
+
+#if ARRAY_SOA_ALIGNMENT <= 0 || ( ARRAY_SOA_ALIGNMENT & ( ARRAY_SOA_ALIGNMENT - 1 ) ) != 0
+    #error "ARRAY_SOA_ALIGNMENT must be a power of two"
+#endif
+
+#ifndef ARRAY_SOA_INITIAL_CAPACITY
+    #define ARRAY_SOA_INITIAL_CAPACITY 256 // rounded up to a multiple of ARRAY_SOA_ALIGNMENT
+#endif
+
+#ifndef ARRAY_SOA_MAX_COLUMNS
+    #define ARRAY_SOA_MAX_COLUMNS 16
+#endif
+
+typedef struct array_soa_t array_soa_t;
+
 
 // In C, a void* can be implicitly cast to any other kind of pointer, while in C++ you need an explicit cast. In most
 // cases, the explicit cast works for both C and C++, but if we consider the case where we have nested structs, then
@@ -82,6 +118,16 @@ int internal_array_bsearch( struct internal_array_t* array, void* key, int (*com
 int internal_array_find( struct internal_array_t* array, void* item );
 void* internal_array_item( struct internal_array_t* array, int index );
 
+array_soa_t* internal_array_soa_create( int column_count, int const* column_sizes, void* memctx );
+void internal_array_soa_destroy( array_soa_t* soa );
+int internal_array_soa_add( array_soa_t* soa, void const* const* items );
+void internal_array_soa_remove( array_soa_t* soa, int index );
+void internal_array_soa_remove_ordered( array_soa_t* soa, int index );
+void internal_array_soa_clear( array_soa_t* soa );
+int internal_array_soa_count( array_soa_t* soa );
+void* internal_array_soa_column( array_soa_t* soa, int column );
+void* internal_array_soa_item( array_soa_t* soa, int column, int index );
+
 #endif /* array_h */
 
 
@@ -120,7 +166,14 @@ void* internal_array_item( struct internal_array_t* array, int index );
     #define _CRT_NONSTDC_NO_DEPRECATE
     #define _CRT_SECURE_NO_WARNINGS
     #include <string.h>
-    #define ARRAY_MEMMOVE( dst, src, cnt ) ( memcpy( (dst), (src), (cnt) ) )
+    #define ARRAY_MEMMOVE( dst, src, cnt ) ( memmove( (dst), (src), (cnt) ) )
+#endif
+
+#ifndef ARRAY_MEMSET
+    #define _CRT_NONSTDC_NO_DEPRECATE
+    #define _CRT_SECURE_NO_WARNINGS
+    #include <string.h>
+    #define ARRAY_MEMSET( ptr, val, cnt ) ( memset( (ptr), (val), (cnt) ) )
 #endif
 
 #ifndef ARRAY_MEMCMP
@@ -263,6 +316,147 @@ void* internal_array_item( struct internal_array_t* array, int index ) {
     }
 }
 
+
+struct array_soa_t {
+    int count;
+    int capacity;
+    int column_count;
+    void* memctx;
+    void* storage;
+    int column_sizes[ ARRAY_SOA_MAX_COLUMNS ];
+    void* columns[ ARRAY_SOA_MAX_COLUMNS ];
+};
+
+
+static size_t internal_array_soa_align( size_t value ) {
+    return ( value + ( ARRAY_SOA_ALIGNMENT - 1 ) ) & ~( (size_t)ARRAY_SOA_ALIGNMENT - 1 );
+}
+
+
+// Allocates one block holding all columns at the given capacity, each column starting on an aligned boundary. The
+// existing items (if any) are copied over, and the old block released.
+static void internal_array_soa_allocate( array_soa_t* soa, int capacity ) {
+    size_t total = ARRAY_SOA_ALIGNMENT;
+    for( int i = 0; i < soa->column_count; ++i ) {
+        total += internal_array_soa_align( (size_t) capacity * soa->column_sizes[ i ] );
+    }
+    void* storage = ARRAY_MALLOC( soa->memctx, total );
+    uintptr_t base = (uintptr_t) internal_array_soa_align( (size_t)(uintptr_t) storage );
+    for( int i = 0; i < soa->column_count; ++i ) {
+        void* column = (void*) base;
+        if( soa->count > 0 ) {
+            ARRAY_MEMCPY( column, soa->columns[ i ], (size_t) soa->count * soa->column_sizes[ i ] );
+        }
+        soa->columns[ i ] = column;
+        base += internal_array_soa_align( (size_t) capacity * soa->column_sizes[ i ] );
+    }
+    if( soa->storage ) {
+        ARRAY_FREE( soa->memctx, soa->storage );
+    }
+    soa->storage = storage;
+    soa->capacity = capacity;
+}
+
+
+array_soa_t* internal_array_soa_create( int column_count, int const* column_sizes, void* memctx ) {
+    ARRAY_ASSERT( column_count > 0 && column_count <= ARRAY_SOA_MAX_COLUMNS, "Invalid column count" );
+    array_soa_t* soa = (array_soa_t*) ARRAY_MALLOC( memctx, sizeof( array_soa_t ) );
+    soa->memctx = memctx;
+    soa->count = 0;
+    soa->capacity = 0;
+    soa->column_count = column_count;
+    soa->storage = NULL;
+    for( int i = 0; i < column_count; ++i ) {
+        ARRAY_ASSERT( column_sizes[ i ] > 0, "Invalid column size" );
+        soa->column_sizes[ i ] = column_sizes[ i ];
+        soa->columns[ i ] = NULL;
+    }
+    internal_array_soa_allocate( soa, (int) internal_array_soa_align( ARRAY_SOA_INITIAL_CAPACITY > 0 ? ARRAY_SOA_INITIAL_CAPACITY : 1 ) );
+    return soa;
+}
+
+
+void internal_array_soa_destroy( array_soa_t* soa ) {
+    ARRAY_FREE( soa->memctx, soa->storage );
+    ARRAY_FREE( soa->memctx, soa );
+}
+
+
+// `items` holds one pointer per column to the value to add. A NULL pointer (for the whole list or for a single
+// column) leaves that column's new item zero-initialized. Returns the index of the added item.
+int internal_array_soa_add( array_soa_t* soa, void const* const* items ) {
+    if( soa->count >= soa->capacity ) {
+        internal_array_soa_allocate( soa, soa->capacity * 2 );
+    }
+    int index = soa->count++;
+    for( int i = 0; i < soa->column_count; ++i ) {
+        int size = soa->column_sizes[ i ];
+        void* dst = (void*)( ( (uintptr_t) soa->columns[ i ] ) + (size_t) index * size );
+        if( items && items[ i ] ) {
+            ARRAY_MEMCPY( dst, items[ i ], (size_t) size );
+        } else {
+            ARRAY_MEMSET( dst, 0, (size_t) size );
+        }
+    }
+    return index;
+}
+
+
+void internal_array_soa_remove( array_soa_t* soa, int index ) {
+    if( index >= 0 && index < soa->count ) {
+        --soa->count;
+        if( index == soa->count ) {
+            return;
+        }
+        for( int i = 0; i < soa->column_count; ++i ) {
+            int size = soa->column_sizes[ i ];
+            ARRAY_MEMCPY( (void*)( ( (uintptr_t) soa->columns[ i ] ) + (size_t) index * size ),
+                (void*)( ( (uintptr_t) soa->columns[ i ] ) + (size_t) soa->count * size ), (size_t) size );
+        }
+    }
+}
+
+
+void internal_array_soa_remove_ordered( array_soa_t* soa, int index ) {
+    if( index >= 0 && index < soa->count ) {
+        --soa->count;
+        for( int i = 0; i < soa->column_count; ++i ) {
+            int size = soa->column_sizes[ i ];
+            ARRAY_MEMMOVE( (void*)( ( (uintptr_t) soa->columns[ i ] ) + (size_t) index * size ),
+                (void*)( ( (uintptr_t) soa->columns[ i ] ) + (size_t)( index + 1 ) * size ),
+                (size_t) size * ( soa->count - index ) );
+        }
+    }
+}
+
+
+void internal_array_soa_clear( array_soa_t* soa ) {
+    soa->count = 0;
+}
+
+
+int internal_array_soa_count( array_soa_t* soa ) {
+    return soa->count;
+}
+
+
+void* internal_array_soa_column( array_soa_t* soa, int column ) {
+    if( column >= 0 && column < soa->column_count ) {
+        return soa->columns[ column ];
+    } else {
+        return NULL;
+    }
+}
+
+
+void* internal_array_soa_item( array_soa_t* soa, int column, int index ) {
+    if( column >= 0 && column < soa->column_count && index >= 0 && index < soa->count ) {
+        return (void*)( ( (uintptr_t) soa->columns[ column ] ) + (size_t) index * soa->column_sizes[ column ] );
+    } else {
+        return NULL;
+    }
+}
+
 #endif /* ARRAY_IMPLEMENTATION */
 
 /*
@@ -13,8 +13,19 @@ If you are using miniz.c for other things, and have included it in your
 project, you need to define ASSETSYS_NO_MINIZ as well, to avoid duplicate 
 definitions. 
 
+To load files in the background with `assetsys_load_async`, also define ASSETSYS_ASYNC where the implementation is 
+included. Without it, `assetsys_load_async` loads the file right away, and `assetsys_poll` only delivers the result.
+
+To read zip entries compressed with LZMA, also define ASSETSYS_LZMA where the implementation is included.
+
+To measure how fast assetsys looks up paths and loads files on a given compiler and platform, build and run the 
+benchmark (which needs thread.h), adding -DASSETSYS_ASYNC to time `assetsys_load_async` on its worker threads:
+    clang -O2 -DASSETSYS_RUN_BENCHMARK -DASSETSYS_IMPLEMENTATION -DSTRPOOL_IMPLEMENTATION -xc assetsys.h -o benchmark.exe
+
 Dependencies: 
     strpool.h
+    thread.h (only if ASSETSYS_ASYNC is defined)
+    lzma.h (only if ASSETSYS_LZMA is defined)
 */
 
 #ifndef assetsys_h
@@ -36,6 +47,8 @@ typedef enum assetsys_error_t
     ASSETSYS_ERROR_DIR_NOT_FOUND = -7, 
     ASSETSYS_ERROR_INVALID_PARAMETER = -8,
     ASSETSYS_ERROR_BUFFER_TOO_SMALL = -9,
+    ASSETSYS_ERROR_INVALID_INDEX = -10,
+    ASSETSYS_ERROR_NOT_SUPPORTED = -11,
     } assetsys_error_t;
 
 typedef struct assetsys_t assetsys_t;
@@ -45,13 +58,51 @@ void assetsys_destroy( assetsys_t* sys );
 
 assetsys_error_t assetsys_mount( assetsys_t* sys, char const* path, char const* mount_as );
 assetsys_error_t assetsys_mount_from_memory( assetsys_t* sys, void const* data, int size, char const* mount_as);
+assetsys_error_t assetsys_mount_mapped( assetsys_t* sys, char const* path, char const* mount_as );
+assetsys_error_t assetsys_mount_indexed( assetsys_t* sys, char const* path, char const* mount_as, 
+    char const* index_path );
+assetsys_error_t assetsys_index_save( assetsys_t* sys, char const* path, char const* mounted_as, 
+    char const* index_path );
 assetsys_error_t assetsys_dismount( assetsys_t* sys, char const* path, char const* mounted_as );
 
+assetsys_error_t assetsys_watch( assetsys_t* sys, char const* path, char const* mounted_as );
+int assetsys_watch_update( assetsys_t* sys );
+
 typedef struct assetsys_file_t { ASSETSYS_U64 mount; ASSETSYS_U64 path; int index; } assetsys_file_t;
 
 assetsys_error_t assetsys_file( assetsys_t* sys, char const* path, assetsys_file_t* file );
 assetsys_error_t assetsys_file_load( assetsys_t* sys, assetsys_file_t file, int* size, void* buffer, int capacity );
 int assetsys_file_size( assetsys_t* sys, assetsys_file_t file );
+void const* assetsys_file_data( assetsys_t* sys, assetsys_file_t file, int* size );
+
+typedef struct assetsys_cache_stats_t
+    {
+    ASSETSYS_U64 hits;
+    ASSETSYS_U64 misses;
+    ASSETSYS_U64 evictions;
+    ASSETSYS_U64 bytes;
+    int entries;
+    } assetsys_cache_stats_t;
+
+void assetsys_cache_budget( assetsys_t* sys, ASSETSYS_U64 bytes );
+assetsys_error_t assetsys_cache_acquire( assetsys_t* sys, assetsys_file_t file, void const** data, int* size );
+void assetsys_cache_release( assetsys_t* sys, void const* data );
+void assetsys_cache_stats( assetsys_t* sys, assetsys_cache_stats_t* stats );
+
+typedef void (*assetsys_load_callback_t)( assetsys_file_t file, assetsys_error_t result, void* buffer, int size, 
+    void* user_data );
+
+assetsys_error_t assetsys_load_async( assetsys_t* sys, assetsys_file_t file, void* buffer, int capacity, int priority,
+    assetsys_load_callback_t callback, void* user_data );
+int assetsys_poll( assetsys_t* sys );
+
+typedef struct assetsys_stream_t assetsys_stream_t;
+
+assetsys_error_t assetsys_stream_open( assetsys_t* sys, assetsys_file_t file, assetsys_stream_t** stream );
+int assetsys_stream_read( assetsys_stream_t* stream, void* buffer, int size );
+assetsys_error_t assetsys_stream_seek( assetsys_stream_t* stream, int position );
+int assetsys_stream_tell( assetsys_stream_t* stream );
+void assetsys_stream_close( assetsys_stream_t* stream );
 
 int assetsys_file_count( assetsys_t* sys, char const* path );
 char const* assetsys_file_name( assetsys_t* sys, char const* path, int index );
@@ -216,6 +267,33 @@ this:
     #define ASSETSYS_NO_MINIZ
     #include "assetsys.h"
 
+
+#### Compression methods
+
+Besides stored and deflated zip entries, assetsys.h can read entries compressed with LZ4, which decodes several times 
+faster than deflate at a somewhat lower ratio. LZ4 has no standard zip method id, so assetsys.h uses the private id
+0x4C34, and other zip tools will not be able to extract those entries. LZMA (zip method 14) gives the best ratio, but is
+the slowest to decode. It uses the LZMA decoder from lzma.h, and is enabled by defining `ASSETSYS_LZMA`. lzma.h is
+included automatically, but, like with strpool.h, the LZMA_IMPLEMENTATION define needs to be added in one place:
+
+    #define ASSETSYS_IMPLEMENTATION
+    #define ASSETSYS_LZMA
+    #define LZMA_IMPLEMENTATION
+    #include "assetsys.h"
+
+To build archives using these methods, compiling assetsys.h with `ASSETSYS_PACK_TOOL` defined (in addition to the 
+implementation defines) builds a command line tool which packs all the files in a directory into a zip file:
+
+    assetsys_pack [-r <read speed in MB/s>] <directory> <zip file>
+
+For each file, the tool compresses it with every available method, measures how long each one takes to decode, and
+picks the method with the lowest estimated load time: the time to read the compressed data at the given read speed
+(200 MB/s by default) plus the time to decode it. Files which don't gain from compression are stored, so they can be 
+accessed directly with `assetsys_file_data`. LZMA is only considered if the tool is built with `ASSETSYS_LZMA`.
+LZ4 and LZMA entries are decoded in full when opened with `assetsys_stream_open`, so files larger than 16MB are only
+stored or deflated, which keeps streaming them within a fixed amount of memory. The limit can be changed by defining
+`ASSETSYS_PACK_MAX_UNPACKED_SIZE` to the largest size, in bytes, to consider LZ4 and LZMA for.
+
     
 assetsys_create
 ---------------
@@ -225,7 +303,8 @@ assetsys_create
 Creates a new assetsys instance. assetsys.h does not use any global variables, all data it needs is accessed through
 the instance created by calling assetsys_create. Different instances can be used safely from different threads, but if
 using the same instance from multiple threads, it is up to the user to make sure functions are not called concurrently,
-for example by adding a mutex lock around each call.
+for example by adding a mutex lock around each call. The exceptions are the functions for finding and loading files,
+which are documented as safe to call from several threads while no thread is mounting or dismounting.
 
 
 assetsys_destroy
@@ -263,6 +342,54 @@ assetsys_mount_from_memory
 Same as `assetsys_mount()`, but takes a data buffer of an archived *.zip* file, along with the size of the file.
 
 
+assetsys_mount_mapped
+---------------------
+
+    assetsys_error_t assetsys_mount_mapped( assetsys_t* sys, char const* path, char const* mount_as )
+
+Same as `assetsys_mount()` for a *.zip* file, but maps the whole archive into memory (mmap on posix, a file mapping on
+windows) instead of reading it through stdio. Compressed entries are inflated straight from the mapping, and stored 
+entries can be accessed without any copy through `assetsys_file_data`. Returns `ASSETSYS_ERROR_INVALID_PATH` if `path`
+is not a file, and `ASSETSYS_ERROR_FAILED_TO_READ_ZIP` if it could not be mapped or is not a valid zip file. Dismount
+it with `assetsys_dismount` as usual, which also unmaps the file.
+
+
+assetsys_mount_indexed
+----------------------
+
+    assetsys_error_t assetsys_mount_indexed( assetsys_t* sys, char const* path, char const* mount_as, 
+        char const* index_path )
+
+Same as `assetsys_mount()`, but takes the list of files and directories from a sidecar index file written by 
+`assetsys_index_save`, instead of building it. For directories, this avoids walking and stat'ing the whole tree, and for
+zip files, it avoids sorting the central directory and deriving the directory tree from the file names. The index holds
+the path, size and zip entry of each file, and the parent of each entry, so mounting only needs to register the paths.
+If the index file can't be read, is not a valid index, or does not match the data source (a different type, a zip file
+of a different size or number of entries, or a directory whose modification time has changed since the index was 
+saved), `assetsys_mount_indexed` returns `ASSETSYS_ERROR_INVALID_INDEX` without mounting anything, and the caller can 
+fall back to `assetsys_mount`. For directories, the index holds the modification time of each directory, which changes
+when files are added, removed or renamed in it, so mounting stats every directory but none of the files. Files which 
+change size without being replaced are not detected, and times only have a resolution of one second, so an index 
+saved in the same second as a change to the tree may still be accepted. The mount is dismounted with 
+`assetsys_dismount` as usual.
+
+
+assetsys_index_save
+-------------------
+
+    assetsys_error_t assetsys_index_save( assetsys_t* sys, char const* path, char const* mounted_as, 
+        char const* index_path )
+
+Writes an index of the mount specified by `path` and `mounted_as` (the same as was passed when mounting it) to the file
+`index_path`, for use with `assetsys_mount_indexed`. The index only holds paths relative to the mount point, so it can 
+be used to mount the data source with a different `mount_as`. Returns `ASSETSYS_ERROR_INVALID_MOUNT` if there is no such
+mount, and `ASSETSYS_ERROR_FAILED_TO_READ_FILE` if the index file could not be written. 
+For use in a build step, compiling assetsys.h with `ASSETSYS_INDEX_TOOL` defined (in addition to the implementation 
+defines) builds a command line tool which mounts a zip file or directory and saves its index:
+
+    assetsys_index <zip file or directory> <index file>
+
+
 assetsys_dismount
 -----------------
 
@@ -273,6 +400,32 @@ used when mounting. If `path` is NULL, `assetsys_dismount` returns `ASSETSYS_ERR
 is NULL, or no matching mount could be found, it returns `ASSETSYS_ERROR_INVALID_MOUNT`. 
 
 
+assetsys_watch
+--------------
+
+    assetsys_error_t assetsys_watch( assetsys_t* sys, char const* path, char const* mounted_as )
+
+Starts watching the directory mount specified by `path` and `mounted_as` (the same as was passed when mounting it) for
+changes on disk, which are then applied by calling `assetsys_watch_update`. This is meant for development builds, to 
+pick up edited assets without having to dismount and remount. Changes made between mounting and calling 
+`assetsys_watch` are not picked up. Returns `ASSETSYS_ERROR_INVALID_MOUNT` if there is no such mount, or if it is not a
+directory mount. Watching is implemented with inotify, and is only available on Linux; on other platforms, or if 
+inotify could not be initialized, `assetsys_watch` returns `ASSETSYS_ERROR_NOT_SUPPORTED`.
+
+
+assetsys_watch_update
+---------------------
+
+    int assetsys_watch_update( assetsys_t* sys )
+
+Applies the changes made on disk since the last call, to all mounts being watched. Files and directories which were
+added or removed are added to or removed from the mount, and files which changed are given their new size, without
+walking the rest of the directory tree. File handles for files which were not removed stay valid. Returns the number of
+files and directories which were added, removed or changed. If the system dropped change notifications because too many
+changes were made at once, the whole mount is walked again. Like `assetsys_mount`, `assetsys_watch_update` must not be 
+called while any other thread is using the same assetsys instance.
+
+
 assetsys_file
 -------------
 
@@ -284,6 +437,8 @@ order they were added, and if a file with the specified path could not be found,
 `ASSETSYS_ERROR_FILE_NOT_FOUND`. The handle is written to `file`, which must be a pointer to a `assetsys_file_t`
 variable declared by the caller. The handle is used in calls to `assetsys_file_load` and `assetsys_file_size`. The 
 handle is only valid until any mounts are modified by calling `assetsys_mount` or `assetsys_dismount`.
+`assetsys_file` does not modify the assetsys instance, so it can be called from several threads at the same time, as 
+long as no other thread is mounting or dismounting.
 
 
 assetsys_file_load
@@ -299,6 +454,11 @@ reported with different values if the file was updated on disk between the call
 `assetsys_file_load`. 
 If the file could not be loaded, `assetsys_file_load` returns `ASSETSYS_ERROR_FAILED_TO_READ_FILE`. If the `capacity`
 parameter is too small to hold the file data, `assetsys_file_load` returns `ASSETSYS_ERROR_BUFFER_TOO_SMALL`.
+`assetsys_file_load` (and `assetsys_file_size`) may be called from several threads at the same time, as long as no
+thread is mounting or dismounting. Loads from the same zip archive run concurrently, as each call reads the archive
+with positioned reads and decompresses with its own state on the stack. If `ASSETSYS_FILE` is redefined, also define
+`ASSETSYS_FREAD_AT( buffer, count, offset, file )` to keep this guarantee for zip mounts. The guarantee does not hold 
+for zip mounts when ASSETSYS_NO_MINIZ is defined, as the read callback can then not be replaced.
 
 
 assetsys_file_size
@@ -312,6 +472,146 @@ re-queried on each call to `assetsys_file_size` (to support the case where a fil
 last call). In the case where the file resides in an archive mount, `assetsys_file_size` will return its initial value.
 
 
+assetsys_file_data
+------------------
+
+    void const* assetsys_file_data( assetsys_t* sys, assetsys_file_t file, int* size )
+
+Returns a pointer directly to the data of the file specified by the handle `file`, without loading or copying it, and 
+writes its size to `size` (if not NULL). This is only possible for files which are stored uncompressed in a zip which 
+was mounted with `assetsys_mount_mapped` or `assetsys_mount_from_memory`; for all other files, `assetsys_file_data`
+returns NULL, and the file needs to be loaded with `assetsys_file_load`. The pointer stays valid until the mount is 
+dismounted. Note that the data is not crc checked, and that it has no particular alignment.
+
+
+assetsys_cache_budget
+---------------------
+
+    void assetsys_cache_budget( assetsys_t* sys, ASSETSYS_U64 bytes )
+
+Sets how many bytes of decompressed file data the cache used by `assetsys_cache_acquire` may keep around. The default is
+0, which disables caching: buffers are then freed as soon as they are released. Lowering the budget evicts the least 
+recently used entries which are not currently borrowed.
+
+
+assetsys_cache_acquire
+----------------------
+
+    assetsys_error_t assetsys_cache_acquire( assetsys_t* sys, assetsys_file_t file, void const** data, int* size )
+
+Borrows a buffer with the contents of the file specified by the handle `file`, writing a pointer to it to `data` and its
+size to `size`. Files in zip mounts are kept in a cache, keyed by path, so acquiring the same file again returns the same
+buffer without decompressing it again. Files in directory mounts are always loaded fresh, so that changes on disk are 
+picked up, and are freed when released. Every successful call must be matched by a call to `assetsys_cache_release`. 
+Buffers that are borrowed are never evicted, even if that puts the cache over its budget; the budget is enforced again
+as they are released. Mounting or dismounting empties the cache, but buffers which are borrowed at that time stay valid 
+until released. Returns `ASSETSYS_ERROR_INVALID_MOUNT` if the handle is not valid, or any error from 
+`assetsys_file_load`. The buffers are 16 byte aligned. Unlike `assetsys_file_load`, the cache functions modify the 
+assetsys instance, and must not be called from several threads at the same time.
+
+
+assetsys_cache_release
+----------------------
+
+    void assetsys_cache_release( assetsys_t* sys, void const* data )
+
+Returns a buffer borrowed by calling `assetsys_cache_acquire`. When no one is borrowing it anymore, it becomes the most
+recently used entry in the cache, or is freed if it is not cached or the cache is over budget.
+
+
+assetsys_cache_stats
+--------------------
+
+    void assetsys_cache_stats( assetsys_t* sys, assetsys_cache_stats_t* stats )
+
+Fills in `stats` with the number of cache hits, misses and evictions since the instance was created, and the number of
+entries and bytes currently held by the cache.
+
+
+assetsys_load_async
+-------------------
+
+    assetsys_error_t assetsys_load_async( assetsys_t* sys, assetsys_file_t file, void* buffer, int capacity, 
+        int priority, assetsys_load_callback_t callback, void* user_data )
+
+Queues the file specified by the handle `file` to be loaded into `buffer`, which must stay valid and untouched until the
+load is delivered by `assetsys_poll`. `capacity` is the size of `buffer`, and should be at least `assetsys_file_size`.
+Returns `ASSETSYS_ERROR_INVALID_MOUNT` if the handle is not valid, and `ASSETSYS_SUCCESS` otherwise; errors from the load
+itself are passed to the callback.
+If ASSETSYS_ASYNC is defined, loads run on a pool of worker threads: a single thread reads the compressed data, 
+sorted by mount and by offset within the zip file, so that a batch of loads reads each archive front to back, and the
+remaining threads (ASSETSYS_ASYNC_INFLATE_THREADS, default 3) decompress and verify the data. The reader stops reading
+ahead when ASSETSYS_ASYNC_READAHEAD bytes (default 32MB) of compressed data are waiting to be decompressed.
+Do not mount or dismount while loads are in flight, and do not call `assetsys_file_load` from other threads at the same
+time if `ASSETSYS_FILE` has been redefined without `ASSETSYS_FREAD_AT`.
+
+
+assetsys_poll
+-------------
+
+    int assetsys_poll( assetsys_t* sys )
+
+Calls the callbacks for loads queued with `assetsys_load_async` which have completed, on the calling thread, and returns
+the number of loads still in flight. Results are delivered in priority order, highest `priority` first: a completed load
+is held back while a load with a higher priority is still in flight, and loads with the same priority are delivered in
+the order they were queued. The callback receives the file handle, the result of the load (one of the error codes of 
+`assetsys_file_load`), the buffer, the size of the file and the `user_data` passed to `assetsys_load_async`. It is fine
+to queue new loads from the callback. Loads which are still in flight when `assetsys_destroy` is called are cancelled,
+and their callbacks are not called.
+
+
+assetsys_stream_open
+--------------------
+
+    assetsys_error_t assetsys_stream_open( assetsys_t* sys, assetsys_file_t file, assetsys_stream_t** stream )
+
+Opens the file specified by the handle `file` for reading in chunks, without loading all of it into memory, and stores
+the stream in `stream`. Files in directory mounts are read directly from disk, stored (uncompressed) entries in zip 
+files are read straight from the archive, and deflated entries are decompressed incrementally, through a fixed 32KB 
+window. Each stream uses around 64KB of memory, regardless of the size of the file. LZMA and LZ4 entries can't be
+decoded incrementally, so those are decoded in full when the stream is opened, allocating the whole uncompressed size
+(the pack tool only uses them for files up to 16MB by default, see `ASSETSYS_PACK_TOOL`). Returns `ASSETSYS_SUCCESS`,
+`ASSETSYS_ERROR_INVALID_MOUNT` if the handle is not valid, or `ASSETSYS_ERROR_FAILED_TO_READ_FILE`. The mount must stay
+mounted until the stream is closed. Different streams may be read from different threads.
+
+
+assetsys_stream_read
+--------------------
+
+    int assetsys_stream_read( assetsys_stream_t* stream, void* buffer, int size )
+
+Reads up to `size` bytes from the current position of the stream into `buffer`, and returns the number of bytes read,
+which is 0 at the end of the file, or `ASSETSYS_ERROR_FAILED_TO_READ_FILE` if the data could not be read or is corrupt.
+The crc of zip entries is checked when the end of the entry is reached, unless the stream has skipped ahead by seeking.
+
+
+assetsys_stream_seek
+--------------------
+
+    assetsys_error_t assetsys_stream_seek( assetsys_stream_t* stream, int position )
+
+Moves the read position of the stream to `position` bytes from the start of the file. This is cheap for directory mounts
+and stored zip entries. For deflated entries, seeking forward decompresses and discards the data up to the new position,
+and seeking backward restarts decompression from the start of the entry, so it is best to seek sparingly. Returns 
+`ASSETSYS_ERROR_INVALID_PARAMETER` if `position` is outside the file.
+
+
+assetsys_stream_tell
+--------------------
+
+    int assetsys_stream_tell( assetsys_stream_t* stream )
+
+Returns the current read position of the stream.
+
+
+assetsys_stream_close
+---------------------
+
+    void assetsys_stream_close( assetsys_stream_t* stream )
+
+Closes the stream and releases its memory.
+
+
 assetsys_file_count
 -------------------
 
@@ -402,6 +702,7 @@ path. If the path is invalid or index is out of range, `assetsys_subdir_path` re
 #ifndef ASSETSYS_FILE
   #include <stdio.h>
   #define ASSETSYS_FILE FILE
+  #define ASSETSYS_INTERNAL_STDIO_FILE
 #endif
 
 #ifndef ASSETSYS_FOPEN
@@ -479,6 +780,15 @@ path. If the path is invalid or index is out of range, `assetsys_subdir_path` re
   #define ASSETSYS_DELETE_FILE( f ) remove( f )
 #endif
 
+// Positioned read which does not move a shared file pointer, so several threads can read from the same zip at once.
+// Only available by default for stdio files; if ASSETSYS_FILE is overridden, define ASSETSYS_FREAD_AT as well to make
+// zip loads reentrant.
+#ifndef ASSETSYS_FREAD_AT
+  #ifdef ASSETSYS_INTERNAL_STDIO_FILE
+    #define ASSETSYS_FREAD_AT( b, c, o, s ) assetsys_internal_fread_at( b, (c), (o), s )
+  #endif
+#endif
+
 #ifdef ASSETSYS_NO_MINIZ
   #define MINIZ_HEADER_FILE_ONLY
 #else
@@ -5369,6 +5679,20 @@ void *mz_zip_extract_archive_file_to_heap(const char *pZip_filename, const char
 
 #include "strpool.h"
 
+#ifdef ASSETSYS_ASYNC
+    #include "thread.h"
+    #ifndef ASSETSYS_ASYNC_INFLATE_THREADS
+        #define ASSETSYS_ASYNC_INFLATE_THREADS 3
+    #endif
+    #ifndef ASSETSYS_ASYNC_READAHEAD
+        #define ASSETSYS_ASYNC_READAHEAD ( 32 * 1024 * 1024 )
+    #endif
+#endif
+
+#ifdef ASSETSYS_LZMA
+    #include "lzma.h"
+#endif
+
 #ifndef ASSETSYS_ASSERT
     #define _CRT_NONSTDC_NO_DEPRECATE 
     #define _CRT_SECURE_NO_WARNINGS
@@ -5385,6 +5709,24 @@ void *mz_zip_extract_archive_file_to_heap(const char *pZip_filename, const char
 #endif
 
 
+// Change notifications for watched directory mounts, as decoded by the platform specific code
+enum assetsys_internal_watch_event_type_t
+    {
+    ASSETSYS_INTERNAL_WATCH_EVENT_CHANGED, // an entry was added or modified
+    ASSETSYS_INTERNAL_WATCH_EVENT_REMOVED,
+    ASSETSYS_INTERNAL_WATCH_EVENT_STOPPED, // the watched directory is gone
+    ASSETSYS_INTERNAL_WATCH_EVENT_OVERFLOW, // events were dropped
+    };
+
+struct assetsys_internal_watch_event_t
+    {
+    enum assetsys_internal_watch_event_type_t type;
+    int descriptor;
+    char const* name; // name of the entry within the watched directory
+    int is_dir;
+    };
+
+
 #if defined( _WIN32 )
     #define _CRT_NONSTDC_NO_DEPRECATE 
     #define _CRT_SECURE_NO_WARNINGS
@@ -5479,6 +5821,62 @@ void *mz_zip_extract_archive_file_to_heap(const char *pZip_filename, const char
         }
 
 
+    static void const* assetsys_internal_mmap_file( char const* path, size_t* size )
+        {
+        HANDLE file = CreateFileA( path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL );
+        if( file == INVALID_HANDLE_VALUE ) return NULL;
+        LARGE_INTEGER file_size;
+        if( !GetFileSizeEx( file, &file_size ) || file_size.QuadPart == 0 || 
+            (ULONGLONG) file_size.QuadPart > (ULONGLONG)(size_t) -1 ) 
+            { 
+            CloseHandle( file ); 
+            return NULL; 
+            }
+        HANDLE mapping = CreateFileMappingA( file, NULL, PAGE_READONLY, 0, 0, NULL );
+        CloseHandle( file );
+        if( !mapping ) return NULL;
+        void const* data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+        CloseHandle( mapping ); // the view keeps the mapping alive
+        if( !data ) return NULL;
+        *size = (size_t) file_size.QuadPart;
+        return data;
+        }
+
+
+    static void assetsys_internal_munmap_file( void const* data, size_t size )
+        {
+        (void) size;
+        UnmapViewOfFile( data );
+        }
+
+
+    #ifdef ASSETSYS_INTERNAL_STDIO_FILE
+        #include <io.h> // _get_osfhandle, _fileno
+
+        static size_t assetsys_internal_fread_at( void* buffer, size_t count, ASSETSYS_U64 offset, FILE* fp )
+            {
+            HANDLE handle = (HANDLE) _get_osfhandle( _fileno( fp ) );
+            if( handle == INVALID_HANDLE_VALUE ) return 0;
+            size_t total = 0;
+            while( total < count )
+                {
+                ASSETSYS_U64 pos = offset + total;
+                OVERLAPPED overlapped;
+                memset( &overlapped, 0, sizeof( overlapped ) );
+                overlapped.Offset = (DWORD)( pos & 0xffffffffu );
+                overlapped.OffsetHigh = (DWORD)( pos >> 32 );
+                size_t remaining = count - total;
+                DWORD to_read = remaining > 0x40000000u ? 0x40000000u : (DWORD) remaining;
+                DWORD bytes_read = 0;
+                if( !ReadFile( handle, (char*) buffer + total, to_read, &bytes_read, &overlapped ) || bytes_read == 0 ) 
+                    break;
+                total += bytes_read;
+                }
+            return total;
+            }
+    #endif
+
+
 #else
 
     #include <dirent.h>
@@ -5527,6 +5925,112 @@ void *mz_zip_extract_archive_file_to_heap(const char *pZip_filename, const char
         return ( (struct dirent*)entry )->d_type == DT_DIR;
         }
 
+
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <unistd.h>
+
+    static void const* assetsys_internal_mmap_file( char const* path, size_t* size )
+        {
+        int fd = open( path, O_RDONLY );
+        if( fd < 0 ) return NULL;
+        struct stat s;
+        if( fstat( fd, &s ) != 0 || s.st_size <= 0 ) 
+            { 
+            close( fd ); 
+            return NULL; 
+            }
+        void* data = mmap( NULL, (size_t) s.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+        close( fd ); // the mapping stays valid after closing the file
+        if( data == MAP_FAILED ) return NULL;
+        *size = (size_t) s.st_size;
+        return data;
+        }
+
+
+    static void assetsys_internal_munmap_file( void const* data, size_t size )
+        {
+        munmap( (void*) data, size );
+        }
+
+
+    #ifdef __linux__
+        #include <sys/inotify.h>
+
+        #define ASSETSYS_INTERNAL_WATCH
+
+        static int assetsys_internal_watch_open( void )
+            {
+            return inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+            }
+
+
+        static void assetsys_internal_watch_close( int watch )
+            {
+            close( watch );
+            }
+
+
+        static int assetsys_internal_watch_add( int watch, char const* path )
+            {
+            return inotify_add_watch( watch, path, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_MODIFY | 
+                IN_CLOSE_WRITE | IN_ONLYDIR );
+            }
+
+
+        static void assetsys_internal_watch_remove( int watch, int descriptor )
+            {
+            inotify_rm_watch( watch, descriptor );
+            }
+
+
+        // Reads pending events without blocking. Returns the number of bytes read, or 0 if there were none.
+        static int assetsys_internal_watch_read( int watch, void* buffer, int size )
+            {
+            ssize_t count = read( watch, buffer, (size_t) size );
+            return count > 0 ? (int) count : 0;
+            }
+
+
+        // Decodes the event at `offset` in a buffer filled by assetsys_internal_watch_read, and advances `offset` 
+        // past it. Returns 0 when there are no more events.
+        static int assetsys_internal_watch_next( void const* buffer, int size, int* offset, 
+            struct assetsys_internal_watch_event_t* event )
+            {
+            if( *offset + (int) sizeof( struct inotify_event ) > size ) return 0;
+            struct inotify_event const* e = (struct inotify_event const*)( (char const*) buffer + *offset );
+            *offset += (int)( sizeof( struct inotify_event ) + e->len );
+            event->descriptor = e->wd;
+            event->name = e->len > 0 ? e->name : NULL;
+            event->is_dir = ( e->mask & IN_ISDIR ) != 0;
+            if( e->mask & IN_Q_OVERFLOW ) event->type = ASSETSYS_INTERNAL_WATCH_EVENT_OVERFLOW;
+            else if( e->mask & IN_IGNORED ) event->type = ASSETSYS_INTERNAL_WATCH_EVENT_STOPPED;
+            else if( e->mask & ( IN_DELETE | IN_MOVED_FROM ) ) event->type = ASSETSYS_INTERNAL_WATCH_EVENT_REMOVED;
+            else event->type = ASSETSYS_INTERNAL_WATCH_EVENT_CHANGED;
+            return 1;
+            }
+    #endif
+
+
+    #ifdef ASSETSYS_INTERNAL_STDIO_FILE
+        #include <unistd.h> // pread
+        #include <errno.h>
+
+        static size_t assetsys_internal_fread_at( void* buffer, size_t count, ASSETSYS_U64 offset, FILE* fp )
+            {
+            int fd = fileno( fp );
+            size_t total = 0;
+            while( total < count )
+                {
+                ssize_t bytes_read = pread( fd, (char*) buffer + total, count - total, (off_t)( offset + total ) );
+                if( bytes_read < 0 && errno == EINTR ) continue;
+                if( bytes_read <= 0 ) break;
+                total += (size_t) bytes_read;
+                }
+            return total;
+            }
+    #endif
+
 #endif 
 
 
@@ -5566,8 +6070,30 @@ static void* assetsys_internal_mz_realloc( void* memctx, void* ptr, size_t items
     }
 
 
+#if defined( ASSETSYS_FREAD_AT ) && !defined( ASSETSYS_NO_MINIZ )
+    // Replaces the miniz stdio read callback, which seeks and reads on the shared FILE and so can not be used from 
+    // more than one thread at a time. The central directory is only read during mount, so with this callback in place,
+    // extracting files only reads shared state.
+    static size_t assetsys_internal_zip_read_at( void* opaque, mz_uint64 ofs, void* buf, size_t n )
+        {
+        mz_zip_archive* zip = (mz_zip_archive*) opaque;
+        return ASSETSYS_FREAD_AT( buf, n, (ASSETSYS_U64) ofs, zip->m_pState->m_pFile );
+        }
+#endif
+
+
 static char* assetsys_internal_dirname( char const* path );
 
+// Open addressing hash map from a 64-bit key to a non-negative int, used to index collated entries by path handle and
+// mount files by collated index. Empty slots have a negative value.
+struct assetsys_internal_map_t
+    {
+    ASSETSYS_U64* keys;
+    int* values;
+    int capacity;
+    int count;
+    };
+
 struct assetsys_internal_file_t
     {
     int size;
@@ -5593,14 +6119,33 @@ struct assetsys_internal_mount_t
     int mount_len;
     enum assetsys_internal_mount_type_t type;
     mz_zip_archive zip;
+    void const* data; // archive in memory, for zips mounted from memory or mapped
+    size_t data_size;
+    int is_mapped;
 
     struct assetsys_internal_file_t* files;
     int files_count;
     int files_capacity;
+    struct assetsys_internal_map_t files_map; // collated index -> index in files
+    int files_free; // first removed entry in files (collated index -1), linked through zip_index
 
     struct assetsys_internal_folder_t* dirs;
     int dirs_count;
     int dirs_capacity;
+
+    int watch; // change notification handle for watched directory mounts, or -1
+    struct assetsys_internal_map_t watch_dirs; // watch descriptor -> collated index of the directory
+    struct assetsys_internal_map_t watch_descriptors; // collated index of a directory -> its watch descriptor
+    };
+
+struct assetsys_internal_cache_entry_t
+    {
+    void* block; // header holding the entry index, followed by the file data
+    int size;
+    int collated_index; // -1 if the entry is not in the cache, and is freed on release
+    int ref_count;
+    int prev; // links in the LRU list, which only holds entries that are not borrowed
+    int next;
     };
 
 struct assetsys_internal_collated_t
@@ -5624,11 +6169,36 @@ struct assetsys_t
     struct assetsys_internal_collated_t* collated;
     int collated_count;
     int collated_capacity;
+    struct assetsys_internal_map_t collated_map; // path handle -> index in collated
+
+    int* collated_free;
+    int collated_free_count;
+    int collated_free_capacity;
+
+    struct assetsys_internal_async_t* async; // created on first call to assetsys_load_async
+
+    struct assetsys_internal_cache_entry_t* cache_entries;
+    int cache_entries_count;
+    int cache_entries_capacity;
+    int cache_free; // first unused entry, linked through next
+    int cache_lru_head; // least recently used entry which is not borrowed
+    int cache_lru_tail;
+    struct assetsys_internal_map_t cache_map; // collated index -> index in cache_entries
+    ASSETSYS_U64 cache_budget;
+    assetsys_cache_stats_t cache_stats;
 
     char temp[ 260 ];
     };
 
 
+static void assetsys_internal_map_init( assetsys_t* sys, struct assetsys_internal_map_t* map, int capacity );
+static void assetsys_internal_map_term( assetsys_t* sys, struct assetsys_internal_map_t* map );
+static int assetsys_internal_map_find( struct assetsys_internal_map_t const* map, ASSETSYS_U64 key );
+static void assetsys_internal_map_insert( assetsys_t* sys, struct assetsys_internal_map_t* map, ASSETSYS_U64 key, 
+    int value );
+static void assetsys_internal_map_remove( struct assetsys_internal_map_t* map, ASSETSYS_U64 key );
+
+
 static ASSETSYS_U64 assetsys_internal_add_string( assetsys_t* sys, char const* const str )
     {
     ASSETSYS_U64 h = strpool_inject( &sys->strpool, str, (int) strlen( str ) );
@@ -5661,17 +6231,44 @@ assetsys_t* assetsys_create( void* memctx )
     sys->collated_capacity = 16384;
     sys->collated = (struct assetsys_internal_collated_t*) ASSETSYS_MALLOC( memctx, 
         sizeof( *sys->collated ) * sys->collated_capacity );
+    assetsys_internal_map_init( sys, &sys->collated_map, sys->collated_capacity * 2 );
+
+    sys->collated_free_count = 0;
+    sys->collated_free_capacity = 1024;
+    sys->collated_free = (int*) ASSETSYS_MALLOC( memctx, sizeof( *sys->collated_free ) * sys->collated_free_capacity );
+
+    sys->async = NULL;
+
+    sys->cache_entries = NULL;
+    sys->cache_entries_count = 0;
+    sys->cache_entries_capacity = 0;
+    sys->cache_free = -1;
+    sys->cache_lru_head = -1;
+    sys->cache_lru_tail = -1;
+    assetsys_internal_map_init( sys, &sys->cache_map, 64 );
+    sys->cache_budget = 0;
+    memset( &sys->cache_stats, 0, sizeof( sys->cache_stats ) );
     return sys;
     }
 
 
+static void assetsys_internal_async_term( assetsys_t* sys );
+static void assetsys_internal_cache_flush( assetsys_t* sys );
+
 void assetsys_destroy( assetsys_t* sys )
     {
+    assetsys_internal_async_term( sys );
     while( sys->mounts_count > 0 )
         {
         assetsys_dismount( sys, assetsys_internal_get_string( sys, sys->mounts[ 0 ].path ), 
             assetsys_internal_get_string( sys, sys->mounts[ 0 ].mounted_as ) );
         }
+    for( int i = 0; i < sys->cache_entries_count; ++i )
+        if( sys->cache_entries[ i ].block ) ASSETSYS_FREE( sys->memctx, sys->cache_entries[ i ].block );
+    if( sys->cache_entries ) ASSETSYS_FREE( sys->memctx, sys->cache_entries );
+    assetsys_internal_map_term( sys, &sys->cache_map );
+    ASSETSYS_FREE( sys->memctx, sys->collated_free );
+    assetsys_internal_map_term( sys, &sys->collated_map );
     ASSETSYS_FREE( sys->memctx, sys->collated );
     ASSETSYS_FREE( sys->memctx, sys->mounts );
     strpool_term( &sys->strpool );
@@ -5679,26 +6276,123 @@ void assetsys_destroy( assetsys_t* sys )
     }
 
 
+static int assetsys_internal_map_slot( struct assetsys_internal_map_t const* map, ASSETSYS_U64 key )
+    {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return (int)( key & (ASSETSYS_U64)( map->capacity - 1 ) );
+    }
+
+
+static void assetsys_internal_map_init( assetsys_t* sys, struct assetsys_internal_map_t* map, int capacity )
+    {
+    (void) sys;
+    int pow2 = 16;
+    while( pow2 < capacity ) pow2 *= 2;
+    map->capacity = pow2;
+    map->count = 0;
+    map->keys = (ASSETSYS_U64*) ASSETSYS_MALLOC( sys->memctx, sizeof( *map->keys ) * map->capacity );
+    map->values = (int*) ASSETSYS_MALLOC( sys->memctx, sizeof( *map->values ) * map->capacity );
+    for( int i = 0; i < map->capacity; ++i ) map->values[ i ] = -1;
+    }
+
+
+static void assetsys_internal_map_term( assetsys_t* sys, struct assetsys_internal_map_t* map )
+    {
+    (void) sys;
+    ASSETSYS_FREE( sys->memctx, map->values );
+    ASSETSYS_FREE( sys->memctx, map->keys );
+    }
+
+
+static int assetsys_internal_map_find( struct assetsys_internal_map_t const* map, ASSETSYS_U64 key )
+    {
+    int slot = assetsys_internal_map_slot( map, key );
+    while( map->values[ slot ] >= 0 )
+        {
+        if( map->keys[ slot ] == key ) return map->values[ slot ];
+        slot = ( slot + 1 ) & ( map->capacity - 1 );
+        }
+    return -1;
+    }
+
+
+static void assetsys_internal_map_insert( assetsys_t* sys, struct assetsys_internal_map_t* map, ASSETSYS_U64 key, 
+    int value )
+    {
+    ASSETSYS_ASSERT( value >= 0, "Invalid map value" );
+    if( ( map->count + 1 ) * 2 > map->capacity )
+        {
+        struct assetsys_internal_map_t old_map = *map;
+        assetsys_internal_map_init( sys, map, old_map.capacity * 2 );
+        for( int i = 0; i < old_map.capacity; ++i )
+            if( old_map.values[ i ] >= 0 ) assetsys_internal_map_insert( sys, map, old_map.keys[ i ], old_map.values[ i ] );
+        assetsys_internal_map_term( sys, &old_map );
+        }
+
+    int slot = assetsys_internal_map_slot( map, key );
+    while( map->values[ slot ] >= 0 )
+        {
+        if( map->keys[ slot ] == key ) 
+            {
+            map->values[ slot ] = value;
+            return;
+            }
+        slot = ( slot + 1 ) & ( map->capacity - 1 );
+        }
+    map->keys[ slot ] = key;
+    map->values[ slot ] = value;
+    ++map->count;
+    }
+
+
+static void assetsys_internal_map_remove( struct assetsys_internal_map_t* map, ASSETSYS_U64 key )
+    {
+    int mask = map->capacity - 1;
+    int slot = assetsys_internal_map_slot( map, key );
+    while( map->values[ slot ] >= 0 && map->keys[ slot ] != key ) slot = ( slot + 1 ) & mask;
+    if( map->values[ slot ] < 0 ) return;
+
+    // Backward shift deletion, so that no tombstones are needed for linear probing
+    map->values[ slot ] = -1;
+    --map->count;
+    int next = ( slot + 1 ) & mask;
+    while( map->values[ next ] >= 0 )
+        {
+        int home = assetsys_internal_map_slot( map, map->keys[ next ] );
+        if( ( ( next - home ) & mask ) >= ( ( next - slot ) & mask ) )
+            {
+            map->keys[ slot ] = map->keys[ next ];
+            map->values[ slot ] = map->values[ next ];
+            map->values[ next ] = -1;
+            slot = next;
+            }
+        next = ( next + 1 ) & mask;
+        }
+    }
+
+
 static int assetsys_internal_register_collated( assetsys_t* sys, char const* path, int const is_file )
     {
     if( path[ 0 ] == '/' && path[ 1 ] == '/' ) ++path;
 
     ASSETSYS_U64 handle = strpool_inject( &sys->strpool, path, (int) strlen( path ) );
 
-    int first_free = -1;
-    for( int i = 0; i < sys->collated_count; ++i )
+    int existing = assetsys_internal_map_find( &sys->collated_map, handle );
+    if( existing >= 0 )
         {
-        if( sys->collated[ i ].ref_count > 0 && sys->collated[ i ].path == handle )
-            {
-            ASSETSYS_ASSERT( is_file == sys->collated[ i ].is_file, "Entry type mismatch" );
-            ++sys->collated[ i ].ref_count;
-            strpool_discard( &sys->strpool, handle );
-            return i;
-            }
-        if( sys->collated[ i ].ref_count == 0 ) first_free = i;
+        ASSETSYS_ASSERT( is_file == sys->collated[ existing ].is_file, "Entry type mismatch" );
+        ++sys->collated[ existing ].ref_count;
+        return existing;
         }
 
-    if( first_free < 0)
+    int first_free = -1;
+    if( sys->collated_free_count > 0 ) 
+        {
+        first_free = sys->collated_free[ --sys->collated_free_count ];
+        }
+    else
         {
         if( sys->collated_count >= sys->collated_capacity ) 
             {
@@ -5719,6 +6413,7 @@ static int assetsys_internal_register_collated( assetsys_t* sys, char const* pat
     dir->parent = -1;
     dir->ref_count = 1;
     dir->is_file = is_file;
+    assetsys_internal_map_insert( sys, &sys->collated_map, handle, first_free );
     return first_free;
     }
 
@@ -5732,38 +6427,20 @@ static void assetsys_internal_collate_directories( assetsys_t* sys, struct asset
             {
             char const* a = assetsys_internal_get_string( sys, subdir->path ); (void) a;
             char* sub_path = assetsys_internal_dirname( assetsys_internal_get_string( sys, subdir->path ) ) ;
-            ASSETSYS_U64 handle = strpool_inject( &sys->strpool, sub_path, (int) strlen( sub_path ) - 1 );
-            for( int j = 0; j < sys->collated_count; ++j )
-                {
-                struct assetsys_internal_collated_t* dir = &sys->collated[ j ];
-                char const* b = assetsys_internal_get_string( sys, dir->path ); (void) b;
-                if( dir->path == handle )
-                    {
-                    subdir->parent = j;
-                    break;
-                    }
-                }
-            if( subdir->parent < 0 ) strpool_discard( &sys->strpool, handle );
+            ASSETSYS_U64 handle = strpool_find( &sys->strpool, sub_path, (int) strlen( sub_path ) - 1 );
+            subdir->parent = assetsys_internal_map_find( &sys->collated_map, handle );
             }
         }
 
     for( int i = 0; i < mount->files_count; ++i )
         {
+        if( mount->files[ i ].collated_index < 0 ) continue; // removed from a watched mount
         struct assetsys_internal_collated_t* file = &sys->collated[ mount->files[ i ].collated_index ];
         if( file->parent < 0 )
             {
             char* file_path = assetsys_internal_dirname( assetsys_internal_get_string( sys, file->path ) ) ;
-            ASSETSYS_U64 handle = strpool_inject( &sys->strpool, file_path, file_path[0] == '/' && file_path[1] == '\0' ? 1 : (int) strlen( file_path ) - 1 );
-            for( int j = 0; j < sys->collated_count; ++j )
-                {
-                struct assetsys_internal_collated_t* dir = &sys->collated[ j ];
-                if( dir->path == handle )
-                    {
-                    file->parent = j;
-                    break;
-                    }
-                }
-            if( file->parent < 0 ) strpool_discard( &sys->strpool, handle );
+            ASSETSYS_U64 handle = strpool_find( &sys->strpool, file_path, file_path[0] == '/' && file_path[1] == '\0' ? 1 : (int) strlen( file_path ) - 1 );
+            file->parent = assetsys_internal_map_find( &sys->collated_map, handle );
             }
         }
     }
@@ -5875,6 +6552,10 @@ assetsys_error_t assetsys_internal_mount_files( assetsys_t* sys, struct assetsys
     {
     int count = (int) mz_zip_reader_get_num_files( &mount->zip );
 
+    // Collated indices of the directories registered for this mount so far, to avoid scanning `dirs` for each file
+    struct assetsys_internal_map_t dirs_map;
+    assetsys_internal_map_init( sys, &dirs_map, 256 );
+
     for( int i = 0; i < count; ++i )
         {
         if( mz_zip_reader_is_file_a_directory( &mount->zip, (mz_uint) i ) )
@@ -5898,6 +6579,7 @@ assetsys_error_t assetsys_internal_mount_files( assetsys_t* sys, struct assetsys
             strcat( sys->temp, filename );
             sys->temp[ strlen( sys->temp )  - 1 ] = '\0';
             as_dir->collated_index = assetsys_internal_register_collated( sys, sys->temp, 0 );
+            assetsys_internal_map_insert( sys, &dirs_map, (ASSETSYS_U64) as_dir->collated_index, 1 );
             }
         }
 
@@ -5919,6 +6601,7 @@ assetsys_error_t assetsys_internal_mount_files( assetsys_t* sys, struct assetsys
             mz_bool result = mz_zip_reader_file_stat( &mount->zip, (mz_uint) i, &stat);
             if( !result )
                 {
+                assetsys_internal_map_term( sys, &dirs_map );
                 mz_zip_reader_end( &mount->zip );
                 ASSETSYS_FREE( sys->memctx, mount->dirs );
                 ASSETSYS_FREE( sys->memctx, mount->files );
@@ -5935,24 +6618,45 @@ assetsys_error_t assetsys_internal_mount_files( assetsys_t* sys, struct assetsys
 
             char* dir_path = assetsys_internal_dirname( sys->temp );
             ASSETSYS_U64 handle = strpool_inject( &sys->strpool, dir_path, (int) strlen( dir_path ) - 1 );               
-            int found = 0;
-            for( int j = 0; j < mount->dirs_count; ++j )
-                {
-                if( handle == sys->collated[ mount->dirs[ j ].collated_index ].path )
-                    found = 1;
-                }
+            int collated_dir = assetsys_internal_map_find( &sys->collated_map, handle );
+            int found = collated_dir >= 0 && assetsys_internal_map_find( &dirs_map, (ASSETSYS_U64) collated_dir ) >= 0;
             if( !found ) 
                 {
+                if( mount->dirs_count >= mount->dirs_capacity )
+                    {
+                    mount->dirs_capacity *= 2;
+                    struct assetsys_internal_folder_t* new_dirs = (struct assetsys_internal_folder_t*) ASSETSYS_MALLOC( 
+                        sys->memctx, sizeof( *(mount->dirs) ) * mount->dirs_capacity );
+                    memcpy( new_dirs, mount->dirs, sizeof( *(mount->dirs) ) * mount->dirs_count );
+                    ASSETSYS_FREE( sys->memctx, mount->dirs );
+                    mount->dirs = new_dirs;
+                    }
                 struct assetsys_internal_folder_t* as_dir = &mount->dirs[ mount->dirs_count++ ];
                 as_dir->collated_index = assetsys_internal_register_collated( sys, 
                     assetsys_internal_get_string( sys, handle ), 0 );
+                assetsys_internal_map_insert( sys, &dirs_map, (ASSETSYS_U64) as_dir->collated_index, 1 );
                 }
             }
         }
 
+        assetsys_internal_map_term( sys, &dirs_map );
         return ASSETSYS_SUCCESS;
     }
 
+
+// Builds the lookup from collated index to file index for a mount, once all its files have been added. If the same
+// path occurs more than once in the mount, the first one is used.
+static void assetsys_internal_index_mount_files( assetsys_t* sys, struct assetsys_internal_mount_t* mount )
+    {
+    assetsys_internal_map_init( sys, &mount->files_map, mount->files_count * 2 );
+    for( int i = 0; i < mount->files_count; ++i )
+        {
+        ASSETSYS_U64 key = (ASSETSYS_U64) mount->files[ i ].collated_index;
+        if( mount->files[ i ].collated_index >= 0 && assetsys_internal_map_find( &mount->files_map, key ) < 0 )
+            assetsys_internal_map_insert( sys, &mount->files_map, key, i );
+        }
+    }
+
 /**
  * Creates an internal mount object for use by assetsys.
  * 
@@ -5976,12 +6680,18 @@ struct assetsys_internal_mount_t* assetsys_internal_create_mount( assetsys_t* sy
     mount->mount_len = mount_as ? (int) strlen( mount_as ) : 0;
     mount->path = assetsys_internal_add_string( sys, path );
     mount->type = type;
+    mount->data = NULL;
+    mount->data_size = 0;
+    mount->is_mapped = 0;
         
     mount->files_count = 0;
     mount->files_capacity = 4096;
     mount->files = (struct assetsys_internal_file_t*) ASSETSYS_MALLOC( sys->memctx, 
         sizeof( *(mount->files) ) * mount->files_capacity );
 
+    mount->files_free = -1;
+    mount->watch = -1;
+
     mount->dirs_count = 0;
     mount->dirs_capacity = 1024;
     mount->dirs = (struct assetsys_internal_folder_t*) ASSETSYS_MALLOC( sys->memctx, 
@@ -6008,6 +6718,7 @@ assetsys_error_t assetsys_mount_from_memory( assetsys_t* sys, void const* data,
     if( mount_len == 0 || mount_as[ 0 ] != '/' || ( mount_len > 1 && mount_as[ mount_len - 1 ] == '/' ) ) 
         return ASSETSYS_ERROR_INVALID_PATH;
 
+    assetsys_internal_cache_flush( sys );
     struct assetsys_internal_mount_t* mount = assetsys_internal_create_mount(sys, ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP, "data", mount_as);
 
     mz_bool status = mz_zip_reader_init_mem( &mount->zip, data, size, 0 );
@@ -6017,12 +6728,15 @@ assetsys_error_t assetsys_mount_from_memory( assetsys_t* sys, void const* data,
         ASSETSYS_FREE( sys->memctx, mount->files );
         return ASSETSYS_ERROR_FAILED_TO_READ_ZIP;
         }
+    mount->data = data;
+    mount->data_size = (size_t) size;
 
     assetsys_error_t result = assetsys_internal_mount_files( sys, mount );
     if( result != ASSETSYS_SUCCESS )
         return result;
 
     assetsys_internal_collate_directories( sys, mount );
+    assetsys_internal_index_mount_files( sys, mount );
 
     ++sys->mounts_count;
     return ASSETSYS_SUCCESS;
@@ -6060,6 +6774,7 @@ assetsys_error_t assetsys_mount( assetsys_t* sys, char const* path, char const*
         return ASSETSYS_ERROR_INVALID_PATH;
         }
 
+    assetsys_internal_cache_flush( sys );
     struct assetsys_internal_mount_t* mount = assetsys_internal_create_mount(sys, type, path, mount_as);
 
     if( type == ASSETSYS_INTERNAL_MOUNT_TYPE_DIR )
@@ -6081,6 +6796,9 @@ assetsys_error_t assetsys_mount( assetsys_t* sys, char const* path, char const*
             ASSETSYS_FREE( sys->memctx, mount->files );
             return ASSETSYS_ERROR_FAILED_TO_READ_ZIP;
             }
+        #if defined( ASSETSYS_FREAD_AT ) && !defined( ASSETSYS_NO_MINIZ )
+            mount->zip.m_pRead = assetsys_internal_zip_read_at;
+        #endif
 
         assetsys_error_t result = assetsys_internal_mount_files( sys, mount );
         if( result != ASSETSYS_SUCCESS )
@@ -6089,298 +6807,2956 @@ assetsys_error_t assetsys_mount( assetsys_t* sys, char const* path, char const*
         }
 
     assetsys_internal_collate_directories( sys, mount );
+    assetsys_internal_index_mount_files( sys, mount );
 
     ++sys->mounts_count;
     return ASSETSYS_SUCCESS;
     }
 
 
-static void assetsys_internal_remove_collated( assetsys_t* sys, int const index )
+assetsys_error_t assetsys_mount_mapped( assetsys_t* sys, char const* path, char const* mount_as )
     {
-    struct assetsys_internal_collated_t* coll = &sys->collated[ index ];
-    ASSETSYS_ASSERT( coll->ref_count > 0, "Invalid ref count" );
-    --coll->ref_count;
-    if( coll->ref_count == 0 )
-        {
-        strpool_decref( &sys->strpool, coll->path );
-        strpool_discard( &sys->strpool, coll->path );
-        }
-    }
+    if( !path ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+    if( !mount_as ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+    if( strchr( path, '\\' ) ) return ASSETSYS_ERROR_INVALID_PATH;
+    if( strchr( mount_as, '\\' ) ) return ASSETSYS_ERROR_INVALID_PATH;
+    int mount_len = (int) strlen( mount_as );
+    if( mount_len == 0 || mount_as[ 0 ] != '/' || ( mount_len > 1 && mount_as[ mount_len - 1 ] == '/' ) ) 
+        return ASSETSYS_ERROR_INVALID_PATH;     
 
+    #if defined( _MSC_VER ) && _MSC_VER >= 1400
+        struct _stat64 s;
+        int res = __stat64( path, &s );
+    #else
+        struct stat s;
+        int res = stat( path, &s );
+    #endif
+    if( res != 0 || !( s.st_mode & S_IFREG ) ) return ASSETSYS_ERROR_INVALID_PATH;
 
-assetsys_error_t assetsys_dismount( assetsys_t* sys, char const* path, char const* mounted_as )
-    {
-    if( !path ) return ASSETSYS_ERROR_INVALID_PARAMETER;
-    if( !mounted_as ) return ASSETSYS_ERROR_INVALID_MOUNT;
+    size_t size = 0;
+    void const* data = assetsys_internal_mmap_file( path, &size );
+    if( !data ) return ASSETSYS_ERROR_FAILED_TO_READ_ZIP;
 
-    ASSETSYS_U64 path_handle = strpool_inject( &sys->strpool, path, (int) strlen( path ) );
-    ASSETSYS_U64 mount_handle = strpool_inject( &sys->strpool, mounted_as, (int) strlen( mounted_as ) );
+    assetsys_internal_cache_flush( sys );
+    struct assetsys_internal_mount_t* mount = assetsys_internal_create_mount( sys, ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP, 
+        path, mount_as );
+    mz_bool status = mz_zip_reader_init_mem( &mount->zip, data, size, 0 );
+    if( !status )
+        {
+        assetsys_internal_munmap_file( data, size );
+        ASSETSYS_FREE( sys->memctx, mount->dirs );
+        ASSETSYS_FREE( sys->memctx, mount->files );
+        return ASSETSYS_ERROR_FAILED_TO_READ_ZIP;
+        }
+    mount->data = data;
+    mount->data_size = size;
+    mount->is_mapped = 1;
 
-    for( int i = 0; i < sys->mounts_count; ++i )
+    assetsys_error_t result = assetsys_internal_mount_files( sys, mount );
+    if( result != ASSETSYS_SUCCESS )
         {
-        struct assetsys_internal_mount_t* mount = &sys->mounts[ i ];
-        if( mount->mounted_as == mount_handle && mount->path == path_handle )
-            {
-            mz_bool result = 1;
-            if( mount->type == ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP ) result = mz_zip_reader_end( &mount->zip );
+        assetsys_internal_munmap_file( data, size );
+        return result;
+        }
 
-            strpool_decref( &sys->strpool, mount->mounted_as );
-            strpool_decref( &sys->strpool, mount->path );
-            strpool_discard( &sys->strpool, mount_handle );
-            strpool_discard( &sys->strpool, path_handle );
-            
-            for( int j = 0; j < mount->dirs_count; ++j )
-                assetsys_internal_remove_collated( sys, mount->dirs[ j ].collated_index );
+    assetsys_internal_collate_directories( sys, mount );
+    assetsys_internal_index_mount_files( sys, mount );
 
-            for( int j = 0; j < mount->files_count; ++j )
-                assetsys_internal_remove_collated( sys, mount->files[ j ].collated_index );
+    ++sys->mounts_count;
+    return ASSETSYS_SUCCESS;
+    }
 
-            ASSETSYS_FREE( sys->memctx, mount->dirs );
-            ASSETSYS_FREE( sys->memctx, mount->files );
 
-            int count = sys->mounts_count - i;
-            if( count > 0 ) memcpy( &sys->mounts[ i ], &sys->mounts[ i + 1 ], sizeof( *sys->mounts ) * count );
-            --sys->mounts_count;
+// Sidecar index file, all values little endian:
+//     header:  "ASIX", u32 version, u32 type, u64 zip size, u32 zip entry count, u32 dirs count, u32 files count, 
+//              u32 string data size
+//     entries: u32 string offset, u32 string length, i32 parent entry, i32 size, i32 zip index (dirs, then files).
+//              For dirs, size and zip index are replaced by a u64 modification time (0 for zip files).
+//     strings: paths relative to the mount point, without terminators
+#define ASSETSYS_INTERNAL_INDEX_VERSION 2
+#define ASSETSYS_INTERNAL_INDEX_HEADER_SIZE 36
+#define ASSETSYS_INTERNAL_INDEX_ENTRY_SIZE 20
 
-            return !result ? ASSETSYS_ERROR_FAILED_TO_CLOSE_ZIP : ASSETSYS_SUCCESS;
-            }
-        }
+static int assetsys_internal_find_mount_index( assetsys_t* sys, ASSETSYS_U64 const mount, ASSETSYS_U64 const path );
 
-    strpool_discard( &sys->strpool, mount_handle );
-    strpool_discard( &sys->strpool, path_handle );
-    return ASSETSYS_ERROR_INVALID_MOUNT;
+static void assetsys_internal_index_put( unsigned char* out, ASSETSYS_U64 value, int bytes )
+    {
+    for( int i = 0; i < bytes; ++i ) out[ i ] = (unsigned char)( value >> ( i * 8 ) );
     }
 
 
-assetsys_error_t assetsys_file( assetsys_t* sys, char const* path, assetsys_file_t* file )
+static ASSETSYS_U64 assetsys_internal_index_get( unsigned char const* in, int bytes )
     {
-    if( !file || !path ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+    ASSETSYS_U64 value = 0;
+    for( int i = 0; i < bytes; ++i ) value |= ( (ASSETSYS_U64) in[ i ] ) << ( i * 8 );
+    return value;
+    }
 
-    ASSETSYS_U64 handle = strpool_inject( &sys->strpool, path, (int) strlen( path ) );
 
-    int m = sys->mounts_count;
-    while( m > 0)
-        {
-        --m;
-        struct assetsys_internal_mount_t* mount = &sys->mounts[ m ];
-        for( int i = 0; i < mount->files_count; ++i )
-            {
-            ASSETSYS_U64 h = sys->collated[ mount->files[ i ].collated_index ].path;
-            if( handle == h )
-                {
-                file->mount = mount->mounted_as;
-                file->path = mount->path;
-                file->index = i;
-                return ASSETSYS_SUCCESS;
-                }
-            }
-        }
+// Modification time of a directory in a directory mount, given its path relative to the mount path. Adding, removing
+// or renaming entries updates the time of the directory holding them. Returns 0 if the directory can't be stat'ed.
+static ASSETSYS_U64 assetsys_internal_index_dir_time( char const* mount_path, char const* relative, size_t length )
+    {
+    char path[ 1024 ];
+    size_t mount_path_len = strlen( mount_path );
+    if( mount_path_len + 1 + length >= sizeof( path ) ) return 0;
+    memcpy( path, mount_path, mount_path_len );
+    if( mount_path_len > 0 && length > 0 ) path[ mount_path_len++ ] = '/';
+    memcpy( path + mount_path_len, relative, length );
+    path[ mount_path_len + length ] = '\0';
+    if( *path == '\0' ) strcpy( path, "." );
 
-    strpool_discard( &sys->strpool, handle );
-    return ASSETSYS_ERROR_FILE_NOT_FOUND;
+    #if defined( _MSC_VER ) && _MSC_VER >= 1400
+        struct _stat64 s;
+        if( __stat64( path, &s ) != 0 ) return 0;
+    #else
+        struct stat s;
+        if( stat( path, &s ) != 0 ) return 0;
+    #endif
+    return (ASSETSYS_U64) s.st_mtime;
     }
 
 
-static int assetsys_internal_find_mount_index( assetsys_t* sys, ASSETSYS_U64 const mount, ASSETSYS_U64 const path )
+// Returns the path of a collated entry relative to the mount point of the mount
+static char const* assetsys_internal_index_relative_path( assetsys_t* sys, struct assetsys_internal_mount_t* mount, 
+    int collated_index )
     {
-    for( int i = 0; i < sys->mounts_count; ++i )
-        {
-        if( sys->mounts[ i ].mounted_as == mount && sys->mounts[ i ].path == path )
-            return i;
-        }
-    return -1;
+    char const* path = assetsys_internal_get_string( sys, sys->collated[ collated_index ].path );
+    char const* mounted_as = assetsys_internal_get_string( sys, mount->mounted_as );
+    size_t len = strlen( mounted_as );
+    if( strncmp( path, mounted_as, len ) == 0 ) path += len;
+    if( *path == '/' ) ++path;
+    return path;
     }
 
 
-assetsys_error_t assetsys_file_load( assetsys_t* sys, assetsys_file_t f, int* size, void* buffer, int capacity )
+assetsys_error_t assetsys_index_save( assetsys_t* sys, char const* path, char const* mounted_as, 
+    char const* index_path )
     {
-    int mount_index = assetsys_internal_find_mount_index( sys, f.mount, f.path );
+    if( !path || !mounted_as || !index_path ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+    ASSETSYS_U64 path_handle = strpool_find( &sys->strpool, path, (int) strlen( path ) );
+    ASSETSYS_U64 mount_handle = strpool_find( &sys->strpool, mounted_as, (int) strlen( mounted_as ) );
+    int mount_index = assetsys_internal_find_mount_index( sys, mount_handle, path_handle );
     if( mount_index < 0 ) return ASSETSYS_ERROR_INVALID_MOUNT;
-
     struct assetsys_internal_mount_t* mount = &sys->mounts[ mount_index ];
-    struct assetsys_internal_file_t* file = &mount->files[ f.index ];
-    if( mount->type == ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP )
-        {
-        if( size ) *size = (int) file->size;
-        if( file->size > capacity ) return ASSETSYS_ERROR_BUFFER_TOO_SMALL;
 
-        mz_bool result = mz_zip_reader_extract_to_mem_no_alloc( &mount->zip, (mz_uint) file->zip_index, buffer, 
-            (size_t) file->size, 0, 0, 0 ); 
-        return result ? ASSETSYS_SUCCESS : ASSETSYS_ERROR_FAILED_TO_READ_FILE;
-        }
-    else
+    // Files removed from a watched mount leave gaps in `files`, which are left out of the index
+    int* files = (int*) ASSETSYS_MALLOC( sys->memctx, sizeof( int ) * 
+        ( mount->files_count > 0 ? mount->files_count : 1 ) );
+    int files_count = 0;
+    for( int i = 0; i < mount->files_count; ++i ) 
+        if( mount->files[ i ].collated_index >= 0 ) files[ files_count++ ] = i;
+
+    // Entries are numbered dirs first, then files, so parents can be stored as entry numbers
+    int count = mount->dirs_count + files_count;
+    struct assetsys_internal_map_t entries_map; // collated index -> entry
+    assetsys_internal_map_init( sys, &entries_map, count * 2 );
+    size_t strings_size = 0;
+    for( int i = 0; i < count; ++i )
         {
-        strcpy( sys->temp, assetsys_internal_get_string( sys, mount->path ) );
-        strcat( sys->temp, *sys->temp == '\0' ? "" : "/" );
-        strcat( sys->temp, assetsys_internal_get_string( sys, 
-            sys->collated[ file->collated_index ].path ) + 
-            ( strcmp( assetsys_internal_get_string( sys, mount->mounted_as ), "/" ) == 0 ? 0 : mount->mount_len + 1 ) );
-        ASSETSYS_FILE* fp = ASSETSYS_FOPEN( sys->temp, "rb" );
-        if( !fp ) return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
-        
-        ASSETSYS_FSEEK( fp, 0, ASSETSYS_SEEK_END );
-        int file_size = (int) ASSETSYS_FTELL( fp );
-        ASSETSYS_FSEEK( fp, 0, ASSETSYS_SEEK_SET );
-        if( size ) *size = file_size;
-
-        if( file_size > capacity ) { ASSETSYS_FCLOSE( fp ); return ASSETSYS_ERROR_BUFFER_TOO_SMALL; }
-
-        int size_read = (int) ASSETSYS_FREAD( buffer, 1, (size_t) file_size, fp );
-        ASSETSYS_FCLOSE( fp );
-        if( size_read != file_size ) return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+        int collated_index = i < mount->dirs_count ? mount->dirs[ i ].collated_index : 
+            mount->files[ files[ i - mount->dirs_count ] ].collated_index;
+        if( assetsys_internal_map_find( &entries_map, (ASSETSYS_U64) collated_index ) < 0 )
+            assetsys_internal_map_insert( sys, &entries_map, (ASSETSYS_U64) collated_index, i );
+        strings_size += strlen( assetsys_internal_index_relative_path( sys, mount, collated_index ) );
+        }
 
-        return ASSETSYS_SUCCESS;
+    size_t size = ASSETSYS_INTERNAL_INDEX_HEADER_SIZE + (size_t) count * ASSETSYS_INTERNAL_INDEX_ENTRY_SIZE + 
+        strings_size;
+    unsigned char* data = (unsigned char*) ASSETSYS_MALLOC( sys->memctx, size );
+    memcpy( data, "ASIX", 4 );
+    assetsys_internal_index_put( data + 4, ASSETSYS_INTERNAL_INDEX_VERSION, 4 );
+    assetsys_internal_index_put( data + 8, (ASSETSYS_U64) mount->type, 4 );
+    assetsys_internal_index_put( data + 12, mount->type == ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP ? 
+        mount->zip.m_archive_size : 0, 8 );
+    assetsys_internal_index_put( data + 20, mount->type == ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP ? 
+        mz_zip_reader_get_num_files( &mount->zip ) : 0, 4 );
+    assetsys_internal_index_put( data + 24, (ASSETSYS_U64) mount->dirs_count, 4 );
+    assetsys_internal_index_put( data + 28, (ASSETSYS_U64) files_count, 4 );
+    assetsys_internal_index_put( data + 32, (ASSETSYS_U64) strings_size, 4 );
+
+    unsigned char* entry = data + ASSETSYS_INTERNAL_INDEX_HEADER_SIZE;
+    unsigned char* strings = entry + (size_t) count * ASSETSYS_INTERNAL_INDEX_ENTRY_SIZE;
+    size_t string_offset = 0;
+    for( int i = 0; i < count; ++i, entry += ASSETSYS_INTERNAL_INDEX_ENTRY_SIZE )
+        {
+        int is_file = i >= mount->dirs_count;
+        struct assetsys_internal_file_t* file = is_file ? &mount->files[ files[ i - mount->dirs_count ] ] : NULL;
+        int collated_index = is_file ? file->collated_index : mount->dirs[ i ].collated_index;
+        char const* relative = assetsys_internal_index_relative_path( sys, mount, collated_index );
+        size_t len = strlen( relative );
+        int parent = sys->collated[ collated_index ].parent;
+        parent = parent >= 0 ? assetsys_internal_map_find( &entries_map, (ASSETSYS_U64) parent ) : -1;
+        memcpy( strings + string_offset, relative, len );
+        assetsys_internal_index_put( entry + 0, (ASSETSYS_U64) string_offset, 4 );
+        assetsys_internal_index_put( entry + 4, (ASSETSYS_U64) len, 4 );
+        assetsys_internal_index_put( entry + 8, (ASSETSYS_U64)(unsigned int) parent, 4 );
+        if( file )
+            {
+            assetsys_internal_index_put( entry + 12, (ASSETSYS_U64)(unsigned int) file->size, 4 );
+            assetsys_internal_index_put( entry + 16, (ASSETSYS_U64)(unsigned int) file->zip_index, 4 );
+            }
+        else
+            {
+            assetsys_internal_index_put( entry + 12, mount->type == ASSETSYS_INTERNAL_MOUNT_TYPE_DIR ? 
+                assetsys_internal_index_dir_time( path, relative, len ) : 0, 8 );
+            }
+        string_offset += len;
         }
+    assetsys_internal_map_term( sys, &entries_map );
+    ASSETSYS_FREE( sys->memctx, files );
+
+    ASSETSYS_FILE* fp = ASSETSYS_FOPEN( index_path, "wb" );
+    size_t written = fp ? ASSETSYS_FWRITE( data, 1, size, fp ) : 0;
+    if( fp ) ASSETSYS_FCLOSE( fp );
+    ASSETSYS_FREE( sys->memctx, data );
+    return written == size ? ASSETSYS_SUCCESS : ASSETSYS_ERROR_FAILED_TO_READ_FILE;
     }
 
 
-int assetsys_file_size( assetsys_t* sys, assetsys_file_t file )
+static void assetsys_internal_free_mount( assetsys_t* sys, struct assetsys_internal_mount_t* mount );
+
+assetsys_error_t assetsys_mount_indexed( assetsys_t* sys, char const* path, char const* mount_as, 
+    char const* index_path )
     {
-    int mount_index = assetsys_internal_find_mount_index( sys, file.mount, file.path );
-    if( mount_index < 0 ) return 0;
+    if( !path || !index_path ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+    if( !mount_as ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+    if( strchr( path, '\\' ) ) return ASSETSYS_ERROR_INVALID_PATH;
+    if( strchr( mount_as, '\\' ) ) return ASSETSYS_ERROR_INVALID_PATH;
+    int len = (int) strlen( path );
+    if( len > 1 && path[ len - 1 ] == '/' ) return ASSETSYS_ERROR_INVALID_PATH;     
+    int mount_len = (int) strlen( mount_as );
+    if( mount_len == 0 || mount_as[ 0 ] != '/' || ( mount_len > 1 && mount_as[ mount_len - 1 ] == '/' ) ) 
+        return ASSETSYS_ERROR_INVALID_PATH;     
 
-    struct assetsys_internal_mount_t* mount = &sys->mounts[ mount_index ];
-    if( mount->type == ASSETSYS_INTERNAL_MOUNT_TYPE_DIR )
-        {
-        strcpy( sys->temp, assetsys_internal_get_string( sys, mount->path ) );
-        strcat( sys->temp, *sys->temp == '\0' ? "" : "/" );
-        strcat( sys->temp, assetsys_internal_get_string( sys, 
-            sys->collated[ mount->files[ file.index ].collated_index ].path ) + mount->mount_len + 1 );
+    #if defined( _MSC_VER ) && _MSC_VER >= 1400
+        struct _stat64 s;
+        int res = __stat64( *path == '\0' ? "." : path, &s );
+    #else
         struct stat s;
-        if( stat( sys->temp, &s ) == 0 )
-            mount->files[ file.index ].size = (int) s.st_size;
+        int res = stat( *path == '\0' ? "." : path, &s );
+    #endif
+    if( res != 0 ) return ASSETSYS_ERROR_INVALID_PATH;
+    enum assetsys_internal_mount_type_t type;
+    if( s.st_mode & S_IFDIR ) type = ASSETSYS_INTERNAL_MOUNT_TYPE_DIR;
+    else if( s.st_mode & S_IFREG ) type = ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP;
+    else return ASSETSYS_ERROR_INVALID_PATH;
+
+    // Read the whole index and validate it against the data source before touching any state
+    ASSETSYS_FILE* fp = ASSETSYS_FOPEN( index_path, "rb" );
+    if( !fp ) return ASSETSYS_ERROR_INVALID_INDEX;
+    ASSETSYS_FSEEK( fp, 0, ASSETSYS_SEEK_END );
+    long index_size = ASSETSYS_FTELL( fp );
+    ASSETSYS_FSEEK( fp, 0, ASSETSYS_SEEK_SET );
+    if( index_size < ASSETSYS_INTERNAL_INDEX_HEADER_SIZE ) { ASSETSYS_FCLOSE( fp ); return ASSETSYS_ERROR_INVALID_INDEX; }
+    unsigned char* data = (unsigned char*) ASSETSYS_MALLOC( sys->memctx, (size_t) index_size );
+    size_t size_read = ASSETSYS_FREAD( data, 1, (size_t) index_size, fp );
+    ASSETSYS_FCLOSE( fp );
+
+    ASSETSYS_U64 dirs_count = assetsys_internal_index_get( data + 24, 4 );
+    ASSETSYS_U64 files_count = assetsys_internal_index_get( data + 28, 4 );
+    ASSETSYS_U64 strings_size = assetsys_internal_index_get( data + 32, 4 );
+    ASSETSYS_U64 zip_size = assetsys_internal_index_get( data + 12, 8 );
+    ASSETSYS_U64 zip_entries = assetsys_internal_index_get( data + 20, 4 );
+    int count = (int)( dirs_count + files_count );
+    if( size_read != (size_t) index_size || memcmp( data, "ASIX", 4 ) != 0 ||
+        assetsys_internal_index_get( data + 4, 4 ) != ASSETSYS_INTERNAL_INDEX_VERSION ||
+        assetsys_internal_index_get( data + 8, 4 ) != (ASSETSYS_U64) type || dirs_count + files_count > 0x7fffffff ||
+        ASSETSYS_INTERNAL_INDEX_HEADER_SIZE + ( dirs_count + files_count ) * ASSETSYS_INTERNAL_INDEX_ENTRY_SIZE + 
+            strings_size != (ASSETSYS_U64) index_size ||
+        ( type == ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP && zip_size != (ASSETSYS_U64) s.st_size ) )
+        {
+        ASSETSYS_FREE( sys->memctx, data );
+        return ASSETSYS_ERROR_INVALID_INDEX;
         }
-        
-    return mount->files[ file.index ].size;
-    }
 
+    unsigned char const* entries = data + ASSETSYS_INTERNAL_INDEX_HEADER_SIZE;
+    unsigned char const* strings = entries + (size_t) count * ASSETSYS_INTERNAL_INDEX_ENTRY_SIZE;
+    for( int i = 0; i < count; ++i )
+        {
+        unsigned char const* entry = entries + (size_t) i * ASSETSYS_INTERNAL_INDEX_ENTRY_SIZE;
+        ASSETSYS_U64 offset = assetsys_internal_index_get( entry + 0, 4 );
+        ASSETSYS_U64 length = assetsys_internal_index_get( entry + 4, 4 );
+        int parent = (int)(unsigned int) assetsys_internal_index_get( entry + 8, 4 );
+        int zip_index = (int)(unsigned int) assetsys_internal_index_get( entry + 16, 4 );
+        int is_file = i >= (int) dirs_count;
+        if( offset + length > strings_size || mount_len + 1 + length >= sizeof( sys->temp ) || parent >= count || 
+            ( is_file && type == ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP && 
+                ( zip_index < 0 || (ASSETSYS_U64) zip_index >= zip_entries ) ) )
+            {
+            ASSETSYS_FREE( sys->memctx, data );
+            return ASSETSYS_ERROR_INVALID_INDEX;
+            }
 
-static int assetsys_internal_find_collated( assetsys_t* sys, char const* const path )
-    {
-    ASSETSYS_U64 handle = strpool_inject( &sys->strpool, path, (int) strlen( path ) );
+        // Files added to or removed from a directory since the index was saved change the directory's time
+        if( !is_file && type == ASSETSYS_INTERNAL_MOUNT_TYPE_DIR && assetsys_internal_index_get( entry + 12, 8 ) != 
+            assetsys_internal_index_dir_time( path, (char const*) strings + offset, (size_t) length ) )
+            {
+            ASSETSYS_FREE( sys->memctx, data );
+            return ASSETSYS_ERROR_INVALID_INDEX;
+            }
+        }
 
-    for( int i = 0; i < sys->collated_count; ++i )
+    assetsys_internal_cache_flush( sys );
+    struct assetsys_internal_mount_t* mount = assetsys_internal_create_mount( sys, type, path, mount_as );
+    if( type == ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP )
         {
-        if( sys->collated[ i ].path == handle )
+#ifdef MINIZ_NO_STDIO
+        assetsys_internal_free_mount( sys, mount );
+        ASSETSYS_FREE( sys->memctx, data );
+        return ASSETSYS_ERROR_FAILED_TO_READ_ZIP;
+#else
+        // Files are only accessed by index, so there is no need to sort the central directory
+        if( !mz_zip_reader_init_file( &mount->zip, path, MZ_ZIP_FLAG_DO_NOT_SORT_CENTRAL_DIRECTORY ) )
             {
-            return i;
+            assetsys_internal_free_mount( sys, mount );
+            ASSETSYS_FREE( sys->memctx, data );
+            return ASSETSYS_ERROR_FAILED_TO_READ_ZIP;
+            }
+        if( mz_zip_reader_get_num_files( &mount->zip ) != zip_entries )
+            {
+            mz_zip_reader_end( &mount->zip );
+            assetsys_internal_free_mount( sys, mount );
+            ASSETSYS_FREE( sys->memctx, data );
+            return ASSETSYS_ERROR_INVALID_INDEX;
             }
+        #if defined( ASSETSYS_FREAD_AT ) && !defined( ASSETSYS_NO_MINIZ )
+            mount->zip.m_pRead = assetsys_internal_zip_read_at;
+        #endif
+#endif
         }
 
-    strpool_discard( &sys->strpool, handle );
-    return -1;
-    }
-
+    if( (int) dirs_count > mount->dirs_capacity )
+        {
+        ASSETSYS_FREE( sys->memctx, mount->dirs );
+        mount->dirs_capacity = (int) dirs_count;
+        mount->dirs = (struct assetsys_internal_folder_t*) ASSETSYS_MALLOC( sys->memctx, 
+            sizeof( *(mount->dirs) ) * mount->dirs_capacity );
+        }
+    if( (int) files_count > mount->files_capacity )
+        {
+        ASSETSYS_FREE( sys->memctx, mount->files );
+        mount->files_capacity = (int) files_count;
+        mount->files = (struct assetsys_internal_file_t*) ASSETSYS_MALLOC( sys->memctx, 
+            sizeof( *(mount->files) ) * mount->files_capacity );
+        }
 
-int assetsys_file_count( assetsys_t* sys, char const* path )
-    {
-    if( !path ) return 0;
-    int dir = assetsys_internal_find_collated( sys, path );
-    int count = 0;
-    for( int i = 0; i < sys->collated_count; ++i )
+    // Register all entries, then link each to its parent. Entries whose parent is outside the mount are linked up by
+    // assetsys_internal_collate_directories, as for a regular mount.
+    int* collated = (int*) ASSETSYS_MALLOC( sys->memctx, sizeof( int ) * ( count > 0 ? count : 1 ) );
+    for( int i = 0; i < count; ++i )
         {
-        if( sys->collated[ i ].is_file && sys->collated[ i ].parent == dir )
+        unsigned char const* entry = entries + (size_t) i * ASSETSYS_INTERNAL_INDEX_ENTRY_SIZE;
+        size_t offset = (size_t) assetsys_internal_index_get( entry + 0, 4 );
+        size_t length = (size_t) assetsys_internal_index_get( entry + 4, 4 );
+        strcpy( sys->temp, mount_as );
+        if( length > 0 )
             {
-            ++count;
+            size_t prefix = strlen( sys->temp );
+            if( prefix == 0 || sys->temp[ prefix - 1 ] != '/' ) sys->temp[ prefix++ ] = '/';
+            memcpy( sys->temp + prefix, strings + offset, length );
+            sys->temp[ prefix + length ] = '\0';
+            }
+        int is_file = i >= (int) dirs_count;
+        collated[ i ] = assetsys_internal_register_collated( sys, sys->temp, is_file );
+        if( is_file )
+            {
+            struct assetsys_internal_file_t* file = &mount->files[ mount->files_count++ ];
+            file->collated_index = collated[ i ];
+            file->size = (int)(unsigned int) assetsys_internal_index_get( entry + 12, 4 );
+            file->zip_index = (int)(unsigned int) assetsys_internal_index_get( entry + 16, 4 );
+            }
+        else
+            {
+            mount->dirs[ mount->dirs_count++ ].collated_index = collated[ i ];
             }
         }
-    return count;
+    for( int i = 0; i < count; ++i )
+        {
+        int parent = (int)(unsigned int) assetsys_internal_index_get( entries + (size_t) i * 
+            ASSETSYS_INTERNAL_INDEX_ENTRY_SIZE + 8, 4 );
+        if( parent >= 0 && sys->collated[ collated[ i ] ].parent < 0 ) 
+            sys->collated[ collated[ i ] ].parent = collated[ parent ];
+        }
+    ASSETSYS_FREE( sys->memctx, collated );
+    ASSETSYS_FREE( sys->memctx, data );
+
+    assetsys_internal_collate_directories( sys, mount );
+    assetsys_internal_index_mount_files( sys, mount );
+
+    ++sys->mounts_count;
+    return ASSETSYS_SUCCESS;
     }
 
 
-char const* assetsys_file_name( assetsys_t* sys, char const* path, int index )
+// Releases a mount which failed part way through being mounted, before any entries were registered
+static void assetsys_internal_free_mount( assetsys_t* sys, struct assetsys_internal_mount_t* mount )
     {
-    char const* file_path = assetsys_file_path( sys, path, index );
-    if( file_path ) 
-        {
-        char const* name = strrchr( file_path, '/' );
-        if( !name ) return file_path;
-        return name + 1;
-        }
-
-    return NULL;
+    strpool_decref( &sys->strpool, mount->mounted_as );
+    strpool_decref( &sys->strpool, mount->path );
+    strpool_discard( &sys->strpool, mount->mounted_as );
+    strpool_discard( &sys->strpool, mount->path );
+    ASSETSYS_FREE( sys->memctx, mount->dirs );
+    ASSETSYS_FREE( sys->memctx, mount->files );
     }
 
 
-char const* assetsys_file_path( assetsys_t* sys, char const* path, int index )
+static void assetsys_internal_remove_collated( assetsys_t* sys, int const index )
     {
-    if( !path ) return 0;
-    int dir = assetsys_internal_find_collated( sys, path );
-    int count = 0;
-    for( int i = 0; i < sys->collated_count; ++i )
-        {
-        if( sys->collated[ i ].is_file &&  sys->collated[ i ].parent == dir )
-            {
+    struct assetsys_internal_collated_t* coll = &sys->collated[ index ];
+    ASSETSYS_ASSERT( coll->ref_count > 0, "Invalid ref count" );
+    --coll->ref_count;
+    if( coll->ref_count == 0 )
+        {
+        assetsys_internal_map_remove( &sys->collated_map, coll->path );
+        strpool_decref( &sys->strpool, coll->path );
+        strpool_discard( &sys->strpool, coll->path );
+
+        if( sys->collated_free_count >= sys->collated_free_capacity )
+            {
+            sys->collated_free_capacity *= 2;
+            int* new_free = (int*) ASSETSYS_MALLOC( sys->memctx, 
+                sizeof( *sys->collated_free ) * sys->collated_free_capacity );
+            memcpy( new_free, sys->collated_free, sizeof( *sys->collated_free ) * sys->collated_free_count );
+            ASSETSYS_FREE( sys->memctx, sys->collated_free );
+            sys->collated_free = new_free;
+            }
+        sys->collated_free[ sys->collated_free_count++ ] = index;
+        }
+    }
+
+
+#ifdef ASSETSYS_INTERNAL_WATCH
+
+    // Builds the on-disk path of a directory in a directory mount, the same way assetsys_internal_recurse_directories
+    // does
+    static int assetsys_internal_watch_dir_path( assetsys_t* sys, struct assetsys_internal_mount_t* mount, 
+        int collated_index, char* out, size_t capacity )
+        {
+        char const* mount_path = assetsys_internal_get_string( sys, mount->path );
+        char const* dir_path = assetsys_internal_get_string( sys, sys->collated[ collated_index ].path ) + 
+            mount->mount_len;
+        if( *dir_path == '/' ) ++dir_path;
+        size_t mount_len = strlen( mount_path );
+        size_t dir_len = strlen( dir_path );
+        size_t separator = mount_len > 0 && dir_len > 0 ? 1 : 0;
+        if( mount_len + separator + dir_len + 2 > capacity ) return 0;
+        memcpy( out, mount_path, mount_len );
+        if( separator ) out[ mount_len ] = '/';
+        memcpy( out + mount_len + separator, dir_path, dir_len + 1 );
+        if( *out == '\0' ) strcpy( out, "." );
+        return 1;
+        }
+
+
+    // Appends `name` to a path, with a separator unless the path already ends with one
+    static int assetsys_internal_watch_join( char* out, size_t capacity, char const* path, char const* name )
+        {
+        size_t path_len = strlen( path );
+        size_t name_len = strlen( name );
+        size_t separator = path_len > 0 && path[ path_len - 1 ] != '/' ? 1 : 0;
+        if( path_len + separator + name_len + 1 > capacity ) return 0;
+        memmove( out, path, path_len );
+        if( separator ) out[ path_len ] = '/';
+        memcpy( out + path_len + separator, name, name_len + 1 );
+        return 1;
+        }
+
+
+    // Links a single collated entry to its parent, like assetsys_internal_collate_directories does for a whole mount
+    static void assetsys_internal_watch_collate( assetsys_t* sys, int collated_index )
+        {
+        if( sys->collated[ collated_index ].parent >= 0 ) return;
+        char* dir_path = assetsys_internal_dirname( assetsys_internal_get_string( sys, 
+            sys->collated[ collated_index ].path ) );
+        ASSETSYS_U64 handle = strpool_find( &sys->strpool, dir_path, dir_path[ 0 ] == '/' && dir_path[ 1 ] == '\0' ? 
+            1 : (int) strlen( dir_path ) - 1 );
+        sys->collated[ collated_index ].parent = assetsys_internal_map_find( &sys->collated_map, handle );
+        }
+
+
+    static void assetsys_internal_watch_dir( assetsys_t* sys, struct assetsys_internal_mount_t* mount, 
+        int collated_index )
+        {
+        char path[ sizeof( sys->temp ) ];
+        if( !assetsys_internal_watch_dir_path( sys, mount, collated_index, path, sizeof( path ) ) ) return;
+        int descriptor = assetsys_internal_watch_add( mount->watch, path );
+        if( descriptor < 0 ) return;
+        assetsys_internal_map_insert( sys, &mount->watch_dirs, (ASSETSYS_U64) descriptor, collated_index );
+        assetsys_internal_map_insert( sys, &mount->watch_descriptors, (ASSETSYS_U64) collated_index, descriptor );
+        }
+
+
+    static void assetsys_internal_watch_start( assetsys_t* sys, struct assetsys_internal_mount_t* mount )
+        {
+        assetsys_internal_map_init( sys, &mount->watch_dirs, mount->dirs_count * 2 );
+        assetsys_internal_map_init( sys, &mount->watch_descriptors, mount->dirs_count * 2 );
+        for( int i = 0; i < mount->dirs_count; ++i ) 
+            assetsys_internal_watch_dir( sys, mount, mount->dirs[ i ].collated_index );
+        }
+
+
+    static void assetsys_internal_watch_stop( assetsys_t* sys, struct assetsys_internal_mount_t* mount )
+        {
+        assetsys_internal_watch_close( mount->watch );
+        mount->watch = -1;
+        assetsys_internal_map_term( sys, &mount->watch_dirs );
+        assetsys_internal_map_term( sys, &mount->watch_descriptors );
+        }
+
+
+    // Adds a file to a watched mount, or updates its size if it is already there. Removed entries are reused first, 
+    // which keeps the file handle the same when a file is saved by replacing it.
+    static int assetsys_internal_watch_add_file( assetsys_t* sys, struct assetsys_internal_mount_t* mount, 
+        char const* path, int size )
+        {
+        ASSETSYS_U64 handle = strpool_find( &sys->strpool, path, (int) strlen( path ) );
+        int collated_index = assetsys_internal_map_find( &sys->collated_map, handle );
+        int index = collated_index >= 0 ? 
+            assetsys_internal_map_find( &mount->files_map, (ASSETSYS_U64) collated_index ) : -1;
+        if( index >= 0 )
+            {
+            if( mount->files[ index ].size == size ) return 0;
+            mount->files[ index ].size = size;
+            return 1;
+            }
+        if( collated_index >= 0 && !sys->collated[ collated_index ].is_file ) return 0;
+
+        if( mount->files_free >= 0 )
+            {
+            index = mount->files_free;
+            mount->files_free = mount->files[ index ].zip_index;
+            }
+        else
+            {
+            if( mount->files_count >= mount->files_capacity )
+                {
+                mount->files_capacity = mount->files_capacity ? mount->files_capacity * 2 : 64;
+                struct assetsys_internal_file_t* new_files = (struct assetsys_internal_file_t*) ASSETSYS_MALLOC( 
+                    sys->memctx, sizeof( *(mount->files) ) * mount->files_capacity );
+                memcpy( new_files, mount->files, sizeof( *(mount->files) ) * mount->files_count );
+                ASSETSYS_FREE( sys->memctx, mount->files );
+                mount->files = new_files;
+                }
+            index = mount->files_count++;
+            }
+
+        struct assetsys_internal_file_t* file = &mount->files[ index ];
+        file->size = size;
+        file->zip_index = -1;
+        file->collated_index = assetsys_internal_register_collated( sys, path, 1 );
+        assetsys_internal_watch_collate( sys, file->collated_index );
+        assetsys_internal_map_insert( sys, &mount->files_map, (ASSETSYS_U64) file->collated_index, index );
+        return 1;
+        }
+
+
+    static void assetsys_internal_watch_remove_index( assetsys_t* sys, struct assetsys_internal_mount_t* mount, 
+        int index )
+        {
+        struct assetsys_internal_file_t* file = &mount->files[ index ];
+        assetsys_internal_map_remove( &mount->files_map, (ASSETSYS_U64) file->collated_index );
+        assetsys_internal_remove_collated( sys, file->collated_index );
+        file->collated_index = -1;
+        file->size = 0;
+        file->zip_index = mount->files_free;
+        mount->files_free = index;
+        }
+
+
+    static int assetsys_internal_watch_remove_file( assetsys_t* sys, struct assetsys_internal_mount_t* mount, 
+        char const* path )
+        {
+        ASSETSYS_U64 handle = strpool_find( &sys->strpool, path, (int) strlen( path ) );
+        int collated_index = assetsys_internal_map_find( &sys->collated_map, handle );
+        int index = collated_index >= 0 ? 
+            assetsys_internal_map_find( &mount->files_map, (ASSETSYS_U64) collated_index ) : -1;
+        if( index < 0 ) return 0;
+        assetsys_internal_watch_remove_index( sys, mount, index );
+        return 1;
+        }
+
+
+    // Adds a new directory to a watched mount, along with anything already in it. The watch is added before the 
+    // directory is walked, so that nothing created in between is missed.
+    static int assetsys_internal_watch_add_dir( assetsys_t* sys, struct assetsys_internal_mount_t* mount, 
+        char const* path )
+        {
+        ASSETSYS_U64 handle = strpool_find( &sys->strpool, path, (int) strlen( path ) );
+        int existing = assetsys_internal_map_find( &sys->collated_map, handle );
+        if( existing >= 0 && ( sys->collated[ existing ].is_file || 
+            assetsys_internal_map_find( &mount->watch_descriptors, (ASSETSYS_U64) existing ) >= 0 ) )
+            return 0;
+
+        if( mount->dirs_count >= mount->dirs_capacity )
+            {
+            mount->dirs_capacity = mount->dirs_capacity ? mount->dirs_capacity * 2 : 64;
+            struct assetsys_internal_folder_t* new_dirs = (struct assetsys_internal_folder_t*) ASSETSYS_MALLOC( 
+                sys->memctx, sizeof( *(mount->dirs) ) * mount->dirs_capacity );
+            memcpy( new_dirs, mount->dirs, sizeof( *(mount->dirs) ) * mount->dirs_count );
+            ASSETSYS_FREE( sys->memctx, mount->dirs );
+            mount->dirs = new_dirs;
+            }
+        if( mount->files_capacity == 0 ) 
+            {
+            // assetsys_internal_recurse_directories grows the array by doubling it
+            ASSETSYS_FREE( sys->memctx, mount->files );
+            mount->files_capacity = 64;
+            mount->files = (struct assetsys_internal_file_t*) ASSETSYS_MALLOC( sys->memctx, 
+                sizeof( *(mount->files) ) * mount->files_capacity );
+            }
+
+        int collated_index = assetsys_internal_register_collated( sys, path, 0 );
+        mount->dirs[ mount->dirs_count++ ].collated_index = collated_index;
+        assetsys_internal_watch_collate( sys, collated_index );
+        assetsys_internal_watch_dir( sys, mount, collated_index );
+
+        int first_dir = mount->dirs_count;
+        int first_file = mount->files_count;
+        assetsys_internal_recurse_directories( sys, collated_index, mount );
+        for( int i = first_dir; i < mount->dirs_count; ++i )
+            {
+            assetsys_internal_watch_collate( sys, mount->dirs[ i ].collated_index );
+            assetsys_internal_watch_dir( sys, mount, mount->dirs[ i ].collated_index );
+            }
+        for( int i = first_file; i < mount->files_count; ++i )
+            {
+            assetsys_internal_watch_collate( sys, mount->files[ i ].collated_index );
+            assetsys_internal_map_insert( sys, &mount->files_map, (ASSETSYS_U64) mount->files[ i ].collated_index, i );
+            }
+        return 1 + ( mount->dirs_count - first_dir ) + ( mount->files_count - first_file );
+        }
+
+
+    // Removes a directory and everything in it from a watched mount. Nothing links a directory to its contents, so 
+    // this scans the entries of the mount.
+    static int assetsys_internal_watch_remove_dir( assetsys_t* sys, struct assetsys_internal_mount_t* mount, 
+        char const* path )
+        {
+        ASSETSYS_U64 handle = strpool_find( &sys->strpool, path, (int) strlen( path ) );
+        int collated_index = assetsys_internal_map_find( &sys->collated_map, handle );
+        if( collated_index < 0 || sys->collated[ collated_index ].is_file ) return 0;
+
+        char prefix[ sizeof( sys->temp ) ];
+        strcpy( prefix, path );
+        size_t prefix_len = strlen( prefix );
+        int changes = 0;
+        for( int i = 0; i < mount->files_count; ++i )
+            {
+            if( mount->files[ i ].collated_index < 0 ) continue;
+            char const* file_path = assetsys_internal_get_string( sys, 
+                sys->collated[ mount->files[ i ].collated_index ].path );
+            if( strncmp( file_path, prefix, prefix_len ) == 0 && file_path[ prefix_len ] == '/' )
+                {
+                assetsys_internal_watch_remove_index( sys, mount, i );
+                ++changes;
+                }
+            }
+        for( int i = mount->dirs_count - 1; i > 0; --i )
+            {
+            int dir_index = mount->dirs[ i ].collated_index;
+            char const* dir_path = assetsys_internal_get_string( sys, sys->collated[ dir_index ].path );
+            if( strncmp( dir_path, prefix, prefix_len ) == 0 && 
+                ( dir_path[ prefix_len ] == '/' || dir_path[ prefix_len ] == '\0' ) )
+                {
+                int descriptor = assetsys_internal_map_find( &mount->watch_descriptors, (ASSETSYS_U64) dir_index );
+                if( descriptor >= 0 )
+                    {
+                    assetsys_internal_watch_remove( mount->watch, descriptor );
+                    assetsys_internal_map_remove( &mount->watch_dirs, (ASSETSYS_U64) descriptor );
+                    assetsys_internal_map_remove( &mount->watch_descriptors, (ASSETSYS_U64) dir_index );
+                    }
+                assetsys_internal_remove_collated( sys, dir_index );
+                mount->dirs[ i ] = mount->dirs[ --mount->dirs_count ];
+                ++changes;
+                }
+            }
+        return changes;
+        }
+
+
+    // Walks the whole mount again, for when change notifications were lost
+    static int assetsys_internal_watch_rescan( assetsys_t* sys, struct assetsys_internal_mount_t* mount )
+        {
+        assetsys_internal_watch_stop( sys, mount );
+        for( int i = 0; i < mount->files_count; ++i )
+            if( mount->files[ i ].collated_index >= 0 ) 
+                assetsys_internal_remove_collated( sys, mount->files[ i ].collated_index );
+        for( int i = 1; i < mount->dirs_count; ++i )
+            assetsys_internal_remove_collated( sys, mount->dirs[ i ].collated_index );
+        mount->files_count = 0;
+        mount->files_free = -1;
+        mount->dirs_count = 1;
+        assetsys_internal_map_term( sys, &mount->files_map );
+
+        mount->watch = assetsys_internal_watch_open();
+        if( mount->files_capacity == 0 ) 
+            {
+            ASSETSYS_FREE( sys->memctx, mount->files );
+            mount->files_capacity = 64;
+            mount->files = (struct assetsys_internal_file_t*) ASSETSYS_MALLOC( sys->memctx, 
+                sizeof( *(mount->files) ) * mount->files_capacity );
+            }
+        assetsys_internal_recurse_directories( sys, mount->dirs[ 0 ].collated_index, mount );
+        assetsys_internal_collate_directories( sys, mount );
+        assetsys_internal_index_mount_files( sys, mount );
+        if( mount->watch >= 0 ) assetsys_internal_watch_start( sys, mount );
+        return mount->dirs_count + mount->files_count;
+        }
+
+
+    static int assetsys_internal_watch_update_mount( assetsys_t* sys, struct assetsys_internal_mount_t* mount )
+        {
+        int changes = 0;
+        int overflow = 0;
+        ASSETSYS_U64 buffer[ 512 ]; // 8 byte aligned, as the events are read in place
+        for( int size = assetsys_internal_watch_read( mount->watch, buffer, sizeof( buffer ) ); size > 0; 
+            size = assetsys_internal_watch_read( mount->watch, buffer, sizeof( buffer ) ) )
+            {
+            int offset = 0;
+            struct assetsys_internal_watch_event_t event;
+            while( assetsys_internal_watch_next( buffer, size, &offset, &event ) )
+                {
+                if( event.type == ASSETSYS_INTERNAL_WATCH_EVENT_OVERFLOW ) 
+                    {
+                    overflow = 1;
+                    continue;
+                    }
+                int dir = assetsys_internal_map_find( &mount->watch_dirs, (ASSETSYS_U64) event.descriptor );
+                if( dir < 0 ) continue; // the directory was already removed
+                if( event.type == ASSETSYS_INTERNAL_WATCH_EVENT_STOPPED )
+                    {
+                    assetsys_internal_map_remove( &mount->watch_dirs, (ASSETSYS_U64) event.descriptor );
+                    assetsys_internal_map_remove( &mount->watch_descriptors, (ASSETSYS_U64) dir );
+                    continue;
+                    }
+                if( !event.name ) continue;
+
+                char path[ sizeof( sys->temp ) ];
+                if( !assetsys_internal_watch_join( path, sizeof( path ), 
+                    assetsys_internal_get_string( sys, sys->collated[ dir ].path ), event.name ) )
+                    continue;
+                if( event.type == ASSETSYS_INTERNAL_WATCH_EVENT_REMOVED )
+                    {
+                    changes += event.is_dir ? assetsys_internal_watch_remove_dir( sys, mount, path ) :
+                        assetsys_internal_watch_remove_file( sys, mount, path );
+                    continue;
+                    }
+
+                // Entries which are gone by the time the event is handled are left for their remove event
+                char disk_path[ sizeof( sys->temp ) ];
+                struct stat s;
+                if( !assetsys_internal_watch_dir_path( sys, mount, dir, disk_path, sizeof( disk_path ) ) ||
+                    !assetsys_internal_watch_join( disk_path, sizeof( disk_path ), disk_path, event.name ) ||
+                    stat( disk_path, &s ) != 0 )
+                    continue;
+                if( S_ISDIR( s.st_mode ) ) 
+                    changes += assetsys_internal_watch_add_dir( sys, mount, path );
+                else if( S_ISREG( s.st_mode ) ) 
+                    changes += assetsys_internal_watch_add_file( sys, mount, path, (int) s.st_size );
+                }
+            }
+        if( overflow ) changes += assetsys_internal_watch_rescan( sys, mount );
+        return changes;
+        }
+
+#endif /* ASSETSYS_INTERNAL_WATCH */
+
+
+assetsys_error_t assetsys_watch( assetsys_t* sys, char const* path, char const* mounted_as )
+    {
+    if( !path || !mounted_as ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+    ASSETSYS_U64 path_handle = strpool_find( &sys->strpool, path, (int) strlen( path ) );
+    ASSETSYS_U64 mount_handle = strpool_find( &sys->strpool, mounted_as, (int) strlen( mounted_as ) );
+    int mount_index = assetsys_internal_find_mount_index( sys, mount_handle, path_handle );
+    if( mount_index < 0 ) return ASSETSYS_ERROR_INVALID_MOUNT;
+    struct assetsys_internal_mount_t* mount = &sys->mounts[ mount_index ];
+    if( mount->type != ASSETSYS_INTERNAL_MOUNT_TYPE_DIR ) return ASSETSYS_ERROR_INVALID_MOUNT;
+
+    #ifdef ASSETSYS_INTERNAL_WATCH
+        if( mount->watch >= 0 ) return ASSETSYS_SUCCESS;
+        mount->watch = assetsys_internal_watch_open();
+        if( mount->watch < 0 ) return ASSETSYS_ERROR_NOT_SUPPORTED;
+        assetsys_internal_watch_start( sys, mount );
+        return ASSETSYS_SUCCESS;
+    #else
+        return ASSETSYS_ERROR_NOT_SUPPORTED;
+    #endif
+    }
+
+
+int assetsys_watch_update( assetsys_t* sys )
+    {
+    int changes = 0;
+    #ifdef ASSETSYS_INTERNAL_WATCH
+        for( int i = 0; i < sys->mounts_count; ++i )
+            if( sys->mounts[ i ].watch >= 0 ) changes += assetsys_internal_watch_update_mount( sys, &sys->mounts[ i ] );
+    #else
+        (void) sys;
+    #endif
+    return changes;
+    }
+
+
+assetsys_error_t assetsys_dismount( assetsys_t* sys, char const* path, char const* mounted_as )
+    {
+    if( !path ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+    if( !mounted_as ) return ASSETSYS_ERROR_INVALID_MOUNT;
+
+    ASSETSYS_U64 path_handle = strpool_find( &sys->strpool, path, (int) strlen( path ) );
+    ASSETSYS_U64 mount_handle = strpool_find( &sys->strpool, mounted_as, (int) strlen( mounted_as ) );
+    if( ( !path_handle && *path ) || ( !mount_handle && *mounted_as ) ) return ASSETSYS_ERROR_INVALID_MOUNT;
+
+    for( int i = 0; i < sys->mounts_count; ++i )
+        {
+        struct assetsys_internal_mount_t* mount = &sys->mounts[ i ];
+        if( mount->mounted_as == mount_handle && mount->path == path_handle )
+            {
+            assetsys_internal_cache_flush( sys );
+            mz_bool result = 1;
+            if( mount->type == ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP ) result = mz_zip_reader_end( &mount->zip );
+            if( mount->is_mapped ) assetsys_internal_munmap_file( mount->data, mount->data_size );
+
+            strpool_decref( &sys->strpool, mount->mounted_as );
+            strpool_decref( &sys->strpool, mount->path );
+            strpool_discard( &sys->strpool, mount_handle );
+            strpool_discard( &sys->strpool, path_handle );
+            
+            for( int j = 0; j < mount->dirs_count; ++j )
+                assetsys_internal_remove_collated( sys, mount->dirs[ j ].collated_index );
+
+            for( int j = 0; j < mount->files_count; ++j )
+                if( mount->files[ j ].collated_index >= 0 ) 
+                    assetsys_internal_remove_collated( sys, mount->files[ j ].collated_index );
+
+            #ifdef ASSETSYS_INTERNAL_WATCH
+                if( mount->watch >= 0 ) assetsys_internal_watch_stop( sys, mount );
+            #endif
+
+            assetsys_internal_map_term( sys, &mount->files_map );
+            ASSETSYS_FREE( sys->memctx, mount->dirs );
+            ASSETSYS_FREE( sys->memctx, mount->files );
+
+            int count = sys->mounts_count - i - 1;
+            if( count > 0 ) memmove( &sys->mounts[ i ], &sys->mounts[ i + 1 ], sizeof( *sys->mounts ) * count );
+            --sys->mounts_count;
+
+            return !result ? ASSETSYS_ERROR_FAILED_TO_CLOSE_ZIP : ASSETSYS_SUCCESS;
+            }
+        }
+
+    return ASSETSYS_ERROR_INVALID_MOUNT;
+    }
+
+
+assetsys_error_t assetsys_file( assetsys_t* sys, char const* path, assetsys_file_t* file )
+    {
+    if( !file || !path ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+
+    // Look the path up without adding it to the string pool, so that lookups don't modify any state
+    ASSETSYS_U64 handle = strpool_find( &sys->strpool, path, (int) strlen( path ) );
+
+    int collated_index = assetsys_internal_map_find( &sys->collated_map, handle );
+    if( collated_index >= 0 && sys->collated[ collated_index ].is_file )
+        {
+        // Later mounts take precedence, so check the mounts in reverse order
+        int m = sys->mounts_count;
+        while( m > 0)
+            {
+            --m;
+            struct assetsys_internal_mount_t* mount = &sys->mounts[ m ];
+            int i = assetsys_internal_map_find( &mount->files_map, (ASSETSYS_U64) collated_index );
+            if( i >= 0 )
+                {
+                file->mount = mount->mounted_as;
+                file->path = mount->path;
+                file->index = i;
+                return ASSETSYS_SUCCESS;
+                }
+            }
+        }
+
+    return ASSETSYS_ERROR_FILE_NOT_FOUND;
+    }
+
+
+static int assetsys_internal_find_mount_index( assetsys_t* sys, ASSETSYS_U64 const mount, ASSETSYS_U64 const path )
+    {
+    for( int i = 0; i < sys->mounts_count; ++i )
+        {
+        if( sys->mounts[ i ].mounted_as == mount && sys->mounts[ i ].path == path )
+            return i;
+        }
+    return -1;
+    }
+
+
+// Builds the on-disk path of a file in a directory mount. Writes to a caller provided buffer rather than sys->temp, so
+// that loads from different threads don't share any scratch memory.
+static int assetsys_internal_file_path( assetsys_t* sys, struct assetsys_internal_mount_t* mount, int collated_index,
+    char* out, size_t capacity )
+    {
+    if( collated_index < 0 ) return 0; // removed from a watched mount
+    char const* mount_path = assetsys_internal_get_string( sys, mount->path );
+    char const* file_path = assetsys_internal_get_string( sys, sys->collated[ collated_index ].path ) + 
+        ( strcmp( assetsys_internal_get_string( sys, mount->mounted_as ), "/" ) == 0 ? 0 : mount->mount_len + 1 );
+    size_t mount_len = strlen( mount_path );
+    size_t file_len = strlen( file_path );
+    size_t separator = mount_len > 0 ? 1 : 0;
+    if( mount_len + separator + file_len + 1 > capacity ) return 0;
+    memcpy( out, mount_path, mount_len );
+    if( separator ) out[ mount_len ] = '/';
+    memcpy( out + mount_len + separator, file_path, file_len + 1 );
+    return 1;
+    }
+
+
+// Finds the start of the data of a zip entry, which follows its local directory header
+static int assetsys_internal_zip_data_offset( struct assetsys_internal_mount_t* mount, ASSETSYS_U64 header_offset,
+    ASSETSYS_U64* data_offset )
+    {
+    mz_uint8 header[ 30 ];
+    if( mount->zip.m_pRead( mount->zip.m_pIO_opaque, header_offset, header, sizeof( header ) ) != sizeof( header ) 
+        || header[ 0 ] != 'P' || header[ 1 ] != 'K' || header[ 2 ] != 3 || header[ 3 ] != 4 )
+        return 0;
+    int filename_len = header[ 26 ] | ( header[ 27 ] << 8 );
+    int extra_len = header[ 28 ] | ( header[ 29 ] << 8 );
+    *data_offset = header_offset + sizeof( header ) + filename_len + extra_len;
+    return 1;
+    }
+
+
+// Compression methods beyond stored and deflate. Method 14 is the standard zip id for LZMA, while LZ4 has no assigned 
+// id, so a private one is used, which other zip tools will report as unsupported.
+#define ASSETSYS_INTERNAL_METHOD_LZMA 14
+#define ASSETSYS_INTERNAL_METHOD_LZ4 0x4C34
+
+static int assetsys_internal_is_packed_method( int method )
+    {
+    #ifdef ASSETSYS_LZMA
+        if( method == ASSETSYS_INTERNAL_METHOD_LZMA ) return 1;
+    #endif
+    return method == ASSETSYS_INTERNAL_METHOD_LZ4;
+    }
+
+
+// Decodes LZ4 block format data. Every length and offset is checked, so bad data fails rather than reading or writing
+// out of bounds.
+static int assetsys_internal_lz4_decode( mz_uint8 const* in, size_t in_size, mz_uint8* out, size_t out_size )
+    {
+    mz_uint8 const* in_end = in + in_size;
+    mz_uint8* out_pos = out;
+    mz_uint8* out_end = out + out_size;
+    while( in < in_end )
+        {
+        unsigned token = *in++;
+        size_t literals = token >> 4;
+        if( literals == 15 )
+            {
+            unsigned value = 255;
+            while( value == 255 && in < in_end ) { value = *in++; literals += value; }
+            if( value == 255 ) return 0;
+            }
+        if( literals > (size_t)( in_end - in ) || literals > (size_t)( out_end - out_pos ) ) return 0;
+        memcpy( out_pos, in, literals );
+        in += literals;
+        out_pos += literals;
+        if( in == in_end ) break; // the last sequence has no match
+
+        if( in_end - in < 2 ) return 0;
+        size_t offset = (size_t)( in[ 0 ] | ( in[ 1 ] << 8 ) );
+        in += 2;
+        if( offset == 0 || offset > (size_t)( out_pos - out ) ) return 0;
+        size_t length = token & 15;
+        if( length == 15 )
+            {
+            unsigned value = 255;
+            while( value == 255 && in < in_end ) { value = *in++; length += value; }
+            if( value == 255 ) return 0;
+            }
+        length += 4;
+        if( length > (size_t)( out_end - out_pos ) ) return 0;
+
+        mz_uint8 const* match = out_pos - offset;
+        if( offset >= length )
+            {
+            memcpy( out_pos, match, length );
+            out_pos += length;
+            }
+        else
+            {
+            // Overlapping matches repeat the last `offset` bytes
+            mz_uint8* match_end = out_pos + length;
+            while( out_pos < match_end ) *out_pos++ = *match++;
+            }
+        }
+    return out_pos == out_end;
+    }
+
+
+// Decodes the data of a compressed zip entry. Returns 1 if exactly `out_size` bytes were produced.
+static int assetsys_internal_decode( int method, void const* in, size_t in_size, void* out, size_t out_size )
+    {
+    if( method == MZ_DEFLATED )
+        {
+        return tinfl_decompress_mem_to_mem( out, out_size, in, in_size, TINFL_FLAG_USING_NON_WRAPPING_OUTPUT_BUF ) 
+            == out_size;
+        }
+    else if( method == ASSETSYS_INTERNAL_METHOD_LZ4 )
+        {
+        return assetsys_internal_lz4_decode( (mz_uint8 const*) in, in_size, (mz_uint8*) out, out_size );
+        }
+    #ifdef ASSETSYS_LZMA
+        else if( method == ASSETSYS_INTERNAL_METHOD_LZMA )
+            {
+            // Zip LZMA data starts with the encoder version (2 bytes) and the size of the properties (2 bytes)
+            mz_uint8 const* data = (mz_uint8 const*) in;
+            if( in_size < 4 + LZMA_PROPS_SIZE || ( data[ 2 ] | ( data[ 3 ] << 8 ) ) != LZMA_PROPS_SIZE ) return 0;
+            size_t dest_len = out_size;
+            size_t src_len = in_size - 4 - LZMA_PROPS_SIZE;
+            int result = LzmaUncompress( (unsigned char*) out, &dest_len, data + 4 + LZMA_PROPS_SIZE, &src_len, 
+                data + 4, LZMA_PROPS_SIZE );
+            return result == SZ_OK && dest_len == out_size;
+            }
+    #endif
+    return 0;
+    }
+
+
+// Loads an entry compressed with one of the methods miniz doesn't handle. Archives in memory are decoded in place, 
+// others have their compressed data read into a temporary buffer first.
+static assetsys_error_t assetsys_internal_load_packed( assetsys_t* sys, struct assetsys_internal_mount_t* mount, 
+    mz_zip_archive_file_stat const* stat, void* buffer )
+    {
+    (void) sys;
+    size_t out_size = (size_t) stat->m_uncomp_size;
+    size_t in_size = (size_t) stat->m_comp_size;
+    if( out_size == 0 ) return ASSETSYS_SUCCESS;
+
+    void* temp = NULL;
+    void const* in = NULL;
+    ASSETSYS_U64 data_offset;
+    if( mount->data && assetsys_internal_zip_data_offset( mount, stat->m_local_header_ofs, &data_offset ) 
+        && data_offset + in_size <= mount->data_size )
+        {
+        in = (char const*) mount->data + data_offset;
+        }
+    else
+        {
+        temp = ASSETSYS_MALLOC( sys->memctx, in_size ? in_size : 1 );
+        if( !mz_zip_reader_extract_to_mem_no_alloc( &mount->zip, stat->m_file_index, temp, in_size, 
+            MZ_ZIP_FLAG_COMPRESSED_DATA, 0, 0 ) )
+            {
+            ASSETSYS_FREE( sys->memctx, temp );
+            return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+            }
+        in = temp;
+        }
+
+    int ok = assetsys_internal_decode( stat->m_method, in, in_size, buffer, out_size ) &&
+        mz_crc32( MZ_CRC32_INIT, (mz_uint8 const*) buffer, out_size ) == stat->m_crc32;
+    if( temp ) ASSETSYS_FREE( sys->memctx, temp );
+    return ok ? ASSETSYS_SUCCESS : ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+    }
+
+
+assetsys_error_t assetsys_file_load( assetsys_t* sys, assetsys_file_t f, int* size, void* buffer, int capacity )
+    {
+    int mount_index = assetsys_internal_find_mount_index( sys, f.mount, f.path );
+    if( mount_index < 0 ) return ASSETSYS_ERROR_INVALID_MOUNT;
+
+    struct assetsys_internal_mount_t* mount = &sys->mounts[ mount_index ];
+    struct assetsys_internal_file_t* file = &mount->files[ f.index ];
+    if( mount->type == ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP )
+        {
+        if( size ) *size = (int) file->size;
+        if( file->size > capacity ) return ASSETSYS_ERROR_BUFFER_TOO_SMALL;
+
+        mz_zip_archive_file_stat stat;
+        if( !mz_zip_reader_file_stat( &mount->zip, (mz_uint) file->zip_index, &stat ) ) 
+            return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+        if( assetsys_internal_is_packed_method( stat.m_method ) && !( stat.m_bit_flag & ( 1 | 32 ) ) ) 
+            return assetsys_internal_load_packed( sys, mount, &stat, buffer );
+
+        mz_bool result = mz_zip_reader_extract_to_mem_no_alloc( &mount->zip, (mz_uint) file->zip_index, buffer, 
+            (size_t) file->size, 0, 0, 0 ); 
+        return result ? ASSETSYS_SUCCESS : ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+        }
+    else
+        {
+        char path[ sizeof( sys->temp ) ];
+        if( !assetsys_internal_file_path( sys, mount, file->collated_index, path, sizeof( path ) ) ) 
+            return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+        ASSETSYS_FILE* fp = ASSETSYS_FOPEN( path, "rb" );
+        if( !fp ) return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+        
+        ASSETSYS_FSEEK( fp, 0, ASSETSYS_SEEK_END );
+        int file_size = (int) ASSETSYS_FTELL( fp );
+        ASSETSYS_FSEEK( fp, 0, ASSETSYS_SEEK_SET );
+        if( size ) *size = file_size;
+
+        if( file_size > capacity ) { ASSETSYS_FCLOSE( fp ); return ASSETSYS_ERROR_BUFFER_TOO_SMALL; }
+
+        int size_read = (int) ASSETSYS_FREAD( buffer, 1, (size_t) file_size, fp );
+        ASSETSYS_FCLOSE( fp );
+        if( size_read != file_size ) return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+
+        return ASSETSYS_SUCCESS;
+        }
+    }
+
+
+int assetsys_file_size( assetsys_t* sys, assetsys_file_t file )
+    {
+    int mount_index = assetsys_internal_find_mount_index( sys, file.mount, file.path );
+    if( mount_index < 0 ) return 0;
+
+    struct assetsys_internal_mount_t* mount = &sys->mounts[ mount_index ];
+    if( mount->type == ASSETSYS_INTERNAL_MOUNT_TYPE_DIR )
+        {
+        // The stored size is not updated here, as other threads may be reading it
+        char path[ sizeof( sys->temp ) ];
+        struct stat s;
+        if( assetsys_internal_file_path( sys, mount, mount->files[ file.index ].collated_index, path, sizeof( path ) ) 
+            && stat( path, &s ) == 0 )
+            return (int) s.st_size;
+        }
+        
+    return mount->files[ file.index ].size;
+    }
+
+struct assetsys_internal_load_t
+    {
+    assetsys_file_t file;
+    void* buffer;
+    int capacity;
+    int priority;
+    assetsys_load_callback_t callback;
+    void* user_data;
+    int sequence;
+    int mount_index;
+
+    ASSETSYS_U64 offset; // offset of the local header in the zip, used to order reads
+    ASSETSYS_U64 compressed_size;
+    mz_uint32 crc32;
+    int method;
+    void* compressed; // compressed data waiting to be decoded, or NULL for stored data
+
+    int size;
+    assetsys_error_t result;
+    int is_done;
+    };
+
+
+struct assetsys_internal_async_t
+    {
+    struct assetsys_internal_load_t** loads; // all loads not yet delivered by assetsys_poll
+    int loads_count;
+    int loads_capacity;
+
+    struct assetsys_internal_load_t** deliver; // only used by assetsys_poll
+    int deliver_count;
+    int deliver_capacity;
+
+    int sequence;
+
+    #ifdef ASSETSYS_ASYNC
+        struct assetsys_internal_load_t** pending; // queued, not yet picked up by the reader thread
+        int pending_count;
+        int pending_capacity;
+
+        struct assetsys_internal_load_t** batch; // owned by the reader thread
+        int batch_count;
+        int batch_capacity;
+
+        struct assetsys_internal_load_t** inflate; // read, waiting for an inflate thread
+        int inflate_head;
+        int inflate_count;
+        int inflate_capacity;
+        ASSETSYS_U64 inflight_bytes;
+
+        assetsys_t* sys;
+        thread_mutex_t mutex;
+        thread_signal_t read_signal;
+        thread_signal_t inflate_signal;
+        thread_signal_t space_signal;
+        thread_atomic_int_t exit_flag; // 1 stops the reader, 2 stops the inflate threads
+        thread_ptr_t reader;
+        thread_ptr_t inflaters[ ASSETSYS_ASYNC_INFLATE_THREADS ];
+    #endif
+    };
+
+
+static void assetsys_internal_load_list_add( assetsys_t* sys, struct assetsys_internal_load_t*** list, int* count, 
+    int* capacity, struct assetsys_internal_load_t* load )
+    {
+    (void) sys;
+    if( *count >= *capacity )
+        {
+        int new_capacity = *capacity ? *capacity * 2 : 64;
+        struct assetsys_internal_load_t** new_list = (struct assetsys_internal_load_t**) ASSETSYS_MALLOC( sys->memctx,
+            sizeof( *new_list ) * new_capacity );
+        if( *list ) 
+            {
+            memcpy( new_list, *list, sizeof( *new_list ) * *count );
+            ASSETSYS_FREE( sys->memctx, *list );
+            }
+        *list = new_list;
+        *capacity = new_capacity;
+        }
+    (*list)[ (*count)++ ] = load;
+    }
+
+
+#ifdef ASSETSYS_ASYNC
+
+    static void assetsys_internal_async_complete( struct assetsys_internal_async_t* async, 
+        struct assetsys_internal_load_t* load, assetsys_error_t result )
+        {
+        thread_mutex_lock( &async->mutex );
+        load->result = result;
+        load->is_done = 1;
+        thread_mutex_unlock( &async->mutex );
+        }
+
+
+    static void assetsys_internal_async_prepare( assetsys_t* sys, struct assetsys_internal_load_t* load )
+        {
+        struct assetsys_internal_mount_t* mount = &sys->mounts[ load->mount_index ];
+        load->offset = 0;
+        load->method = -1;
+        if( mount->type != ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP ) return;
+
+        struct assetsys_internal_file_t* file = &mount->files[ load->file.index ];
+        load->size = file->size;
+        mz_zip_archive_file_stat stat;
+        if( !mz_zip_reader_file_stat( &mount->zip, (mz_uint) file->zip_index, &stat ) ) return;
+        if( stat.m_bit_flag & ( 1 | 32 ) ) return; // encryption and patch files are not supported
+        load->offset = stat.m_local_header_ofs;
+        load->compressed_size = stat.m_comp_size;
+        load->crc32 = stat.m_crc32;
+        load->method = stat.m_method;
+        }
+
+
+    static int assetsys_internal_async_compare( void const* a, void const* b )
+        {
+        struct assetsys_internal_load_t const* x = *(struct assetsys_internal_load_t const* const*) a;
+        struct assetsys_internal_load_t const* y = *(struct assetsys_internal_load_t const* const*) b;
+        if( x->mount_index != y->mount_index ) return x->mount_index < y->mount_index ? -1 : 1;
+        if( x->offset != y->offset ) return x->offset < y->offset ? -1 : 1;
+        return x->sequence < y->sequence ? -1 : x->sequence > y->sequence ? 1 : 0;
+        }
+
+
+    // Reads the data for one load. Directory mounts and failures complete right away, zip entries are handed over to
+    // the inflate threads, which decompress them and verify the crc.
+    static void assetsys_internal_async_read( struct assetsys_internal_async_t* async, 
+        struct assetsys_internal_load_t* load )
+        {
+        assetsys_t* sys = async->sys;
+        struct assetsys_internal_mount_t* mount = &sys->mounts[ load->mount_index ];
+        if( mount->type != ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP )
+            {
+            assetsys_error_t result = assetsys_file_load( sys, load->file, &load->size, load->buffer, load->capacity );
+            assetsys_internal_async_complete( async, load, result );
+            return;
+            }
+
+        if( load->size > load->capacity ) 
+            { 
+            assetsys_internal_async_complete( async, load, ASSETSYS_ERROR_BUFFER_TOO_SMALL ); 
+            return; 
+            }
+        if( load->method != 0 && load->method != MZ_DEFLATED && !assetsys_internal_is_packed_method( load->method ) ) 
+            { 
+            assetsys_internal_async_complete( async, load, ASSETSYS_ERROR_FAILED_TO_READ_FILE ); 
+            return; 
+            }
+        if( load->compressed_size == 0 || load->size == 0 )
+            {
+            load->size = 0;
+            assetsys_internal_async_complete( async, load, ASSETSYS_SUCCESS );
+            return;
+            }
+
+        ASSETSYS_U64 data_offset;
+        if( !assetsys_internal_zip_data_offset( mount, load->offset, &data_offset ) )
+            {
+            assetsys_internal_async_complete( async, load, ASSETSYS_ERROR_FAILED_TO_READ_FILE );
+            return;
+            }
+
+        void* target = load->buffer;
+        if( load->method != 0 )
+            {
+            // Don't read too far ahead of the inflate threads
+            for( ; ; )
+                {
+                thread_mutex_lock( &async->mutex );
+                int has_space = async->inflight_bytes == 0 || 
+                    async->inflight_bytes + load->compressed_size <= ASSETSYS_ASYNC_READAHEAD;
+                if( has_space ) async->inflight_bytes += load->compressed_size;
+                thread_mutex_unlock( &async->mutex );
+                if( has_space ) break;
+                if( thread_atomic_int_load( &async->exit_flag ) ) return;
+                thread_signal_wait( &async->space_signal, THREAD_SIGNAL_WAIT_INFINITE );
+                }
+            load->compressed = ASSETSYS_MALLOC( sys->memctx, (size_t) load->compressed_size );
+            target = load->compressed;
+            }
+        else if( load->compressed_size != (ASSETSYS_U64) load->size )
+            {
+            assetsys_internal_async_complete( async, load, ASSETSYS_ERROR_FAILED_TO_READ_FILE );
+            return;
+            }
+
+        int read_ok = mount->zip.m_pRead( mount->zip.m_pIO_opaque, data_offset, target, 
+            (size_t) load->compressed_size ) == load->compressed_size;
+
+        thread_mutex_lock( &async->mutex );
+        if( read_ok )
+            {
+            assetsys_internal_load_list_add( sys, &async->inflate, &async->inflate_count, &async->inflate_capacity, 
+                load );
+            }
+        else
+            {
+            if( load->compressed ) async->inflight_bytes -= load->compressed_size;
+            load->result = ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+            load->is_done = 1;
+            }
+        thread_mutex_unlock( &async->mutex );
+
+        if( read_ok ) 
+            {
+            thread_signal_raise( &async->inflate_signal );
+            }
+        else if( load->compressed ) 
+            {
+            ASSETSYS_FREE( sys->memctx, load->compressed );
+            load->compressed = NULL;
+            }
+        }
+
+
+    static int assetsys_internal_async_reader_thread( void* user_data )
+        {
+        struct assetsys_internal_async_t* async = (struct assetsys_internal_async_t*) user_data;
+        while( !thread_atomic_int_load( &async->exit_flag ) )
+            {
+            // Take everything queued so far as one batch
+            thread_mutex_lock( &async->mutex );
+            struct assetsys_internal_load_t** list = async->pending;
+            int count = async->pending_count;
+            int capacity = async->pending_capacity;
+            async->pending = async->batch;
+            async->pending_count = 0;
+            async->pending_capacity = async->batch_capacity;
+            async->batch = list;
+            async->batch_count = count;
+            async->batch_capacity = capacity;
+            thread_mutex_unlock( &async->mutex );
+
+            if( async->batch_count == 0 )
+                {
+                thread_signal_wait( &async->read_signal, THREAD_SIGNAL_WAIT_INFINITE );
+                continue;
+                }
+
+            for( int i = 0; i < async->batch_count; ++i ) 
+                assetsys_internal_async_prepare( async->sys, async->batch[ i ] );
+            qsort( async->batch, (size_t) async->batch_count, sizeof( *async->batch ), 
+                assetsys_internal_async_compare );
+            for( int i = 0; i < async->batch_count && !thread_atomic_int_load( &async->exit_flag ); ++i )
+                assetsys_internal_async_read( async, async->batch[ i ] );
+            async->batch_count = 0;
+            }
+        return 0;
+        }
+
+
+    static int assetsys_internal_async_inflate_thread( void* user_data )
+        {
+        struct assetsys_internal_async_t* async = (struct assetsys_internal_async_t*) user_data;
+        for( ; ; )
+            {
+            struct assetsys_internal_load_t* load = NULL;
+            thread_mutex_lock( &async->mutex );
+            if( async->inflate_head < async->inflate_count ) 
+                {
+                load = async->inflate[ async->inflate_head++ ];
+                if( async->inflate_head == async->inflate_count ) async->inflate_head = async->inflate_count = 0;
+                }
+            int more = async->inflate_head < async->inflate_count;
+            thread_mutex_unlock( &async->mutex );
+
+            // Signals only wake a single thread, so pass it on while there is more work
+            if( more ) thread_signal_raise( &async->inflate_signal );
+            if( !load )
+                {
+                if( thread_atomic_int_load( &async->exit_flag ) == 2 ) break;
+                thread_signal_wait( &async->inflate_signal, THREAD_SIGNAL_WAIT_INFINITE );
+                continue;
+                }
+
+            int ok = 1;
+            ASSETSYS_U64 compressed_size = 0;
+            if( load->compressed )
+                {
+                ok = assetsys_internal_decode( load->method, load->compressed, (size_t) load->compressed_size, 
+                    load->buffer, (size_t) load->size );
+                ASSETSYS_FREE( async->sys->memctx, load->compressed );
+                load->compressed = NULL;
+                compressed_size = load->compressed_size;
+                }
+            ok = ok && mz_crc32( MZ_CRC32_INIT, (mz_uint8 const*) load->buffer, (size_t) load->size ) == load->crc32;
+
+            thread_mutex_lock( &async->mutex );
+            async->inflight_bytes -= compressed_size;
+            load->result = ok ? ASSETSYS_SUCCESS : ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+            load->is_done = 1;
+            thread_mutex_unlock( &async->mutex );
+            if( compressed_size ) thread_signal_raise( &async->space_signal );
+            }
+
+        thread_signal_raise( &async->inflate_signal ); // wake the next thread, so it can exit too
+        return 0;
+        }
+
+#endif /* ASSETSYS_ASYNC */
+
+
+static struct assetsys_internal_async_t* assetsys_internal_async_init( assetsys_t* sys )
+    {
+    (void) sys;
+    struct assetsys_internal_async_t* async = (struct assetsys_internal_async_t*) ASSETSYS_MALLOC( sys->memctx, 
+        sizeof( struct assetsys_internal_async_t ) );
+    memset( async, 0, sizeof( *async ) );
+
+    #ifdef ASSETSYS_ASYNC
+        async->sys = sys;
+        thread_mutex_init( &async->mutex );
+        thread_signal_init( &async->read_signal );
+        thread_signal_init( &async->inflate_signal );
+        thread_signal_init( &async->space_signal );
+        thread_atomic_int_store( &async->exit_flag, 0 );
+        async->reader = thread_create( assetsys_internal_async_reader_thread, async, THREAD_STACK_SIZE_DEFAULT );
+        for( int i = 0; i < ASSETSYS_ASYNC_INFLATE_THREADS; ++i )
+            {
+            async->inflaters[ i ] = thread_create( assetsys_internal_async_inflate_thread, async, 
+                THREAD_STACK_SIZE_DEFAULT );
+            }
+    #endif
+
+    return async;
+    }
+
+
+static void assetsys_internal_async_term( assetsys_t* sys )
+    {
+    struct assetsys_internal_async_t* async = sys->async;
+    if( !async ) return;
+
+    #ifdef ASSETSYS_ASYNC
+        // Stop reading, then let the inflate threads finish what has already been read
+        thread_atomic_int_store( &async->exit_flag, 1 );
+        thread_signal_raise( &async->read_signal );
+        thread_signal_raise( &async->space_signal );
+        thread_join( async->reader );
+        thread_destroy( async->reader );
+        thread_atomic_int_store( &async->exit_flag, 2 );
+        thread_signal_raise( &async->inflate_signal );
+        for( int i = 0; i < ASSETSYS_ASYNC_INFLATE_THREADS; ++i )
+            {
+            thread_join( async->inflaters[ i ] );
+            thread_destroy( async->inflaters[ i ] );
+            }
+        thread_signal_term( &async->space_signal );
+        thread_signal_term( &async->inflate_signal );
+        thread_signal_term( &async->read_signal );
+        thread_mutex_term( &async->mutex );
+        if( async->pending ) ASSETSYS_FREE( sys->memctx, async->pending );
+        if( async->batch ) ASSETSYS_FREE( sys->memctx, async->batch );
+        if( async->inflate ) ASSETSYS_FREE( sys->memctx, async->inflate );
+    #endif
+
+    for( int i = 0; i < async->loads_count; ++i ) ASSETSYS_FREE( sys->memctx, async->loads[ i ] );
+    if( async->loads ) ASSETSYS_FREE( sys->memctx, async->loads );
+    if( async->deliver ) ASSETSYS_FREE( sys->memctx, async->deliver );
+    ASSETSYS_FREE( sys->memctx, async );
+    sys->async = NULL;
+    }
+
+
+assetsys_error_t assetsys_load_async( assetsys_t* sys, assetsys_file_t file, void* buffer, int capacity, int priority,
+    assetsys_load_callback_t callback, void* user_data )
+    {
+    int mount_index = assetsys_internal_find_mount_index( sys, file.mount, file.path );
+    if( mount_index < 0 ) return ASSETSYS_ERROR_INVALID_MOUNT;
+    if( !sys->async ) sys->async = assetsys_internal_async_init( sys );
+    struct assetsys_internal_async_t* async = sys->async;
+
+    struct assetsys_internal_load_t* load = (struct assetsys_internal_load_t*) ASSETSYS_MALLOC( sys->memctx, 
+        sizeof( struct assetsys_internal_load_t ) );
+    memset( load, 0, sizeof( *load ) );
+    load->file = file;
+    load->buffer = buffer;
+    load->capacity = capacity;
+    load->priority = priority;
+    load->callback = callback;
+    load->user_data = user_data;
+    load->mount_index = mount_index;
+
+    #ifdef ASSETSYS_ASYNC
+        thread_mutex_lock( &async->mutex );
+        load->sequence = async->sequence++;
+        assetsys_internal_load_list_add( sys, &async->loads, &async->loads_count, &async->loads_capacity, load );
+        assetsys_internal_load_list_add( sys, &async->pending, &async->pending_count, &async->pending_capacity, load );
+        thread_mutex_unlock( &async->mutex );
+        thread_signal_raise( &async->read_signal );
+    #else
+        load->sequence = async->sequence++;
+        load->result = assetsys_file_load( sys, file, &load->size, buffer, capacity );
+        load->is_done = 1;
+        assetsys_internal_load_list_add( sys, &async->loads, &async->loads_count, &async->loads_capacity, load );
+    #endif
+
+    return ASSETSYS_SUCCESS;
+    }
+
+
+static int assetsys_internal_deliver_compare( void const* a, void const* b )
+    {
+    struct assetsys_internal_load_t const* x = *(struct assetsys_internal_load_t const* const*) a;
+    struct assetsys_internal_load_t const* y = *(struct assetsys_internal_load_t const* const*) b;
+    if( x->priority != y->priority ) return x->priority > y->priority ? -1 : 1;
+    return x->sequence < y->sequence ? -1 : x->sequence > y->sequence ? 1 : 0;
+    }
+
+
+int assetsys_poll( assetsys_t* sys )
+    {
+    struct assetsys_internal_async_t* async = sys->async;
+    if( !async ) return 0;
+
+    #ifdef ASSETSYS_ASYNC
+        thread_mutex_lock( &async->mutex );
+    #endif
+
+    // Completed loads are held back while a load with higher priority is still in flight
+    int has_pending = 0;
+    int max_pending_priority = 0;
+    for( int i = 0; i < async->loads_count; ++i )
+        {
+        struct assetsys_internal_load_t* load = async->loads[ i ];
+        if( !load->is_done && ( !has_pending || load->priority > max_pending_priority ) ) 
+            {
+            has_pending = 1;
+            max_pending_priority = load->priority;
+            }
+        }
+    async->deliver_count = 0;
+    for( int i = 0; i < async->loads_count; )
+        {
+        struct assetsys_internal_load_t* load = async->loads[ i ];
+        if( load->is_done && ( !has_pending || load->priority >= max_pending_priority ) )
+            {
+            assetsys_internal_load_list_add( sys, &async->deliver, &async->deliver_count, &async->deliver_capacity, 
+                load );
+            async->loads[ i ] = async->loads[ --async->loads_count ];
+            }
+        else
+            {
+            ++i;
+            }
+        }
+
+    #ifdef ASSETSYS_ASYNC
+        thread_mutex_unlock( &async->mutex );
+    #endif
+
+    if( async->deliver_count > 1 )
+        qsort( async->deliver, (size_t) async->deliver_count, sizeof( *async->deliver ), 
+            assetsys_internal_deliver_compare );
+
+    // Callbacks may queue new loads, which only adds to the loads list, never to the deliver list
+    for( int i = 0; i < async->deliver_count; ++i )
+        {
+        struct assetsys_internal_load_t* load = async->deliver[ i ];
+        if( load->callback ) 
+            load->callback( load->file, load->result, load->buffer, load->size, load->user_data );
+        ASSETSYS_FREE( sys->memctx, load );
+        }
+    async->deliver_count = 0;
+
+    #ifdef ASSETSYS_ASYNC
+        thread_mutex_lock( &async->mutex );
+        int remaining = async->loads_count;
+        thread_mutex_unlock( &async->mutex );
+        return remaining;
+    #else
+        return async->loads_count;
+    #endif
+    }
+
+
+
+#ifndef ASSETSYS_STREAM_READ_SIZE
+    #define ASSETSYS_STREAM_READ_SIZE ( 16 * 1024 )
+#endif
+
+struct assetsys_stream_t
+    {
+    assetsys_t* sys;
+    int mount_index;
+    ASSETSYS_FILE* fp; // directory mounts only
+    int size;
+    int position;
+
+    // Zip entries
+    int method;
+    ASSETSYS_U64 data_offset;
+    ASSETSYS_U64 compressed_size;
+    ASSETSYS_U64 compressed_position;
+    mz_uint32 crc32;
+    mz_uint32 running_crc32; // crc of everything produced since the start of the entry
+    int crc_valid; // cleared when a stored entry skips ahead
+    mz_uint8* unpacked; // entries using methods which can't be streamed are decoded in full on open
+    mz_uint8 const* mapped; // the entry's data, for archives mounted from memory or mapped, read without copying to `in`
+
+    // Deflated entries. Output is produced into the 32KB dictionary window, which is all the history deflate needs, 
+    // and copied out from there.
+    tinfl_decompressor inflator;
+    tinfl_status status;
+    mz_uint8 const* in_data; // either `in` or a part of `mapped`
+    int in_offset;
+    int in_available;
+    int dict_offset;
+    int out_offset;
+    int out_available;
+    mz_uint8 in[ ASSETSYS_STREAM_READ_SIZE ];
+    mz_uint8 dict[ TINFL_LZ_DICT_SIZE ];
+    };
+
+
+static void assetsys_internal_stream_restart( assetsys_stream_t* stream )
+    {
+    tinfl_init( &stream->inflator );
+    stream->status = TINFL_STATUS_NEEDS_MORE_INPUT;
+    stream->compressed_position = 0;
+    stream->in_data = stream->in;
+    stream->in_offset = 0;
+    stream->in_available = 0;
+    stream->dict_offset = 0;
+    stream->out_offset = 0;
+    stream->out_available = 0;
+    stream->position = 0;
+    stream->running_crc32 = MZ_CRC32_INIT;
+    stream->crc_valid = 1;
+    }
+
+
+assetsys_error_t assetsys_stream_open( assetsys_t* sys, assetsys_file_t f, assetsys_stream_t** stream )
+    {
+    if( !stream ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+    *stream = NULL;
+    int mount_index = assetsys_internal_find_mount_index( sys, f.mount, f.path );
+    if( mount_index < 0 ) return ASSETSYS_ERROR_INVALID_MOUNT;
+
+    struct assetsys_internal_mount_t* mount = &sys->mounts[ mount_index ];
+    struct assetsys_internal_file_t* file = &mount->files[ f.index ];
+    ASSETSYS_FILE* fp = NULL;
+    mz_zip_archive_file_stat stat;
+    ASSETSYS_U64 data_offset = 0;
+    if( mount->type == ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP )
+        {
+        if( !mz_zip_reader_file_stat( &mount->zip, (mz_uint) file->zip_index, &stat ) ) 
+            return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+        if( ( stat.m_bit_flag & ( 1 | 32 ) ) || ( stat.m_method != 0 && stat.m_method != MZ_DEFLATED && 
+            !assetsys_internal_is_packed_method( stat.m_method ) ) ) 
+            return ASSETSYS_ERROR_FAILED_TO_READ_FILE; // encrypted, patch files and unsupported compression methods
+        if( stat.m_method == 0 && stat.m_comp_size != stat.m_uncomp_size ) return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+        if( !assetsys_internal_zip_data_offset( mount, stat.m_local_header_ofs, &data_offset ) ) 
+            return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+        }
+    else
+        {
+        char path[ sizeof( sys->temp ) ];
+        if( !assetsys_internal_file_path( sys, mount, file->collated_index, path, sizeof( path ) ) ) 
+            return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+        fp = ASSETSYS_FOPEN( path, "rb" );
+        if( !fp ) return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+        }
+
+    assetsys_stream_t* s = (assetsys_stream_t*) ASSETSYS_MALLOC( sys->memctx, sizeof( assetsys_stream_t ) );
+    s->sys = sys;
+    s->mount_index = mount_index;
+    s->fp = fp;
+    s->unpacked = NULL;
+    s->mapped = NULL;
+    if( fp )
+        {
+        ASSETSYS_FSEEK( fp, 0, ASSETSYS_SEEK_END );
+        s->size = (int) ASSETSYS_FTELL( fp );
+        ASSETSYS_FSEEK( fp, 0, ASSETSYS_SEEK_SET );
+        s->method = -1;
+        }
+    else
+        {
+        s->size = (int) stat.m_uncomp_size;
+        s->method = stat.m_method;
+        s->data_offset = data_offset;
+        s->compressed_size = stat.m_comp_size;
+        s->crc32 = stat.m_crc32;
+        if( mount->data && data_offset + stat.m_comp_size <= mount->data_size )
+            s->mapped = (mz_uint8 const*) mount->data + data_offset;
+        if( assetsys_internal_is_packed_method( s->method ) )
+            {
+            s->unpacked = (mz_uint8*) ASSETSYS_MALLOC( sys->memctx, s->size ? (size_t) s->size : 1 );
+            if( assetsys_internal_load_packed( sys, mount, &stat, s->unpacked ) != ASSETSYS_SUCCESS )
+                {
+                ASSETSYS_FREE( sys->memctx, s->unpacked );
+                ASSETSYS_FREE( sys->memctx, s );
+                return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+                }
+            }
+        }
+    assetsys_internal_stream_restart( s );
+    *stream = s;
+    return ASSETSYS_SUCCESS;
+    }
+
+
+void assetsys_stream_close( assetsys_stream_t* stream )
+    {
+    if( !stream ) return;
+    if( stream->fp ) ASSETSYS_FCLOSE( stream->fp );
+    if( stream->unpacked ) ASSETSYS_FREE( stream->sys->memctx, stream->unpacked );
+    ASSETSYS_FREE( stream->sys->memctx, stream );
+    }
+
+
+// Produces up to `size` bytes of a deflated entry into `buffer`, or discards them if `buffer` is NULL
+static int assetsys_internal_stream_inflate( assetsys_stream_t* stream, mz_uint8* buffer, int size )
+    {
+    struct assetsys_internal_mount_t* mount = &stream->sys->mounts[ stream->mount_index ];
+    int produced = 0;
+    while( produced < size )
+        {
+        if( stream->out_available > 0 )
+            {
+            int count = size - produced < stream->out_available ? size - produced : stream->out_available;
+            mz_uint8 const* out = stream->dict + stream->out_offset;
+            stream->running_crc32 = (mz_uint32) mz_crc32( stream->running_crc32, out, (size_t) count );
+            if( buffer ) memcpy( buffer + produced, out, (size_t) count );
+            stream->out_offset += count;
+            stream->out_available -= count;
+            produced += count;
+            continue;
+            }
+
+        if( stream->status == TINFL_STATUS_DONE ) break;
+        if( stream->status < TINFL_STATUS_DONE ) return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+
+        ASSETSYS_U64 compressed_remaining = stream->compressed_size - stream->compressed_position;
+        if( stream->in_available == 0 && compressed_remaining > 0 && stream->mapped )
+            {
+            // All of the remaining input is already in memory, so hand it to the inflator in one go
+            int count = compressed_remaining < 0x40000000 ? (int) compressed_remaining : 0x40000000;
+            stream->in_data = stream->mapped + stream->compressed_position;
+            stream->compressed_position += (ASSETSYS_U64) count;
+            stream->in_offset = 0;
+            stream->in_available = count;
+            }
+        else if( stream->in_available == 0 && compressed_remaining > 0 )
+            {
+            int count = compressed_remaining < ASSETSYS_STREAM_READ_SIZE ? (int) compressed_remaining : 
+                ASSETSYS_STREAM_READ_SIZE;
+            if( mount->zip.m_pRead( mount->zip.m_pIO_opaque, stream->data_offset + stream->compressed_position, 
+                stream->in, (size_t) count ) != (size_t) count )
+                return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+            stream->compressed_position += (ASSETSYS_U64) count;
+            stream->in_data = stream->in;
+            stream->in_offset = 0;
+            stream->in_available = count;
+            }
+
+        size_t in_size = (size_t) stream->in_available;
+        size_t out_size = (size_t)( TINFL_LZ_DICT_SIZE - stream->dict_offset );
+        stream->status = tinfl_decompress( &stream->inflator, stream->in_data + stream->in_offset, &in_size, stream->dict,
+            stream->dict + stream->dict_offset, &out_size, 
+            stream->compressed_position < stream->compressed_size ? TINFL_FLAG_HAS_MORE_INPUT : 0 );
+        stream->in_offset += (int) in_size;
+        stream->in_available -= (int) in_size;
+        stream->out_offset = stream->dict_offset;
+        stream->out_available = (int) out_size;
+        stream->dict_offset = ( stream->dict_offset + (int) out_size ) & ( TINFL_LZ_DICT_SIZE - 1 );
+        if( stream->status == TINFL_STATUS_NEEDS_MORE_INPUT && stream->in_available == 0 && 
+            stream->compressed_position >= stream->compressed_size && out_size == 0 )
+            return ASSETSYS_ERROR_FAILED_TO_READ_FILE; // truncated data
+        }
+    return produced;
+    }
+
+
+int assetsys_stream_read( assetsys_stream_t* stream, void* buffer, int size )
+    {
+    if( !stream || !buffer || size < 0 ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+    if( size > stream->size - stream->position ) size = stream->size - stream->position;
+    if( size <= 0 ) return 0;
+
+    int count = 0;
+    if( stream->fp )
+        {
+        count = (int) ASSETSYS_FREAD( buffer, 1, (size_t) size, stream->fp );
+        stream->position += count;
+        return count;
+        }
+    else if( stream->unpacked )
+        {
+        memcpy( buffer, stream->unpacked + stream->position, (size_t) size );
+        stream->position += size;
+        return size; // the crc was checked when the entry was decoded
+        }
+    else if( stream->method == 0 && stream->mapped )
+        {
+        memcpy( buffer, stream->mapped + stream->position, (size_t) size );
+        stream->running_crc32 = (mz_uint32) mz_crc32( stream->running_crc32, (mz_uint8 const*) buffer, (size_t) size );
+        count = size;
+        }
+    else if( stream->method == 0 )
+        {
+        struct assetsys_internal_mount_t* mount = &stream->sys->mounts[ stream->mount_index ];
+        if( mount->zip.m_pRead( mount->zip.m_pIO_opaque, stream->data_offset + (ASSETSYS_U64) stream->position, 
+            buffer, (size_t) size ) != (size_t) size )
+            return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+        stream->running_crc32 = (mz_uint32) mz_crc32( stream->running_crc32, (mz_uint8 const*) buffer, (size_t) size );
+        count = size;
+        }
+    else
+        {
+        count = assetsys_internal_stream_inflate( stream, (mz_uint8*) buffer, size );
+        if( count < 0 ) return count;
+        if( count < size ) return ASSETSYS_ERROR_FAILED_TO_READ_FILE; // entry ended early
+        }
+
+    stream->position += count;
+    if( stream->position == stream->size && stream->crc_valid && stream->running_crc32 != stream->crc32 )
+        return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+    return count;
+    }
+
+
+assetsys_error_t assetsys_stream_seek( assetsys_stream_t* stream, int position )
+    {
+    if( !stream ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+    if( position < 0 || position > stream->size ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+    if( position == stream->position ) return ASSETSYS_SUCCESS;
+
+    if( stream->fp )
+        {
+        if( ASSETSYS_FSEEK( stream->fp, position, ASSETSYS_SEEK_SET ) != 0 ) return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+        stream->position = position;
+        }
+    else if( stream->unpacked )
+        {
+        stream->position = position;
+        }
+    else if( stream->method == 0 )
+        {
+        if( position == 0 ) 
+            {
+            assetsys_internal_stream_restart( stream );
+            }
+        else
+            {
+            stream->position = position;
+            stream->crc_valid = 0;
+            }
+        }
+    else
+        {
+        if( position < stream->position ) assetsys_internal_stream_restart( stream );
+        int skip = position - stream->position;
+        if( assetsys_internal_stream_inflate( stream, NULL, skip ) != skip ) return ASSETSYS_ERROR_FAILED_TO_READ_FILE;
+        stream->position = position;
+        }
+    return ASSETSYS_SUCCESS;
+    }
+
+
+int assetsys_stream_tell( assetsys_stream_t* stream )
+    {
+    return stream ? stream->position : 0;
+    }
+
+
+
+void const* assetsys_file_data( assetsys_t* sys, assetsys_file_t f, int* size )
+    {
+    if( size ) *size = 0;
+    int mount_index = assetsys_internal_find_mount_index( sys, f.mount, f.path );
+    if( mount_index < 0 ) return NULL;
+
+    struct assetsys_internal_mount_t* mount = &sys->mounts[ mount_index ];
+    if( mount->type != ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP || !mount->data ) return NULL;
+
+    mz_zip_archive_file_stat stat;
+    if( !mz_zip_reader_file_stat( &mount->zip, (mz_uint) mount->files[ f.index ].zip_index, &stat ) ) return NULL;
+    if( stat.m_method != 0 || ( stat.m_bit_flag & ( 1 | 32 ) ) || stat.m_comp_size != stat.m_uncomp_size ) return NULL;
+
+    ASSETSYS_U64 data_offset;
+    if( !assetsys_internal_zip_data_offset( mount, stat.m_local_header_ofs, &data_offset ) ) return NULL;
+    if( data_offset + stat.m_uncomp_size > mount->data_size ) return NULL;
+
+    if( size ) *size = (int) stat.m_uncomp_size;
+    return (char const*) mount->data + data_offset;
+    }
+
+#define ASSETSYS_INTERNAL_CACHE_HEADER 16 // keeps the data 16 byte aligned
+
+static void assetsys_internal_cache_unlink( assetsys_t* sys, int index )
+    {
+    struct assetsys_internal_cache_entry_t* entry = &sys->cache_entries[ index ];
+    if( entry->prev >= 0 ) sys->cache_entries[ entry->prev ].next = entry->next; else sys->cache_lru_head = entry->next;
+    if( entry->next >= 0 ) sys->cache_entries[ entry->next ].prev = entry->prev; else sys->cache_lru_tail = entry->prev;
+    entry->prev = -1;
+    entry->next = -1;
+    }
+
+
+static void assetsys_internal_cache_link( assetsys_t* sys, int index )
+    {
+    struct assetsys_internal_cache_entry_t* entry = &sys->cache_entries[ index ];
+    entry->prev = sys->cache_lru_tail;
+    entry->next = -1;
+    if( sys->cache_lru_tail >= 0 ) sys->cache_entries[ sys->cache_lru_tail ].next = index; else sys->cache_lru_head = index;
+    sys->cache_lru_tail = index;
+    }
+
+
+static void assetsys_internal_cache_free_entry( assetsys_t* sys, int index )
+    {
+    struct assetsys_internal_cache_entry_t* entry = &sys->cache_entries[ index ];
+    if( entry->collated_index >= 0 )
+        {
+        assetsys_internal_map_remove( &sys->cache_map, (ASSETSYS_U64) entry->collated_index );
+        sys->cache_stats.bytes -= (ASSETSYS_U64) entry->size;
+        --sys->cache_stats.entries;
+        }
+    ASSETSYS_FREE( sys->memctx, entry->block );
+    entry->block = NULL;
+    entry->next = sys->cache_free;
+    sys->cache_free = index;
+    }
+
+
+// Evicts the least recently used entries which are not borrowed, until the cache is within its budget
+static void assetsys_internal_cache_trim( assetsys_t* sys, ASSETSYS_U64 budget )
+    {
+    while( sys->cache_stats.bytes > budget && sys->cache_lru_head >= 0 )
+        {
+        int index = sys->cache_lru_head;
+        assetsys_internal_cache_unlink( sys, index );
+        assetsys_internal_cache_free_entry( sys, index );
+        ++sys->cache_stats.evictions;
+        }
+    }
+
+
+// Called when mounts change, as the same path may then refer to a different file
+static void assetsys_internal_cache_flush( assetsys_t* sys )
+    {
+    assetsys_internal_cache_trim( sys, 0 );
+    for( int i = 0; i < sys->cache_entries_count; ++i )
+        {
+        struct assetsys_internal_cache_entry_t* entry = &sys->cache_entries[ i ];
+        if( entry->block && entry->collated_index >= 0 ) 
+            {
+            assetsys_internal_map_remove( &sys->cache_map, (ASSETSYS_U64) entry->collated_index );
+            sys->cache_stats.bytes -= (ASSETSYS_U64) entry->size;
+            --sys->cache_stats.entries;
+            entry->collated_index = -1;
+            }
+        }
+    }
+
+
+void assetsys_cache_budget( assetsys_t* sys, ASSETSYS_U64 bytes )
+    {
+    sys->cache_budget = bytes;
+    assetsys_internal_cache_trim( sys, sys->cache_budget );
+    }
+
+
+assetsys_error_t assetsys_cache_acquire( assetsys_t* sys, assetsys_file_t f, void const** data, int* size )
+    {
+    if( !data ) return ASSETSYS_ERROR_INVALID_PARAMETER;
+    *data = NULL;
+    if( size ) *size = 0;
+    int mount_index = assetsys_internal_find_mount_index( sys, f.mount, f.path );
+    if( mount_index < 0 ) return ASSETSYS_ERROR_INVALID_MOUNT;
+
+    struct assetsys_internal_mount_t* mount = &sys->mounts[ mount_index ];
+    int collated_index = mount->files[ f.index ].collated_index;
+    int is_cached = mount->type == ASSETSYS_INTERNAL_MOUNT_TYPE_ZIP;
+    if( is_cached )
+        {
+        int index = assetsys_internal_map_find( &sys->cache_map, (ASSETSYS_U64) collated_index );
+        if( index >= 0 )
+            {
+            struct assetsys_internal_cache_entry_t* entry = &sys->cache_entries[ index ];
+            if( entry->ref_count++ == 0 ) assetsys_internal_cache_unlink( sys, index );
+            ++sys->cache_stats.hits;
+            *data = (char*) entry->block + ASSETSYS_INTERNAL_CACHE_HEADER;
+            if( size ) *size = entry->size;
+            return ASSETSYS_SUCCESS;
+            }
+        }
+    ++sys->cache_stats.misses;
+
+    // Directory files may change size on disk between calls, so retry with the size reported by the load
+    int file_size = assetsys_file_size( sys, f );
+    void* block = NULL;
+    assetsys_error_t result = ASSETSYS_ERROR_BUFFER_TOO_SMALL;
+    for( int attempt = 0; attempt < 2 && result == ASSETSYS_ERROR_BUFFER_TOO_SMALL; ++attempt )
+        {
+        if( block ) ASSETSYS_FREE( sys->memctx, block );
+        block = ASSETSYS_MALLOC( sys->memctx, (size_t) file_size + ASSETSYS_INTERNAL_CACHE_HEADER );
+        result = assetsys_file_load( sys, f, &file_size, (char*) block + ASSETSYS_INTERNAL_CACHE_HEADER, file_size );
+        }
+    if( result != ASSETSYS_SUCCESS ) 
+        {
+        ASSETSYS_FREE( sys->memctx, block );
+        return result;
+        }
+
+    int index = sys->cache_free;
+    if( index >= 0 )
+        {
+        sys->cache_free = sys->cache_entries[ index ].next;
+        }
+    else
+        {
+        if( sys->cache_entries_count >= sys->cache_entries_capacity )
+            {
+            sys->cache_entries_capacity = sys->cache_entries_capacity ? sys->cache_entries_capacity * 2 : 64;
+            struct assetsys_internal_cache_entry_t* new_entries = (struct assetsys_internal_cache_entry_t*) 
+                ASSETSYS_MALLOC( sys->memctx, sizeof( *sys->cache_entries ) * sys->cache_entries_capacity );
+            if( sys->cache_entries )
+                {
+                memcpy( new_entries, sys->cache_entries, sizeof( *sys->cache_entries ) * sys->cache_entries_count );
+                ASSETSYS_FREE( sys->memctx, sys->cache_entries );
+                }
+            sys->cache_entries = new_entries;
+            }
+        index = sys->cache_entries_count++;
+        }
+
+    struct assetsys_internal_cache_entry_t* entry = &sys->cache_entries[ index ];
+    entry->block = block;
+    entry->size = file_size;
+    entry->collated_index = is_cached ? collated_index : -1;
+    entry->ref_count = 1;
+    entry->prev = -1;
+    entry->next = -1;
+    *(int*) block = index;
+    if( is_cached )
+        {
+        assetsys_internal_map_insert( sys, &sys->cache_map, (ASSETSYS_U64) collated_index, index );
+        sys->cache_stats.bytes += (ASSETSYS_U64) file_size;
+        ++sys->cache_stats.entries;
+        assetsys_internal_cache_trim( sys, sys->cache_budget );
+        }
+
+    *data = (char*) block + ASSETSYS_INTERNAL_CACHE_HEADER;
+    if( size ) *size = file_size;
+    return ASSETSYS_SUCCESS;
+    }
+
+
+void assetsys_cache_release( assetsys_t* sys, void const* data )
+    {
+    if( !data ) return;
+    int index = *(int const*)( (char const*) data - ASSETSYS_INTERNAL_CACHE_HEADER );
+    ASSETSYS_ASSERT( index >= 0 && index < sys->cache_entries_count, "Invalid cache buffer" );
+    struct assetsys_internal_cache_entry_t* entry = &sys->cache_entries[ index ];
+    ASSETSYS_ASSERT( entry->ref_count > 0, "Cache buffer released too many times" );
+    if( --entry->ref_count > 0 ) return;
+
+    if( entry->collated_index < 0 )
+        {
+        assetsys_internal_cache_free_entry( sys, index );
+        }
+    else
+        {
+        assetsys_internal_cache_link( sys, index );
+        assetsys_internal_cache_trim( sys, sys->cache_budget );
+        }
+    }
+
+
+void assetsys_cache_stats( assetsys_t* sys, assetsys_cache_stats_t* stats )
+    {
+    if( stats ) *stats = sys->cache_stats;
+    }
+
+
+
+static int assetsys_internal_find_collated( assetsys_t* sys, char const* const path )
+    {
+    ASSETSYS_U64 handle = strpool_find( &sys->strpool, path, (int) strlen( path ) );
+    return assetsys_internal_map_find( &sys->collated_map, handle );
+    }
+
+
+int assetsys_file_count( assetsys_t* sys, char const* path )
+    {
+    if( !path ) return 0;
+    int dir = assetsys_internal_find_collated( sys, path );
+    int count = 0;
+    for( int i = 0; i < sys->collated_count; ++i )
+        {
+        if( sys->collated[ i ].ref_count > 0 && sys->collated[ i ].is_file && sys->collated[ i ].parent == dir )
+            {
+            ++count;
+            }
+        }
+    return count;
+    }
+
+
+char const* assetsys_file_name( assetsys_t* sys, char const* path, int index )
+    {
+    char const* file_path = assetsys_file_path( sys, path, index );
+    if( file_path ) 
+        {
+        char const* name = strrchr( file_path, '/' );
+        if( !name ) return file_path;
+        return name + 1;
+        }
+
+    return NULL;
+    }
+
+
+char const* assetsys_file_path( assetsys_t* sys, char const* path, int index )
+    {
+    if( !path ) return 0;
+    int dir = assetsys_internal_find_collated( sys, path );
+    int count = 0;
+    for( int i = 0; i < sys->collated_count; ++i )
+        {
+        if( sys->collated[ i ].ref_count > 0 && sys->collated[ i ].is_file && sys->collated[ i ].parent == dir )
+            {
+            if( count == index ) return assetsys_internal_get_string( sys, sys->collated[ i ].path );
+            ++count;
+            }
+        }
+    return NULL;
+    }
+
+
+int assetsys_subdir_count( assetsys_t* sys, char const* path )
+    {
+    if( !path ) return 0;
+    int dir = assetsys_internal_find_collated( sys, path );
+    int count = 0;
+    for( int i = 0; i < sys->collated_count; ++i )
+        {
+        if( sys->collated[ i ].ref_count > 0 && !sys->collated[ i ].is_file && sys->collated[ i ].parent == dir )
+            {
+            ++count;
+            }
+        }
+    return count;
+    }
+
+
+char const* assetsys_subdir_name( assetsys_t* sys, char const* path, int index )
+    {
+    char const* subdir_path = assetsys_subdir_path( sys, path, index );
+    if( subdir_path ) 
+        {
+        char const* name = strrchr( subdir_path, '/' );
+        if( !name ) return subdir_path;
+        return name + 1;
+        }
+
+    return NULL;
+    }
+
+
+char const* assetsys_subdir_path( assetsys_t* sys, char const* path, int index )
+    {
+    if( !path ) return 0;
+    int dir = assetsys_internal_find_collated( sys, path );
+    int count = 0;
+    for( int i = 0; i < sys->collated_count; ++i )
+        {
+        if( sys->collated[ i ].ref_count > 0 && !sys->collated[ i ].is_file && sys->collated[ i ].parent == dir )
+            {
             if( count == index ) return assetsys_internal_get_string( sys, sys->collated[ i ].path );
             ++count;
             }
         }
-    return NULL;
+    return NULL;
+    }
+
+
+static char* assetsys_internal_dirname( char const* path )
+    {
+    static char result[ 260 ];
+    strncpy( result, path, sizeof( result ) );
+      
+    char* lastForwardSlash = strrchr( result, '/' );
+
+    if( lastForwardSlash ) *(lastForwardSlash + 1 ) = '\0';
+    else *result = '\0';
+
+    return result;
+    }
+
+
+#endif /* ASSETSYS_IMPLEMENTATION */
+
+
+/*
+----------------------
+    INDEX TOOL
+----------------------
+*/
+
+
+#if defined( ASSETSYS_INDEX_TOOL ) && !defined( ASSETSYS_RUN_TESTS )
+
+#include <stdio.h>
+
+int main( int argc, char** argv ) 
+    {
+    if( argc != 3 )
+        {
+        printf( "Usage: %s <zip file or directory> <index file>\n", argv[ 0 ] );
+        return 1;
+        }
+
+    assetsys_t* assetsys = assetsys_create( 0 );
+    assetsys_error_t result = assetsys_mount( assetsys, argv[ 1 ], "/index" );
+    if( result != ASSETSYS_SUCCESS )
+        {
+        printf( "Failed to mount '%s' (error %d)\n", argv[ 1 ], (int) result );
+        assetsys_destroy( assetsys );
+        return 1;
+        }
+
+    result = assetsys_index_save( assetsys, argv[ 1 ], "/index", argv[ 2 ] );
+    assetsys_destroy( assetsys );
+    if( result != ASSETSYS_SUCCESS )
+        {
+        printf( "Failed to write '%s' (error %d)\n", argv[ 2 ], (int) result );
+        return 1;
+        }
+    return 0;
+    }
+
+#endif /* ASSETSYS_INDEX_TOOL */
+
+
+/*
+----------------------
+    PACK TOOL
+----------------------
+*/
+
+
+#if defined( ASSETSYS_PACK_TOOL ) && !defined( ASSETSYS_RUN_TESTS )
+
+#include <stdio.h>
+#include <time.h>
+
+// LZ4 and LZMA entries are decoded in full when streamed, so larger files are kept to deflate or stored
+#ifndef ASSETSYS_PACK_MAX_UNPACKED_SIZE
+    #define ASSETSYS_PACK_MAX_UNPACKED_SIZE ( 16 * 1024 * 1024 )
+#endif
+
+struct assetsys_pack_entry_t
+    {
+    char name[ 256 ];
+    int method;
+    mz_uint32 crc32;
+    size_t size;
+    size_t compressed_size;
+    size_t offset;
+    };
+
+
+struct assetsys_pack_t
+    {
+    assetsys_t* assetsys;
+    FILE* fp;
+    size_t offset;
+    double read_speed; // bytes per second
+    int lz4_table[ 1 << 16 ];
+    struct assetsys_pack_entry_t* entries;
+    int count;
+    int capacity;
+    int failed;
+    };
+
+
+static mz_uint8* assetsys_pack_lz4_length( mz_uint8* out, size_t length )
+    {
+    for( ; length >= 255; length -= 255 ) *out++ = 255;
+    *out++ = (mz_uint8) length;
+    return out;
+    }
+
+
+static mz_uint8* assetsys_pack_lz4_sequence( mz_uint8* out, mz_uint8 const* literals, size_t literals_count, 
+    size_t offset, size_t length )
+    {
+    size_t match = length ? length - 4 : 0;
+    *out++ = (mz_uint8)( ( ( literals_count < 15 ? literals_count : 15 ) << 4 ) | ( match < 15 ? match : 15 ) );
+    if( literals_count >= 15 ) out = assetsys_pack_lz4_length( out, literals_count - 15 );
+    memcpy( out, literals, literals_count );
+    out += literals_count;
+    if( !length ) return out;
+    *out++ = (mz_uint8)( offset & 0xff );
+    *out++ = (mz_uint8)( offset >> 8 );
+    if( match >= 15 ) out = assetsys_pack_lz4_length( out, match - 15 );
+    return out;
+    }
+
+
+// Greedy LZ4 block compressor, with a single hash table probe per position. The output needs room for 
+// size + size / 255 + 16 bytes. Follows the end of block rules of the LZ4 format (the last match starts at least 12 
+// bytes before the end, and the last 5 bytes are literals), so the output can be read by other LZ4 decoders as well.
+static size_t assetsys_pack_lz4_encode( int* table, mz_uint8 const* in, size_t size, mz_uint8* out )
+    {
+    for( int i = 0; i < 1 << 16; ++i ) table[ i ] = -1;
+    mz_uint8* out_pos = out;
+    size_t anchor = 0;
+    size_t pos = 0;
+    while( size >= 13 && pos < size - 12 )
+        {
+        mz_uint32 sequence;
+        memcpy( &sequence, in + pos, sizeof( sequence ) );
+        mz_uint32 hash = ( sequence * 2654435761u ) >> 16;
+        int candidate = table[ hash ];
+        table[ hash ] = (int) pos;
+        mz_uint32 candidate_sequence = 0;
+        if( candidate >= 0 ) memcpy( &candidate_sequence, in + candidate, sizeof( candidate_sequence ) );
+        if( candidate < 0 || pos - (size_t) candidate > 65535 || candidate_sequence != sequence ) 
+            {
+            pos += 1 + ( ( pos - anchor ) >> 6 ); // skip ahead faster through data which doesn't compress
+            continue;
+            }
+
+        size_t length = 4;
+        size_t max_length = size - 5 - pos;
+        while( length < max_length && in[ candidate + length ] == in[ pos + length ] ) ++length;
+        out_pos = assetsys_pack_lz4_sequence( out_pos, in + anchor, pos - anchor, pos - (size_t) candidate, length );
+        pos += length;
+        anchor = pos;
+        }
+    out_pos = assetsys_pack_lz4_sequence( out_pos, in + anchor, size - anchor, 0, 0 );
+    return (size_t)( out_pos - out );
+    }
+
+
+// Average time, in seconds, it takes to decode the data. Returns a negative value if it doesn't decode correctly.
+static double assetsys_pack_decode_time( int method, void const* in, size_t in_size, void const* original, 
+    mz_uint8* out, size_t out_size )
+    {
+    if( !assetsys_internal_decode( method, in, in_size, out, out_size ) || memcmp( out, original, out_size ) != 0 ) 
+        return -1.0;
+    int runs = 0;
+    clock_t start = clock();
+    clock_t now;
+    do 
+        {
+        assetsys_internal_decode( method, in, in_size, out, out_size );
+        ++runs;
+        now = clock();
+        } 
+    while( now - start < CLOCKS_PER_SEC / 50 && runs < 1000 );
+    return (double)( now - start ) / CLOCKS_PER_SEC / runs;
+    }
+
+
+// Deflates into a buffer allocated with malloc, as miniz is built without its own allocation functions, so
+// tdefl_compress_mem_to_heap can't be used. Returns NULL if compression fails.
+static mz_uint8* assetsys_pack_deflate( mz_uint8 const* data, size_t size, size_t* out_size )
+    {
+    tdefl_compressor* compressor = (tdefl_compressor*) malloc( sizeof( tdefl_compressor ) );
+    size_t capacity = (size_t) mz_compressBound( (mz_ulong) size );
+    mz_uint8* out = (mz_uint8*) malloc( capacity );
+    tdefl_init( compressor, NULL, NULL, (int) tdefl_create_comp_flags_from_zip_params( MZ_UBER_COMPRESSION, 
+        -MZ_DEFAULT_WINDOW_BITS, MZ_DEFAULT_STRATEGY ) );
+    size_t in_size = size;
+    *out_size = capacity;
+    tdefl_status status = tdefl_compress( compressor, data, &in_size, out, out_size, TDEFL_FINISH );
+    free( compressor );
+    if( status != TDEFL_STATUS_DONE ) 
+        {
+        free( out );
+        return NULL;
+        }
+    return out;
+    }
+
+
+static void assetsys_pack_file( struct assetsys_pack_t* pack, char const* path, char const* name )
+    {
+    assetsys_file_t file;
+    if( assetsys_file( pack->assetsys, path, &file ) != ASSETSYS_SUCCESS ) { pack->failed = 1; return; }
+    int file_size = assetsys_file_size( pack->assetsys, file );
+    mz_uint8* data = (mz_uint8*) malloc( (size_t) file_size + 1 );
+    if( assetsys_file_load( pack->assetsys, file, &file_size, data, file_size ) != ASSETSYS_SUCCESS ) 
+        { 
+        printf( "Failed to read '%s'\n", path );
+        free( data ); 
+        pack->failed = 1; 
+        return; 
+        }
+    size_t size = (size_t) file_size;
+
+    // Compress with every method, keeping the one with the lowest read time plus decode time
+    mz_uint8* scratch = (mz_uint8*) malloc( size + 1 );
+    mz_uint8 const* best = data;
+    size_t best_size = size;
+    int best_method = 0;
+    double best_time = (double) size / pack->read_speed;
+
+    int can_unpack = size <= ASSETSYS_PACK_MAX_UNPACKED_SIZE;
+    mz_uint8* lz4 = NULL;
+    double decode_time = -1.0;
+    if( can_unpack )
+        {
+        lz4 = (mz_uint8*) malloc( size + size / 255 + 16 );
+        size_t lz4_size = assetsys_pack_lz4_encode( pack->lz4_table, data, size, lz4 );
+        decode_time = assetsys_pack_decode_time( ASSETSYS_INTERNAL_METHOD_LZ4, lz4, lz4_size, data, scratch, size );
+        if( decode_time >= 0.0 && lz4_size < size && (double) lz4_size / pack->read_speed + decode_time < best_time )
+            {
+            best = lz4; best_size = lz4_size; best_method = ASSETSYS_INTERNAL_METHOD_LZ4;
+            best_time = (double) lz4_size / pack->read_speed + decode_time;
+            }
+        }
+
+    size_t deflate_size = 0;
+    mz_uint8* deflate = assetsys_pack_deflate( data, size, &deflate_size );
+    decode_time = deflate ? assetsys_pack_decode_time( MZ_DEFLATED, deflate, deflate_size, data, scratch, size ) : -1.0;
+    if( decode_time >= 0.0 && deflate_size < size && 
+        (double) deflate_size / pack->read_speed + decode_time < best_time )
+        {
+        best = deflate; best_size = deflate_size; best_method = MZ_DEFLATED;
+        best_time = (double) deflate_size / pack->read_speed + decode_time;
+        }
+
+    mz_uint8* lzma = NULL;
+    #ifdef ASSETSYS_LZMA
+        // Zip LZMA data is prefixed by the encoder version and the size of the properties
+        if( can_unpack )
+            {
+            unsigned dict_size = 1 << 12;
+            while( dict_size < size && dict_size < ( 1u << 26 ) ) dict_size <<= 1;
+            size_t lzma_size = size + size / 3 + 128;
+            lzma = (mz_uint8*) malloc( 4 + LZMA_PROPS_SIZE + lzma_size );
+            size_t props_size = LZMA_PROPS_SIZE;
+            lzma[ 0 ] = 18; lzma[ 1 ] = 5; lzma[ 2 ] = LZMA_PROPS_SIZE; lzma[ 3 ] = 0;
+            if( size > 0 && LzmaCompress( lzma + 4 + LZMA_PROPS_SIZE, &lzma_size, data, size, lzma + 4, &props_size, 9, 
+                dict_size, -1, -1, -1, -1, NULL, NULL ) == SZ_OK )
+                {
+                lzma_size += 4 + LZMA_PROPS_SIZE;
+                decode_time = assetsys_pack_decode_time( ASSETSYS_INTERNAL_METHOD_LZMA, lzma, lzma_size, data, scratch, 
+                    size );
+                if( decode_time >= 0.0 && lzma_size < size && 
+                    (double) lzma_size / pack->read_speed + decode_time < best_time )
+                    {
+                    best = lzma; best_size = lzma_size; best_method = ASSETSYS_INTERNAL_METHOD_LZMA;
+                    best_time = (double) lzma_size / pack->read_speed + decode_time;
+                    }
+                }
+            }
+    #endif
+
+    if( pack->count >= pack->capacity )
+        {
+        pack->capacity = pack->capacity ? pack->capacity * 2 : 256;
+        pack->entries = (struct assetsys_pack_entry_t*) realloc( pack->entries, 
+            sizeof( *pack->entries ) * (size_t) pack->capacity );
+        }
+    struct assetsys_pack_entry_t* entry = &pack->entries[ pack->count++ ];
+    strncpy( entry->name, name, sizeof( entry->name ) - 1 );
+    entry->name[ sizeof( entry->name ) - 1 ] = '\0';
+    entry->method = best_method;
+    entry->crc32 = (mz_uint32) mz_crc32( MZ_CRC32_INIT, data, size );
+    entry->size = size;
+    entry->compressed_size = best_size;
+    entry->offset = pack->offset;
+
+    unsigned char header[ 30 ];
+    size_t name_len = strlen( entry->name );
+    assetsys_internal_index_put( header, 0x04034b50, 4 );
+    assetsys_internal_index_put( header + 4, best_method == 0 ? 10 : best_method == MZ_DEFLATED ? 20 : 63, 2 );
+    assetsys_internal_index_put( header + 6, 0, 2 ); // flags
+    assetsys_internal_index_put( header + 8, (ASSETSYS_U64) best_method, 2 );
+    assetsys_internal_index_put( header + 10, 0, 2 ); // time
+    assetsys_internal_index_put( header + 12, ( 1 << 5 ) | 1, 2 ); // date, 1980-01-01
+    assetsys_internal_index_put( header + 14, entry->crc32, 4 );
+    assetsys_internal_index_put( header + 18, best_size, 4 );
+    assetsys_internal_index_put( header + 22, size, 4 );
+    assetsys_internal_index_put( header + 26, name_len, 2 );
+    assetsys_internal_index_put( header + 28, 0, 2 ); // extra field length
+    if( fwrite( header, 1, sizeof( header ), pack->fp ) != sizeof( header ) || 
+        fwrite( entry->name, 1, name_len, pack->fp ) != name_len ||
+        fwrite( best, 1, best_size, pack->fp ) != best_size )
+        {
+        pack->failed = 1;
+        }
+    pack->offset += sizeof( header ) + name_len + best_size;
+    if( pack->offset > 0xffffffff ) pack->failed = 1; // zip64 is not supported
+
+    char const* method_names[] = { "stored", "deflate", "lz4", "lzma" };
+    printf( "%-8s %10d -> %10d  %s\n", method_names[ best_method == 0 ? 0 : best_method == MZ_DEFLATED ? 1 : 
+        best_method == ASSETSYS_INTERNAL_METHOD_LZ4 ? 2 : 3 ], (int) size, (int) best_size, name );
+
+    if( lzma ) free( lzma );
+    if( deflate ) free( deflate );
+    if( lz4 ) free( lz4 );
+    free( scratch );
+    free( data );
+    }
+
+
+static void assetsys_pack_directory( struct assetsys_pack_t* pack, char const* path, size_t root_len )
+    {
+    for( int i = 0; i < assetsys_file_count( pack->assetsys, path ) && !pack->failed; ++i )
+        {
+        char file_path[ 1024 ];
+        strncpy( file_path, assetsys_file_path( pack->assetsys, path, i ), sizeof( file_path ) - 1 );
+        file_path[ sizeof( file_path ) - 1 ] = '\0';
+        if( strlen( file_path ) - root_len >= sizeof( pack->entries->name ) ) 
+            {
+            printf( "Path too long: '%s'\n", file_path );
+            pack->failed = 1;
+            break;
+            }
+        assetsys_pack_file( pack, file_path, file_path + root_len );
+        }
+    for( int i = 0; i < assetsys_subdir_count( pack->assetsys, path ) && !pack->failed; ++i )
+        {
+        char subdir_path[ 1024 ];
+        strncpy( subdir_path, assetsys_subdir_path( pack->assetsys, path, i ), sizeof( subdir_path ) - 1 );
+        subdir_path[ sizeof( subdir_path ) - 1 ] = '\0';
+        assetsys_pack_directory( pack, subdir_path, root_len );
+        }
+    }
+
+
+static int assetsys_pack_central_directory( struct assetsys_pack_t* pack )
+    {
+    size_t start = pack->offset;
+    for( int i = 0; i < pack->count; ++i )
+        {
+        struct assetsys_pack_entry_t* entry = &pack->entries[ i ];
+        unsigned char header[ 46 ];
+        size_t name_len = strlen( entry->name );
+        int version = entry->method == 0 ? 10 : entry->method == MZ_DEFLATED ? 20 : 63;
+        memset( header, 0, sizeof( header ) );
+        assetsys_internal_index_put( header, 0x02014b50, 4 );
+        assetsys_internal_index_put( header + 4, (ASSETSYS_U64) version, 2 ); // version made by
+        assetsys_internal_index_put( header + 6, (ASSETSYS_U64) version, 2 ); // version needed
+        assetsys_internal_index_put( header + 10, (ASSETSYS_U64) entry->method, 2 );
+        assetsys_internal_index_put( header + 14, ( 1 << 5 ) | 1, 2 );
+        assetsys_internal_index_put( header + 16, entry->crc32, 4 );
+        assetsys_internal_index_put( header + 20, entry->compressed_size, 4 );
+        assetsys_internal_index_put( header + 24, entry->size, 4 );
+        assetsys_internal_index_put( header + 28, name_len, 2 );
+        assetsys_internal_index_put( header + 42, entry->offset, 4 );
+        if( fwrite( header, 1, sizeof( header ), pack->fp ) != sizeof( header ) || 
+            fwrite( entry->name, 1, name_len, pack->fp ) != name_len )
+            return 0;
+        pack->offset += sizeof( header ) + name_len;
+        }
+
+    unsigned char end[ 22 ];
+    memset( end, 0, sizeof( end ) );
+    assetsys_internal_index_put( end, 0x06054b50, 4 );
+    assetsys_internal_index_put( end + 8, (ASSETSYS_U64) pack->count, 2 );
+    assetsys_internal_index_put( end + 10, (ASSETSYS_U64) pack->count, 2 );
+    assetsys_internal_index_put( end + 12, pack->offset - start, 4 );
+    assetsys_internal_index_put( end + 16, start, 4 );
+    return pack->count <= 0xffff && pack->offset <= 0xffffffff && fwrite( end, 1, sizeof( end ), pack->fp ) == 
+        sizeof( end );
+    }
+
+
+int main( int argc, char** argv ) 
+    {
+    double read_speed = 200.0;
+    int arg = 1;
+    if( argc == 5 && strcmp( argv[ 1 ], "-r" ) == 0 ) 
+        {
+        read_speed = atof( argv[ 2 ] );
+        arg = 3;
+        }
+    if( argc - arg != 2 || read_speed <= 0.0 )
+        {
+        printf( "Usage: %s [-r <read speed in MB/s>] <directory> <zip file>\n", argv[ 0 ] );
+        return 1;
+        }
+
+    struct assetsys_pack_t* pack = (struct assetsys_pack_t*) malloc( sizeof( struct assetsys_pack_t ) );
+    memset( pack, 0, sizeof( *pack ) );
+    pack->read_speed = read_speed * 1024.0 * 1024.0;
+    pack->assetsys = assetsys_create( 0 );
+    assetsys_error_t result = assetsys_mount( pack->assetsys, argv[ arg ], "/pack" );
+    if( result != ASSETSYS_SUCCESS )
+        {
+        printf( "Failed to mount '%s' (error %d)\n", argv[ arg ], (int) result );
+        assetsys_destroy( pack->assetsys );
+        free( pack );
+        return 1;
+        }
+
+    pack->fp = fopen( argv[ arg + 1 ], "wb" );
+    if( pack->fp )
+        {
+        assetsys_pack_directory( pack, "/pack", strlen( "/pack/" ) );
+        if( !pack->failed && !assetsys_pack_central_directory( pack ) ) pack->failed = 1;
+        if( fclose( pack->fp ) != 0 ) pack->failed = 1;
+        }
+    int failed = !pack->fp || pack->failed;
+    if( failed ) printf( "Failed to write '%s'\n", argv[ arg + 1 ] );
+
+    assetsys_destroy( pack->assetsys );
+    free( pack->entries );
+    free( pack );
+    return failed ? 1 : 0;
     }
 
+#endif /* ASSETSYS_PACK_TOOL */
 
-int assetsys_subdir_count( assetsys_t* sys, char const* path )
+
+/*
+----------------------
+    BENCHMARK
+----------------------
+*/
+
+
+#if defined( ASSETSYS_RUN_BENCHMARK ) && !defined( ASSETSYS_RUN_TESTS )
+
+#include <stdio.h>
+#include "thread.h"
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+
+static double benchmark_assetsys_seconds( void )
     {
-    if( !path ) return 0;
-    int dir = assetsys_internal_find_collated( sys, path );
-    int count = 0;
-    for( int i = 0; i < sys->collated_count; ++i )
+    #ifdef _WIN32
+        LARGE_INTEGER count, frequency;
+        QueryPerformanceCounter( &count );
+        QueryPerformanceFrequency( &frequency );
+        return (double) count.QuadPart / (double) frequency.QuadPart;
+    #else
+        struct timespec t;
+        clock_gettime( CLOCK_MONOTONIC, &t );
+        return (double) t.tv_sec + (double) t.tv_nsec * 1e-9;
+    #endif
+    }
+
+
+// A zip file holds at most 65535 entries, so the files are spread over several archives, all mounted as /data
+#define BENCHMARK_ASSETSYS_ZIPS 2
+#define BENCHMARK_ASSETSYS_ZIP_FILES 60000
+#define BENCHMARK_ASSETSYS_FILES ( BENCHMARK_ASSETSYS_ZIPS * BENCHMARK_ASSETSYS_ZIP_FILES )
+#define BENCHMARK_ASSETSYS_LINEAR_LOOKUPS 2000
+
+
+static void* benchmark_assetsys_zip( int first, int count, size_t* size )
+    {
+    mz_zip_archive zip;
+    memset( &zip, 0, sizeof( zip ) );
+    zip.m_pAlloc = assetsys_internal_mz_alloc; // miniz is built without its own allocation functions
+    zip.m_pRealloc = assetsys_internal_mz_realloc;
+    zip.m_pFree = assetsys_internal_mz_free;
+    mz_zip_writer_init_heap( &zip, 0, 0 );
+    for( int i = first; i < first + count; ++i )
         {
-        if( !sys->collated[ i ].is_file && sys->collated[ i ].parent == dir )
+        char name[ 32 ];
+        sprintf( name, "dir%03d/file%06d.txt", i % 500, i );
+        mz_zip_writer_add_mem( &zip, name, name, strlen( name ), MZ_NO_COMPRESSION );
+        }
+    void* data = NULL;
+    *size = 0;
+    mz_zip_writer_finalize_heap_archive( &zip, &data, size );
+    mz_zip_writer_end( &zip );
+    return data;
+    }
+
+
+// How assetsys_file found a file before paths were indexed: by comparing the path against every file of every mount
+static assetsys_error_t benchmark_assetsys_linear_file( assetsys_t* sys, char const* path, assetsys_file_t* file )
+    {
+    ASSETSYS_U64 handle = strpool_find( &sys->strpool, path, (int) strlen( path ) );
+    int m = sys->mounts_count;
+    while( m > 0 )
+        {
+        --m;
+        struct assetsys_internal_mount_t* mount = &sys->mounts[ m ];
+        for( int i = 0; i < mount->files_count; ++i )
             {
-            ++count;
+            int collated_index = mount->files[ i ].collated_index;
+            if( collated_index >= 0 && sys->collated[ collated_index ].path == handle )
+                {
+                file->mount = mount->mounted_as;
+                file->path = mount->path;
+                file->index = i;
+                return ASSETSYS_SUCCESS;
+                }
             }
         }
-    return count;
+    return ASSETSYS_ERROR_FILE_NOT_FOUND;
     }
 
 
-char const* assetsys_subdir_name( assetsys_t* sys, char const* path, int index )
+static void benchmark_assetsys_lookup( void )
     {
-    char const* subdir_path = assetsys_subdir_path( sys, path, index );
-    if( subdir_path ) 
+    void* zips[ BENCHMARK_ASSETSYS_ZIPS ];
+    size_t sizes[ BENCHMARK_ASSETSYS_ZIPS ];
+    for( int i = 0; i < BENCHMARK_ASSETSYS_ZIPS; ++i )
+        zips[ i ] = benchmark_assetsys_zip( i * BENCHMARK_ASSETSYS_ZIP_FILES, BENCHMARK_ASSETSYS_ZIP_FILES, &sizes[ i ] );
+
+    assetsys_t* assetsys = assetsys_create( 0 );
+    double start = benchmark_assetsys_seconds();
+    for( int i = 0; i < BENCHMARK_ASSETSYS_ZIPS; ++i )
+        assetsys_mount_from_memory( assetsys, zips[ i ], (int) sizes[ i ], "/data" );
+    double mount = benchmark_assetsys_seconds() - start;
+    printf( "mount %d zip files, %d files: %.1f ms\n", BENCHMARK_ASSETSYS_ZIPS, BENCHMARK_ASSETSYS_FILES, 
+        mount * 1000.0 );
+
+    // Look the files up in a scattered order, so it's not just the last few entries being found over and over
+    char (*paths)[ 32 ] = (char (*)[ 32 ]) malloc( sizeof( *paths ) * BENCHMARK_ASSETSYS_FILES );
+    unsigned int seed = 0x2545f491;
+    for( int i = 0; i < BENCHMARK_ASSETSYS_FILES; ++i )
         {
-        char const* name = strrchr( subdir_path, '/' );
-        if( !name ) return subdir_path;
-        return name + 1;
+        seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+        int index = (int)( seed % BENCHMARK_ASSETSYS_FILES );
+        sprintf( paths[ i ], "/data/dir%03d/file%06d.txt", index % 500, index );
         }
 
-    return NULL;
+    int found = 0;
+    start = benchmark_assetsys_seconds();
+    for( int i = 0; i < BENCHMARK_ASSETSYS_FILES; ++i )
+        {
+        assetsys_file_t file;
+        found += assetsys_file( assetsys, paths[ i ], &file ) == ASSETSYS_SUCCESS;
+        }
+    double hashed = benchmark_assetsys_seconds() - start;
+    printf( "assetsys_file:              %8.1f ns per lookup, %d lookups in %8.1f ms, %d found\n", 
+        hashed * 1e9 / BENCHMARK_ASSETSYS_FILES, BENCHMARK_ASSETSYS_FILES, hashed * 1000.0, found );
+
+    // The linear scan is too slow to do every lookup, so time a sample and scale it up
+    found = 0;
+    start = benchmark_assetsys_seconds();
+    for( int i = 0; i < BENCHMARK_ASSETSYS_LINEAR_LOOKUPS; ++i )
+        {
+        assetsys_file_t file;
+        found += benchmark_assetsys_linear_file( assetsys, paths[ i ], &file ) == ASSETSYS_SUCCESS;
+        }
+    double linear = ( benchmark_assetsys_seconds() - start ) / BENCHMARK_ASSETSYS_LINEAR_LOOKUPS;
+    printf( "linear scan (before index): %8.1f ns per lookup, %d lookups in %8.1f ms (estimated from %d, %d found)\n",
+        linear * 1e9, BENCHMARK_ASSETSYS_FILES, linear * BENCHMARK_ASSETSYS_FILES * 1000.0, 
+        BENCHMARK_ASSETSYS_LINEAR_LOOKUPS, found );
+
+    free( paths );
+    assetsys_destroy( assetsys );
+    for( int i = 0; i < BENCHMARK_ASSETSYS_ZIPS; ++i ) assetsys_internal_mz_free( NULL, zips[ i ] );
     }
 
 
-char const* assetsys_subdir_path( assetsys_t* sys, char const* path, int index )
+#define BENCHMARK_ASSETSYS_LOAD_FILENAME "assetsys_benchmark.zip"
+#define BENCHMARK_ASSETSYS_LOAD_FILES 256
+#define BENCHMARK_ASSETSYS_LOAD_SIZE ( 256 * 1024 )
+#define BENCHMARK_ASSETSYS_LOAD_THREADS 16
+
+
+struct benchmark_assetsys_loads_t
     {
-    if( !path ) return 0;
-    int dir = assetsys_internal_find_collated( sys, path );
-    int count = 0;
-    for( int i = 0; i < sys->collated_count; ++i )
+    assetsys_t* assetsys;
+    assetsys_file_t files[ BENCHMARK_ASSETSYS_LOAD_FILES ];
+    char* buffers[ BENCHMARK_ASSETSYS_LOAD_FILES ];
+    thread_atomic_int_t next;
+    thread_atomic_int_t failed;
+    };
+
+
+// Loads files until there are none left, so any number of threads can share the work
+static int benchmark_assetsys_load_thread( void* user_data )
+    {
+    struct benchmark_assetsys_loads_t* loads = (struct benchmark_assetsys_loads_t*) user_data;
+    for( ; ; )
+        {
+        int i = thread_atomic_int_inc( &loads->next );
+        if( i >= BENCHMARK_ASSETSYS_LOAD_FILES ) break;
+        int size = 0;
+        if( assetsys_file_load( loads->assetsys, loads->files[ i ], &size, loads->buffers[ i ], 
+            BENCHMARK_ASSETSYS_LOAD_SIZE ) != ASSETSYS_SUCCESS || size != BENCHMARK_ASSETSYS_LOAD_SIZE )
+            thread_atomic_int_inc( &loads->failed );
+        }
+    return 0;
+    }
+
+
+static void benchmark_assetsys_load_callback( assetsys_file_t file, assetsys_error_t result, void* buffer, int size, 
+    void* user_data )
+    {
+    (void) file, (void) buffer;
+    struct benchmark_assetsys_loads_t* loads = (struct benchmark_assetsys_loads_t*) user_data;
+    if( result != ASSETSYS_SUCCESS || size != BENCHMARK_ASSETSYS_LOAD_SIZE ) thread_atomic_int_inc( &loads->failed );
+    }
+
+
+static void benchmark_assetsys_load_report( char const* name, double seconds, double serial, 
+    struct benchmark_assetsys_loads_t* loads )
+    {
+    double megabytes = (double) BENCHMARK_ASSETSYS_LOAD_FILES * BENCHMARK_ASSETSYS_LOAD_SIZE / ( 1024.0 * 1024.0 );
+    printf( "%-44s %8.1f ms, %8.1f MB/s, %5.2fx serial, %d failed\n", name, seconds * 1000.0, megabytes / seconds, 
+        serial / seconds, thread_atomic_int_load( &loads->failed ) );
+    }
+
+
+static void benchmark_assetsys_load( void )
+    {
+    // Deflated files of text-like data, so that decompressing them is most of the work of loading them
+    mz_zip_archive zip;
+    memset( &zip, 0, sizeof( zip ) );
+    zip.m_pAlloc = assetsys_internal_mz_alloc; // miniz is built without its own allocation functions
+    zip.m_pRealloc = assetsys_internal_mz_realloc;
+    zip.m_pFree = assetsys_internal_mz_free;
+    mz_zip_writer_init_heap( &zip, 0, 0 );
+    char* content = (char*) malloc( BENCHMARK_ASSETSYS_LOAD_SIZE );
+    unsigned int seed = 0x2545f491;
+    for( int i = 0; i < BENCHMARK_ASSETSYS_LOAD_FILES; ++i )
         {
-        if( !sys->collated[ i ].is_file &&  sys->collated[ i ].parent == dir )
+        for( int j = 0; j < BENCHMARK_ASSETSYS_LOAD_SIZE; ++j )
             {
-            if( count == index ) return assetsys_internal_get_string( sys, sys->collated[ i ].path );
-            ++count;
+            seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+            content[ j ] = ( seed & 7 ) == 0 ? ' ' : (char)( 'a' + ( seed >> 3 ) % 8 );
             }
+        char name[ 32 ];
+        sprintf( name, "file%03d.txt", i );
+        mz_zip_writer_add_mem( &zip, name, content, BENCHMARK_ASSETSYS_LOAD_SIZE, MZ_DEFAULT_LEVEL );
         }
-    return NULL;
+    free( content );
+    void* zip_data = NULL;
+    size_t zip_size = 0;
+    mz_zip_writer_finalize_heap_archive( &zip, &zip_data, &zip_size );
+    mz_zip_writer_end( &zip );
+    FILE* fp = fopen( BENCHMARK_ASSETSYS_LOAD_FILENAME, "wb" );
+    if( fp ) 
+        {
+        fwrite( zip_data, 1, zip_size, fp );
+        fclose( fp );
+        }
+    assetsys_internal_mz_free( NULL, zip_data );
+
+    struct benchmark_assetsys_loads_t* loads = 
+        (struct benchmark_assetsys_loads_t*) malloc( sizeof( struct benchmark_assetsys_loads_t ) );
+    loads->assetsys = assetsys_create( 0 );
+    if( assetsys_mount( loads->assetsys, BENCHMARK_ASSETSYS_LOAD_FILENAME, "/data" ) != ASSETSYS_SUCCESS )
+        {
+        printf( "failed to mount " BENCHMARK_ASSETSYS_LOAD_FILENAME "\n" );
+        assetsys_destroy( loads->assetsys );
+        free( loads );
+        remove( BENCHMARK_ASSETSYS_LOAD_FILENAME );
+        return;
+        }
+    for( int i = 0; i < BENCHMARK_ASSETSYS_LOAD_FILES; ++i )
+        {
+        char path[ 32 ];
+        sprintf( path, "/data/file%03d.txt", i );
+        assetsys_file( loads->assetsys, path, &loads->files[ i ] );
+        loads->buffers[ i ] = (char*) malloc( BENCHMARK_ASSETSYS_LOAD_SIZE );
+        }
+    printf( "%d files of %d kb, deflated to %.1f MB\n", BENCHMARK_ASSETSYS_LOAD_FILES, 
+        BENCHMARK_ASSETSYS_LOAD_SIZE / 1024, (double) zip_size / ( 1024.0 * 1024.0 ) );
+
+    // Serial, on the calling thread
+    thread_atomic_int_store( &loads->next, 0 );
+    thread_atomic_int_store( &loads->failed, 0 );
+    double start = benchmark_assetsys_seconds();
+    benchmark_assetsys_load_thread( loads );
+    double serial = benchmark_assetsys_seconds() - start;
+    benchmark_assetsys_load_report( "assetsys_file_load, serial", serial, serial, loads );
+
+    // Parallel, with assetsys_file_load called from several threads at once
+    for( int count = 2; count <= BENCHMARK_ASSETSYS_LOAD_THREADS; count *= 2 )
+        {
+        thread_atomic_int_store( &loads->next, 0 );
+        thread_atomic_int_store( &loads->failed, 0 );
+        thread_ptr_t threads[ BENCHMARK_ASSETSYS_LOAD_THREADS ];
+        start = benchmark_assetsys_seconds();
+        for( int i = 0; i < count; ++i )
+            threads[ i ] = thread_create( benchmark_assetsys_load_thread, loads, THREAD_STACK_SIZE_DEFAULT );
+        for( int i = 0; i < count; ++i )
+            {
+            thread_join( threads[ i ] );
+            thread_destroy( threads[ i ] );
+            }
+        char name[ 64 ];
+        sprintf( name, "assetsys_file_load, %d threads", count );
+        benchmark_assetsys_load_report( name, benchmark_assetsys_seconds() - start, serial, loads );
+        }
+
+    // Queued with assetsys_load_async, and delivered by assetsys_poll
+    thread_atomic_int_store( &loads->failed, 0 );
+    start = benchmark_assetsys_seconds();
+    for( int i = 0; i < BENCHMARK_ASSETSYS_LOAD_FILES; ++i )
+        assetsys_load_async( loads->assetsys, loads->files[ i ], loads->buffers[ i ], BENCHMARK_ASSETSYS_LOAD_SIZE, 0,
+            benchmark_assetsys_load_callback, loads );
+    while( assetsys_poll( loads->assetsys ) > 0 ) thread_yield();
+    #ifdef ASSETSYS_ASYNC
+        char name[ 64 ];
+        sprintf( name, "assetsys_load_async, 1 + %d worker threads", ASSETSYS_ASYNC_INFLATE_THREADS );
+        benchmark_assetsys_load_report( name, benchmark_assetsys_seconds() - start, serial, loads );
+    #else
+        benchmark_assetsys_load_report( "assetsys_load_async, without ASSETSYS_ASYNC", benchmark_assetsys_seconds() - 
+            start, serial, loads );
+    #endif
+
+    assetsys_destroy( loads->assetsys );
+    for( int i = 0; i < BENCHMARK_ASSETSYS_LOAD_FILES; ++i ) free( loads->buffers[ i ] );
+    free( loads );
+    remove( BENCHMARK_ASSETSYS_LOAD_FILENAME );
     }
 
 
-static char* assetsys_internal_dirname( char const* path )
+int main( int argc, char** argv )
     {
-    static char result[ 260 ];
-    strncpy( result, path, sizeof( result ) );
-      
-    char* lastForwardSlash = strrchr( result, '/' );
-
-    if( lastForwardSlash ) *(lastForwardSlash + 1 ) = '\0';
-    else *result = '\0';
+    (void) argc, (void) argv;
 
-    return result;
+    printf( "assetsys benchmark, path lookup\n" );
+    benchmark_assetsys_lookup();
+    printf( "\nassetsys benchmark, loading\n" );
+    benchmark_assetsys_load();
+    return 0;
     }
 
 
-#endif /* ASSETSYS_IMPLEMENTATION */
+#define THREAD_IMPLEMENTATION
+#include "thread.h"
+
+#endif /* ASSETSYS_RUN_BENCHMARK */
 
 
 /*
@@ -6394,6 +9770,42 @@ static char* assetsys_internal_dirname( char const* path )
 
 #include "testfw.h"
 
+static int test_assetsys_async_order[ 3 ];
+static int test_assetsys_async_count = 0;
+
+static void test_assetsys_async_callback( assetsys_file_t file, assetsys_error_t result, void* buffer, int size, 
+    void* user_data ) {
+    (void) file;
+    if( result == ASSETSYS_SUCCESS && size == 14 && memcmp( buffer, "Hello, World!", 13 ) == 0 && 
+        test_assetsys_async_count < 3 ) {
+        test_assetsys_async_order[ test_assetsys_async_count ] = *(int*) user_data;
+    }
+    ++test_assetsys_async_count;
+}
+
+#ifdef ASSETSYS_ASYNC
+
+#define TEST_ASSETSYS_THREADED_LOADS 8
+#define TEST_ASSETSYS_THREADED_SIZE ( 1024 * 1024 )
+
+static int test_assetsys_threaded_order[ TEST_ASSETSYS_THREADED_LOADS ];
+static int test_assetsys_threaded_count = 0;
+
+// user_data points to the priority, which is also the number of the file that was loaded
+static void test_assetsys_threaded_callback( assetsys_file_t file, assetsys_error_t result, void* buffer, int size, 
+    void* user_data ) {
+    (void) file;
+    int priority = *(int*) user_data;
+    int ok = result == ASSETSYS_SUCCESS && size == TEST_ASSETSYS_THREADED_SIZE && 
+        ( (char*) buffer )[ 0 ] == (char)( '0' + priority );
+    if( test_assetsys_threaded_count < TEST_ASSETSYS_THREADED_LOADS ) {
+        test_assetsys_threaded_order[ test_assetsys_threaded_count ] = ok ? priority : -1;
+    }
+    ++test_assetsys_threaded_count;
+}
+
+#endif /* ASSETSYS_ASYNC */
+
 void test_assetsys( void ) {
     // Zip file with a test.txt file containing "Hello, World!"
     const unsigned char test_assetsys_data[]  = {
@@ -6513,6 +9925,416 @@ void test_assetsys( void ) {
         assetsys_destroy( assetsys );
         }
     TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test mapped zip mount and direct data access" );
+        {
+        ASSETSYS_FILE* fp = ASSETSYS_FOPEN( "test.zip", "wb" );
+        TESTFW_EXPECTED( fp != NULL );
+        ASSETSYS_FWRITE( test_assetsys_data, 1, test_assetsys_data_size, fp );
+        ASSETSYS_FCLOSE( fp );
+
+        assetsys_t* assetsys = assetsys_create( 0 );
+        TESTFW_EXPECTED( assetsys_mount_mapped( assetsys, "test.zip", "/mapped" ) == ASSETSYS_SUCCESS );
+
+        // test.txt is stored uncompressed, so it can be accessed in place
+        assetsys_file_t file;
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/mapped/test.txt", &file ) == ASSETSYS_SUCCESS );
+        int size = 0;
+        char const* data = (char const*) assetsys_file_data( assetsys, file, &size );
+        TESTFW_EXPECTED( data != NULL );
+        TESTFW_EXPECTED( size == 14 );
+        TESTFW_EXPECTED( data && memcmp( data, "Hello, World!", 13 ) == 0 );
+
+        // Loading still works as usual
+        char content[ 16 ];
+        TESTFW_EXPECTED( assetsys_file_load( assetsys, file, &size, content, sizeof( content ) ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( memcmp( content, "Hello, World!", 13 ) == 0 );
+
+        TESTFW_EXPECTED( assetsys_dismount( assetsys, "test.zip", "/mapped" ) == ASSETSYS_SUCCESS );
+        assetsys_destroy( assetsys );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test mounting with a saved index" );
+        {
+        ASSETSYS_FILE* fp = ASSETSYS_FOPEN( "test.zip", "wb" );
+        TESTFW_EXPECTED( fp != NULL );
+        ASSETSYS_FWRITE( test_assetsys_data, 1, test_assetsys_data_size, fp );
+        ASSETSYS_FCLOSE( fp );
+
+        // Save an index of the zip file
+        assetsys_t* assetsys = assetsys_create( 0 );
+        TESTFW_EXPECTED( assetsys_mount( assetsys, "test.zip", "/data" ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_index_save( assetsys, "test.zip", "/data", "test.idx" ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_index_save( assetsys, "missing.zip", "/data", "test.idx" ) == ASSETSYS_ERROR_INVALID_MOUNT );
+        assetsys_destroy( assetsys );
+
+        // Mount it through the index, at a different mount point
+        assetsys = assetsys_create( 0 );
+        TESTFW_EXPECTED( assetsys_mount_indexed( assetsys, "test.zip", "/indexed", "test.idx" ) == ASSETSYS_SUCCESS );
+        assetsys_file_t file;
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/indexed/test.txt", &file ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_file_size( assetsys, file ) == 14 );
+        TESTFW_EXPECTED( assetsys_file_count( assetsys, "/indexed" ) == 1 );
+        char content[ 16 ];
+        int size = 0;
+        TESTFW_EXPECTED( assetsys_file_load( assetsys, file, &size, content, sizeof( content ) ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( memcmp( content, "Hello, World!", 13 ) == 0 );
+
+        // The index does not match a directory
+        TESTFW_EXPECTED( assetsys_mount_indexed( assetsys, ".", "/dir", "test.idx" ) == ASSETSYS_ERROR_INVALID_INDEX );
+        assetsys_destroy( assetsys );
+        ASSETSYS_DELETE_FILE( "test.idx" );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test cache of loaded files" );
+        {
+        assetsys_t* assetsys = assetsys_create( 0 );
+        TESTFW_EXPECTED( assetsys_mount_from_memory( assetsys, test_assetsys_data, test_assetsys_data_size, "/data" ) == ASSETSYS_SUCCESS );
+        assetsys_cache_budget( assetsys, 1024 );
+
+        assetsys_file_t file;
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/data/test.txt", &file ) == ASSETSYS_SUCCESS );
+
+        // The second acquire is served from the cache, with the same buffer
+        void const* first = NULL;
+        void const* second = NULL;
+        int size = 0;
+        TESTFW_EXPECTED( assetsys_cache_acquire( assetsys, file, &first, &size ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( size == 14 );
+        TESTFW_EXPECTED( first && memcmp( first, "Hello, World!", 13 ) == 0 );
+        TESTFW_EXPECTED( assetsys_cache_acquire( assetsys, file, &second, &size ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( first == second );
+        assetsys_cache_release( assetsys, first );
+        assetsys_cache_release( assetsys, second );
+
+        assetsys_cache_stats_t stats;
+        assetsys_cache_stats( assetsys, &stats );
+        TESTFW_EXPECTED( stats.hits == 1 );
+        TESTFW_EXPECTED( stats.misses == 1 );
+        TESTFW_EXPECTED( stats.entries == 1 );
+        TESTFW_EXPECTED( stats.bytes == 14 );
+
+        // Shrinking the budget evicts entries which are not borrowed
+        assetsys_cache_budget( assetsys, 0 );
+        assetsys_cache_stats( assetsys, &stats );
+        TESTFW_EXPECTED( stats.evictions == 1 );
+        TESTFW_EXPECTED( stats.entries == 0 );
+        TESTFW_EXPECTED( stats.bytes == 0 );
+
+        assetsys_destroy( assetsys );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test file lookup with overlapping mounts" );
+        {
+        assetsys_t* assetsys = assetsys_create( 0 );
+        TESTFW_EXPECTED( assetsys != NULL );
+
+        // Mount both the test zip and the current working folder as "/data"
+        TESTFW_EXPECTED( assetsys_mount_from_memory( assetsys, test_assetsys_data, test_assetsys_data_size, "/data" ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_mount( assetsys, ".", "/data" ) == ASSETSYS_SUCCESS );
+
+        // Files from both mounts are found
+        assetsys_file_t file;
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/data/test.txt", &file ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/data/README.md", &file ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/data/missing.txt", &file ) == ASSETSYS_ERROR_FILE_NOT_FOUND );
+
+        // Removing the zip mount only removes its files
+        TESTFW_EXPECTED( assetsys_dismount( assetsys, "data", "/data" ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/data/test.txt", &file ) == ASSETSYS_ERROR_FILE_NOT_FOUND );
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/data/README.md", &file ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_file_size( assetsys, file ) > 30 );
+
+        // Remounting makes them available again
+        TESTFW_EXPECTED( assetsys_mount_from_memory( assetsys, test_assetsys_data, test_assetsys_data_size, "/data" ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/data/test.txt", &file ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_file_size( assetsys, file ) == 14 );
+
+        assetsys_destroy( assetsys );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test async loading in priority order" );
+        {
+        assetsys_t* assetsys = assetsys_create( 0 );
+        TESTFW_EXPECTED( assetsys_mount_from_memory( assetsys, test_assetsys_data, test_assetsys_data_size, "/data" ) == ASSETSYS_SUCCESS );
+
+        assetsys_file_t file;
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/data/test.txt", &file ) == ASSETSYS_SUCCESS );
+
+        // Queue the same file three times, with different priorities
+        char buffers[ 3 ][ 16 ];
+        int priorities[ 3 ] = { 1, 5, 3 };
+        for( int i = 0; i < 3; ++i ) {
+            TESTFW_EXPECTED( assetsys_load_async( assetsys, file, buffers[ i ], sizeof( buffers[ i ] ), priorities[ i ], 
+                test_assetsys_async_callback, &priorities[ i ] ) == ASSETSYS_SUCCESS );
+        }
+        while( assetsys_poll( assetsys ) > 0 ) { }
+
+        TESTFW_EXPECTED( test_assetsys_async_count == 3 );
+        TESTFW_EXPECTED( test_assetsys_async_order[ 0 ] == 5 );
+        TESTFW_EXPECTED( test_assetsys_async_order[ 1 ] == 3 );
+        TESTFW_EXPECTED( test_assetsys_async_order[ 2 ] == 1 );
+
+        assetsys_destroy( assetsys );
+        }
+    TESTFW_TEST_END();
+
+    #ifdef ASSETSYS_ASYNC
+        TESTFW_TEST_BEGIN( "Test async loading on worker threads" );
+            {
+            // Zip up some larger files in memory, so the loads are still in flight when first polled
+            mz_zip_archive zip;
+            memset( &zip, 0, sizeof( zip ) );
+            zip.m_pAlloc = assetsys_internal_mz_alloc; // miniz is built without its own allocation functions
+            zip.m_pRealloc = assetsys_internal_mz_realloc;
+            zip.m_pFree = assetsys_internal_mz_free;
+            TESTFW_EXPECTED( mz_zip_writer_init_heap( &zip, 0, 0 ) );
+            char* content = (char*) malloc( TEST_ASSETSYS_THREADED_SIZE );
+            for( int i = 0; i < TEST_ASSETSYS_THREADED_SIZE; ++i ) content[ i ] = (char)( 'a' + ( i * 7 + i / 997 ) % 26 );
+            for( int i = 0; i < TEST_ASSETSYS_THREADED_LOADS; ++i ) {
+                char name[ 16 ];
+                sprintf( name, "file%d.bin", i );
+                content[ 0 ] = (char)( '0' + i );
+                TESTFW_EXPECTED( mz_zip_writer_add_mem( &zip, name, content, TEST_ASSETSYS_THREADED_SIZE, MZ_DEFAULT_LEVEL ) );
+            }
+            void* zip_data = NULL;
+            size_t zip_size = 0;
+            TESTFW_EXPECTED( mz_zip_writer_finalize_heap_archive( &zip, &zip_data, &zip_size ) );
+            mz_zip_writer_end( &zip );
+            free( content );
+
+            assetsys_t* assetsys = assetsys_create( 0 );
+            TESTFW_EXPECTED( assetsys_mount_from_memory( assetsys, zip_data, (int) zip_size, "/data" ) == ASSETSYS_SUCCESS );
+
+            // Queue the files in an order unrelated to their priorities, which are the file numbers
+            int priorities[ TEST_ASSETSYS_THREADED_LOADS ];
+            char* buffers[ TEST_ASSETSYS_THREADED_LOADS ];
+            for( int i = 0; i < TEST_ASSETSYS_THREADED_LOADS; ++i ) {
+                priorities[ i ] = ( i * 5 ) % TEST_ASSETSYS_THREADED_LOADS;
+                buffers[ i ] = (char*) malloc( TEST_ASSETSYS_THREADED_SIZE );
+                char path[ 32 ];
+                sprintf( path, "/data/file%d.bin", priorities[ i ] );
+                assetsys_file_t file;
+                TESTFW_EXPECTED( assetsys_file( assetsys, path, &file ) == ASSETSYS_SUCCESS );
+                TESTFW_EXPECTED( assetsys_load_async( assetsys, file, buffers[ i ], TEST_ASSETSYS_THREADED_SIZE, 
+                    priorities[ i ], test_assetsys_threaded_callback, &priorities[ i ] ) == ASSETSYS_SUCCESS );
+            }
+
+            // Polling right away, normally before any load has completed, only delivers what is done, and the
+            // highest priority file is the last one in the archive, so lower priority loads are usually held back
+            int remaining = assetsys_poll( assetsys );
+            TESTFW_EXPECTED( remaining + test_assetsys_threaded_count == TEST_ASSETSYS_THREADED_LOADS );
+            while( assetsys_poll( assetsys ) > 0 ) thread_yield();
+
+            // All loads are delivered, with the right data, highest priority first
+            TESTFW_EXPECTED( test_assetsys_threaded_count == TEST_ASSETSYS_THREADED_LOADS );
+            for( int i = 0; i < TEST_ASSETSYS_THREADED_LOADS; ++i ) {
+                TESTFW_EXPECTED( test_assetsys_threaded_order[ i ] == TEST_ASSETSYS_THREADED_LOADS - 1 - i );
+            }
+
+            assetsys_destroy( assetsys );
+            for( int i = 0; i < TEST_ASSETSYS_THREADED_LOADS; ++i ) free( buffers[ i ] );
+            assetsys_internal_mz_free( NULL, zip_data );
+            }
+        TESTFW_TEST_END();
+    #endif
+
+    TESTFW_TEST_BEGIN( "Test streaming file in chunks" );
+        {
+        assetsys_t* assetsys = assetsys_create( 0 );
+        TESTFW_EXPECTED( assetsys_mount_from_memory( assetsys, test_assetsys_data, test_assetsys_data_size, "/data" ) == ASSETSYS_SUCCESS );
+
+        assetsys_file_t file;
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/data/test.txt", &file ) == ASSETSYS_SUCCESS );
+        assetsys_stream_t* stream = NULL;
+        TESTFW_EXPECTED( assetsys_stream_open( assetsys, file, &stream ) == ASSETSYS_SUCCESS );
+
+        // Read the file five bytes at a time
+        char content[ 16 ];
+        int size = 0;
+        for( int count = 1; count > 0; size += count ) {
+            count = assetsys_stream_read( stream, content + size, 5 );
+            TESTFW_EXPECTED( count >= 0 );
+        }
+        TESTFW_EXPECTED( size == 14 );
+        TESTFW_EXPECTED( memcmp( content, "Hello, World!", 13 ) == 0 );
+
+        // Seek back and read again
+        TESTFW_EXPECTED( assetsys_stream_seek( stream, 7 ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_stream_read( stream, content, 5 ) == 5 );
+        TESTFW_EXPECTED( memcmp( content, "World", 5 ) == 0 );
+        TESTFW_EXPECTED( assetsys_stream_tell( stream ) == 12 );
+        TESTFW_EXPECTED( assetsys_stream_seek( stream, 15 ) == ASSETSYS_ERROR_INVALID_PARAMETER );
+
+        assetsys_stream_close( stream );
+        assetsys_destroy( assetsys );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test streaming deflated file from memory" );
+        {
+        // Deflate a file larger than the stream's read buffer, and stream it from a zip mounted from memory
+        mz_zip_archive zip;
+        memset( &zip, 0, sizeof( zip ) );
+        zip.m_pAlloc = assetsys_internal_mz_alloc; // miniz is built without its own allocation functions
+        zip.m_pRealloc = assetsys_internal_mz_realloc;
+        zip.m_pFree = assetsys_internal_mz_free;
+        TESTFW_EXPECTED( mz_zip_writer_init_heap( &zip, 0, 0 ) );
+        int const content_size = 256 * 1024;
+        char* content = (char*) malloc( (size_t) content_size );
+        for( int i = 0; i < content_size; ++i ) content[ i ] = (char)( 'a' + ( i * 7 + i / 997 ) % 26 );
+        TESTFW_EXPECTED( mz_zip_writer_add_mem( &zip, "big.txt", content, (size_t) content_size, MZ_DEFAULT_LEVEL ) );
+        void* zip_data = NULL;
+        size_t zip_size = 0;
+        TESTFW_EXPECTED( mz_zip_writer_finalize_heap_archive( &zip, &zip_data, &zip_size ) );
+        mz_zip_writer_end( &zip );
+
+        assetsys_t* assetsys = assetsys_create( 0 );
+        TESTFW_EXPECTED( assetsys_mount_from_memory( assetsys, zip_data, (int) zip_size, "/data" ) == ASSETSYS_SUCCESS );
+
+        assetsys_file_t file;
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/data/big.txt", &file ) == ASSETSYS_SUCCESS );
+        assetsys_stream_t* stream = NULL;
+        TESTFW_EXPECTED( assetsys_stream_open( assetsys, file, &stream ) == ASSETSYS_SUCCESS );
+
+        char* streamed = (char*) malloc( (size_t) content_size );
+        int size = 0;
+        for( int count = 1; count > 0; size += count ) {
+            count = assetsys_stream_read( stream, streamed + size, content_size - size < 5000 ? content_size - size : 5000 );
+            TESTFW_EXPECTED( count >= 0 );
+        }
+        TESTFW_EXPECTED( size == content_size );
+        TESTFW_EXPECTED( memcmp( streamed, content, (size_t) content_size ) == 0 );
+
+        // Seeking backwards restarts the inflator on the same data
+        TESTFW_EXPECTED( assetsys_stream_seek( stream, 100000 ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_stream_read( stream, streamed, 1000 ) == 1000 );
+        TESTFW_EXPECTED( memcmp( streamed, content + 100000, 1000 ) == 0 );
+
+        assetsys_stream_close( stream );
+        assetsys_destroy( assetsys );
+        free( streamed );
+        free( content );
+        assetsys_internal_mz_free( NULL, zip_data );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test loading LZ4 compressed file" );
+        {
+        // Zip file with a lz4.bin file containing "abcd" repeated 16 times, compressed with LZ4
+        unsigned char lz4_data[] = {
+            0x50, 0x4b, 0x03, 0x04, 0x3f, 0x00, 0x00, 0x00, 0x34, 0x4c, 0x00, 0x00, 0x21, 0x00, 0x22, 0x56,
+            0x20, 0xee, 0x0e, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x07, 0x00, 0x00, 0x00, 0x6c, 0x7a,
+            0x34, 0x2e, 0x62, 0x69, 0x6e, 0x4f, 0x61, 0x62, 0x63, 0x64, 0x04, 0x00, 0x24, 0x50, 0x64, 0x61,
+            0x62, 0x63, 0x64, 0x50, 0x4b, 0x01, 0x02, 0x3f, 0x00, 0x3f, 0x00, 0x00, 0x00, 0x34, 0x4c, 0x00,
+            0x00, 0x21, 0x00, 0x22, 0x56, 0x20, 0xee, 0x0e, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x00, 0x07,
+            0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+            0x00, 0x6c, 0x7a, 0x34, 0x2e, 0x62, 0x69, 0x6e, 0x50, 0x4b, 0x05, 0x06, 0x00, 0x00, 0x00, 0x00,
+            0x01, 0x00, 0x01, 0x00, 0x35, 0x00, 0x00, 0x00, 0x33, 0x00, 0x00, 0x00, 0x00, 0x00,
+        };
+        char expected[ 65 ] = "abcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcdabcd";
+
+        assetsys_t* assetsys = assetsys_create( 0 );
+        TESTFW_EXPECTED( assetsys_mount_from_memory( assetsys, lz4_data, sizeof( lz4_data ), "/data" ) == ASSETSYS_SUCCESS );
+
+        assetsys_file_t file;
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/data/lz4.bin", &file ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_file_size( assetsys, file ) == 64 );
+        char content[ 64 ];
+        int size = 0;
+        TESTFW_EXPECTED( assetsys_file_load( assetsys, file, &size, content, sizeof( content ) ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( size == 64 );
+        TESTFW_EXPECTED( memcmp( content, expected, 64 ) == 0 );
+
+        // Streams decode the whole file when opened
+        assetsys_stream_t* stream = NULL;
+        TESTFW_EXPECTED( assetsys_stream_open( assetsys, file, &stream ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_stream_seek( stream, 60 ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_stream_read( stream, content, 16 ) == 4 );
+        TESTFW_EXPECTED( memcmp( content, "abcd", 4 ) == 0 );
+        assetsys_stream_close( stream );
+        TESTFW_EXPECTED( assetsys_dismount( assetsys, "data", "/data" ) == ASSETSYS_SUCCESS );
+
+        // A match offset pointing before the start of the output is rejected
+        lz4_data[ 42 ] = 0x09;
+        TESTFW_EXPECTED( assetsys_mount_from_memory( assetsys, lz4_data, sizeof( lz4_data ), "/data" ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_file( assetsys, "/data/lz4.bin", &file ) == ASSETSYS_SUCCESS );
+        TESTFW_EXPECTED( assetsys_file_load( assetsys, file, &size, content, sizeof( content ) ) == ASSETSYS_ERROR_FAILED_TO_READ_FILE );
+
+        assetsys_destroy( assetsys );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test watching directory mount" );
+        {
+        assetsys_t* assetsys = assetsys_create( 0 );
+        #ifdef __linux__
+            // Work in a fresh directory under the system temp directory, so runs don't see each other's files
+            char const* temp = getenv( "TMPDIR" );
+            char dir[ 256 ];
+            snprintf( dir, sizeof( dir ), "%s/assetsys_watch_XXXXXX", temp && *temp ? temp : "/tmp" );
+            TESTFW_EXPECTED( mkdtemp( dir ) != NULL );
+            char a_path[ 300 ], sub_path[ 300 ], b_path[ 300 ];
+            snprintf( a_path, sizeof( a_path ), "%s/a.txt", dir );
+            snprintf( sub_path, sizeof( sub_path ), "%s/sub", dir );
+            snprintf( b_path, sizeof( b_path ), "%s/sub/b.txt", dir );
+
+            TESTFW_EXPECTED( assetsys_mount( assetsys, dir, "/watch" ) == ASSETSYS_SUCCESS );
+            TESTFW_EXPECTED( assetsys_watch( assetsys, dir, "/watch" ) == ASSETSYS_SUCCESS );
+            TESTFW_EXPECTED( assetsys_file_count( assetsys, "/watch" ) == 0 );
+
+            // Added files and folders show up after the next update
+            FILE* fp = fopen( a_path, "wb" );
+            TESTFW_EXPECTED( fp != NULL );
+            if( fp ) { fwrite( "Hello", 1, 5, fp ); fclose( fp ); }
+            mkdir( sub_path, 0755 );
+            fp = fopen( b_path, "wb" );
+            TESTFW_EXPECTED( fp != NULL );
+            if( fp ) fclose( fp );
+            TESTFW_EXPECTED( assetsys_watch_update( assetsys ) > 0 );
+            TESTFW_EXPECTED( assetsys_file_count( assetsys, "/watch" ) == 1 );
+            TESTFW_EXPECTED( assetsys_subdir_count( assetsys, "/watch" ) == 1 );
+            TESTFW_EXPECTED( assetsys_file_count( assetsys, "/watch/sub" ) == 1 );
+            assetsys_file_t file;
+            TESTFW_EXPECTED( assetsys_file( assetsys, "/watch/a.txt", &file ) == ASSETSYS_SUCCESS );
+            TESTFW_EXPECTED( assetsys_file_size( assetsys, file ) == 5 );
+
+            // Size changes are picked up
+            fp = fopen( a_path, "ab" );
+            TESTFW_EXPECTED( fp != NULL );
+            if( fp ) { fwrite( ", World!", 1, 8, fp ); fclose( fp ); }
+            TESTFW_EXPECTED( assetsys_watch_update( assetsys ) > 0 );
+            TESTFW_EXPECTED( assetsys_file( assetsys, "/watch/a.txt", &file ) == ASSETSYS_SUCCESS );
+            TESTFW_EXPECTED( assetsys_file_size( assetsys, file ) == 13 );
+            TESTFW_EXPECTED( assetsys_watch_update( assetsys ) == 0 );
+
+            // Removed files and folders are gone after the next update
+            remove( a_path );
+            remove( b_path );
+            rmdir( sub_path );
+            TESTFW_EXPECTED( assetsys_watch_update( assetsys ) > 0 );
+            TESTFW_EXPECTED( assetsys_file( assetsys, "/watch/a.txt", &file ) == ASSETSYS_ERROR_FILE_NOT_FOUND );
+            TESTFW_EXPECTED( assetsys_file_count( assetsys, "/watch" ) == 0 );
+            TESTFW_EXPECTED( assetsys_subdir_count( assetsys, "/watch" ) == 0 );
+
+            TESTFW_EXPECTED( assetsys_dismount( assetsys, dir, "/watch" ) == ASSETSYS_SUCCESS );
+
+            // Clean up whatever is left, also when a step above failed
+            remove( a_path );
+            remove( b_path );
+            rmdir( sub_path );
+            rmdir( dir );
+        #else
+            TESTFW_EXPECTED( assetsys_mount( assetsys, ".", "/data" ) == ASSETSYS_SUCCESS );
+            TESTFW_EXPECTED( assetsys_watch( assetsys, ".", "/data" ) == ASSETSYS_ERROR_NOT_SUPPORTED );
+        #endif
+        assetsys_destroy( assetsys );
+        }
+    TESTFW_TEST_END();
 }
 
 
@@ -6545,6 +10367,11 @@ int main( int argc, char** argv ) {
 #define TESTFW_IMPLEMENTATION
 #include "testfw.h"
 
+#ifdef ASSETSYS_ASYNC
+    #define THREAD_IMPLEMENTATION
+    #include "thread.h"
+#endif
+
 #endif /* ASSETSYS_RUN_TESTS */
 
 
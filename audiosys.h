@@ -8,6 +8,43 @@ audiosys.h - v0.1 - Sound and music playback (mixing only) for C/C++.
 Do this:
 	#define AUDIOSYS_IMPLEMENTATION
 before you include this file in *one* C/C++ file to create the implementation.
+
+Voices are mixed and converted to 16-bit with SSE2 or NEON when the compiler targets them. To use the plain C loops 
+instead, do this before including the implementation:
+	#define AUDIOSYS_NO_SIMD
+
+To call audiosys functions on one thread while audiosys_render runs on another (the audio callback, typically), do 
+this before including the implementation:
+	#define AUDIOSYS_THREADED
+Calls are then queued in a lock free queue (with room for AUDIOSYS_COMMAND_QUEUE_SIZE calls, default 1024), and 
+applied at the start of the next audiosys_render, so the audio thread never waits for a lock or allocates memory. When 
+the queue is full, calls are dropped rather than waiting for the audio thread: sources passed to them are released, 
+and audiosys_sound_play returns 0. Sound handles are still returned right away. Getters return the values last set by 
+the calling thread, and sources are released on the calling thread, during later audiosys calls. Position getters call 
+`get_position` of the source while the audio thread might be in `read_samples`. All calls other than audiosys_render 
+must come from the same thread. Requires thread.h, with THREAD_IMPLEMENTATION defined somewhere.
+
+Output is always at 44100 Hz. Sources at other rates set `sample_rate` (0 means 44100), and are resampled with a 
+windowed sinc filter, as are voices with a pitch other than 1. Sounds can use cheaper linear interpolation instead, 
+with audiosys_sound_resample_set. Positions are in seconds of the source, and `read_samples`, `set_position` and 
+`get_position` count sample pairs at the rate of the source.
+
+Voices are mixed on buses: music on AUDIOSYS_BUS_MUSIC, ambience on AUDIOSYS_BUS_AMBIENCE, and sounds on 
+AUDIOSYS_BUS_SOUNDS, or on any other of the AUDIOSYS_BUS_COUNT buses (default 8) with audiosys_sound_bus_set. Each bus 
+has a volume, a low-pass filter and a compressor, and sends to a shared reverb. To mix buses in parallel, do this 
+before including the implementation:
+	#define AUDIOSYS_BUS_THREADS 3
+to have audiosys_create start that many worker threads, which audiosys_render then uses to mix buses alongside the 
+thread calling it, and which audiosys_destroy stops and joins. The output is the same with or without them. Requires 
+thread.h, with THREAD_IMPLEMENTATION defined somewhere.
+
+audiosys_render mixes in blocks of at most AUDIOSYS_BLOCK_SIZE sample pairs (default 1024), into buffers allocated by
+audiosys_create, so it can be called with any number of sample pairs without allocating. Fades and positions count the
+sample pairs rendered, not wall time, so audiosys can render offline, faster than realtime (one second per call, say), 
+and the output is the same every time for the same sequence of calls.
+
+To measure how fast audiosys mixes on a given compiler and platform, build and run the benchmark:
+	clang -O2 -DAUDIOSYS_RUN_BENCHMARK -DAUDIOSYS_IMPLEMENTATION -xc audiosys.h -o benchmark.exe
 */
 
 #ifndef audiosys_h
@@ -30,6 +67,7 @@ typedef struct audiosys_audio_source_t {
 	void (*restart)( void* instance );
 	void (*set_position)( void* instance, int position_in_sample_pairs );
 	int (*get_position)( void* instance );
+	int sample_rate;
 } audiosys_audio_source_t;
 
 
@@ -79,6 +117,8 @@ void audiosys_music_volume_set( audiosys_t* audiosys, float volume );
 float audiosys_music_volume( audiosys_t* audiosys );
 void audiosys_music_pan_set( audiosys_t* audiosys, float pan );
 float audiosys_music_pan( audiosys_t* audiosys );
+void audiosys_music_pitch_set( audiosys_t* audiosys, float pitch );
+float audiosys_music_pitch( audiosys_t* audiosys );
 
 void audiosys_ambience_play( audiosys_t* audiosys, audiosys_audio_source_t source, float fade_in_time );
 void audiosys_ambience_stop( audiosys_t* audiosys, float fade_out_time );
@@ -95,6 +135,8 @@ void audiosys_ambience_volume_set( audiosys_t* audiosys, float volume );
 float audiosys_ambience_volume( audiosys_t* audiosys );
 void audiosys_ambience_pan_set( audiosys_t* audiosys, float pan );
 float audiosys_ambience_pan( audiosys_t* audiosys );
+void audiosys_ambience_pitch_set( audiosys_t* audiosys, float pitch );
+float audiosys_ambience_pitch( audiosys_t* audiosys );
 
 AUDIOSYS_U64 audiosys_sound_play( audiosys_t* audiosys, audiosys_audio_source_t source, float priority, float fade_in_time );
 void audiosys_sound_stop( audiosys_t* audiosys, AUDIOSYS_U64 handle, float fade_out_time );
@@ -109,6 +151,16 @@ void audiosys_sound_volume_set( audiosys_t* audiosys, AUDIOSYS_U64 handle, float
 float audiosys_sound_volume( audiosys_t* audiosys, AUDIOSYS_U64 handle );
 void audiosys_sound_pan_set( audiosys_t* audiosys, AUDIOSYS_U64 handle, float pan );
 float audiosys_sound_pan( audiosys_t* audiosys, AUDIOSYS_U64 handle );
+void audiosys_sound_pitch_set( audiosys_t* audiosys, AUDIOSYS_U64 handle, float pitch );
+float audiosys_sound_pitch( audiosys_t* audiosys, AUDIOSYS_U64 handle );
+
+typedef enum audiosys_resample_t {
+	AUDIOSYS_RESAMPLE_SINC,
+	AUDIOSYS_RESAMPLE_LINEAR,
+} audiosys_resample_t;
+
+void audiosys_sound_resample_set( audiosys_t* audiosys, AUDIOSYS_U64 handle, audiosys_resample_t resample );
+audiosys_resample_t audiosys_sound_resample( audiosys_t* audiosys, AUDIOSYS_U64 handle );
 
 
 typedef enum audiosys_sound_valid_t {
@@ -118,6 +170,34 @@ typedef enum audiosys_sound_valid_t {
 
 audiosys_sound_valid_t audiosys_sound_valid(audiosys_t* audiosys, AUDIOSYS_U64 handle );
 
+
+#define AUDIOSYS_BUS_MUSIC 0
+#define AUDIOSYS_BUS_AMBIENCE 1
+#define AUDIOSYS_BUS_SOUNDS 2
+
+#ifndef AUDIOSYS_BUS_COUNT
+	#define AUDIOSYS_BUS_COUNT 8
+#endif
+
+void audiosys_sound_bus_set( audiosys_t* audiosys, AUDIOSYS_U64 handle, int bus );
+int audiosys_sound_bus( audiosys_t* audiosys, AUDIOSYS_U64 handle );
+
+void audiosys_bus_volume_set( audiosys_t* audiosys, int bus, float volume );
+float audiosys_bus_volume( audiosys_t* audiosys, int bus );
+void audiosys_bus_low_pass_set( audiosys_t* audiosys, int bus, float cutoff_frequency );
+float audiosys_bus_low_pass( audiosys_t* audiosys, int bus );
+void audiosys_bus_reverb_send_set( audiosys_t* audiosys, int bus, float send );
+float audiosys_bus_reverb_send( audiosys_t* audiosys, int bus );
+void audiosys_bus_compressor_set( audiosys_t* audiosys, int bus, float threshold_db, float ratio, float attack_time, float release_time );
+float audiosys_bus_compressor_threshold( audiosys_t* audiosys, int bus );
+float audiosys_bus_compressor_ratio( audiosys_t* audiosys, int bus );
+float audiosys_bus_compressor_attack( audiosys_t* audiosys, int bus );
+float audiosys_bus_compressor_release( audiosys_t* audiosys, int bus );
+
+void audiosys_reverb_set( audiosys_t* audiosys, float room_size, float damping );
+float audiosys_reverb_room_size( audiosys_t* audiosys );
+float audiosys_reverb_damping( audiosys_t* audiosys );
+
 #endif /* audiosys_h */
 
 /*
@@ -129,6 +209,12 @@ audiosys_sound_valid_t audiosys_sound_valid(audiosys_t* audiosys, AUDIOSYS_U64 h
 #ifdef AUDIOSYS_IMPLEMENTATION
 #undef AUDIOSYS_IMPLEMENTATION
 
+// The benchmark below times itself with clock_gettime, which strict modes like -std=c99 only declare if this is
+// defined before the first system header, and the implementation includes the first one
+#if defined( AUDIOSYS_RUN_BENCHMARK ) && !defined( _WIN32 ) && !defined( _POSIX_C_SOURCE )
+	#define _POSIX_C_SOURCE 199309L
+#endif
+
 #ifndef AUDIOSYS_MALLOC
 	#define _CRT_NONSTDC_NO_DEPRECATE 
 	#define _CRT_SECURE_NO_WARNINGS
@@ -167,6 +253,48 @@ audiosys_sound_valid_t audiosys_sound_valid(audiosys_t* audiosys, AUDIOSYS_U64 h
 	#define AUDIOSYS_MEMMOVE( dst, src, cnt ) ( memmove((dst), (src), (cnt) ) )
 #endif 
 
+#ifdef AUDIOSYS_THREADED
+	#include "thread.h"
+	#ifndef AUDIOSYS_COMMAND_QUEUE_SIZE
+		#define AUDIOSYS_COMMAND_QUEUE_SIZE 1024
+	#endif
+#endif
+
+#ifndef AUDIOSYS_BUS_THREADS
+	#define AUDIOSYS_BUS_THREADS 0
+#endif
+
+#ifndef AUDIOSYS_BLOCK_SIZE
+	#define AUDIOSYS_BLOCK_SIZE 1024
+#endif
+
+#if AUDIOSYS_BUS_THREADS > 0 && !defined( AUDIOSYS_THREADED )
+	#include "thread.h"
+#endif
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef AUDIOSYS_NO_SIMD
+	#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+		#include <emmintrin.h>
+		#define AUDIOSYS_SIMD_SSE2
+	#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+		#include <arm_neon.h>
+		#define AUDIOSYS_SIMD_NEON
+	#endif
+#endif 
+
+
+#define AUDIOSYS_INTERNAL_RESAMPLE_TAPS 32 // must be a multiple of 4
+#define AUDIOSYS_INTERNAL_RESAMPLE_PHASES 256
+#define AUDIOSYS_INTERNAL_RESAMPLE_CHUNK 1024 // sample pairs read from a source at a time when resampling
+#define AUDIOSYS_INTERNAL_RESAMPLE_ONE ( 1ull << 32ull ) // positions and steps are 32.32 fixed point
+
+#define AUDIOSYS_INTERNAL_REVERB_COMBS 4
+#define AUDIOSYS_INTERNAL_REVERB_ALLPASSES 2
+
 
 typedef struct audiosys_internal_handles_data_t {
 	int index;
@@ -242,20 +370,6 @@ static void audiosys_internal_handles_release( audiosys_internal_handles_t* hand
 }
 
 
-static int audiosys_internal_handles_index( audiosys_internal_handles_t* handles, int handle ) {
-	if( handle >= 0 && handle < handles->count ) {
-		return handles->data[ handle ].index;
-	} else {
-		return -1;
-	}
-}
-
-
-static void audiosys_internal_handles_update( audiosys_internal_handles_t* handles, int handle, int index ) {
-	handles->data[ handle ].index = index;
-}
-
-
 static uint64_t audiosys_internal_to_u64( int handle, int counter ) {
 	uint64_t i = (uint64_t) ( handle + 1 );
 	uint64_t c = (uint64_t) counter;
@@ -302,7 +416,6 @@ typedef struct audiosys_internal_voice_t {
 	AUDIOSYS_U64 handle;
 	audiosys_internal_voice_state_t state;
 	audiosys_audio_source_t source;
-	int initialized;
 	int paused;
 	int loop;
 	float priority;
@@ -310,13 +423,219 @@ typedef struct audiosys_internal_voice_t {
 	float pan;
 	float fade_in_time;
 	float fade_out_time;
-	float fade_progress;
+	int fade_position;
 
 	float current_fade_volume;
 	float current_fade_delta;
+
+	float audibility; // priority * volume, sounds are sorted on this
+	int is_virtual;
+	int virtual_samples; // sample pairs played while virtual, not yet skipped in the source
+	unsigned int virtual_fraction;
+
+	float pitch;
+	int resample_mode;
+	int resampling; // when 0, sample pairs are read straight into the output
+	AUDIOSYS_U64 resample_position; // next output position, in source sample pairs from the start of resample_history
+	float resample_history[ AUDIOSYS_INTERNAL_RESAMPLE_TAPS * 2 ]; // the last sample pairs read from the source
+
+	int bus;
+	int finished; // ended or faded out while mixing, and retired once all buses are mixed
 } audiosys_internal_voice_t;
 
 
+typedef enum audiosys_internal_command_type_t {
+	AUDIOSYS_INTERNAL_COMMAND_MASTER_VOLUME_SET,
+	AUDIOSYS_INTERNAL_COMMAND_GAIN_SET,
+	AUDIOSYS_INTERNAL_COMMAND_PAUSE_ALL,
+	AUDIOSYS_INTERNAL_COMMAND_RESUME_ALL,
+	AUDIOSYS_INTERNAL_COMMAND_STOP_ALL,
+	AUDIOSYS_INTERNAL_COMMAND_PLAY,
+	AUDIOSYS_INTERNAL_COMMAND_STOP,
+	AUDIOSYS_INTERNAL_COMMAND_PAUSE,
+	AUDIOSYS_INTERNAL_COMMAND_RESUME,
+	AUDIOSYS_INTERNAL_COMMAND_SWITCH,
+	AUDIOSYS_INTERNAL_COMMAND_CROSS_FADE,
+	AUDIOSYS_INTERNAL_COMMAND_POSITION_SET,
+	AUDIOSYS_INTERNAL_COMMAND_LOOP_SET,
+	AUDIOSYS_INTERNAL_COMMAND_VOLUME_SET,
+	AUDIOSYS_INTERNAL_COMMAND_PAN_SET,
+	AUDIOSYS_INTERNAL_COMMAND_PITCH_SET,
+	AUDIOSYS_INTERNAL_COMMAND_RESAMPLE_SET,
+	AUDIOSYS_INTERNAL_COMMAND_BUS_SET,
+	AUDIOSYS_INTERNAL_COMMAND_BUS_SETTINGS_SET,
+	AUDIOSYS_INTERNAL_COMMAND_REVERB_SET,
+	AUDIOSYS_INTERNAL_COMMAND_SOUNDS_GROW,
+} audiosys_internal_command_type_t;
+
+
+typedef enum audiosys_internal_target_t {
+	AUDIOSYS_INTERNAL_TARGET_NONE,
+	AUDIOSYS_INTERNAL_TARGET_MUSIC,
+	AUDIOSYS_INTERNAL_TARGET_AMBIENCE,
+	AUDIOSYS_INTERNAL_TARGET_SOUND,
+	AUDIOSYS_INTERNAL_TARGET_BUS,
+} audiosys_internal_target_t;
+
+
+typedef struct audiosys_internal_bus_settings_t {
+	float volume;
+	float low_pass; // cutoff frequency in Hz, 0 when off
+	float reverb_send;
+	float compressor_threshold; // in dB, relative to a voice at full volume
+	float compressor_ratio; // 1 when off
+	float compressor_attack; // in seconds
+	float compressor_release;
+} audiosys_internal_bus_settings_t;
+
+
+struct audiosys_internal_retired_t;
+
+// The arrays indexed by sound or by sound handle, with room for a sound for every handle. audiosys_sound_play replaces
+// them with larger ones when it runs out of handles, so they never need to grow while commands are applied.
+typedef struct audiosys_internal_sound_arrays_t {
+	int capacity;
+	AUDIOSYS_U64* sounds_by_priority;
+	audiosys_internal_voice_t* sounds;
+	int* sounds_map;
+	audiosys_internal_voice_t** bus_voices; // capacity + 4, for the music and ambience voices
+	struct audiosys_internal_retired_t* retired_pending; // only with AUDIOSYS_THREADED
+} audiosys_internal_sound_arrays_t;
+
+
+// A call to one of the functions which change the playback state. They are all applied through 
+// audiosys_internal_execute, which runs on the audio thread when AUDIOSYS_THREADED is defined.
+typedef struct audiosys_internal_command_t {
+	audiosys_internal_command_type_t type;
+	audiosys_internal_target_t target;
+	AUDIOSYS_U64 handle;
+	audiosys_audio_source_t source;
+	float value;
+	float time; // fade in time, or fade out time for switch
+	int loop;
+	audiosys_internal_bus_settings_t bus;
+	audiosys_internal_sound_arrays_t* arrays; // for AUDIOSYS_INTERNAL_COMMAND_SOUNDS_GROW
+} audiosys_internal_command_t;
+
+
+#ifdef AUDIOSYS_THREADED
+
+// Single producer, single consumer queue. `head` is only advanced by the consumer and `tail` only by the producer, and
+// both keep counting past the capacity, so the number of queued elements is always tail - head.
+typedef struct audiosys_internal_ring_t {
+	char* data;
+	int element_size;
+	int capacity;
+	thread_atomic_int_t head;
+	thread_atomic_int_t tail;
+} audiosys_internal_ring_t;
+
+
+static void audiosys_internal_ring_init( audiosys_internal_ring_t* ring, int element_size, int capacity, void* memctx ) {
+	AUDIOSYS_ASSERT( capacity > 0 && ( capacity & ( capacity - 1 ) ) == 0, "Queue size must be a power of two" );
+	(void) memctx;
+	ring->data = (char*) AUDIOSYS_MALLOC( memctx, (size_t) element_size * capacity );
+	ring->element_size = element_size;
+	ring->capacity = capacity;
+	thread_atomic_int_store( &ring->head, 0 );
+	thread_atomic_int_store( &ring->tail, 0 );
+}
+
+
+static int audiosys_internal_ring_push( audiosys_internal_ring_t* ring, void const* element ) {
+	unsigned int head = (unsigned int) thread_atomic_int_load( &ring->head );
+	unsigned int tail = (unsigned int) thread_atomic_int_load( &ring->tail );
+	if( tail - head >= (unsigned int) ring->capacity ) {
+		return 0;
+	}
+	AUDIOSYS_MEMCPY( ring->data + ( tail & ( ring->capacity - 1 ) ) * ring->element_size, element, ring->element_size );
+	thread_atomic_int_inc( &ring->tail ); // publishes the element
+	return 1;
+}
+
+
+static int audiosys_internal_ring_pop( audiosys_internal_ring_t* ring, void* element ) {
+	unsigned int head = (unsigned int) thread_atomic_int_load( &ring->head );
+	unsigned int tail = (unsigned int) thread_atomic_int_load( &ring->tail );
+	if( tail == head ) {
+		return 0;
+	}
+	AUDIOSYS_MEMCPY( element, ring->data + ( head & ( ring->capacity - 1 ) ) * ring->element_size, ring->element_size );
+	thread_atomic_int_inc( &ring->head ); // hands the slot back to the producer
+	return 1;
+}
+
+
+// A source, sound handle or replaced arrays the audio thread is done with, to be released on the calling thread
+typedef struct audiosys_internal_retired_t {
+	AUDIOSYS_U64 handle;
+	int removed;
+	audiosys_audio_source_t source;
+	audiosys_internal_sound_arrays_t* arrays;
+} audiosys_internal_retired_t;
+
+
+// State as seen by the calling thread: the values it has set, and the sources which have not been released yet
+typedef struct audiosys_internal_game_t {
+	float master_volume;
+	float gain;
+	int paused;
+	audiosys_internal_voice_t music;
+	audiosys_internal_voice_t ambience;
+	audiosys_internal_voice_t* sounds; // indexed by handle, same capacity as sounds_handles
+	int sounds_capacity;
+	audiosys_internal_bus_settings_t buses[ AUDIOSYS_BUS_COUNT ];
+	float reverb_room_size;
+	float reverb_damping;
+} audiosys_internal_game_t;
+
+#endif /* AUDIOSYS_THREADED */
+
+
+// Voices are mixed into the buffers of a bus, and its effects applied, by one thread at a time. Everything the mixing 
+// code writes to is in here or in the voices of the bus, so buses can be mixed in parallel.
+typedef struct audiosys_internal_bus_t {
+	audiosys_internal_bus_settings_t settings;
+	int first_voice; // range in audiosys->bus_voices to mix this block
+	int voice_count;
+	float low_pass_state[ 4 ]; // two per channel
+	float compressor_envelope;
+	float* mixing_buffer;
+	float* sample_buffer;
+	float resample_buffer[ ( AUDIOSYS_INTERNAL_RESAMPLE_CHUNK + AUDIOSYS_INTERNAL_RESAMPLE_TAPS ) * 2 ];
+} audiosys_internal_bus_t;
+
+
+// Freeverb style: parallel lowpass feedback combs followed by allpasses, with slightly longer delays on the right
+typedef struct audiosys_internal_reverb_t {
+	float room_size;
+	float damping;
+	int tail; // sample pairs left before the reverb has died out, after the last send
+	float* memory;
+	float* combs[ 2 ][ AUDIOSYS_INTERNAL_REVERB_COMBS ];
+	int comb_lengths[ 2 ][ AUDIOSYS_INTERNAL_REVERB_COMBS ];
+	int comb_positions[ 2 ][ AUDIOSYS_INTERNAL_REVERB_COMBS ];
+	float comb_filters[ 2 ][ AUDIOSYS_INTERNAL_REVERB_COMBS ];
+	float* allpasses[ 2 ][ AUDIOSYS_INTERNAL_REVERB_ALLPASSES ];
+	int allpass_lengths[ 2 ][ AUDIOSYS_INTERNAL_REVERB_ALLPASSES ];
+	int allpass_positions[ 2 ][ AUDIOSYS_INTERNAL_REVERB_ALLPASSES ];
+	float* input; // mono sum of the sends, one per sample pair
+	float* output; // one channel of the reverb, before it is added to the mix
+} audiosys_internal_reverb_t;
+
+
+#if AUDIOSYS_BUS_THREADS > 0
+
+typedef struct audiosys_internal_worker_t {
+	audiosys_t* audiosys;
+	thread_ptr_t thread;
+	thread_signal_t start;
+	thread_signal_t done;
+} audiosys_internal_worker_t;
+
+#endif
+
+
 struct audiosys_t {
 	void* memctx;
 
@@ -339,10 +658,40 @@ struct audiosys_t {
 	AUDIOSYS_U64* sounds_by_priority;
 	audiosys_internal_voice_t* sounds;
 	audiosys_internal_handles_t sounds_handles;
+	int sounds_map_capacity;
+	int* sounds_map; // index into `sounds` for each handle, or -1
 	
-	int mixing_buffer_size;
 	float* mixing_buffer;
-	float* sample_buffer;
+
+	float* resample_kernel; // RESAMPLE_TAPS coefficients for each phase
+	float* resample_kernel_delta; // difference to the coefficients of the next phase
+
+	audiosys_internal_bus_t buses[ AUDIOSYS_BUS_COUNT ];
+	int bus_voices_capacity;
+	audiosys_internal_voice_t** bus_voices; // the voices to mix this block, grouped by bus
+	int bus_jobs[ AUDIOSYS_BUS_COUNT ]; // the buses with voices to mix this block
+	int bus_jobs_count;
+	int bus_jobs_sample_pairs;
+	audiosys_internal_reverb_t reverb;
+
+	#if AUDIOSYS_BUS_THREADS > 0
+		audiosys_internal_worker_t workers[ AUDIOSYS_BUS_THREADS ];
+		int workers_exit;
+		thread_atomic_int_t next_job; // counts up forever, and the jobs of this block are numbered from bus_jobs_base
+		int bus_jobs_base;
+	#endif
+
+	#ifdef AUDIOSYS_THREADED
+		audiosys_internal_ring_t commands;
+		audiosys_internal_ring_t retired;
+		// Used by the audio thread when the retired queue is full. Each sound handle is retired at most twice (source
+		// and handle) before the calling thread can reuse it, and other sources and arrays only come from commands,
+		// which are fewer than the queue holds, so 2 * sounds_capacity + 8 more is enough for it never to overflow.
+		int retired_pending_count;
+		int retired_pending_capacity;
+		audiosys_internal_retired_t* retired_pending;
+		audiosys_internal_game_t game;
+	#endif
 };
 
 
@@ -359,6 +708,191 @@ static void audiosys_internal_release_source( audiosys_audio_source_t* source )
 }
 
 
+static audiosys_internal_sound_arrays_t* audiosys_internal_sound_arrays_create( int capacity, void* memctx ) {
+	(void) memctx;
+	audiosys_internal_sound_arrays_t* arrays = (audiosys_internal_sound_arrays_t*) AUDIOSYS_MALLOC( memctx, sizeof( audiosys_internal_sound_arrays_t ) );
+	arrays->capacity = capacity;
+	arrays->sounds_by_priority = (AUDIOSYS_U64*) AUDIOSYS_MALLOC( memctx, sizeof( AUDIOSYS_U64 ) * capacity );
+	arrays->sounds = (audiosys_internal_voice_t*) AUDIOSYS_MALLOC( memctx, sizeof( audiosys_internal_voice_t ) * capacity );
+	arrays->sounds_map = (int*) AUDIOSYS_MALLOC( memctx, sizeof( int ) * capacity );
+	arrays->bus_voices = (audiosys_internal_voice_t**) AUDIOSYS_MALLOC( memctx, sizeof( audiosys_internal_voice_t* ) * ( capacity + 4 ) );
+	#ifdef AUDIOSYS_THREADED
+		arrays->retired_pending = (audiosys_internal_retired_t*) AUDIOSYS_MALLOC( memctx, sizeof( audiosys_internal_retired_t ) * ( capacity * 2 + 8 ) );
+	#else
+		arrays->retired_pending = NULL;
+	#endif
+	return arrays;
+}
+
+
+static void audiosys_internal_sound_arrays_destroy( audiosys_internal_sound_arrays_t* arrays, void* memctx ) {
+	(void) memctx;
+	if( arrays->sounds_by_priority ) {
+		AUDIOSYS_FREE( memctx, arrays->sounds_by_priority );
+		AUDIOSYS_FREE( memctx, arrays->sounds );
+		AUDIOSYS_FREE( memctx, arrays->sounds_map );
+		AUDIOSYS_FREE( memctx, arrays->bus_voices );
+	}
+	if( arrays->retired_pending ) {
+		AUDIOSYS_FREE( memctx, arrays->retired_pending );
+	}
+	AUDIOSYS_FREE( memctx, arrays );
+}
+
+
+// Moves the sounds into the (larger) arrays, and leaves the arrays it used before in `arrays`. Called by the audio 
+// thread, between blocks, so this only copies and never allocates.
+static void audiosys_internal_sound_arrays_swap( audiosys_t* audiosys, audiosys_internal_sound_arrays_t* arrays ) {
+	if( audiosys->sounds_count > 0 ) {
+		AUDIOSYS_MEMCPY( arrays->sounds_by_priority, audiosys->sounds_by_priority, sizeof( AUDIOSYS_U64 ) * audiosys->sounds_count );
+		AUDIOSYS_MEMCPY( arrays->sounds, audiosys->sounds, sizeof( audiosys_internal_voice_t ) * audiosys->sounds_count );
+	}
+	if( audiosys->sounds_map_capacity > 0 ) {
+		AUDIOSYS_MEMCPY( arrays->sounds_map, audiosys->sounds_map, sizeof( int ) * audiosys->sounds_map_capacity );
+	}
+	for( int i = audiosys->sounds_map_capacity; i < arrays->capacity; ++i ) {
+		arrays->sounds_map[ i ] = -1;
+	}
+
+	audiosys_internal_sound_arrays_t old;
+	old.capacity = audiosys->sounds_capacity;
+	old.sounds_by_priority = audiosys->sounds_by_priority;
+	old.sounds = audiosys->sounds;
+	old.sounds_map = audiosys->sounds_map;
+	old.bus_voices = audiosys->bus_voices; // filled in again for every block, so nothing to copy
+	old.retired_pending = NULL;
+
+	audiosys->sounds_capacity = arrays->capacity;
+	audiosys->sounds_by_priority = arrays->sounds_by_priority;
+	audiosys->sounds = arrays->sounds;
+	audiosys->sounds_map_capacity = arrays->capacity;
+	audiosys->sounds_map = arrays->sounds_map;
+	audiosys->bus_voices_capacity = arrays->capacity + 4;
+	audiosys->bus_voices = arrays->bus_voices;
+
+	#ifdef AUDIOSYS_THREADED
+		if( audiosys->retired_pending_count > 0 ) {
+			AUDIOSYS_MEMCPY( arrays->retired_pending, audiosys->retired_pending, sizeof( audiosys_internal_retired_t ) * audiosys->retired_pending_count );
+		}
+		old.retired_pending = audiosys->retired_pending;
+		audiosys->retired_pending_capacity = arrays->capacity * 2 + 8;
+		audiosys->retired_pending = arrays->retired_pending;
+	#endif
+
+	*arrays = old;
+}
+
+
+#ifdef AUDIOSYS_THREADED
+
+// Hands something back to the calling thread, through the pending list if the retired queue is full
+static void audiosys_internal_retired_push( audiosys_t* audiosys, audiosys_internal_retired_t const* retired ) {
+	if( audiosys->retired_pending_count > 0 || !audiosys_internal_ring_push( &audiosys->retired, retired ) ) {
+		AUDIOSYS_ASSERT( audiosys->retired_pending_count < audiosys->retired_pending_capacity, "Retired queue overflow" );
+		if( audiosys->retired_pending_count < audiosys->retired_pending_capacity ) {
+			audiosys->retired_pending[ audiosys->retired_pending_count++ ] = *retired;
+		}
+	}
+}
+
+#endif /* AUDIOSYS_THREADED */
+
+
+// Called by the audio thread when it is done with the source of a voice, and with `removed` set when a sound is 
+// removed and its handle can be reused. With AUDIOSYS_THREADED, both are passed back to the calling thread, so that 
+// sources are never released while the calling thread might still be using them.
+static void audiosys_internal_retire( audiosys_t* audiosys, audiosys_internal_voice_t* voice, int removed ) {
+	#ifdef AUDIOSYS_THREADED
+		if( removed || voice->source.read_samples ) {
+			audiosys_internal_retired_t retired;
+			AUDIOSYS_MEMSET( &retired, 0, sizeof( retired ) );
+			retired.handle = voice->handle;
+			retired.removed = removed;
+			retired.source = voice->source;
+			audiosys_internal_retired_push( audiosys, &retired );
+		}
+		AUDIOSYS_MEMSET( &voice->source, 0, sizeof( voice->source ) );
+	#else
+		audiosys_internal_release_source( &voice->source );
+		if( removed ) {
+			audiosys_internal_handles_release( &audiosys->sounds_handles, audiosys_internal_handles_from_u64( &audiosys->sounds_handles, voice->handle ) );
+		}
+	#endif
+}
+
+
+// Builds the windowed sinc filter for each fractional position between two sample pairs. Tap t is at sample pair
+// t - ( TAPS / 2 - 1 ) relative to the integer part of the position, and the taps of each phase are scaled to sum to 1.
+static void audiosys_internal_resample_kernel( float* kernel, float* delta ) {
+	double const pi = 3.14159265358979323846;
+	double const cutoff = 0.85; // relative to the nyquist frequency of the source
+	int const half = AUDIOSYS_INTERNAL_RESAMPLE_TAPS / 2;
+	double phase_kernel[ AUDIOSYS_INTERNAL_RESAMPLE_TAPS ];
+	for( int p = 0; p <= AUDIOSYS_INTERNAL_RESAMPLE_PHASES; ++p ) {
+		double fraction = p / (double) AUDIOSYS_INTERNAL_RESAMPLE_PHASES;
+		double sum = 0.0;
+		for( int t = 0; t < AUDIOSYS_INTERNAL_RESAMPLE_TAPS; ++t ) {
+			double x = ( t - ( half - 1 ) ) - fraction;
+			double sinc = x == 0.0 ? 1.0 : sin( pi * cutoff * x ) / ( pi * cutoff * x );
+			double w = ( x + half ) / ( 2.0 * half ); // blackman-harris window over [-half, half]
+			double window = 0.35875 - 0.48829 * cos( 2.0 * pi * w ) + 0.14128 * cos( 4.0 * pi * w ) - 0.01168 * cos( 6.0 * pi * w );
+			phase_kernel[ t ] = sinc * window;
+			sum += phase_kernel[ t ];
+		}
+		for( int t = 0; t < AUDIOSYS_INTERNAL_RESAMPLE_TAPS; ++t ) {
+			float k = (float)( phase_kernel[ t ] / sum );
+			if( p < AUDIOSYS_INTERNAL_RESAMPLE_PHASES ) {
+				kernel[ p * AUDIOSYS_INTERNAL_RESAMPLE_TAPS + t ] = k;
+			}
+			if( p > 0 ) {
+				delta[ ( p - 1 ) * AUDIOSYS_INTERNAL_RESAMPLE_TAPS + t ] = k - kernel[ ( p - 1 ) * AUDIOSYS_INTERNAL_RESAMPLE_TAPS + t ];
+			}
+		}
+	}
+}
+
+
+static void audiosys_internal_reverb_init( audiosys_internal_reverb_t* reverb, void* memctx ) {
+	(void) memctx;
+	int const comb_lengths[ AUDIOSYS_INTERNAL_REVERB_COMBS ] = { 1116, 1188, 1277, 1356 };
+	int const allpass_lengths[ AUDIOSYS_INTERNAL_REVERB_ALLPASSES ] = { 556, 441 };
+	int const spread = 23;
+
+	int size = 0;
+	for( int c = 0; c < 2; ++c ) {
+		for( int i = 0; i < AUDIOSYS_INTERNAL_REVERB_COMBS; ++i ) {
+			reverb->comb_lengths[ c ][ i ] = comb_lengths[ i ] + c * spread;
+			size += reverb->comb_lengths[ c ][ i ];
+		}
+		for( int i = 0; i < AUDIOSYS_INTERNAL_REVERB_ALLPASSES; ++i ) {
+			reverb->allpass_lengths[ c ][ i ] = allpass_lengths[ i ] + c * spread;
+			size += reverb->allpass_lengths[ c ][ i ];
+		}
+	}
+	reverb->memory = (float*) AUDIOSYS_MALLOC( memctx, sizeof( float ) * size );
+	AUDIOSYS_MEMSET( reverb->memory, 0, sizeof( float ) * size );
+
+	float* memory = reverb->memory;
+	for( int c = 0; c < 2; ++c ) {
+		for( int i = 0; i < AUDIOSYS_INTERNAL_REVERB_COMBS; ++i ) {
+			reverb->combs[ c ][ i ] = memory;
+			memory += reverb->comb_lengths[ c ][ i ];
+		}
+		for( int i = 0; i < AUDIOSYS_INTERNAL_REVERB_ALLPASSES; ++i ) {
+			reverb->allpasses[ c ][ i ] = memory;
+			memory += reverb->allpass_lengths[ c ][ i ];
+		}
+	}
+	reverb->room_size = 0.5f;
+	reverb->damping = 0.5f;
+}
+
+
+#if AUDIOSYS_BUS_THREADS > 0
+	static int audiosys_internal_worker_proc( void* user_data );
+#endif
+
+
 audiosys_t* audiosys_create( int active_voice_count, void* memctx ) {
 	audiosys_t* audiosys = (audiosys_t*) AUDIOSYS_MALLOC( memctx, sizeof( audiosys_t ) );
 	AUDIOSYS_MEMSET( audiosys, 0, sizeof( audiosys_t ) );
@@ -373,26 +907,112 @@ audiosys_t* audiosys_create( int active_voice_count, void* memctx ) {
 
 	audiosys->music.volume = 1.0f;
 	audiosys->music.loop = true;
+	audiosys->music.pitch = 1.0f;
 	audiosys->music_crossfade.volume = 1.0f;
 	audiosys->music_crossfade.loop = true;
+	audiosys->music_crossfade.pitch = 1.0f;
 
 	audiosys->ambience.volume = 1.0f;
 	audiosys->ambience.loop = true;
+	audiosys->ambience.pitch = 1.0f;
 	audiosys->ambience_crossfade.volume = 1.0f;
 	audiosys->ambience_crossfade.loop = true;
+	audiosys->ambience_crossfade.pitch = 1.0f;
+
+	int kernel_size = AUDIOSYS_INTERNAL_RESAMPLE_PHASES * AUDIOSYS_INTERNAL_RESAMPLE_TAPS;
+	audiosys->resample_kernel = (float*) AUDIOSYS_MALLOC( memctx, sizeof( float ) * kernel_size );
+	audiosys->resample_kernel_delta = (float*) AUDIOSYS_MALLOC( memctx, sizeof( float ) * kernel_size );
+	audiosys_internal_resample_kernel( audiosys->resample_kernel, audiosys->resample_kernel_delta );
+
+	for( int i = 0; i < AUDIOSYS_BUS_COUNT; ++i ) {
+		audiosys->buses[ i ].settings.volume = 1.0f;
+		audiosys->buses[ i ].settings.compressor_threshold = 0.0f;
+		audiosys->buses[ i ].settings.compressor_ratio = 1.0f;
+		audiosys->buses[ i ].settings.compressor_attack = 0.01f;
+		audiosys->buses[ i ].settings.compressor_release = 0.1f;
+	}
+	audiosys_internal_reverb_init( &audiosys->reverb, memctx );
+
+	int block_size = AUDIOSYS_BLOCK_SIZE;
+	audiosys->mixing_buffer = (float*) AUDIOSYS_MALLOC( memctx, block_size * sizeof( float ) * 2 );
+	audiosys->reverb.input = (float*) AUDIOSYS_MALLOC( memctx, block_size * sizeof( float ) );
+	audiosys->reverb.output = (float*) AUDIOSYS_MALLOC( memctx, block_size * sizeof( float ) );
+	for( int i = 0; i < AUDIOSYS_BUS_COUNT; ++i ) {
+		audiosys->buses[ i ].mixing_buffer = (float*) AUDIOSYS_MALLOC( memctx, block_size * sizeof( float ) * 2 );
+		audiosys->buses[ i ].sample_buffer = (float*) AUDIOSYS_MALLOC( memctx, block_size * sizeof( float ) * 2 );
+	}
+
+	#if AUDIOSYS_BUS_THREADS > 0
+		for( int i = 0; i < AUDIOSYS_BUS_THREADS; ++i ) {
+			audiosys_internal_worker_t* worker = &audiosys->workers[ i ];
+			worker->audiosys = audiosys;
+			thread_signal_init( &worker->start );
+			thread_signal_init( &worker->done );
+			worker->thread = thread_create( audiosys_internal_worker_proc, worker, THREAD_STACK_SIZE_DEFAULT );
+		}
+	#endif
 
-	audiosys->sounds_capacity = 64;
 	audiosys->sounds_count = 0;
-	audiosys->sounds_by_priority = (AUDIOSYS_U64*) AUDIOSYS_MALLOC( memctx, sizeof( AUDIOSYS_U64 ) * audiosys->sounds_capacity );
-	AUDIOSYS_MEMSET( audiosys->sounds_by_priority, 0, sizeof( AUDIOSYS_U64 ) * audiosys->sounds_capacity );
-	audiosys->sounds = (audiosys_internal_voice_t*) AUDIOSYS_MALLOC( memctx, sizeof( audiosys_internal_voice_t ) * audiosys->sounds_capacity );
-	audiosys_internal_handles_init( &audiosys->sounds_handles, audiosys->sounds_capacity, memctx );   
+	audiosys_internal_handles_init( &audiosys->sounds_handles, 64, memctx );   
+	audiosys_internal_sound_arrays_t* arrays = audiosys_internal_sound_arrays_create( audiosys->sounds_handles.capacity, memctx );
+	audiosys_internal_sound_arrays_swap( audiosys, arrays );
+	audiosys_internal_sound_arrays_destroy( arrays, memctx ); // holds no arrays, as there were none before
+
+	#ifdef AUDIOSYS_THREADED
+		audiosys_internal_ring_init( &audiosys->commands, sizeof( audiosys_internal_command_t ), AUDIOSYS_COMMAND_QUEUE_SIZE, memctx );
+		audiosys_internal_ring_init( &audiosys->retired, sizeof( audiosys_internal_retired_t ), AUDIOSYS_COMMAND_QUEUE_SIZE, memctx );
+		audiosys->game.master_volume = audiosys->master_volume;
+		audiosys->game.gain = audiosys->gain;
+		audiosys->game.paused = audiosys->paused;
+		audiosys->game.music = audiosys->music;
+		audiosys->game.ambience = audiosys->ambience;
+		audiosys->game.sounds_capacity = audiosys->sounds_handles.capacity;
+		audiosys->game.sounds = (audiosys_internal_voice_t*) AUDIOSYS_MALLOC( memctx, sizeof( audiosys_internal_voice_t ) * audiosys->game.sounds_capacity );
+		for( int i = 0; i < AUDIOSYS_BUS_COUNT; ++i ) {
+			audiosys->game.buses[ i ] = audiosys->buses[ i ].settings;
+		}
+		audiosys->game.reverb_room_size = audiosys->reverb.room_size;
+		audiosys->game.reverb_damping = audiosys->reverb.damping;
+	#endif
 
 	return audiosys;
 }
 
 
+static void audiosys_internal_execute( audiosys_t* audiosys, audiosys_internal_command_t const* command );
+
+#ifdef AUDIOSYS_THREADED
+	static void audiosys_internal_collect( audiosys_t* audiosys );
+#endif
+
+
 void audiosys_destroy( audiosys_t* audiosys ) {
+	#if AUDIOSYS_BUS_THREADS > 0
+		audiosys->workers_exit = 1;
+		for( int i = 0; i < AUDIOSYS_BUS_THREADS; ++i ) {
+			thread_signal_raise( &audiosys->workers[ i ].start );
+			thread_join( audiosys->workers[ i ].thread );
+			thread_destroy( audiosys->workers[ i ].thread );
+			thread_signal_term( &audiosys->workers[ i ].start );
+			thread_signal_term( &audiosys->workers[ i ].done );
+		}
+	#endif
+
+	#ifdef AUDIOSYS_THREADED
+		// Apply the calls the audio thread never got to, so that the sources passed to them are released below
+		audiosys_internal_command_t command;
+		while( audiosys_internal_ring_pop( &audiosys->commands, &command ) ) {
+			audiosys_internal_execute( audiosys, &command );
+		}
+		audiosys_internal_collect( audiosys );
+		for( int i = 0; i < audiosys->retired_pending_count; ++i ) {
+			audiosys_internal_release_source( &audiosys->retired_pending[ i ].source );
+			if( audiosys->retired_pending[ i ].arrays ) {
+				audiosys_internal_sound_arrays_destroy( audiosys->retired_pending[ i ].arrays, audiosys->memctx );
+			}
+		}
+	#endif
+
 	audiosys_internal_release_source( &audiosys->music.source );
 	audiosys_internal_release_source( &audiosys->music_crossfade.source );
 	audiosys_internal_release_source( &audiosys->ambience.source );
@@ -404,41 +1024,51 @@ void audiosys_destroy( audiosys_t* audiosys ) {
 	audiosys_internal_handles_term( &audiosys->sounds_handles );
 	AUDIOSYS_FREE( audiosys->memctx, audiosys->sounds_by_priority );
 	AUDIOSYS_FREE( audiosys->memctx, audiosys->sounds );
+	AUDIOSYS_FREE( audiosys->memctx, audiosys->sounds_map );
 
-	if( audiosys->mixing_buffer ) {
-		AUDIOSYS_FREE( audiosys->memctx, audiosys->mixing_buffer );
-	}
+	AUDIOSYS_FREE( audiosys->memctx, audiosys->mixing_buffer );
+
+	AUDIOSYS_FREE( audiosys->memctx, audiosys->resample_kernel );
+	AUDIOSYS_FREE( audiosys->memctx, audiosys->resample_kernel_delta );
 
-	if( audiosys->sample_buffer ) {
-		AUDIOSYS_FREE( audiosys->memctx, audiosys->sample_buffer );
+	for( int i = 0; i < AUDIOSYS_BUS_COUNT; ++i ) {
+		AUDIOSYS_FREE( audiosys->memctx, audiosys->buses[ i ].mixing_buffer );
+		AUDIOSYS_FREE( audiosys->memctx, audiosys->buses[ i ].sample_buffer );
 	}
+	if( audiosys->bus_voices ) {
+		AUDIOSYS_FREE( audiosys->memctx, audiosys->bus_voices );
+	}
+	AUDIOSYS_FREE( audiosys->memctx, audiosys->reverb.memory );
+	AUDIOSYS_FREE( audiosys->memctx, audiosys->reverb.input );
+	AUDIOSYS_FREE( audiosys->memctx, audiosys->reverb.output );
+
+	#ifdef AUDIOSYS_THREADED
+		AUDIOSYS_FREE( audiosys->memctx, audiosys->commands.data );
+		AUDIOSYS_FREE( audiosys->memctx, audiosys->retired.data );
+		if( audiosys->retired_pending ) {
+			AUDIOSYS_FREE( audiosys->memctx, audiosys->retired_pending );
+		}
+		AUDIOSYS_FREE( audiosys->memctx, audiosys->game.sounds );
+	#endif
 
 	AUDIOSYS_FREE( audiosys->memctx, audiosys );
 }
 
 
 static audiosys_internal_voice_t* audiosys_internal_get_sound( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
-	int index = audiosys_internal_handles_index( &audiosys->sounds_handles, audiosys_internal_handles_from_u64( &audiosys->sounds_handles, handle ) );
-	if( index < 0 ) { 
+	int slot = audiosys_internal_u64_to_handle( handle );
+	if( slot < 0 || slot >= audiosys->sounds_map_capacity || audiosys->sounds_map[ slot ] < 0 ) { 
 		return 0;
 	}
-	return &audiosys->sounds[ index ];
+	audiosys_internal_voice_t* sound = &audiosys->sounds[ audiosys->sounds_map[ slot ] ];
+	return sound->handle == handle ? sound : 0;
 }
 
 
-static AUDIOSYS_U64 audiosys_internal_add_sound( audiosys_t* audiosys, audiosys_internal_voice_t** sound, float priority ) {
-	if( audiosys->sounds_count >= audiosys->sounds_capacity ) {
-		int new_capacity = audiosys->sounds_capacity * 2;
-		AUDIOSYS_U64* new_sounds_by_priority = (AUDIOSYS_U64*) AUDIOSYS_MALLOC( memctx, sizeof( AUDIOSYS_U64 ) * new_capacity );
-		audiosys_internal_voice_t* new_sounds = (audiosys_internal_voice_t*) AUDIOSYS_MALLOC( memctx, sizeof( audiosys_internal_voice_t ) * new_capacity );
-		AUDIOSYS_MEMCPY( new_sounds_by_priority, audiosys->sounds_by_priority, sizeof( AUDIOSYS_U64 ) * audiosys->sounds_count );
-		AUDIOSYS_MEMCPY( new_sounds, audiosys->sounds, sizeof( audiosys_internal_voice_t ) * audiosys->sounds_count );
-		AUDIOSYS_FREE( audiosys->memctx, audiosys->sounds_by_priority );
-		AUDIOSYS_FREE( audiosys->memctx, audiosys->sounds );
-		audiosys->sounds_capacity = new_capacity;
-		audiosys->sounds_by_priority = new_sounds_by_priority;
-		audiosys->sounds = new_sounds;
-	}
+static audiosys_internal_voice_t* audiosys_internal_add_sound( audiosys_t* audiosys, AUDIOSYS_U64 handle, float priority ) {
+	// audiosys_sound_play made room for a sound for every handle before queuing this, so there is no need to grow here
+	int slot = audiosys_internal_u64_to_handle( handle );
+	AUDIOSYS_ASSERT( audiosys->sounds_count < audiosys->sounds_capacity && slot < audiosys->sounds_map_capacity, "Sound arrays too small" );
 
 	int index = audiosys->sounds_count;
 	if( audiosys->sounds_count > 0 ) {
@@ -447,7 +1077,7 @@ static AUDIOSYS_U64 audiosys_internal_add_sound( audiosys_t* audiosys, audiosys_
 		while( min_index <= max_index ) {
 			int center = ( max_index - min_index ) / 2 + min_index;
 			audiosys_internal_voice_t* snd = audiosys_internal_get_sound( audiosys, audiosys->sounds_by_priority[ center ] );
-			float center_prio = snd->priority;
+			float center_prio = snd->audibility;
 			if( center_prio <= priority ) {
 				max_index = center - 1;
 			} else {
@@ -458,28 +1088,23 @@ static AUDIOSYS_U64 audiosys_internal_add_sound( audiosys_t* audiosys, audiosys_
 	}
 	
 	++audiosys->sounds_count;
-	*sound = &audiosys->sounds[ audiosys->sounds_count - 1 ];
-	AUDIOSYS_U64 handle = audiosys_internal_handles_to_u64( &audiosys->sounds_handles, audiosys_internal_handles_alloc( &audiosys->sounds_handles, audiosys->sounds_count - 1 ) );
+	audiosys->sounds_map[ slot ] = audiosys->sounds_count - 1;
 
 	for( int i = audiosys->sounds_count - 1; i > index ; --i ) {
 		audiosys->sounds_by_priority[ i ] = audiosys->sounds_by_priority[ i - 1 ];
 	}
 
 	audiosys->sounds_by_priority[ index ] = handle;
-	return handle;
+	return &audiosys->sounds[ audiosys->sounds_count - 1 ];
 }
 
 	
 static void audiosys_internal_remove_sound( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
-	int index = audiosys_internal_handles_index( &audiosys->sounds_handles, audiosys_internal_handles_from_u64( &audiosys->sounds_handles, handle ) );
-	if( index < 0 ) {
+	audiosys_internal_voice_t* sound_to_remove = audiosys_internal_get_sound( audiosys, handle );
+	if( !sound_to_remove ) {
 		return;
 	}
 
-	audiosys_internal_handles_release( &audiosys->sounds_handles, audiosys_internal_handles_from_u64( &audiosys->sounds_handles, handle ) );
-	audiosys_internal_voice_t* sound_to_remove = &audiosys->sounds[ index ];
-	audiosys_internal_release_source( &sound_to_remove->source );
-
 	for( int j = 0; j < audiosys->sounds_count; ++j ) {
 		if( audiosys->sounds_by_priority[ j ] == handle ) {
 			for( int i = j; i < audiosys->sounds_count - 1; ++i ) {
@@ -489,15 +1114,26 @@ static void audiosys_internal_remove_sound( audiosys_t* audiosys, AUDIOSYS_U64 h
 		}
 	}
 
-	audiosys_internal_voice_t* last_sound = &audiosys->sounds[ audiosys->sounds_count - 1 ];
-	audiosys_internal_handles_update( &audiosys->sounds_handles, audiosys_internal_handles_from_u64( &audiosys->sounds_handles, last_sound->handle ), index );
+	audiosys->sounds_map[ audiosys_internal_u64_to_handle( handle ) ] = -1;
+	audiosys_internal_retire( audiosys, sound_to_remove, 1 );
 	--audiosys->sounds_count;
 
-	*sound_to_remove = *last_sound;
+	audiosys_internal_voice_t* last_sound = &audiosys->sounds[ audiosys->sounds_count ];
+	if( sound_to_remove != last_sound ) {
+		*sound_to_remove = *last_sound;
+		audiosys->sounds_map[ audiosys_internal_u64_to_handle( last_sound->handle ) ] = (int)( sound_to_remove - audiosys->sounds );
+	}
 }
 	
 
-void audiosys_internal_update_fading( audiosys_internal_voice_t* voice, float delta_time ) {
+static int audiosys_internal_fade_length( float fade_time ) {
+	int length = (int)( fade_time * 44100.0f + 0.5f );
+	return length < 1 ? 1 : length;
+}
+
+
+// Fades are counted in sample pairs rendered, so they don't depend on how rendering is split into blocks
+void audiosys_internal_update_fading( audiosys_internal_voice_t* voice, int sample_pairs_count ) {
 	if( !voice ) {
 		return;
 	}
@@ -505,31 +1141,25 @@ void audiosys_internal_update_fading( audiosys_internal_voice_t* voice, float de
 	float fade_volume = 1.0f;
 	float fade_delta = 0.0f;
 	if( voice->state == AUDIOSYS_INTERNAL_VOICE_STATE_FADING_OUT && voice->fade_out_time > 0.0f ) {
-		voice->fade_progress -= delta_time / voice->fade_out_time;
-		if( voice->fade_progress <= 0.0f ) {
-			voice->fade_progress = 0.0f;
+		int length = audiosys_internal_fade_length( voice->fade_out_time );
+		if( voice->fade_position >= length ) {
 			voice->state = AUDIOSYS_INTERNAL_VOICE_STATE_STOPPED;
 			fade_volume = 0.0f;
-			audiosys_internal_release_source( &voice->source );
+			voice->finished = 1;
 		} else {
-			float volume_dec_per_second = 1.0f / voice->fade_out_time;
-			float volume_dec_per_sample = volume_dec_per_second / 44100.0f;
-			fade_volume = voice->fade_progress;
-			fade_volume = fade_volume < 0.0f ? 0.0f : fade_volume > 1.0f ? 1.0f : fade_volume;			
-			fade_delta = -volume_dec_per_sample;
+			fade_volume = 1.0f - voice->fade_position / (float) length;
+			fade_delta = -1.0f / length;
+			voice->fade_position += sample_pairs_count;
 		}
 	} else if( voice->state == AUDIOSYS_INTERNAL_VOICE_STATE_FADING_IN && voice->fade_in_time > 0.0f ) {
-		voice->fade_progress += delta_time / voice->fade_in_time;
-		if( voice->fade_progress >= 1.0f ) {				
-			voice->fade_progress = 1.0f;
+		int length = audiosys_internal_fade_length( voice->fade_in_time );
+		if( voice->fade_position >= length ) {
 			voice->state = AUDIOSYS_INTERNAL_VOICE_STATE_PLAYING;
 			fade_volume = 1.0f;
-			} else {
-			float volume_inc_per_second = 1.0f / voice->fade_in_time;
-			float volume_inc_per_sample = volume_inc_per_second / 44100.0f;
-			fade_volume = voice->fade_progress;
-			fade_volume = fade_volume < 0.0f ? 0.0f : fade_volume > 1.0f ? 1.0f : fade_volume;			
-			fade_delta = volume_inc_per_sample;
+		} else {
+			fade_volume = voice->fade_position / (float) length;
+			fade_delta = 1.0f / length;
+			voice->fade_position += sample_pairs_count;
 		}
 	}
 
@@ -538,22 +1168,17 @@ void audiosys_internal_update_fading( audiosys_internal_voice_t* voice, float de
 }
 
 
-void audiosys_internal_update_from_source( audiosys_t* audiosys, audiosys_internal_voice_t* voice, float* output_sample_pairs, int sample_pairs_count ) {
-	int samples_to_write = sample_pairs_count;
-	if( !voice->initialized ) {
-		audiosys_internal_update_fading( voice, 0.0f );
-		voice->initialized = 1;
-	} else {        
-		audiosys_internal_update_fading( voice, sample_pairs_count / 44100.0f );
-	}
-
-	if( !voice->source.read_samples || voice->state == AUDIOSYS_INTERNAL_VOICE_STATE_STOPPED ) {
+// Reads from the source of a voice, restarting it if it loops. When a source ends, the voice is finished and the rest 
+// of the output is silent.
+static void audiosys_internal_read_source( audiosys_internal_voice_t* voice, float* output_sample_pairs, int sample_pairs_count ) {
+	if( !voice->source.read_samples || voice->finished ) {
 		AUDIOSYS_MEMSET( output_sample_pairs, 0, sample_pairs_count * sizeof( float ) * 2 );
 		return;
 	}
 
 	float* out = output_sample_pairs;
-	int count_written = voice->source.read_samples( voice->source.instance, out, samples_to_write );
+	int samples_to_write = sample_pairs_count;
+	int count_written = samples_to_write > 0 ? voice->source.read_samples( voice->source.instance, out, samples_to_write ) : 0;
 	out += count_written * 2;
 	while( count_written < samples_to_write ) {
 		if( voice->loop && voice->source.restart ) {
@@ -562,7 +1187,7 @@ void audiosys_internal_update_from_source( audiosys_t* audiosys, audiosys_intern
 			out += written * 2;
 			count_written += written;
 		} else {
-			audiosys_internal_release_source( &voice->source );
+			voice->finished = 1;
 			for( int i = 0; i < ( samples_to_write - count_written ) * 2; ++i ) {
 				out[ i ] = 0.0f;	
 			}
@@ -571,210 +1196,675 @@ void audiosys_internal_update_from_source( audiosys_t* audiosys, audiosys_intern
 	}
 }
 
-   
-void audiosys_internal_mix_voice( audiosys_t* audiosys, audiosys_internal_voice_t* voice, float* sample_pairs, int sample_pairs_count ) {
-	if( !voice ) {
-		return;
+
+// Source sample pairs per output sample pair, in 32.32 fixed point
+static AUDIOSYS_U64 audiosys_internal_resample_step( audiosys_internal_voice_t const* voice ) {
+	int sample_rate = voice->source.sample_rate > 0 ? voice->source.sample_rate : 44100;
+	if( sample_rate == 44100 && voice->pitch == 1.0f ) {
+		return AUDIOSYS_INTERNAL_RESAMPLE_ONE;
 	}
+	double step = ( sample_rate / 44100.0 ) * voice->pitch;
+	double max_step = AUDIOSYS_INTERNAL_RESAMPLE_CHUNK / 2; // at least one output sample pair for each chunk read
+	step = step > max_step ? max_step : step;
+	return (AUDIOSYS_U64)( step * (double) AUDIOSYS_INTERNAL_RESAMPLE_ONE );
+}
 
-	audiosys_internal_update_from_source( audiosys, voice, sample_pairs, sample_pairs_count );
 
-	float fade_volume = voice->current_fade_volume;
-	float fade_delta = voice->current_fade_delta;
+// Forgets the sample pairs read so far, for when the source has moved
+static void audiosys_internal_resample_reset( audiosys_internal_voice_t* voice ) {
+	voice->resampling = 0;
+	voice->resample_position = 0;
+	AUDIOSYS_MEMSET( voice->resample_history, 0, sizeof( voice->resample_history ) );
+}
 
-	if( voice->pan < 0.0f && fade_delta != 0.0f ) {
-		float a = -voice->pan; 
-		float ia = 1.0f - a;
-		for( int i = 0; i < sample_pairs_count; ++i ) {
-		    float l = sample_pairs[ i * 2 + 0 ];
-		    float r = sample_pairs[ i * 2 + 1 ];
-			float left = l + a * r;
-			float right = r * ia;
-		    left *= voice->volume * fade_volume * audiosys->master_volume;
-		    right *= voice->volume * fade_volume * audiosys->master_volume;
-		    audiosys->mixing_buffer[ i * 2 + 0 ] += left;
-		    audiosys->mixing_buffer[ i * 2 + 1 ] += right;
-			fade_volume += fade_delta;
-			fade_volume = fade_volume < 0.0f ? 0.0f : fade_volume > 1.0f ? 1.0f : fade_volume;			
-		}
-	} else if( voice->pan > 0.0f && fade_delta != 0.0f ) {
-		float a = voice->pan;
-		float ia = 1.0f - a;
-		for( int i = 0; i < sample_pairs_count; ++i ) {
-		    float l = sample_pairs[ i * 2 + 0 ];
-		    float r = sample_pairs[ i * 2 + 1 ];
-			float right = l * a + r;
-			float left = l * ia;
-		    left *= voice->volume * fade_volume * audiosys->master_volume;
-		    right *= voice->volume * fade_volume * audiosys->master_volume;
-		    audiosys->mixing_buffer[ i * 2 + 0 ] += left;
-		    audiosys->mixing_buffer[ i * 2 + 1 ] += right;
-			fade_volume += fade_delta;
-			fade_volume = fade_volume < 0.0f ? 0.0f : fade_volume > 1.0f ? 1.0f : fade_volume;			
-		}
-	} else if( voice->pan < 0.0f && fade_delta == 0.0f ) {
-		float a = -voice->pan; 
-		float ia = 1.0f - a;
-		for( int i = 0; i < sample_pairs_count; ++i ) {
-		    float l = sample_pairs[ i * 2 + 0 ];
-		    float r = sample_pairs[ i * 2 + 1 ];
-			float left = l + a * r;
-			float right = r * ia;
-		    left *= voice->volume * fade_volume * audiosys->master_volume;
-		    right *= voice->volume * fade_volume * audiosys->master_volume;
-		    audiosys->mixing_buffer[ i * 2 + 0 ] += left;
-		    audiosys->mixing_buffer[ i * 2 + 1 ] += right;
-		}
-	} else if( voice->pan > 0.0f && fade_delta == 0.0f ) {
-		float a = voice->pan;
-		float ia = 1.0f - a;
-		for( int i = 0; i < sample_pairs_count; ++i ) {
-		    float l = sample_pairs[ i * 2 + 0 ];
-		    float r = sample_pairs[ i * 2 + 1 ];
-			float right = l * a + r;
-			float left = l * ia;
-		    left *= voice->volume * fade_volume * audiosys->master_volume;
-		    right *= voice->volume * fade_volume * audiosys->master_volume;
-		    audiosys->mixing_buffer[ i * 2 + 0 ] += left;
-		    audiosys->mixing_buffer[ i * 2 + 1 ] += right;
-		}
-	} else if( voice->pan == 0.0f && fade_delta != 0.0f ) {
-		for( int i = 0; i < sample_pairs_count; ++i ) {
-		    float left = sample_pairs[ i * 2 + 0 ];
-		    float right = sample_pairs[ i * 2 + 1 ];
-		    left *= voice->volume * fade_volume * audiosys->master_volume;
-		    right *= voice->volume * fade_volume * audiosys->master_volume;
-		    audiosys->mixing_buffer[ i * 2 + 0 ] += left;
-		    audiosys->mixing_buffer[ i * 2 + 1 ] += right;
-			fade_volume += fade_delta;
-			fade_volume = fade_volume < 0.0f ? 0.0f : fade_volume > 1.0f ? 1.0f : fade_volume;			
-		}
-	} else if( voice->pan == 0.0f && fade_delta == 0.0f ) {
-		for( int i = 0; i < sample_pairs_count; ++i ) {
-		    float left = sample_pairs[ i * 2 + 0 ];
-		    float right = sample_pairs[ i * 2 + 1 ];
-		    left *= voice->volume * fade_volume * audiosys->master_volume;
-		    right *= voice->volume * fade_volume * audiosys->master_volume;
-		    audiosys->mixing_buffer[ i * 2 + 0 ] += left;
-		    audiosys->mixing_buffer[ i * 2 + 1 ] += right;
-		}
-	} else {
-		AUDIOSYS_ASSERT( false, "Invalid mix parameters" );
+
+// Filters `input` at `position`, `position` + `step` and so on, for `count` output sample pairs. For each, the kernels 
+// for the two nearest phases are blended, and applied to the TAPS sample pairs around the position.
+static void audiosys_internal_resample_sinc( audiosys_t* audiosys, float const* input, AUDIOSYS_U64 position, AUDIOSYS_U64 step, float* output, int count ) {
+	int const taps = AUDIOSYS_INTERNAL_RESAMPLE_TAPS;
+	for( int i = 0; i < count; ++i, position += step ) {
+		float const* in = input + ( (int)( position >> 32ull ) - ( taps / 2 - 1 ) ) * 2;
+		unsigned int fraction = (unsigned int)( position & 0xffffffffull );
+		int phase = (int)( fraction >> 24 );
+		float blend = ( fraction & 0xffffff ) * ( 1.0f / 16777216.0f );
+		float const* kernel = audiosys->resample_kernel + phase * taps;
+		float const* delta = audiosys->resample_kernel_delta + phase * taps;
+		#if defined( AUDIOSYS_SIMD_SSE2 )
+			__m128 b = _mm_set1_ps( blend );
+			__m128 acc0 = _mm_setzero_ps();
+			__m128 acc1 = _mm_setzero_ps();
+			for( int t = 0; t < taps; t += 4 ) {
+				__m128 k = _mm_add_ps( _mm_loadu_ps( kernel + t ), _mm_mul_ps( _mm_loadu_ps( delta + t ), b ) );
+				acc0 = _mm_add_ps( acc0, _mm_mul_ps( _mm_loadu_ps( in + t * 2 ), _mm_unpacklo_ps( k, k ) ) );
+				acc1 = _mm_add_ps( acc1, _mm_mul_ps( _mm_loadu_ps( in + t * 2 + 4 ), _mm_unpackhi_ps( k, k ) ) );
+			}
+			acc0 = _mm_add_ps( acc0, acc1 );
+			acc0 = _mm_add_ps( acc0, _mm_movehl_ps( acc0, acc0 ) );
+			_mm_storel_pi( (__m64*)( output + i * 2 ), acc0 );
+		#elif defined( AUDIOSYS_SIMD_NEON )
+			float32x4_t acc0 = vdupq_n_f32( 0.0f );
+			float32x4_t acc1 = vdupq_n_f32( 0.0f );
+			for( int t = 0; t < taps; t += 4 ) {
+				float32x4_t k = vmlaq_n_f32( vld1q_f32( kernel + t ), vld1q_f32( delta + t ), blend );
+				float32x4x2_t kk = vzipq_f32( k, k );
+				acc0 = vmlaq_f32( acc0, vld1q_f32( in + t * 2 ), kk.val[ 0 ] );
+				acc1 = vmlaq_f32( acc1, vld1q_f32( in + t * 2 + 4 ), kk.val[ 1 ] );
+			}
+			acc0 = vaddq_f32( acc0, acc1 );
+			vst1_f32( output + i * 2, vadd_f32( vget_low_f32( acc0 ), vget_high_f32( acc0 ) ) );
+		#else
+			float left = 0.0f;
+			float right = 0.0f;
+			for( int t = 0; t < taps; ++t ) {
+				float k = kernel[ t ] + delta[ t ] * blend;
+				left += in[ t * 2 + 0 ] * k;
+				right += in[ t * 2 + 1 ] * k;
+			}
+			output[ i * 2 + 0 ] = left;
+			output[ i * 2 + 1 ] = right;
+		#endif
 	}
 }
 
 
-void audiosys_render( audiosys_t* audiosys, AUDIOSYS_S16* output_sample_pairs, int sample_pairs_count ) {
-	if( audiosys->paused ) {
-		AUDIOSYS_MEMSET( output_sample_pairs, 0, sample_pairs_count * sizeof( AUDIOSYS_S16 ) * 2 );
-		return;
+static void audiosys_internal_resample_linear( float const* input, AUDIOSYS_U64 position, AUDIOSYS_U64 step, float* output, int count ) {
+	for( int i = 0; i < count; ++i, position += step ) {
+		float const* in = input + (int)( position >> 32ull ) * 2;
+		float blend = (float)( ( position & 0xffffffffull ) >> 8 ) * ( 1.0f / 16777216.0f );
+		output[ i * 2 + 0 ] = in[ 0 ] + ( in[ 2 ] - in[ 0 ] ) * blend;
+		output[ i * 2 + 1 ] = in[ 1 ] + ( in[ 3 ] - in[ 1 ] ) * blend;
 	}
+}
 
-	if( audiosys->mixing_buffer_size < sample_pairs_count ) {
-		if( audiosys->mixing_buffer ) {
-			AUDIOSYS_FREE( audiosys->memctx, audiosys->mixing_buffer );
-		}
-		if( audiosys->sample_buffer ) {
-			AUDIOSYS_FREE( audiosys->memctx, audiosys->sample_buffer );
+
+// Reads the source in chunks of at most RESAMPLE_CHUNK sample pairs, placed after the history of the voice, and 
+// filters them. The last TAPS sample pairs of each chunk become the new history.
+static void audiosys_internal_resample( audiosys_t* audiosys, audiosys_internal_bus_t* bus, audiosys_internal_voice_t* voice, float* output_sample_pairs, int sample_pairs_count, AUDIOSYS_U64 step ) {
+	int const taps = AUDIOSYS_INTERNAL_RESAMPLE_TAPS;
+	float* buffer = bus->resample_buffer;
+	AUDIOSYS_U64 limit = (AUDIOSYS_U64)( AUDIOSYS_INTERNAL_RESAMPLE_CHUNK + taps / 2 ) << 32ull;
+	while( sample_pairs_count > 0 ) {
+		AUDIOSYS_U64 position = voice->resample_position;
+		AUDIOSYS_U64 fits = ( limit - 1 - position ) / step + 1;
+		int count = fits < (AUDIOSYS_U64) sample_pairs_count ? (int) fits : sample_pairs_count;
+		int end = (int)( ( position + ( count - 1 ) * step ) >> 32ull ) + taps / 2 + 1;
+
+		AUDIOSYS_MEMCPY( buffer, voice->resample_history, sizeof( voice->resample_history ) );
+		audiosys_internal_read_source( voice, buffer + taps * 2, end - taps );
+		if( voice->resample_mode == AUDIOSYS_RESAMPLE_LINEAR ) {
+			audiosys_internal_resample_linear( buffer, position, step, output_sample_pairs, count );
+		} else {
+			audiosys_internal_resample_sinc( audiosys, buffer, position, step, output_sample_pairs, count );
 		}
-		audiosys->mixing_buffer_size = sample_pairs_count;
-		audiosys->mixing_buffer = (float*) AUDIOSYS_MALLOC( audiosys->memctx, sample_pairs_count * sizeof( float ) * 2 );
-		audiosys->sample_buffer = (float*) AUDIOSYS_MALLOC( audiosys->memctx, sample_pairs_count * sizeof( float ) * 2 );
+		AUDIOSYS_MEMCPY( voice->resample_history, buffer + ( end - taps ) * 2, sizeof( voice->resample_history ) );
+		voice->resample_position = position + count * step - ( (AUDIOSYS_U64)( end - taps ) << 32ull );
+
+		output_sample_pairs += count * 2;
+		sample_pairs_count -= count;
 	}
+}
 
-	// remove sounds which have finished playing
-	for( int i = audiosys->sounds_count - 1; i >= 0; --i ) {
-		audiosys_internal_voice_t* voice = &audiosys->sounds[ i ];
-		if( voice->source.read_samples == NULL ) audiosys_internal_remove_sound( audiosys, voice->handle );
+
+// Keeps the last sample pairs read straight from the source, so resampling can start from them if the pitch changes
+static void audiosys_internal_resample_keep( audiosys_internal_voice_t* voice, float const* sample_pairs, int sample_pairs_count ) {
+	int const taps = AUDIOSYS_INTERNAL_RESAMPLE_TAPS;
+	if( sample_pairs_count >= taps ) {
+		AUDIOSYS_MEMCPY( voice->resample_history, sample_pairs + ( sample_pairs_count - taps ) * 2, sizeof( voice->resample_history ) );
+	} else {
+		AUDIOSYS_MEMMOVE( voice->resample_history, voice->resample_history + sample_pairs_count * 2, ( taps - sample_pairs_count ) * sizeof( float ) * 2 );
+		AUDIOSYS_MEMCPY( voice->resample_history + ( taps - sample_pairs_count ) * 2, sample_pairs, sample_pairs_count * sizeof( float ) * 2 );
 	}
+}
 
-	// clear buffer for mixing
-	for( int i = 0; i < sample_pairs_count * 2; ++i ) {
-		audiosys->mixing_buffer[ i ] = 0.0f;
+
+void audiosys_internal_update_from_source( audiosys_t* audiosys, audiosys_internal_bus_t* bus, audiosys_internal_voice_t* voice, float* output_sample_pairs, int sample_pairs_count ) {
+	audiosys_internal_update_fading( voice, sample_pairs_count );
+
+	if( !voice->source.read_samples || voice->finished || voice->state == AUDIOSYS_INTERNAL_VOICE_STATE_STOPPED ) {
+		AUDIOSYS_MEMSET( output_sample_pairs, 0, sample_pairs_count * sizeof( float ) * 2 );
+		return;
 	}
-	
-	// mix all active voices
-	audiosys_internal_mix_voice( audiosys, &audiosys->music, audiosys->sample_buffer, sample_pairs_count );
-	audiosys_internal_mix_voice( audiosys, &audiosys->music_crossfade, audiosys->sample_buffer, sample_pairs_count );
-	audiosys_internal_mix_voice( audiosys, &audiosys->ambience, audiosys->sample_buffer, sample_pairs_count );
-	audiosys_internal_mix_voice( audiosys, &audiosys->ambience_crossfade, audiosys->sample_buffer, sample_pairs_count );
-
-	int sounds_count = audiosys->active_voice_count;
-	for( int i = 0; i < sounds_count; ++i ) {
-	   audiosys_internal_mix_voice( audiosys, audiosys_internal_get_sound( audiosys, audiosys->sounds_by_priority[ i ] ), audiosys->sample_buffer, sample_pairs_count );
-	}
-
-	if( audiosys->use_soft_clip ) {
-		for( int i = 0; i < sample_pairs_count * 2; ++i ) {
-			float s = audiosys->mixing_buffer[ i ];
-			s *= audiosys->gain * 0.5f;
-			s = s < -1.0f ? -2.0f / 3.0f : s > 1.0f ? 2.0f / 3.0f : s - ( s * s * s ) / 3; // soft clip 
-			s *= 32000.0f;
-			output_sample_pairs[ i ] = (AUDIOSYS_S16)( s );
+
+	int const taps = AUDIOSYS_INTERNAL_RESAMPLE_TAPS;
+	AUDIOSYS_U64 step = audiosys_internal_resample_step( voice );
+	if( step == AUDIOSYS_INTERNAL_RESAMPLE_ONE && voice->resampling ) {
+		// Back at the source rate. If on a whole sample pair, play out the history and continue reading straight.
+		int position = (int)( voice->resample_position >> 32ull );
+		int buffered = taps - position;
+		if( ( voice->resample_position & 0xffffffffull ) == 0 && buffered >= 0 && buffered <= sample_pairs_count ) {
+			AUDIOSYS_MEMCPY( output_sample_pairs, voice->resample_history + position * 2, buffered * sizeof( float ) * 2 );
+			audiosys_internal_read_source( voice, output_sample_pairs + buffered * 2, sample_pairs_count - buffered );
+			audiosys_internal_resample_keep( voice, output_sample_pairs, sample_pairs_count );
+			voice->resampling = 0;
+			voice->resample_position = 0;
+			return;
 		}
+	}
+
+	if( step == AUDIOSYS_INTERNAL_RESAMPLE_ONE && !voice->resampling ) {
+		audiosys_internal_read_source( voice, output_sample_pairs, sample_pairs_count );
+		audiosys_internal_resample_keep( voice, output_sample_pairs, sample_pairs_count );
 	} else {
-		for( int i = 0; i < sample_pairs_count * 2; ++i ) {
-			float s = audiosys->mixing_buffer[ i ];
-			s *= audiosys->gain * 0.5f;
-			s = s < -1.0f ? -1.0f : s > 1.0f ? 1.0f : s;
-			s *= 32000.0f;
-			output_sample_pairs[ i ] = (AUDIOSYS_S16)( s );
+		if( !voice->resampling ) {
+			voice->resampling = 1;
+			voice->resample_position += (AUDIOSYS_U64) taps << 32ull; // the fraction is kept from virtual time
 		}
+		audiosys_internal_resample( audiosys, bus, voice, output_sample_pairs, sample_pairs_count, step );
 	}
 }
 
-
-void audiosys_master_volume_set( audiosys_t* audiosys, float volume ) {
-	audiosys->master_volume = volume < 0.0f ? 0.0f : volume > 1.0f ? 1.0f : volume;
+   
+// Mixes stereo sample pairs into the mixing buffer. `pan` is the matrix taking (l, r) to (left, right), as 
+// { l to left, r to left, l to right, r to right }. The gain for pair i is gain + i * gain_step, so a fade is applied 
+// in the same pass.
+static void audiosys_internal_mix_block( float* mix, float const* samples, int count, float const* pan, float gain, float gain_step ) {
+	int i = 0;
+	#if defined( AUDIOSYS_SIMD_SSE2 )
+		__m128 pan_l = _mm_setr_ps( pan[ 0 ], pan[ 2 ], pan[ 0 ], pan[ 2 ] );
+		__m128 pan_r = _mm_setr_ps( pan[ 1 ], pan[ 3 ], pan[ 1 ], pan[ 3 ] );
+		__m128 g = _mm_setr_ps( gain, gain, gain + gain_step, gain + gain_step );
+		__m128 g_step = _mm_set1_ps( gain_step * 2.0f );
+		for( ; i + 2 <= count; i += 2 ) {
+			__m128 s = _mm_loadu_ps( samples + i * 2 );
+			__m128 l = _mm_shuffle_ps( s, s, _MM_SHUFFLE( 2, 2, 0, 0 ) );
+			__m128 r = _mm_shuffle_ps( s, s, _MM_SHUFFLE( 3, 3, 1, 1 ) );
+			__m128 out = _mm_add_ps( _mm_mul_ps( l, pan_l ), _mm_mul_ps( r, pan_r ) );
+			_mm_storeu_ps( mix + i * 2, _mm_add_ps( _mm_loadu_ps( mix + i * 2 ), _mm_mul_ps( out, g ) ) );
+			g = _mm_add_ps( g, g_step );
+		}
+		gain = _mm_cvtss_f32( g );
+	#elif defined( AUDIOSYS_SIMD_NEON )
+		float const steps[ 4 ] = { 0.0f, 1.0f, 2.0f, 3.0f };
+		float32x4_t g = vmlaq_n_f32( vdupq_n_f32( gain ), vld1q_f32( steps ), gain_step );
+		float32x4_t g_step = vdupq_n_f32( gain_step * 4.0f );
+		for( ; i + 4 <= count; i += 4 ) {
+			float32x4x2_t s = vld2q_f32( samples + i * 2 );
+			float32x4x2_t m = vld2q_f32( mix + i * 2 );
+			float32x4_t left = vmlaq_n_f32( vmulq_n_f32( s.val[ 0 ], pan[ 0 ] ), s.val[ 1 ], pan[ 1 ] );
+			float32x4_t right = vmlaq_n_f32( vmulq_n_f32( s.val[ 0 ], pan[ 2 ] ), s.val[ 1 ], pan[ 3 ] );
+			m.val[ 0 ] = vmlaq_f32( m.val[ 0 ], left, g );
+			m.val[ 1 ] = vmlaq_f32( m.val[ 1 ], right, g );
+			vst2q_f32( mix + i * 2, m );
+			g = vaddq_f32( g, g_step );
+		}
+		gain = vgetq_lane_f32( g, 0 );
+	#endif
+	for( ; i < count; ++i ) {
+		float l = samples[ i * 2 + 0 ];
+		float r = samples[ i * 2 + 1 ];
+		mix[ i * 2 + 0 ] += ( l * pan[ 0 ] + r * pan[ 1 ] ) * gain;
+		mix[ i * 2 + 1 ] += ( l * pan[ 2 ] + r * pan[ 3 ] ) * gain;
+		gain += gain_step;
+	}
 }
 
 
-float audiosys_master_volume( audiosys_t* audiosys ) {
-	return audiosys->master_volume;
-}
-
+void audiosys_internal_mix_voice( audiosys_t* audiosys, audiosys_internal_bus_t* bus, audiosys_internal_voice_t* voice, int sample_pairs_count ) {
+	if( !voice || voice->paused ) {
+		return;
+	}
 
-void audiosys_gain_set( audiosys_t* audiosys, float gain ) {
-	audiosys->gain = gain;
-}
+	float* sample_pairs = bus->sample_buffer;
+	audiosys_internal_update_from_source( audiosys, bus, voice, sample_pairs, sample_pairs_count );
 
+	float pan[ 4 ] = { 1.0f, 0.0f, 0.0f, 1.0f };
+	if( voice->pan < 0.0f ) {
+		pan[ 1 ] = -voice->pan;
+		pan[ 3 ] = 1.0f + voice->pan;
+	} else if( voice->pan > 0.0f ) {
+		pan[ 0 ] = 1.0f - voice->pan;
+		pan[ 2 ] = voice->pan;
+	}
 
-float audiosys_gain( audiosys_t* audiosys ) {
-	return audiosys->gain;
+	// The fade moves by a constant step per sample until it reaches 0 or 1, so the block is mixed as a linear ramp 
+	// followed by a constant part, instead of recalculating and clamping the gain for each sample.
+	float gain = voice->volume * audiosys->master_volume;
+	float fade_volume = voice->current_fade_volume;
+	float fade_delta = voice->current_fade_delta;
+	int ramp_count = 0;
+	if( fade_delta != 0.0f ) {
+		float end_volume = fade_delta > 0.0f ? 1.0f : 0.0f;
+		float steps = ( end_volume - fade_volume ) / fade_delta;
+		ramp_count = steps <= 0.0f ? 0 : steps >= (float) sample_pairs_count ? sample_pairs_count : (int) steps;
+		if( ramp_count < sample_pairs_count && (float) ramp_count < steps ) {
+			++ramp_count;
+		}
+		audiosys_internal_mix_block( bus->mixing_buffer, sample_pairs, ramp_count, pan, gain * fade_volume, gain * fade_delta );
+		fade_volume = end_volume;
+	}
+	if( ramp_count < sample_pairs_count && gain * fade_volume != 0.0f ) {
+		audiosys_internal_mix_block( bus->mixing_buffer + ramp_count * 2, sample_pairs + ramp_count * 2, sample_pairs_count - ramp_count, pan, gain * fade_volume, 0.0f );
+	}
 }
 
 
-void audiosys_pause( audiosys_t* audiosys ) {
-	audiosys->paused = 1;
-}
-
+// Second order (12 dB per octave) butterworth low-pass, run separately on each channel
+static void audiosys_internal_low_pass( audiosys_internal_bus_t* bus, int sample_pairs_count ) {
+	float cutoff = bus->settings.low_pass;
+	if( cutoff <= 0.0f || cutoff >= 20000.0f ) {
+		AUDIOSYS_MEMSET( bus->low_pass_state, 0, sizeof( bus->low_pass_state ) );
+		return;
+	}
 
-void audiosys_resume( audiosys_t* audiosys ) {
-	audiosys->paused = 0;
+	double w = 2.0 * 3.14159265358979323846 * ( cutoff < 10.0f ? 10.0f : cutoff ) / 44100.0;
+	double alpha = sin( w ) / ( 2.0 * 0.70710678118654752 );
+	double a0 = 1.0 + alpha;
+	float b0 = (float)( ( 1.0 - cos( w ) ) / 2.0 / a0 );
+	float b1 = (float)( ( 1.0 - cos( w ) ) / a0 );
+	float b2 = b0;
+	float a1 = (float)( -2.0 * cos( w ) / a0 );
+	float a2 = (float)( ( 1.0 - alpha ) / a0 );
+	for( int c = 0; c < 2; ++c ) {
+		float* samples = bus->mixing_buffer + c;
+		float z1 = bus->low_pass_state[ c * 2 + 0 ];
+		float z2 = bus->low_pass_state[ c * 2 + 1 ];
+		for( int i = 0; i < sample_pairs_count; ++i ) {
+			float x = samples[ i * 2 ];
+			float y = b0 * x + z1;
+			z1 = b1 * x - a1 * y + z2;
+			z2 = b2 * x - a2 * y;
+			samples[ i * 2 ] = y;
+		}
+		// flush to zero, so a silent bus does not end up processing denormals
+		bus->low_pass_state[ c * 2 + 0 ] = fabsf( z1 ) < 1e-20f ? 0.0f : z1;
+		bus->low_pass_state[ c * 2 + 1 ] = fabsf( z2 ) < 1e-20f ? 0.0f : z2;
+	}
 }
 
 
-void audiosys_stop_all( audiosys_t* audiosys ) {
-	audiosys_music_stop( audiosys, 0.0f );
-	audiosys_ambience_stop( audiosys, 0.0f );
+// Peak compressor, following the louder of the two channels so the stereo image stays put
+static void audiosys_internal_compressor( audiosys_internal_bus_t* bus, int sample_pairs_count ) {
+	audiosys_internal_bus_settings_t const* settings = &bus->settings;
+	if( settings->compressor_ratio <= 1.0f ) {
+		bus->compressor_envelope = 0.0f;
+		return;
+	}
 
-	for( int i = 0; i < audiosys->sounds_count; ++i ) {
-		audiosys_internal_voice_t* sound = &audiosys->sounds[ i ];
-		sound->state = AUDIOSYS_INTERNAL_VOICE_STATE_STOPPED;
-		audiosys_internal_remove_sound( audiosys, sound->handle );
-		audiosys_internal_release_source( &sound->source );
+	float threshold = powf( 10.0f, settings->compressor_threshold / 20.0f );
+	float attack = settings->compressor_attack > 0.0f ? expf( -1.0f / ( settings->compressor_attack * 44100.0f ) ) : 0.0f;
+	float release = settings->compressor_release > 0.0f ? expf( -1.0f / ( settings->compressor_release * 44100.0f ) ) : 0.0f;
+	float exponent = 1.0f / settings->compressor_ratio - 1.0f;
+	float envelope = bus->compressor_envelope;
+	float* samples = bus->mixing_buffer;
+	for( int i = 0; i < sample_pairs_count; ++i ) {
+		float l = fabsf( samples[ i * 2 + 0 ] );
+		float r = fabsf( samples[ i * 2 + 1 ] );
+		float peak = l > r ? l : r;
+		envelope = peak + ( envelope - peak ) * ( peak > envelope ? attack : release );
+		if( envelope > threshold ) {
+			float gain = powf( envelope / threshold, exponent );
+			samples[ i * 2 + 0 ] *= gain;
+			samples[ i * 2 + 1 ] *= gain;
+		}
+	}
+	bus->compressor_envelope = envelope < 1e-20f ? 0.0f : envelope;
+}
+
+
+// Adds the reverb of `reverb->input` to `mix`. Each comb and allpass runs over the whole block before the next one.
+static void audiosys_internal_reverb( audiosys_internal_reverb_t* reverb, float* mix, int sample_pairs_count ) {
+	float const input_gain = 0.015f;
+	float feedback = reverb->room_size * 0.28f + 0.7f;
+	float damping = reverb->damping * 0.4f;
+	float* output = reverb->output;
+	for( int c = 0; c < 2; ++c ) {
+		AUDIOSYS_MEMSET( output, 0, sample_pairs_count * sizeof( float ) );
+		for( int j = 0; j < AUDIOSYS_INTERNAL_REVERB_COMBS; ++j ) {
+			float* comb = reverb->combs[ c ][ j ];
+			int length = reverb->comb_lengths[ c ][ j ];
+			int position = reverb->comb_positions[ c ][ j ];
+			float filter = reverb->comb_filters[ c ][ j ];
+			for( int i = 0; i < sample_pairs_count; ++i ) {
+				float delayed = comb[ position ];
+				filter = delayed * ( 1.0f - damping ) + filter * damping;
+				comb[ position ] = reverb->input[ i ] * input_gain + filter * feedback;
+				output[ i ] += delayed;
+				if( ++position >= length ) {
+					position = 0;
+				}
+			}
+			reverb->comb_positions[ c ][ j ] = position;
+			reverb->comb_filters[ c ][ j ] = fabsf( filter ) < 1e-20f ? 0.0f : filter;
+		}
+		for( int j = 0; j < AUDIOSYS_INTERNAL_REVERB_ALLPASSES; ++j ) {
+			float* allpass = reverb->allpasses[ c ][ j ];
+			int length = reverb->allpass_lengths[ c ][ j ];
+			int position = reverb->allpass_positions[ c ][ j ];
+			for( int i = 0; i < sample_pairs_count; ++i ) {
+				float delayed = allpass[ position ];
+				allpass[ position ] = output[ i ] + delayed * 0.5f;
+				output[ i ] = delayed - output[ i ];
+				if( ++position >= length ) {
+					position = 0;
+				}
+			}
+			reverb->allpass_positions[ c ][ j ] = position;
+		}
+		for( int i = 0; i < sample_pairs_count; ++i ) {
+			mix[ i * 2 + c ] += output[ i ];
+		}
 	}
 }
 
 
-audiosys_paused_t audiosys_paused( audiosys_t* audiosys ) {
-	return audiosys->paused ? AUDIOSYS_PAUSED : AUDIOSYS_NOT_PAUSED;
+// Scales, clips and converts the mixing buffer to 16-bit samples. The soft clip is the cubic s - s^3/3 on the range 
+// [-1,1], which levels out at +/-2/3, so clamping before it is the same as clipping after.
+static void audiosys_internal_convert( float const* mix, AUDIOSYS_S16* output, int count, float gain, int soft_clip ) {
+	float const third = 1.0f / 3.0f;
+	float const scale = 32000.0f;
+	int i = 0;
+	#if defined( AUDIOSYS_SIMD_SSE2 )
+		__m128 g = _mm_set1_ps( gain );
+		__m128 lo = _mm_set1_ps( -1.0f );
+		__m128 hi = _mm_set1_ps( 1.0f );
+		__m128 t = _mm_set1_ps( third );
+		__m128 sc = _mm_set1_ps( scale );
+		for( ; i + 8 <= count; i += 8 ) {
+			__m128 a = _mm_min_ps( _mm_max_ps( _mm_mul_ps( _mm_loadu_ps( mix + i ), g ), lo ), hi );
+			__m128 b = _mm_min_ps( _mm_max_ps( _mm_mul_ps( _mm_loadu_ps( mix + i + 4 ), g ), lo ), hi );
+			if( soft_clip ) {
+				a = _mm_sub_ps( a, _mm_mul_ps( _mm_mul_ps( _mm_mul_ps( a, a ), a ), t ) );
+				b = _mm_sub_ps( b, _mm_mul_ps( _mm_mul_ps( _mm_mul_ps( b, b ), b ), t ) );
+			}
+			__m128i ia = _mm_cvttps_epi32( _mm_mul_ps( a, sc ) );
+			__m128i ib = _mm_cvttps_epi32( _mm_mul_ps( b, sc ) );
+			_mm_storeu_si128( (__m128i*)( output + i ), _mm_packs_epi32( ia, ib ) );
+		}
+	#elif defined( AUDIOSYS_SIMD_NEON )
+		float32x4_t lo = vdupq_n_f32( -1.0f );
+		float32x4_t hi = vdupq_n_f32( 1.0f );
+		for( ; i + 8 <= count; i += 8 ) {
+			float32x4_t a = vminq_f32( vmaxq_f32( vmulq_n_f32( vld1q_f32( mix + i ), gain ), lo ), hi );
+			float32x4_t b = vminq_f32( vmaxq_f32( vmulq_n_f32( vld1q_f32( mix + i + 4 ), gain ), lo ), hi );
+			if( soft_clip ) {
+				a = vsubq_f32( a, vmulq_n_f32( vmulq_f32( vmulq_f32( a, a ), a ), third ) );
+				b = vsubq_f32( b, vmulq_n_f32( vmulq_f32( vmulq_f32( b, b ), b ), third ) );
+			}
+			int32x4_t ia = vcvtq_s32_f32( vmulq_n_f32( a, scale ) );
+			int32x4_t ib = vcvtq_s32_f32( vmulq_n_f32( b, scale ) );
+			vst1q_s16( (int16_t*)( output + i ), vcombine_s16( vqmovn_s32( ia ), vqmovn_s32( ib ) ) );
+		}
+	#endif
+	for( ; i < count; ++i ) {
+		float s = mix[ i ] * gain;
+		s = s < -1.0f ? -1.0f : s > 1.0f ? 1.0f : s;
+		if( soft_clip ) {
+			s = s - s * s * s * third;
+		}
+		output[ i ] = (AUDIOSYS_S16)( s * scale );
+	}
+}
+
+
+// Sounds which are not among the `active_voice_count` most audible are virtual: they are not read from or mixed, but 
+// their fades still run and the number of sample pairs they have missed is counted, so they can be skipped ahead in the 
+// source if they become audible again. This is cheap enough to keep thousands of sounds alive.
+static void audiosys_internal_virtual_voice( audiosys_internal_voice_t* voice, int sample_pairs_count ) {
+	if( voice->paused ) {
+		return;
+	}
+
+	voice->is_virtual = 1;
+	audiosys_internal_update_fading( voice, sample_pairs_count );
+	if( voice->source.read_samples && !voice->finished ) {
+		AUDIOSYS_U64 advance = sample_pairs_count * audiosys_internal_resample_step( voice ) + voice->virtual_fraction;
+		voice->virtual_samples += (int)( advance >> 32ull );
+		voice->virtual_fraction = (unsigned int)( advance & 0xffffffffull );
+	}
+}
+
+
+// Skips a voice which is becoming audible ahead by the time it was virtual. Sources without `set_position` continue 
+// from where they were, and sources which have ended in the meantime end (or restart, if looping) on the next read.
+static void audiosys_internal_promote_voice( audiosys_internal_voice_t* voice ) {
+	if( !voice->is_virtual ) {
+		return;
+	}
+
+	voice->is_virtual = 0;
+	if( voice->virtual_samples > 0 && voice->source.set_position && voice->source.get_position ) {
+		voice->source.set_position( voice->source.instance, voice->source.get_position( voice->source.instance ) + voice->virtual_samples );
+	}
+	audiosys_internal_resample_reset( voice );
+	voice->resample_position = voice->virtual_fraction;
+	voice->virtual_samples = 0;
+	voice->virtual_fraction = 0;
+}
+
+
+// Keeps `sounds_by_priority` sorted on priority * volume, most audible first. The order rarely changes much between
+// blocks, so an insertion sort from the previous order is close to a single pass over the sounds.
+static void audiosys_internal_sort_sounds( audiosys_t* audiosys ) {
+	for( int i = 0; i < audiosys->sounds_count; ++i ) {
+		audiosys_internal_voice_t* voice = &audiosys->sounds[ i ];
+		voice->audibility = voice->priority * voice->volume;
+	}
+
+	AUDIOSYS_U64* sounds = audiosys->sounds_by_priority;
+	for( int i = 1; i < audiosys->sounds_count; ++i ) {
+		AUDIOSYS_U64 handle = sounds[ i ];
+		float audibility = audiosys_internal_get_sound( audiosys, handle )->audibility;
+		int j = i;
+		while( j > 0 && audiosys_internal_get_sound( audiosys, sounds[ j - 1 ] )->audibility < audibility ) {
+			sounds[ j ] = sounds[ j - 1 ];
+			--j;
+		}
+		sounds[ j ] = handle;
+	}
+}
+
+
+static void audiosys_internal_mix_bus( audiosys_t* audiosys, int index ) {
+	audiosys_internal_bus_t* bus = &audiosys->buses[ index ];
+	int sample_pairs_count = audiosys->bus_jobs_sample_pairs;
+	AUDIOSYS_MEMSET( bus->mixing_buffer, 0, sample_pairs_count * sizeof( float ) * 2 );
+	for( int i = 0; i < bus->voice_count; ++i ) {
+		audiosys_internal_voice_t* voice = audiosys->bus_voices[ bus->first_voice + i ];
+		audiosys_internal_promote_voice( voice );
+		audiosys_internal_mix_voice( audiosys, bus, voice, sample_pairs_count );
+	}
+	audiosys_internal_low_pass( bus, sample_pairs_count );
+	audiosys_internal_compressor( bus, sample_pairs_count );
+}
+
+
+#if AUDIOSYS_BUS_THREADS > 0
+
+static void audiosys_internal_take_jobs( audiosys_t* audiosys ) {
+	for( ; ; ) {
+		unsigned int job = (unsigned int) thread_atomic_int_inc( &audiosys->next_job ) - (unsigned int) audiosys->bus_jobs_base;
+		if( job >= (unsigned int) audiosys->bus_jobs_count ) {
+			return;
+		}
+		audiosys_internal_mix_bus( audiosys, audiosys->bus_jobs[ job ] );
+	}
+}
+
+
+static int audiosys_internal_worker_proc( void* user_data ) {
+	audiosys_internal_worker_t* worker = (audiosys_internal_worker_t*) user_data;
+	audiosys_t* audiosys = worker->audiosys;
+	for( ; ; ) {
+		thread_signal_wait( &worker->start, THREAD_SIGNAL_WAIT_INFINITE );
+		if( audiosys->workers_exit ) {
+			return 0;
+		}
+		audiosys_internal_take_jobs( audiosys );
+		thread_signal_raise( &worker->done );
+	}
+}
+
+#endif /* AUDIOSYS_BUS_THREADS > 0 */
+
+
+// Mixes each bus in `bus_jobs`. Buses only touch their own buffers and voices, so with AUDIOSYS_BUS_THREADS they are 
+// handed out to the workers and the calling thread, which all take the next job until there are none left.
+static void audiosys_internal_mix_buses( audiosys_t* audiosys ) {
+	#if AUDIOSYS_BUS_THREADS > 0
+		if( audiosys->bus_jobs_count > 1 ) {
+			audiosys->bus_jobs_base = thread_atomic_int_load( &audiosys->next_job );
+			int workers = audiosys->bus_jobs_count - 1 < AUDIOSYS_BUS_THREADS ? audiosys->bus_jobs_count - 1 : AUDIOSYS_BUS_THREADS;
+			for( int i = 0; i < workers; ++i ) {
+				thread_signal_raise( &audiosys->workers[ i ].start );
+			}
+			audiosys_internal_take_jobs( audiosys );
+			for( int i = 0; i < workers; ++i ) {
+				thread_signal_wait( &audiosys->workers[ i ].done, THREAD_SIGNAL_WAIT_INFINITE );
+			}
+			return;
+		}
+	#endif
+	for( int i = 0; i < audiosys->bus_jobs_count; ++i ) {
+		audiosys_internal_mix_bus( audiosys, audiosys->bus_jobs[ i ] );
+	}
+}
+
+
+// Sorts the voices to be mixed by bus, and lists the buses which have any. Sounds beyond the active voice count are 
+// updated as virtual voices instead.
+static void audiosys_internal_assign_buses( audiosys_t* audiosys, int sample_pairs_count ) {
+	AUDIOSYS_ASSERT( audiosys->bus_voices_capacity >= audiosys->sounds_count + 4, "Bus voices array too small" );
+
+	int counts[ AUDIOSYS_BUS_COUNT ] = { 0 };
+	counts[ AUDIOSYS_BUS_MUSIC ] += 2;
+	counts[ AUDIOSYS_BUS_AMBIENCE ] += 2;
+	int real_count = audiosys->active_voice_count < audiosys->sounds_count ? audiosys->active_voice_count : audiosys->sounds_count;
+	for( int i = 0; i < audiosys->sounds_count; ++i ) {
+		audiosys_internal_voice_t* voice = audiosys_internal_get_sound( audiosys, audiosys->sounds_by_priority[ i ] );
+		if( i < real_count ) {
+			++counts[ voice->bus ];
+		} else {
+			audiosys_internal_virtual_voice( voice, sample_pairs_count );
+		}
+	}
+
+	int first = 0;
+	for( int i = 0; i < AUDIOSYS_BUS_COUNT; ++i ) {
+		audiosys->buses[ i ].first_voice = first;
+		audiosys->buses[ i ].voice_count = 0;
+		first += counts[ i ];
+	}
+
+	audiosys_internal_voice_t** voices = audiosys->bus_voices;
+	audiosys_internal_bus_t* music = &audiosys->buses[ AUDIOSYS_BUS_MUSIC ];
+	voices[ music->first_voice + music->voice_count++ ] = &audiosys->music;
+	voices[ music->first_voice + music->voice_count++ ] = &audiosys->music_crossfade;
+	audiosys_internal_bus_t* ambience = &audiosys->buses[ AUDIOSYS_BUS_AMBIENCE ];
+	voices[ ambience->first_voice + ambience->voice_count++ ] = &audiosys->ambience;
+	voices[ ambience->first_voice + ambience->voice_count++ ] = &audiosys->ambience_crossfade;
+	for( int i = 0; i < real_count; ++i ) {
+		audiosys_internal_voice_t* voice = audiosys_internal_get_sound( audiosys, audiosys->sounds_by_priority[ i ] );
+		audiosys_internal_bus_t* bus = &audiosys->buses[ voice->bus ];
+		voices[ bus->first_voice + bus->voice_count++ ] = voice;
+	}
+
+	audiosys->bus_jobs_count = 0;
+	audiosys->bus_jobs_sample_pairs = sample_pairs_count;
+	for( int i = 0; i < AUDIOSYS_BUS_COUNT; ++i ) {
+		if( audiosys->buses[ i ].voice_count > 0 ) {
+			audiosys->bus_jobs[ audiosys->bus_jobs_count++ ] = i;
+		}
+	}
+}
+
+
+static void audiosys_internal_retire_finished( audiosys_t* audiosys, audiosys_internal_voice_t* voice ) {
+	if( voice->finished ) {
+		audiosys_internal_retire( audiosys, voice, 0 );
+		voice->finished = 0;
+	}
+}
+
+
+// Mixes at most AUDIOSYS_BLOCK_SIZE sample pairs, the size of the buffers allocated in audiosys_create
+static void audiosys_internal_render_block( audiosys_t* audiosys, AUDIOSYS_S16* output_sample_pairs, int sample_pairs_count ) {
+	// remove sounds which have finished playing
+	for( int i = audiosys->sounds_count - 1; i >= 0; --i ) {
+		audiosys_internal_voice_t* voice = &audiosys->sounds[ i ];
+		if( voice->source.read_samples == NULL ) audiosys_internal_remove_sound( audiosys, voice->handle );
+	}
+
+	// the most audible sounds are mixed on their buses, and the rest only keep track of time
+	audiosys_internal_sort_sounds( audiosys );
+	audiosys_internal_assign_buses( audiosys, sample_pairs_count );
+	audiosys_internal_mix_buses( audiosys );
+
+	// sources which ended while mixing are released here, on one thread
+	audiosys_internal_retire_finished( audiosys, &audiosys->music );
+	audiosys_internal_retire_finished( audiosys, &audiosys->music_crossfade );
+	audiosys_internal_retire_finished( audiosys, &audiosys->ambience );
+	audiosys_internal_retire_finished( audiosys, &audiosys->ambience_crossfade );
+	for( int i = 0; i < audiosys->sounds_count; ++i ) {
+		audiosys_internal_retire_finished( audiosys, &audiosys->sounds[ i ] );
+	}
+
+	// sum the buses, and their sends to the reverb
+	float const identity[ 4 ] = { 1.0f, 0.0f, 0.0f, 1.0f };
+	int reverb_used = 0;
+	AUDIOSYS_MEMSET( audiosys->mixing_buffer, 0, sample_pairs_count * sizeof( float ) * 2 );
+	for( int i = 0; i < audiosys->bus_jobs_count; ++i ) {
+		audiosys_internal_bus_t* bus = &audiosys->buses[ audiosys->bus_jobs[ i ] ];
+		audiosys_internal_mix_block( audiosys->mixing_buffer, bus->mixing_buffer, sample_pairs_count, identity, bus->settings.volume, 0.0f );
+		float send = bus->settings.volume * bus->settings.reverb_send;
+		if( send > 0.0f ) {
+			if( !reverb_used ) {
+				AUDIOSYS_MEMSET( audiosys->reverb.input, 0, sample_pairs_count * sizeof( float ) );
+				reverb_used = 1;
+			}
+			for( int j = 0; j < sample_pairs_count; ++j ) {
+				audiosys->reverb.input[ j ] += ( bus->mixing_buffer[ j * 2 + 0 ] + bus->mixing_buffer[ j * 2 + 1 ] ) * send;
+			}
+		}
+	}
+	if( reverb_used ) {
+		audiosys->reverb.tail = 44100 * 10;
+	} else if( audiosys->reverb.tail > 0 ) {
+		AUDIOSYS_MEMSET( audiosys->reverb.input, 0, sample_pairs_count * sizeof( float ) );
+		audiosys->reverb.tail -= sample_pairs_count;
+	}
+	if( reverb_used || audiosys->reverb.tail > 0 ) {
+		audiosys_internal_reverb( &audiosys->reverb, audiosys->mixing_buffer, sample_pairs_count );
+	}
+
+	audiosys_internal_convert( audiosys->mixing_buffer, output_sample_pairs, sample_pairs_count * 2, audiosys->gain * 0.5f, audiosys->use_soft_clip );
+}
+
+
+void audiosys_render( audiosys_t* audiosys, AUDIOSYS_S16* output_sample_pairs, int sample_pairs_count ) {
+	#ifdef AUDIOSYS_THREADED
+		// hand back anything which did not fit in the retired queue last time
+		int pending = 0;
+		while( pending < audiosys->retired_pending_count && audiosys_internal_ring_push( &audiosys->retired, &audiosys->retired_pending[ pending ] ) ) {
+			++pending;
+		}
+		if( pending > 0 ) {
+			audiosys->retired_pending_count -= pending;
+			AUDIOSYS_MEMMOVE( audiosys->retired_pending, audiosys->retired_pending + pending, sizeof( audiosys_internal_retired_t ) * audiosys->retired_pending_count );
+		}
+
+		// apply the calls queued since the last block, but no more than fits in the queue, so this always finishes
+		audiosys_internal_command_t command;
+		for( int i = 0; i < AUDIOSYS_COMMAND_QUEUE_SIZE && audiosys_internal_ring_pop( &audiosys->commands, &command ); ++i ) {
+			audiosys_internal_execute( audiosys, &command );
+		}
+	#endif
+
+	if( audiosys->paused ) {
+		AUDIOSYS_MEMSET( output_sample_pairs, 0, sample_pairs_count * sizeof( AUDIOSYS_S16 ) * 2 );
+		return;
+	}
+
+	while( sample_pairs_count > 0 ) {
+		int count = sample_pairs_count < AUDIOSYS_BLOCK_SIZE ? sample_pairs_count : AUDIOSYS_BLOCK_SIZE;
+		audiosys_internal_render_block( audiosys, output_sample_pairs, count );
+		output_sample_pairs += count * 2;
+		sample_pairs_count -= count;
+	}
 }
 
 
 static void audiosys_internal_init_voice( audiosys_internal_voice_t* voice, audiosys_audio_source_t source, int is_sound ) {
 	voice->handle = 0;
-	voice->initialized = 0;
 	voice->paused = 0;
 	voice->state = AUDIOSYS_INTERNAL_VOICE_STATE_PLAYING;
 	voice->source = source;
@@ -786,370 +1876,758 @@ static void audiosys_internal_init_voice( audiosys_internal_voice_t* voice, audi
 	voice->fade_in_time = 0.0f;
 	voice->fade_out_time = 0.0f;
 	voice->priority = 0.0f;
-	voice->fade_progress = 1.0f;
+	voice->fade_position = 0;
 	voice->current_fade_volume = 1.0f;
 	voice->current_fade_delta = 0.0f;
+	voice->audibility = 0.0f;
+	voice->is_virtual = 0;
+	voice->virtual_samples = 0;
+	voice->virtual_fraction = 0;
+	voice->finished = 0;
+	if( is_sound ) {
+		voice->pitch = 1.0f;
+		voice->resample_mode = AUDIOSYS_RESAMPLE_SINC;
+		voice->bus = AUDIOSYS_BUS_SOUNDS;
+	}
+	audiosys_internal_resample_reset( voice );
 }
 
 
-void audiosys_music_play( audiosys_t* audiosys, audiosys_audio_source_t source, float fade_in_time ) {
-	audiosys_internal_release_source( &audiosys->music.source );
-	audiosys_internal_init_voice( &audiosys->music, source, 0 );
-	audiosys->music.fade_in_time = fade_in_time;
+// Music and ambience both have a voice playing and a voice for the track being faded out when switching
+static void audiosys_internal_channel_play( audiosys_t* audiosys, audiosys_internal_voice_t* voice, audiosys_audio_source_t source, float fade_in_time ) {
+	audiosys_internal_retire( audiosys, voice, 0 );
+	audiosys_internal_init_voice( voice, source, 0 );
+	voice->fade_in_time = fade_in_time;
 	if( fade_in_time > 0.0f ) {
-		audiosys->music.state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_IN;
-		audiosys->music.fade_progress = 0.0f;
+		voice->state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_IN;
+		voice->fade_position = 0;
 	}
 }
 
 
-void audiosys_music_stop( audiosys_t* audiosys, float fade_out_time ) {
+static void audiosys_internal_channel_stop( audiosys_t* audiosys, audiosys_internal_voice_t* voice, float fade_out_time ) {
 	if( fade_out_time > 0.0f ) {
-		audiosys->music.fade_out_time = fade_out_time;
-		audiosys->music.state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_OUT;
-		audiosys->music.fade_progress = 1.0f;
+		voice->fade_out_time = fade_out_time;
+		voice->state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_OUT;
+		voice->fade_position = 0;
 	} else {
-		audiosys_internal_release_source( &audiosys->music.source );
-		audiosys->music.state = AUDIOSYS_INTERNAL_VOICE_STATE_STOPPED;
+		audiosys_internal_retire( audiosys, voice, 0 );
+		voice->state = AUDIOSYS_INTERNAL_VOICE_STATE_STOPPED;
 	}
 }
 
 
-void audiosys_music_pause( audiosys_t* audiosys ) {
-	if( audiosys->music.paused == 1 ) {
+static void audiosys_internal_channel_switch( audiosys_t* audiosys, audiosys_internal_voice_t* voice, audiosys_internal_voice_t* crossfade, audiosys_audio_source_t source, float fade_out_time, float fade_in_time ) {
+	if( fade_out_time > 0.0f ) {
+		voice->fade_out_time = fade_out_time;
+		voice->state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_OUT;
+		voice->fade_position = 0;
+	} else {
+		audiosys_internal_channel_play( audiosys, voice, source, fade_in_time );
 		return;
 	}
-	audiosys->music.paused = 1;
+	audiosys_internal_retire( audiosys, crossfade, 0 );
+	audiosys_internal_voice_t temp = *voice;
+	*voice = *crossfade;
+	*crossfade = temp;
+
+	audiosys_internal_init_voice( voice, source, 0 );
+	voice->fade_in_time = fade_in_time;
+	if( fade_in_time > 0.0f ) {
+		voice->fade_position = 0;
+	}
+	voice->state = AUDIOSYS_INTERNAL_VOICE_STATE_QUEUED;
 }
 
 
-void audiosys_music_resume( audiosys_t* audiosys ) {
-	if( audiosys->music.paused == 0 ) { 
-		return;
+static void audiosys_internal_channel_cross_fade( audiosys_t* audiosys, audiosys_internal_voice_t* voice, audiosys_internal_voice_t* crossfade, audiosys_audio_source_t source, float cross_fade_time ) {
+	audiosys_internal_channel_stop( audiosys, voice, cross_fade_time );
+	audiosys_internal_retire( audiosys, crossfade, 0 );
+	audiosys_internal_voice_t temp = *voice;
+	*voice = *crossfade;
+	*crossfade = temp;
+
+	audiosys_internal_init_voice( voice, source, 0 );
+	voice->fade_in_time = cross_fade_time;
+	if( cross_fade_time > 0.0f ) {
+		voice->state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_IN;
+		voice->fade_position = 0;
 	}
-	audiosys->music.paused = 0;
 }
 
 
-void audiosys_music_switch( audiosys_t* audiosys, audiosys_audio_source_t source, float fade_out_time, float fade_in_time ) {
-	if( fade_out_time > 0.0f ) {
-		audiosys->music.fade_out_time = fade_out_time;
-		audiosys->music.state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_OUT;
-		audiosys->music.fade_progress = 1.0f;
-	} else {
-		audiosys_internal_release_source( &audiosys->music.source );
-		audiosys_music_play( audiosys, source, fade_in_time );
-		return;
+static void audiosys_internal_execute( audiosys_t* audiosys, audiosys_internal_command_t const* command ) {
+	audiosys_internal_voice_t* voice = NULL;
+	audiosys_internal_voice_t* crossfade = NULL;
+	if( command->target == AUDIOSYS_INTERNAL_TARGET_MUSIC ) {
+		voice = &audiosys->music;
+		crossfade = &audiosys->music_crossfade;
+	} else if( command->target == AUDIOSYS_INTERNAL_TARGET_AMBIENCE ) {
+		voice = &audiosys->ambience;
+		crossfade = &audiosys->ambience_crossfade;
+	} else if( command->target == AUDIOSYS_INTERNAL_TARGET_SOUND && command->type != AUDIOSYS_INTERNAL_COMMAND_PLAY ) {
+		voice = audiosys_internal_get_sound( audiosys, command->handle );
+		if( !voice ) {
+			return; // the sound has already finished
+		}
 	}
-	audiosys_internal_voice_t temp = audiosys->music;
-	audiosys->music = audiosys->music_crossfade;
-	audiosys->music_crossfade = temp;
 
-	audiosys_internal_init_voice( &audiosys->music, source, 0 );
-	audiosys->music.fade_in_time = fade_in_time;
-	if( fade_in_time > 0.0f ) {
-		audiosys->music.fade_progress = 0.0f;
+	switch( command->type ) {
+		case AUDIOSYS_INTERNAL_COMMAND_MASTER_VOLUME_SET:
+			audiosys->master_volume = command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_GAIN_SET:
+			audiosys->gain = command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_PAUSE_ALL:
+			audiosys->paused = 1;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_RESUME_ALL:
+			audiosys->paused = 0;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_STOP_ALL:
+			audiosys_internal_channel_stop( audiosys, &audiosys->music, 0.0f );
+			audiosys_internal_channel_stop( audiosys, &audiosys->music_crossfade, 0.0f );
+			audiosys_internal_channel_stop( audiosys, &audiosys->ambience, 0.0f );
+			audiosys_internal_channel_stop( audiosys, &audiosys->ambience_crossfade, 0.0f );
+			while( audiosys->sounds_count > 0 ) {
+				audiosys_internal_remove_sound( audiosys, audiosys->sounds[ audiosys->sounds_count - 1 ].handle );
+			}
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_PLAY:
+			if( command->target == AUDIOSYS_INTERNAL_TARGET_SOUND ) {
+				voice = audiosys_internal_add_sound( audiosys, command->handle, command->value );
+				audiosys_internal_init_voice( voice, command->source, 1 );
+				voice->handle = command->handle;
+				voice->priority = command->value;
+				voice->audibility = command->value;
+				voice->fade_in_time = command->time;
+				if( command->time > 0.0f )  {
+					voice->state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_IN;
+					voice->fade_position = 0;
+				}
+			} else {
+				audiosys_internal_channel_play( audiosys, voice, command->source, command->time );
+			}
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_STOP:
+			if( command->target == AUDIOSYS_INTERNAL_TARGET_SOUND && command->value <= 0.0f ) {
+				audiosys_internal_remove_sound( audiosys, command->handle );
+			} else {
+				audiosys_internal_channel_stop( audiosys, voice, command->value );
+			}
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_PAUSE:
+			voice->paused = 1;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_RESUME:
+			voice->paused = 0;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_SWITCH:
+			audiosys_internal_channel_switch( audiosys, voice, crossfade, command->source, command->value, command->time );
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_CROSS_FADE:
+			audiosys_internal_channel_cross_fade( audiosys, voice, crossfade, command->source, command->value );
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_POSITION_SET:
+			if( voice->source.set_position ) {
+				int sample_rate = voice->source.sample_rate > 0 ? voice->source.sample_rate : 44100;
+				voice->source.set_position( voice->source.instance, (int)( command->value * sample_rate ) );
+			}
+			voice->virtual_samples = 0;
+			voice->virtual_fraction = 0;
+			audiosys_internal_resample_reset( voice );
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_LOOP_SET:
+			voice->loop = command->loop;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_VOLUME_SET:
+			voice->volume = command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_PAN_SET:
+			voice->pan = command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_PITCH_SET:
+			voice->pitch = command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_RESAMPLE_SET:
+			voice->resample_mode = (int) command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_BUS_SET:
+			voice->bus = (int) command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_BUS_SETTINGS_SET:
+			audiosys->buses[ command->handle ].settings = command->bus;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_REVERB_SET:
+			audiosys->reverb.room_size = command->value;
+			audiosys->reverb.damping = command->time;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_SOUNDS_GROW:
+			audiosys_internal_sound_arrays_swap( audiosys, command->arrays );
+			#ifdef AUDIOSYS_THREADED
+				{
+				audiosys_internal_retired_t retired;
+				AUDIOSYS_MEMSET( &retired, 0, sizeof( retired ) );
+				retired.arrays = command->arrays; // now holds the old arrays, to be freed on the calling thread
+				audiosys_internal_retired_push( audiosys, &retired );
+				}
+			#else
+				audiosys_internal_sound_arrays_destroy( command->arrays, audiosys->memctx );
+			#endif
+			break;
 	}
-	audiosys->music.state = AUDIOSYS_INTERNAL_VOICE_STATE_QUEUED;
 }
 
 
-void audiosys_music_cross_fade( audiosys_t* audiosys, audiosys_audio_source_t source, float cross_fade_time ) {
-	if( cross_fade_time > 0.0f ) {
-		audiosys->music.fade_out_time = cross_fade_time;
-		audiosys->music.state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_OUT;
-		audiosys->music.fade_progress = 1.0f;
-	} else {
-		audiosys_internal_release_source( &audiosys->music.source );
-		audiosys->music.state = AUDIOSYS_INTERNAL_VOICE_STATE_STOPPED;
-	}
-	audiosys_internal_voice_t temp = audiosys->music;
-	audiosys->music = audiosys->music_crossfade;
-	audiosys->music_crossfade = temp;
+#ifdef AUDIOSYS_THREADED
 
-	audiosys_internal_init_voice( &audiosys->music, source, 0 );
-	audiosys->music.fade_in_time = cross_fade_time;
-	if( cross_fade_time > 0.0f ) {
-		audiosys->music.state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_IN;
-		audiosys->music.fade_progress = 0.0f;
+static audiosys_internal_voice_t* audiosys_internal_game_sound( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
+	int slot = audiosys_internal_handles_from_u64( &audiosys->sounds_handles, handle );
+	return slot >= 0 ? &audiosys->game.sounds[ slot ] : 0;
+}
+
+
+static int audiosys_internal_same_source( audiosys_audio_source_t const* a, audiosys_audio_source_t const* b ) {
+	return a->instance == b->instance && a->read_samples == b->read_samples;
+}
+
+
+// Releases the sources and sound handles the audio thread is done with
+static void audiosys_internal_collect( audiosys_t* audiosys ) {
+	audiosys_internal_retired_t retired;
+	for( int i = 0; i < AUDIOSYS_COMMAND_QUEUE_SIZE && audiosys_internal_ring_pop( &audiosys->retired, &retired ); ++i ) {
+		if( retired.handle ) {
+			int slot = audiosys_internal_handles_from_u64( &audiosys->sounds_handles, retired.handle );
+			if( slot >= 0 ) {
+				AUDIOSYS_MEMSET( &audiosys->game.sounds[ slot ].source, 0, sizeof( audiosys->game.sounds[ slot ].source ) );
+			}
+			if( retired.removed ) {
+				audiosys_internal_handles_release( &audiosys->sounds_handles, slot );
+			}
+		} else if( retired.source.read_samples ) {
+			if( audiosys_internal_same_source( &retired.source, &audiosys->game.music.source ) ) {
+				AUDIOSYS_MEMSET( &audiosys->game.music.source, 0, sizeof( audiosys->game.music.source ) );
+			}
+			if( audiosys_internal_same_source( &retired.source, &audiosys->game.ambience.source ) ) {
+				AUDIOSYS_MEMSET( &audiosys->game.ambience.source, 0, sizeof( audiosys->game.ambience.source ) );
+			}
+		}
+		audiosys_internal_release_source( &retired.source );
+		if( retired.arrays ) {
+			audiosys_internal_sound_arrays_destroy( retired.arrays, audiosys->memctx );
+		}
 	}
 }
 
 
-void audiosys_music_position_set( audiosys_t* audiosys, float position ) {
-	if( !audiosys->music.source.set_position ) {
-		return;
+// Applies a command to the state seen by the calling thread, so that getters return what was last set
+static void audiosys_internal_mirror( audiosys_t* audiosys, audiosys_internal_command_t const* command ) {
+	audiosys_internal_voice_t* voice = NULL;
+	if( command->target == AUDIOSYS_INTERNAL_TARGET_MUSIC ) {
+		voice = &audiosys->game.music;
+	} else if( command->target == AUDIOSYS_INTERNAL_TARGET_AMBIENCE ) {
+		voice = &audiosys->game.ambience;
+	} else if( command->target == AUDIOSYS_INTERNAL_TARGET_SOUND ) {
+		voice = audiosys_internal_game_sound( audiosys, command->handle );
+		if( !voice ) {
+			return; // the sound has already finished
+		}
 	}
 
-	audiosys->music.source.set_position( audiosys->music.source.instance, (int)( position * 44100.0f ) );
+	switch( command->type ) {
+		case AUDIOSYS_INTERNAL_COMMAND_MASTER_VOLUME_SET:
+			audiosys->game.master_volume = command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_GAIN_SET:
+			audiosys->game.gain = command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_PAUSE_ALL:
+			audiosys->game.paused = 1;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_RESUME_ALL:
+			audiosys->game.paused = 0;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_STOP_ALL:
+			AUDIOSYS_MEMSET( &audiosys->game.music.source, 0, sizeof( audiosys->game.music.source ) );
+			AUDIOSYS_MEMSET( &audiosys->game.ambience.source, 0, sizeof( audiosys->game.ambience.source ) );
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_PLAY:
+			if( command->target == AUDIOSYS_INTERNAL_TARGET_SOUND ) {
+				audiosys_internal_init_voice( voice, command->source, 1 );
+			} else {
+				voice->source = command->source;
+			}
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_STOP:
+			if( command->value <= 0.0f ) {
+				AUDIOSYS_MEMSET( &voice->source, 0, sizeof( voice->source ) );
+			}
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_PAUSE:
+			voice->paused = 1;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_RESUME:
+			voice->paused = 0;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_SWITCH:
+		case AUDIOSYS_INTERNAL_COMMAND_CROSS_FADE:
+			voice->source = command->source;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_POSITION_SET:
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_LOOP_SET:
+			voice->loop = command->loop;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_VOLUME_SET:
+			voice->volume = command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_PAN_SET:
+			voice->pan = command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_PITCH_SET:
+			voice->pitch = command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_RESAMPLE_SET:
+			voice->resample_mode = (int) command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_BUS_SET:
+			voice->bus = (int) command->value;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_BUS_SETTINGS_SET:
+			audiosys->game.buses[ command->handle ] = command->bus;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_REVERB_SET:
+			audiosys->game.reverb_room_size = command->value;
+			audiosys->game.reverb_damping = command->time;
+			break;
+		case AUDIOSYS_INTERNAL_COMMAND_SOUNDS_GROW:
+			break;
+	}
 }
 
+#endif /* AUDIOSYS_THREADED */
 
-float audiosys_music_position( audiosys_t* audiosys ) {
-	if( !audiosys->music.source.get_position ) {
+
+// Returns the voice as seen by the calling thread - a copy of the settings when AUDIOSYS_THREADED is defined
+static audiosys_internal_voice_t* audiosys_internal_voice( audiosys_t* audiosys, audiosys_internal_target_t target, AUDIOSYS_U64 handle ) {
+	#ifdef AUDIOSYS_THREADED
+		if( target == AUDIOSYS_INTERNAL_TARGET_MUSIC ) {
+			return &audiosys->game.music;
+		} else if( target == AUDIOSYS_INTERNAL_TARGET_AMBIENCE ) {
+			return &audiosys->game.ambience;
+		}
+		return audiosys_internal_game_sound( audiosys, handle );
+	#else
+		if( target == AUDIOSYS_INTERNAL_TARGET_MUSIC ) {
+			return &audiosys->music;
+		} else if( target == AUDIOSYS_INTERNAL_TARGET_AMBIENCE ) {
+			return &audiosys->ambience;
+		}
+		return audiosys_internal_get_sound( audiosys, handle );
+	#endif
+}
+
+
+// Returns 0 if the command was dropped because the queue is full, in which case its source has been released
+static int audiosys_internal_submit( audiosys_t* audiosys, audiosys_internal_command_t const* command ) {
+	#ifdef AUDIOSYS_THREADED
+		audiosys_internal_collect( audiosys );
+		// Rather than waiting for the audio thread, which might not be rendering at all, drop the command
+		if( !audiosys_internal_ring_push( &audiosys->commands, command ) ) {
+			audiosys_audio_source_t source = command->source;
+			audiosys_internal_release_source( &source );
+			return 0;
+		}
+		audiosys_internal_mirror( audiosys, command );
+	#else
+		audiosys_internal_execute( audiosys, command );
+	#endif
+	return 1;
+}
+
+
+static void audiosys_internal_command( audiosys_t* audiosys, audiosys_internal_command_type_t type, audiosys_internal_target_t target, AUDIOSYS_U64 handle, float value ) {
+	audiosys_internal_command_t command;
+	AUDIOSYS_MEMSET( &command, 0, sizeof( command ) );
+	command.type = type;
+	command.target = target;
+	command.handle = handle;
+	command.value = value;
+	audiosys_internal_submit( audiosys, &command );
+}
+
+
+static int audiosys_internal_source_command( audiosys_t* audiosys, audiosys_internal_command_type_t type, audiosys_internal_target_t target, AUDIOSYS_U64 handle, audiosys_audio_source_t source, float value, float time ) {
+	audiosys_internal_command_t command;
+	AUDIOSYS_MEMSET( &command, 0, sizeof( command ) );
+	command.type = type;
+	command.target = target;
+	command.handle = handle;
+	command.source = source;
+	command.value = value;
+	command.time = time;
+	return audiosys_internal_submit( audiosys, &command );
+}
+
+
+static void audiosys_internal_loop_command( audiosys_t* audiosys, audiosys_internal_target_t target, AUDIOSYS_U64 handle, audiosys_loop_t loop ) {
+	audiosys_internal_command_t command;
+	AUDIOSYS_MEMSET( &command, 0, sizeof( command ) );
+	command.type = AUDIOSYS_INTERNAL_COMMAND_LOOP_SET;
+	command.target = target;
+	command.handle = handle;
+	command.loop = loop == AUDIOSYS_LOOP_ON ? 1 : 0;
+	audiosys_internal_submit( audiosys, &command );
+}
+
+
+// Returns the settings of a bus as seen by the calling thread
+static audiosys_internal_bus_settings_t* audiosys_internal_bus_settings( audiosys_t* audiosys, int bus ) {
+	#ifdef AUDIOSYS_THREADED
+		return &audiosys->game.buses[ bus ];
+	#else
+		return &audiosys->buses[ bus ].settings;
+	#endif
+}
+
+
+static void audiosys_internal_bus_command( audiosys_t* audiosys, int bus, audiosys_internal_bus_settings_t const* settings ) {
+	audiosys_internal_command_t command;
+	AUDIOSYS_MEMSET( &command, 0, sizeof( command ) );
+	command.type = AUDIOSYS_INTERNAL_COMMAND_BUS_SETTINGS_SET;
+	command.target = AUDIOSYS_INTERNAL_TARGET_BUS;
+	command.handle = (AUDIOSYS_U64) bus;
+	command.bus = *settings;
+	audiosys_internal_submit( audiosys, &command );
+}
+
+
+static float audiosys_internal_position( audiosys_internal_voice_t* voice ) {
+	if( !voice || !voice->source.get_position ) {
 		return 0.0f;
 	}
 
-	return audiosys->music.source.get_position( audiosys->music.source.instance ) / 44100.0f;
+	int sample_rate = voice->source.sample_rate > 0 ? voice->source.sample_rate : 44100;
+	return ( voice->source.get_position( voice->source.instance ) + voice->virtual_samples ) / (float) sample_rate;
+}
+
+
+void audiosys_master_volume_set( audiosys_t* audiosys, float volume ) {
+	volume = volume < 0.0f ? 0.0f : volume > 1.0f ? 1.0f : volume;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_MASTER_VOLUME_SET, AUDIOSYS_INTERNAL_TARGET_NONE, 0, volume );
+}
+
+
+float audiosys_master_volume( audiosys_t* audiosys ) {
+	#ifdef AUDIOSYS_THREADED
+		return audiosys->game.master_volume;
+	#else
+		return audiosys->master_volume;
+	#endif
+}
+
+
+void audiosys_gain_set( audiosys_t* audiosys, float gain ) {
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_GAIN_SET, AUDIOSYS_INTERNAL_TARGET_NONE, 0, gain );
+}
+
+
+float audiosys_gain( audiosys_t* audiosys ) {
+	#ifdef AUDIOSYS_THREADED
+		return audiosys->game.gain;
+	#else
+		return audiosys->gain;
+	#endif
+}
+
+
+void audiosys_pause( audiosys_t* audiosys ) {
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_PAUSE_ALL, AUDIOSYS_INTERNAL_TARGET_NONE, 0, 0.0f );
+}
+
+
+void audiosys_resume( audiosys_t* audiosys ) {
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_RESUME_ALL, AUDIOSYS_INTERNAL_TARGET_NONE, 0, 0.0f );
+}
+
+
+void audiosys_stop_all( audiosys_t* audiosys ) {
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_STOP_ALL, AUDIOSYS_INTERNAL_TARGET_NONE, 0, 0.0f );
+}
+
+
+audiosys_paused_t audiosys_paused( audiosys_t* audiosys ) {
+	#ifdef AUDIOSYS_THREADED
+		return audiosys->game.paused ? AUDIOSYS_PAUSED : AUDIOSYS_NOT_PAUSED;
+	#else
+		return audiosys->paused ? AUDIOSYS_PAUSED : AUDIOSYS_NOT_PAUSED;
+	#endif
+}
+
+
+void audiosys_music_play( audiosys_t* audiosys, audiosys_audio_source_t source, float fade_in_time ) {
+	audiosys_internal_source_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_PLAY, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0, source, 0.0f, fade_in_time );
+}
+
+
+void audiosys_music_stop( audiosys_t* audiosys, float fade_out_time ) {
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_STOP, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0, fade_out_time );
+}
+
+
+void audiosys_music_pause( audiosys_t* audiosys ) {
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_PAUSE, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0, 0.0f );
+}
+
+
+void audiosys_music_resume( audiosys_t* audiosys ) {
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_RESUME, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0, 0.0f );
+}
+
+
+void audiosys_music_switch( audiosys_t* audiosys, audiosys_audio_source_t source, float fade_out_time, float fade_in_time ) {
+	audiosys_internal_source_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_SWITCH, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0, source, fade_out_time, fade_in_time );
+}
+
+
+void audiosys_music_cross_fade( audiosys_t* audiosys, audiosys_audio_source_t source, float cross_fade_time ) {
+	audiosys_internal_source_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_CROSS_FADE, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0, source, cross_fade_time, 0.0f );
+}
+
+
+void audiosys_music_position_set( audiosys_t* audiosys, float position ) {
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_POSITION_SET, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0, position );
+}
+
+
+float audiosys_music_position( audiosys_t* audiosys ) {
+	return audiosys_internal_position( audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0 ) );
 }
 
 
 audiosys_audio_source_t audiosys_music_source( audiosys_t* audiosys ) {
-	return audiosys->music.source;
+	return audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0 )->source;
 }
 
 
 void audiosys_music_loop_set( audiosys_t* audiosys, audiosys_loop_t loop ) {
-	audiosys->music.loop = loop == AUDIOSYS_LOOP_ON ? 1 : 0;	
+	audiosys_internal_loop_command( audiosys, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0, loop );
 }
 
 
 audiosys_loop_t audiosys_music_loop( audiosys_t* audiosys ) {
-	return audiosys->music.loop ? AUDIOSYS_LOOP_ON : AUDIOSYS_LOOP_OFF;
+	return audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0 )->loop ? AUDIOSYS_LOOP_ON : AUDIOSYS_LOOP_OFF;
 }
 
 
 void audiosys_music_volume_set( audiosys_t* audiosys, float volume ) {
-	audiosys->music.volume = volume;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_VOLUME_SET, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0, volume );
 }
 
 
 float audiosys_music_volume( audiosys_t* audiosys ) {
-	return audiosys->music.volume;
+	return audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0 )->volume;
 }
 
 
 void audiosys_music_pan_set( audiosys_t* audiosys, float pan ) {
-	audiosys->music.pan = pan < -1.0f ? -1.0f : pan > 1.0f ? 1.0f : pan;
+	pan = pan < -1.0f ? -1.0f : pan > 1.0f ? 1.0f : pan;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_PAN_SET, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0, pan );
 }
 
 
 float audiosys_music_pan( audiosys_t* audiosys ) {
-	return audiosys->music.pan;
+	return audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0 )->pan;
+}
+
+
+void audiosys_music_pitch_set( audiosys_t* audiosys, float pitch ) {
+	pitch = pitch < 0.0625f ? 0.0625f : pitch > 16.0f ? 16.0f : pitch;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_PITCH_SET, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0, pitch );
+}
+
+
+float audiosys_music_pitch( audiosys_t* audiosys ) {
+	return audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_MUSIC, 0 )->pitch;
 }
 
 
 void audiosys_ambience_play( audiosys_t* audiosys, audiosys_audio_source_t source, float fade_in_time ) {
-	audiosys_internal_release_source( &audiosys->ambience.source );
-	audiosys_internal_init_voice( &audiosys->ambience, source, 0 );
-	audiosys->ambience.fade_in_time = fade_in_time;
-	if( fade_in_time > 0.0f ) {
-		audiosys->ambience.state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_IN;
-		audiosys->ambience.fade_progress = 0.0f;
-	}
+	audiosys_internal_source_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_PLAY, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0, source, 0.0f, fade_in_time );
 }
 
 
 void audiosys_ambience_stop( audiosys_t* audiosys, float fade_out_time ) {
-	if( fade_out_time > 0.0f ) {
-		audiosys->ambience.fade_out_time = fade_out_time;
-		audiosys->ambience.state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_OUT;
-		audiosys->ambience.fade_progress = 1.0f;
-	} else {
-		audiosys_internal_release_source( &audiosys->ambience.source );
-		audiosys->ambience.state = AUDIOSYS_INTERNAL_VOICE_STATE_STOPPED;
-	}
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_STOP, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0, fade_out_time );
 }
 
 
 void audiosys_ambience_pause( audiosys_t* audiosys ) {
-	if( audiosys->ambience.paused == 1 ) {
-		return;
-	}
-	audiosys->ambience.paused = 1;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_PAUSE, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0, 0.0f );
 }
 
 
 void audiosys_ambience_resume( audiosys_t* audiosys ) {
-	if( audiosys->ambience.paused == 0 ) {
-		return;
-	}
-	audiosys->ambience.paused = 0;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_RESUME, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0, 0.0f );
 }
 
 
 void audiosys_ambience_switch( audiosys_t* audiosys, audiosys_audio_source_t source, float fade_out_time, float fade_in_time ) {
-	if( fade_out_time > 0.0f ) {
-		audiosys->ambience.fade_out_time = fade_out_time;
-		audiosys->ambience.state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_OUT;
-	} else {
-		audiosys_internal_release_source( &audiosys->ambience.source );
-		audiosys_ambience_play( audiosys, source, fade_in_time );
-		return;
-	}
-	audiosys_internal_voice_t temp = audiosys->ambience;
-	audiosys->ambience = audiosys->ambience_crossfade;
-	audiosys->ambience_crossfade = temp;
-
-	audiosys_internal_init_voice( &audiosys->ambience, source, 0 );
-	audiosys->ambience.fade_in_time = fade_in_time;
-	if( fade_in_time > 0.0f ) {
-		audiosys->ambience.fade_progress = 0.0f;
-	}
-	audiosys->ambience.state = AUDIOSYS_INTERNAL_VOICE_STATE_QUEUED;
+	audiosys_internal_source_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_SWITCH, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0, source, fade_out_time, fade_in_time );
 }
 
 
 void audiosys_ambience_cross_fade( audiosys_t* audiosys, audiosys_audio_source_t source, float cross_fade_time ) {
-	if( cross_fade_time > 0.0f ) {
-		audiosys->ambience.fade_out_time = cross_fade_time;
-		audiosys->ambience.state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_OUT;
-		audiosys->ambience.fade_progress = 1.0f;
-	} else {
-		audiosys_internal_release_source( &audiosys->ambience.source );
-		audiosys->ambience.state = AUDIOSYS_INTERNAL_VOICE_STATE_STOPPED;
-	}
-	audiosys_internal_voice_t temp = audiosys->ambience;
-	audiosys->ambience = audiosys->ambience_crossfade;
-	audiosys->ambience_crossfade = temp;
-
-	audiosys_internal_init_voice( &audiosys->ambience, source, 0 );
-	audiosys->ambience.fade_in_time = cross_fade_time;
-	if( cross_fade_time > 0.0f ) {
-		audiosys->ambience.state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_IN;
-		audiosys->ambience.fade_progress = 0.0f;
-	}
+	audiosys_internal_source_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_CROSS_FADE, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0, source, cross_fade_time, 0.0f );
 }
 
 
 void audiosys_ambience_position_set( audiosys_t* audiosys, float position ) {
-	if( !audiosys->ambience.source.set_position ) {
-		return;
-	}
-
-	audiosys->ambience.source.set_position( audiosys->ambience.source.instance, (int)( position * 44100.0f ) );
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_POSITION_SET, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0, position );
 }
 
 
 float audiosys_ambience_position( audiosys_t* audiosys ) {
-	if( !audiosys->ambience.source.get_position ) {
-		return 0.0f;
-	}
-
-	return audiosys->ambience.source.get_position( audiosys->ambience.source.instance ) / 44100.0f;
+	return audiosys_internal_position( audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0 ) );
 }
 
 audiosys_audio_source_t audiosys_ambience_source( audiosys_t* audiosys ) {
-	return audiosys->ambience.source;
+	return audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0 )->source;
 }
 
 
 void audiosys_ambience_loop_set( audiosys_t* audiosys, audiosys_loop_t loop ) {
-	audiosys->ambience.loop = loop == AUDIOSYS_LOOP_ON ? 1 : 0;	
+	audiosys_internal_loop_command( audiosys, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0, loop );
 }
 
 
 audiosys_loop_t audiosys_ambience_loop( audiosys_t* audiosys ) {
-	return audiosys->ambience.loop ? AUDIOSYS_LOOP_ON : AUDIOSYS_LOOP_OFF;
+	return audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0 )->loop ? AUDIOSYS_LOOP_ON : AUDIOSYS_LOOP_OFF;
 }
 
 
 void audiosys_ambience_volume_set( audiosys_t* audiosys, float volume ) {
-	audiosys->ambience.volume = volume;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_VOLUME_SET, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0, volume );
 }
 
 
 float audiosys_ambience_volume( audiosys_t* audiosys ) {
-	return audiosys->ambience.volume;
+	return audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0 )->volume;
 }
 
 
 void audiosys_ambience_pan_set( audiosys_t* audiosys, float pan ) {
-	audiosys->ambience.pan = pan < -1.0f ? -1.0f : pan > 1.0f ? 1.0f : pan;
+	pan = pan < -1.0f ? -1.0f : pan > 1.0f ? 1.0f : pan;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_PAN_SET, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0, pan );
 }
 
 
 float audiosys_ambience_pan( audiosys_t* audiosys )
 	{
-	return audiosys->ambience.pan;
+	return audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0 )->pan;
 	}
 
 
+void audiosys_ambience_pitch_set( audiosys_t* audiosys, float pitch ) {
+	pitch = pitch < 0.0625f ? 0.0625f : pitch > 16.0f ? 16.0f : pitch;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_PITCH_SET, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0, pitch );
+}
+
+
+float audiosys_ambience_pitch( audiosys_t* audiosys ) {
+	return audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_AMBIENCE, 0 )->pitch;
+}
+
+
+// Makes sure there is room for a sound for every handle, by queuing larger arrays for the audio thread to swap in. 
+// Returns 0 if the queue is full.
+static int audiosys_internal_sounds_reserve( audiosys_t* audiosys ) {
+	int capacity = audiosys->sounds_handles.capacity;
+	#ifdef AUDIOSYS_THREADED
+		if( audiosys->game.sounds_capacity >= capacity ) {
+			return 1;
+		}
+		audiosys_internal_command_t command;
+		AUDIOSYS_MEMSET( &command, 0, sizeof( command ) );
+		command.type = AUDIOSYS_INTERNAL_COMMAND_SOUNDS_GROW;
+		command.arrays = audiosys_internal_sound_arrays_create( capacity, audiosys->memctx );
+		if( !audiosys_internal_submit( audiosys, &command ) ) {
+			audiosys_internal_sound_arrays_destroy( command.arrays, audiosys->memctx );
+			return 0;
+		}
+		audiosys_internal_voice_t* new_sounds = (audiosys_internal_voice_t*) AUDIOSYS_MALLOC( audiosys->memctx, sizeof( audiosys_internal_voice_t ) * capacity );
+		AUDIOSYS_MEMCPY( new_sounds, audiosys->game.sounds, sizeof( audiosys_internal_voice_t ) * audiosys->game.sounds_capacity );
+		AUDIOSYS_FREE( audiosys->memctx, audiosys->game.sounds );
+		audiosys->game.sounds = new_sounds;
+		audiosys->game.sounds_capacity = capacity;
+	#else
+		if( audiosys->sounds_capacity < capacity ) {
+			audiosys_internal_sound_arrays_t* arrays = audiosys_internal_sound_arrays_create( capacity, audiosys->memctx );
+			audiosys_internal_sound_arrays_swap( audiosys, arrays );
+			audiosys_internal_sound_arrays_destroy( arrays, audiosys->memctx );
+		}
+	#endif
+	return 1;
+}
+
+
 AUDIOSYS_U64 audiosys_sound_play( audiosys_t* audiosys, audiosys_audio_source_t source, float priority, float fade_in_time ) {
-	audiosys_internal_voice_t* sound;
-	AUDIOSYS_U64 handle = audiosys_internal_add_sound( audiosys, &sound, priority );
-	audiosys_internal_init_voice( sound, source, 1 );
-	sound->handle = handle;
-	sound->priority = priority;
-	sound->fade_in_time = fade_in_time;
-	if( fade_in_time > 0.0f )  {
-		sound->state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_IN;
-		sound->fade_progress = 0.0f;
+	// The handle is allocated here rather than on the audio thread, so it can be returned right away
+	int slot = audiosys_internal_handles_alloc( &audiosys->sounds_handles, 0 );
+	AUDIOSYS_U64 handle = audiosys_internal_handles_to_u64( &audiosys->sounds_handles, slot );
+	if( !audiosys_internal_sounds_reserve( audiosys ) ) {
+		audiosys_internal_release_source( &source );
+		audiosys_internal_handles_release( &audiosys->sounds_handles, slot );
+		return 0;
+	}
+	if( !audiosys_internal_source_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_PLAY, AUDIOSYS_INTERNAL_TARGET_SOUND, handle, source, priority, fade_in_time ) ) {
+		audiosys_internal_handles_release( &audiosys->sounds_handles, slot );
+		return 0; // the queue is full, and the source has been released
 	}
 	return handle;
 }
 
 
 void audiosys_sound_stop( audiosys_t* audiosys, AUDIOSYS_U64 handle, float fade_out_time ) {
-	audiosys_internal_voice_t* sound = audiosys_internal_get_sound( audiosys, handle );
-	if( !sound ) {
+	if( !audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle ) ) {
 		return;
 	}
-
-	if( fade_out_time > 0.0f ) {
-		sound->fade_out_time = fade_out_time;
-		sound->state = AUDIOSYS_INTERNAL_VOICE_STATE_FADING_OUT;
-		sound->fade_progress = 1.0f;
-	} else {
-		sound->state = AUDIOSYS_INTERNAL_VOICE_STATE_STOPPED;
-		audiosys_internal_remove_sound( audiosys, handle );
-		audiosys_internal_release_source( &sound->source );
-	}
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_STOP, AUDIOSYS_INTERNAL_TARGET_SOUND, handle, fade_out_time );
 }
 
 
 void audiosys_sound_pause( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
-	audiosys_internal_voice_t* sound = audiosys_internal_get_sound( audiosys, handle );
-	if( !sound ) {
-		return;
-	}
-	if( sound->paused == 1 ) {
+	if( !audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle ) ) {
 		return;
 	}
-	sound->paused = 1;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_PAUSE, AUDIOSYS_INTERNAL_TARGET_SOUND, handle, 0.0f );
 }
 
 
 void audiosys_sound_resume( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
-	audiosys_internal_voice_t* sound = audiosys_internal_get_sound( audiosys, handle );
-	if( !sound ) {
-		return;
-	}
-	if( sound->paused == 0 ) {
+	if( !audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle ) ) {
 		return;
 	}
-	sound->paused = 0;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_RESUME, AUDIOSYS_INTERNAL_TARGET_SOUND, handle, 0.0f );
 }
 
 
 void audiosys_sound_position_set( audiosys_t* audiosys, AUDIOSYS_U64 handle, float position ) {
-	audiosys_internal_voice_t* sound = audiosys_internal_get_sound( audiosys, handle );
-	if( !sound ) {
-		return;
-	}
-	if( !sound->source.set_position ) {
+	if( !audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle ) ) {
 		return;
 	}
-
-	sound->source.set_position( sound->source.instance, (int)( position * 44100.0f ) );
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_POSITION_SET, AUDIOSYS_INTERNAL_TARGET_SOUND, handle, position );
 }
 
 
 float audiosys_sound_position( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
-	audiosys_internal_voice_t* sound = audiosys_internal_get_sound( audiosys, handle );
-	if( !sound ) {
-		return 0.0f;
-	}
-	if( !sound->source.get_position ) {
-		return 0.0f;
-	}
-
-	return sound->source.get_position( sound->source.instance ) / 44100.0f;
+	return audiosys_internal_position( audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle ) );
 }
 
 
 audiosys_audio_source_t audiosys_sound_source( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
-	audiosys_internal_voice_t* sound = audiosys_internal_get_sound( audiosys, handle );
+	audiosys_internal_voice_t* sound = audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle );
 	if( !sound ) {
 		audiosys_audio_source_t null_source;
 		AUDIOSYS_MEMSET( &null_source, 0, sizeof( null_source ) );
@@ -1160,16 +2638,15 @@ audiosys_audio_source_t audiosys_sound_source( audiosys_t* audiosys, AUDIOSYS_U6
 
 
 void audiosys_sound_loop_set( audiosys_t* audiosys, AUDIOSYS_U64 handle, audiosys_loop_t loop ) {
-	audiosys_internal_voice_t* sound = audiosys_internal_get_sound( audiosys, handle );
-	if( !sound ) {
+	if( !audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle ) ) {
 		return;
 	}
-	sound->loop = loop == AUDIOSYS_LOOP_ON ? 1 : 0;	
+	audiosys_internal_loop_command( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle, loop );
 }
 
 
 audiosys_loop_t audiosys_sound_loop( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
-	audiosys_internal_voice_t* sound = audiosys_internal_get_sound( audiosys, handle );
+	audiosys_internal_voice_t* sound = audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle );
 	if( !sound ) {
 		return AUDIOSYS_LOOP_OFF;
 	}
@@ -1178,16 +2655,15 @@ audiosys_loop_t audiosys_sound_loop( audiosys_t* audiosys, AUDIOSYS_U64 handle )
 
 
 void audiosys_sound_volume_set( audiosys_t* audiosys, AUDIOSYS_U64 handle, float volume ) {
-	audiosys_internal_voice_t* sound = audiosys_internal_get_sound( audiosys, handle );
-	if( !sound ) {
+	if( !audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle ) ) {
 		return;
 	}
-	sound->volume = volume;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_VOLUME_SET, AUDIOSYS_INTERNAL_TARGET_SOUND, handle, volume );
 }
 
 
 float audiosys_sound_volume( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
-	audiosys_internal_voice_t* sound = audiosys_internal_get_sound( audiosys, handle );
+	audiosys_internal_voice_t* sound = audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle );
 	if( !sound ) {
 		return 0.0f;
 	}
@@ -1196,16 +2672,16 @@ float audiosys_sound_volume( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
 
 
 void audiosys_sound_pan_set( audiosys_t* audiosys, AUDIOSYS_U64 handle, float pan ) {
-	audiosys_internal_voice_t* sound = audiosys_internal_get_sound( audiosys, handle );
-	if( !sound ) {
+	if( !audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle ) ) {
 		return;
 	}
-	sound->pan = pan < -1.0f ? -1.0f : pan > 1.0f ? 1.0f : pan;
+	pan = pan < -1.0f ? -1.0f : pan > 1.0f ? 1.0f : pan;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_PAN_SET, AUDIOSYS_INTERNAL_TARGET_SOUND, handle, pan );
 }
 
 
 float audiosys_sound_pan( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
-	audiosys_internal_voice_t* sound = audiosys_internal_get_sound( audiosys, handle );
+	audiosys_internal_voice_t* sound = audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle );
 	if( !sound ) {
 		return 0.0f;
 	}
@@ -1213,16 +2689,416 @@ float audiosys_sound_pan( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
 }
 
 
+void audiosys_sound_pitch_set( audiosys_t* audiosys, AUDIOSYS_U64 handle, float pitch ) {
+	if( !audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle ) ) {
+		return;
+	}
+	pitch = pitch < 0.0625f ? 0.0625f : pitch > 16.0f ? 16.0f : pitch;
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_PITCH_SET, AUDIOSYS_INTERNAL_TARGET_SOUND, handle, pitch );
+}
+
+
+float audiosys_sound_pitch( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
+	audiosys_internal_voice_t* sound = audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle );
+	if( !sound ) {
+		return 1.0f;
+	}
+	return sound->pitch;
+}
+
+
+void audiosys_sound_resample_set( audiosys_t* audiosys, AUDIOSYS_U64 handle, audiosys_resample_t resample ) {
+	if( !audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle ) ) {
+		return;
+	}
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_RESAMPLE_SET, AUDIOSYS_INTERNAL_TARGET_SOUND, handle, (float) resample );
+}
+
+
+audiosys_resample_t audiosys_sound_resample( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
+	audiosys_internal_voice_t* sound = audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle );
+	if( !sound ) {
+		return AUDIOSYS_RESAMPLE_SINC;
+	}
+	return sound->resample_mode == AUDIOSYS_RESAMPLE_LINEAR ? AUDIOSYS_RESAMPLE_LINEAR : AUDIOSYS_RESAMPLE_SINC;
+}
+
+
 audiosys_sound_valid_t audiosys_sound_valid(audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
-	audiosys_internal_voice_t* sound = audiosys_internal_get_sound( audiosys, handle );
+	#ifdef AUDIOSYS_THREADED
+		audiosys_internal_collect( audiosys );
+	#endif
+	audiosys_internal_voice_t* sound = audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle );
 	if( !sound ) {
 		return AUDIOSYS_SOUND_INVALID;
 	}
 	return AUDIOSYS_SOUND_VALID;
 }
 
+
+void audiosys_sound_bus_set( audiosys_t* audiosys, AUDIOSYS_U64 handle, int bus ) {
+	if( !audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle ) || bus < 0 || bus >= AUDIOSYS_BUS_COUNT ) {
+		return;
+	}
+	audiosys_internal_command( audiosys, AUDIOSYS_INTERNAL_COMMAND_BUS_SET, AUDIOSYS_INTERNAL_TARGET_SOUND, handle, (float) bus );
+}
+
+
+int audiosys_sound_bus( audiosys_t* audiosys, AUDIOSYS_U64 handle ) {
+	audiosys_internal_voice_t* sound = audiosys_internal_voice( audiosys, AUDIOSYS_INTERNAL_TARGET_SOUND, handle );
+	if( !sound ) {
+		return AUDIOSYS_BUS_SOUNDS;
+	}
+	return sound->bus;
+}
+
+
+void audiosys_bus_volume_set( audiosys_t* audiosys, int bus, float volume ) {
+	if( bus < 0 || bus >= AUDIOSYS_BUS_COUNT ) {
+		return;
+	}
+	audiosys_internal_bus_settings_t settings = *audiosys_internal_bus_settings( audiosys, bus );
+	settings.volume = volume < 0.0f ? 0.0f : volume;
+	audiosys_internal_bus_command( audiosys, bus, &settings );
+}
+
+
+float audiosys_bus_volume( audiosys_t* audiosys, int bus ) {
+	if( bus < 0 || bus >= AUDIOSYS_BUS_COUNT ) {
+		return 0.0f;
+	}
+	return audiosys_internal_bus_settings( audiosys, bus )->volume;
+}
+
+
+void audiosys_bus_low_pass_set( audiosys_t* audiosys, int bus, float cutoff_frequency ) {
+	if( bus < 0 || bus >= AUDIOSYS_BUS_COUNT ) {
+		return;
+	}
+	audiosys_internal_bus_settings_t settings = *audiosys_internal_bus_settings( audiosys, bus );
+	settings.low_pass = cutoff_frequency < 0.0f ? 0.0f : cutoff_frequency;
+	audiosys_internal_bus_command( audiosys, bus, &settings );
+}
+
+
+float audiosys_bus_low_pass( audiosys_t* audiosys, int bus ) {
+	if( bus < 0 || bus >= AUDIOSYS_BUS_COUNT ) {
+		return 0.0f;
+	}
+	return audiosys_internal_bus_settings( audiosys, bus )->low_pass;
+}
+
+
+void audiosys_bus_reverb_send_set( audiosys_t* audiosys, int bus, float send ) {
+	if( bus < 0 || bus >= AUDIOSYS_BUS_COUNT ) {
+		return;
+	}
+	audiosys_internal_bus_settings_t settings = *audiosys_internal_bus_settings( audiosys, bus );
+	settings.reverb_send = send < 0.0f ? 0.0f : send;
+	audiosys_internal_bus_command( audiosys, bus, &settings );
+}
+
+
+float audiosys_bus_reverb_send( audiosys_t* audiosys, int bus ) {
+	if( bus < 0 || bus >= AUDIOSYS_BUS_COUNT ) {
+		return 0.0f;
+	}
+	return audiosys_internal_bus_settings( audiosys, bus )->reverb_send;
+}
+
+
+void audiosys_bus_compressor_set( audiosys_t* audiosys, int bus, float threshold_db, float ratio, float attack_time, float release_time ) {
+	if( bus < 0 || bus >= AUDIOSYS_BUS_COUNT ) {
+		return;
+	}
+	audiosys_internal_bus_settings_t settings = *audiosys_internal_bus_settings( audiosys, bus );
+	settings.compressor_threshold = threshold_db;
+	settings.compressor_ratio = ratio < 1.0f ? 1.0f : ratio;
+	settings.compressor_attack = attack_time < 0.0f ? 0.0f : attack_time;
+	settings.compressor_release = release_time < 0.0f ? 0.0f : release_time;
+	audiosys_internal_bus_command( audiosys, bus, &settings );
+}
+
+
+float audiosys_bus_compressor_threshold( audiosys_t* audiosys, int bus ) {
+	if( bus < 0 || bus >= AUDIOSYS_BUS_COUNT ) {
+		return 0.0f;
+	}
+	return audiosys_internal_bus_settings( audiosys, bus )->compressor_threshold;
+}
+
+
+float audiosys_bus_compressor_ratio( audiosys_t* audiosys, int bus ) {
+	if( bus < 0 || bus >= AUDIOSYS_BUS_COUNT ) {
+		return 1.0f;
+	}
+	return audiosys_internal_bus_settings( audiosys, bus )->compressor_ratio;
+}
+
+
+float audiosys_bus_compressor_attack( audiosys_t* audiosys, int bus ) {
+	if( bus < 0 || bus >= AUDIOSYS_BUS_COUNT ) {
+		return 0.0f;
+	}
+	return audiosys_internal_bus_settings( audiosys, bus )->compressor_attack;
+}
+
+
+float audiosys_bus_compressor_release( audiosys_t* audiosys, int bus ) {
+	if( bus < 0 || bus >= AUDIOSYS_BUS_COUNT ) {
+		return 0.0f;
+	}
+	return audiosys_internal_bus_settings( audiosys, bus )->compressor_release;
+}
+
+
+void audiosys_reverb_set( audiosys_t* audiosys, float room_size, float damping ) {
+	audiosys_internal_command_t command;
+	AUDIOSYS_MEMSET( &command, 0, sizeof( command ) );
+	command.type = AUDIOSYS_INTERNAL_COMMAND_REVERB_SET;
+	command.target = AUDIOSYS_INTERNAL_TARGET_NONE;
+	command.value = room_size < 0.0f ? 0.0f : room_size > 1.0f ? 1.0f : room_size;
+	command.time = damping < 0.0f ? 0.0f : damping > 1.0f ? 1.0f : damping;
+	audiosys_internal_submit( audiosys, &command );
+}
+
+
+float audiosys_reverb_room_size( audiosys_t* audiosys ) {
+	#ifdef AUDIOSYS_THREADED
+		return audiosys->game.reverb_room_size;
+	#else
+		return audiosys->reverb.room_size;
+	#endif
+}
+
+
+float audiosys_reverb_damping( audiosys_t* audiosys ) {
+	#ifdef AUDIOSYS_THREADED
+		return audiosys->game.reverb_damping;
+	#else
+		return audiosys->reverb.damping;
+	#endif
+}
+
 #endif /* AUDIOSYS_IMPLEMENTATION */
 
+
+/*
+----------------------
+	BENCHMARK
+----------------------
+*/
+
+#ifdef AUDIOSYS_RUN_BENCHMARK
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef _WIN32
+	#define WIN32_LEAN_AND_MEAN
+	#include <windows.h>
+#else
+	#include <time.h>
+#endif
+
+
+static double benchmark_audiosys_seconds( void ) {
+	#ifdef _WIN32
+		LARGE_INTEGER count, frequency;
+		QueryPerformanceCounter( &count );
+		QueryPerformanceFrequency( &frequency );
+		return (double) count.QuadPart / (double) frequency.QuadPart;
+	#else
+		struct timespec t;
+		clock_gettime( CLOCK_MONOTONIC, &t );
+		return (double) t.tv_sec + (double) t.tv_nsec * 1e-9;
+	#endif
+}
+
+
+// Endless quiet noise, so voices never end during a run
+typedef struct benchmark_audiosys_source_t {
+	unsigned int seed;
+	int position;
+} benchmark_audiosys_source_t;
+
+
+static int benchmark_audiosys_read_samples( void* instance, float* sample_pairs, int sample_pairs_count ) {
+	benchmark_audiosys_source_t* source = (benchmark_audiosys_source_t*) instance;
+	for( int i = 0; i < sample_pairs_count * 2; ++i ) {
+		source->seed = source->seed * 1664525u + 1013904223u;
+		sample_pairs[ i ] = (float)( (int)( source->seed >> 16 ) - 32768 ) * ( 0.1f / 32768.0f );
+	}
+	source->position += sample_pairs_count;
+	return sample_pairs_count;
+}
+
+
+static void benchmark_audiosys_set_position( void* instance, int position_in_sample_pairs ) {
+	( (benchmark_audiosys_source_t*) instance )->position = position_in_sample_pairs;
+}
+
+
+static int benchmark_audiosys_get_position( void* instance ) {
+	return ( (benchmark_audiosys_source_t*) instance )->position;
+}
+
+
+static audiosys_audio_source_t benchmark_audiosys_source( benchmark_audiosys_source_t* source, int index, int sample_rate ) {
+	source->seed = (unsigned int) index * 2654435761u + 1u;
+	source->position = 0;
+	audiosys_audio_source_t result;
+	result.instance = source;
+	result.release = NULL;
+	result.read_samples = benchmark_audiosys_read_samples;
+	result.restart = NULL;
+	result.set_position = benchmark_audiosys_set_position;
+	result.get_position = benchmark_audiosys_get_position;
+	result.sample_rate = sample_rate;
+	return result;
+}
+
+
+#define BENCHMARK_AUDIOSYS_SECONDS 10
+#define BENCHMARK_AUDIOSYS_CALL_SIZE 512 // sample pairs per call to audiosys_render, as from a typical audio callback
+
+static AUDIOSYS_S16 benchmark_audiosys_output[ 44100 * 2 ];
+
+
+// Renders BENCHMARK_AUDIOSYS_SECONDS of audio, changing the volume and pan of every sound each call so the mixer has 
+// to ramp gains, and prints how long it took per second of audio. Sources at rates other than 44100 are resampled.
+static void benchmark_audiosys_mix( char const* name, int voices, int sample_rate, audiosys_resample_t resample ) {
+	audiosys_t* audiosys = audiosys_create( voices, NULL );
+	benchmark_audiosys_source_t* sources = (benchmark_audiosys_source_t*) malloc( sizeof( *sources ) * voices );
+	AUDIOSYS_U64* handles = (AUDIOSYS_U64*) malloc( sizeof( *handles ) * voices );
+	for( int i = 0; i < voices; ++i ) {
+		handles[ i ] = audiosys_sound_play( audiosys, benchmark_audiosys_source( &sources[ i ], i, sample_rate ), 1.0f, 
+			0.0f );
+		audiosys_sound_resample_set( audiosys, handles[ i ], resample );
+	}
+	int calls = BENCHMARK_AUDIOSYS_SECONDS * 44100 / BENCHMARK_AUDIOSYS_CALL_SIZE;
+	double start = benchmark_audiosys_seconds();
+	for( int call = 0; call < calls; ++call ) {
+		for( int i = 0; i < voices; ++i ) {
+			audiosys_sound_volume_set( audiosys, handles[ i ], 0.25f + 0.5f * (float)( ( call + i ) & 15 ) / 15.0f );
+			audiosys_sound_pan_set( audiosys, handles[ i ], (float)( ( call * 3 + i ) & 31 ) / 15.5f - 1.0f );
+		}
+		audiosys_render( audiosys, benchmark_audiosys_output, BENCHMARK_AUDIOSYS_CALL_SIZE );
+	}
+	double elapsed = benchmark_audiosys_seconds() - start;
+	printf( "%-24s %4d voices: %8.3f ms per second of audio, %7.1fx realtime\n", name, voices, 
+		elapsed * 1000.0 / BENCHMARK_AUDIOSYS_SECONDS, BENCHMARK_AUDIOSYS_SECONDS / elapsed );
+	audiosys_destroy( audiosys );
+	free( handles );
+	free( sources );
+}
+
+
+// Plays many sounds at different priorities, with only `voices` of them mixed and the rest virtual, and changes the 
+// volume of a few sounds each call, so the most audible ones slowly trade places
+static void benchmark_audiosys_virtual( int sounds, int voices ) {
+	audiosys_t* audiosys = audiosys_create( voices, NULL );
+	benchmark_audiosys_source_t* sources = (benchmark_audiosys_source_t*) malloc( sizeof( *sources ) * sounds );
+	AUDIOSYS_U64* handles = (AUDIOSYS_U64*) malloc( sizeof( *handles ) * sounds );
+	for( int i = 0; i < sounds; ++i ) {
+		handles[ i ] = audiosys_sound_play( audiosys, benchmark_audiosys_source( &sources[ i ], i, 44100 ), 
+			1.0f + (float)( i % 7 ), 0.0f );
+	}
+	int calls = BENCHMARK_AUDIOSYS_SECONDS * 44100 / BENCHMARK_AUDIOSYS_CALL_SIZE;
+	double start = benchmark_audiosys_seconds();
+	for( int call = 0; call < calls; ++call ) {
+		for( int i = 0; i < 64; ++i ) {
+			int sound = ( call * 64 + i ) % sounds;
+			audiosys_sound_volume_set( audiosys, handles[ sound ], 0.25f + 0.5f * (float)( ( call + sound ) & 15 ) / 15.0f );
+		}
+		audiosys_render( audiosys, benchmark_audiosys_output, BENCHMARK_AUDIOSYS_CALL_SIZE );
+	}
+	double elapsed = benchmark_audiosys_seconds() - start;
+	printf( "virtual voices %4d sounds, %4d mixed: %8.3f ms per second of audio, %7.1fx realtime\n", sounds, voices, 
+		elapsed * 1000.0 / BENCHMARK_AUDIOSYS_SECONDS, BENCHMARK_AUDIOSYS_SECONDS / elapsed );
+	audiosys_destroy( audiosys );
+	free( handles );
+	free( sources );
+}
+
+
+#define BENCHMARK_AUDIOSYS_OFFLINE_SECONDS 60
+
+// Renders BENCHMARK_AUDIOSYS_OFFLINE_SECONDS of a mix with resampled and pitched voices, bus filters and reverb, in
+// calls of `call_size` sample pairs, and returns the time it took and a hash of the output
+static double benchmark_audiosys_offline( int voices, int call_size, AUDIOSYS_U64* hash ) {
+	audiosys_t* audiosys = audiosys_create( voices, NULL );
+	benchmark_audiosys_source_t* sources = (benchmark_audiosys_source_t*) malloc( sizeof( *sources ) * voices );
+	for( int i = 0; i < voices; ++i ) {
+		AUDIOSYS_U64 handle = audiosys_sound_play( audiosys, 
+			benchmark_audiosys_source( &sources[ i ], i, i & 1 ? 48000 : 44100 ), 1.0f, 0.5f );
+		audiosys_sound_bus_set( audiosys, handle, AUDIOSYS_BUS_SOUNDS + i % ( AUDIOSYS_BUS_COUNT - AUDIOSYS_BUS_SOUNDS ) );
+		audiosys_sound_pitch_set( audiosys, handle, 0.9f + 0.2f * (float) i / (float) voices );
+		audiosys_sound_volume_set( audiosys, handle, 0.5f );
+	}
+	for( int bus = 0; bus < AUDIOSYS_BUS_COUNT; ++bus ) {
+		audiosys_bus_low_pass_set( audiosys, bus, 4000.0f + 2000.0f * (float) bus );
+		audiosys_bus_reverb_send_set( audiosys, bus, 0.1f );
+	}
+	*hash = 14695981039346656037ull;
+	int remaining = BENCHMARK_AUDIOSYS_OFFLINE_SECONDS * 44100;
+	double start = benchmark_audiosys_seconds();
+	while( remaining > 0 ) {
+		int count = remaining < call_size ? remaining : call_size;
+		audiosys_render( audiosys, benchmark_audiosys_output, count );
+		for( int i = 0; i < count * 2; ++i ) {
+			*hash = ( *hash ^ (AUDIOSYS_U64)(unsigned short) benchmark_audiosys_output[ i ] ) * 1099511628211ull;
+		}
+		remaining -= count;
+	}
+	double elapsed = benchmark_audiosys_seconds() - start;
+	audiosys_destroy( audiosys );
+	free( sources );
+	return elapsed;
+}
+
+int main( int argc, char** argv ) {
+	(void) argc, (void) argv;
+
+	#if defined( AUDIOSYS_SIMD_SSE2 )
+		printf( "audiosys benchmark, SSE2\n" );
+	#elif defined( AUDIOSYS_SIMD_NEON )
+		printf( "audiosys benchmark, NEON\n" );
+	#else
+		printf( "audiosys benchmark, plain C\n" );
+	#endif
+
+	benchmark_audiosys_mix( "mix", 16, 44100, AUDIOSYS_RESAMPLE_SINC );
+	benchmark_audiosys_mix( "mix", 64, 44100, AUDIOSYS_RESAMPLE_SINC );
+	benchmark_audiosys_mix( "mix", 256, 44100, AUDIOSYS_RESAMPLE_SINC );
+	benchmark_audiosys_mix( "resample 48000 sinc", 16, 48000, AUDIOSYS_RESAMPLE_SINC );
+	benchmark_audiosys_mix( "resample 48000 sinc", 64, 48000, AUDIOSYS_RESAMPLE_SINC );
+	benchmark_audiosys_mix( "resample 22050 sinc", 64, 22050, AUDIOSYS_RESAMPLE_SINC );
+	benchmark_audiosys_mix( "resample 48000 linear", 64, 48000, AUDIOSYS_RESAMPLE_LINEAR );
+	benchmark_audiosys_mix( "resample 22050 linear", 64, 22050, AUDIOSYS_RESAMPLE_LINEAR );
+	benchmark_audiosys_virtual( 5000, 32 );
+	benchmark_audiosys_virtual( 5000, 5000 );
+
+	AUDIOSYS_U64 hash_a, hash_b;
+	double realtime_calls = benchmark_audiosys_offline( 64, BENCHMARK_AUDIOSYS_CALL_SIZE, &hash_a );
+	double offline_calls = benchmark_audiosys_offline( 64, 44100, &hash_a );
+	benchmark_audiosys_offline( 64, 44100, &hash_b );
+	printf( "offline, %d seconds of 64 voices: %.3f s in %d sample pair calls, %.3f s in one second calls (%.1fx "
+		"realtime), same output both runs: %s\n", BENCHMARK_AUDIOSYS_OFFLINE_SECONDS, realtime_calls, 
+		BENCHMARK_AUDIOSYS_CALL_SIZE, offline_calls, BENCHMARK_AUDIOSYS_OFFLINE_SECONDS / offline_calls, 
+		hash_a == hash_b ? "yes" : "NO" );
+
+	return EXIT_SUCCESS;
+}
+
+
+#if defined( AUDIOSYS_THREADED ) || AUDIOSYS_BUS_THREADS > 0
+	#define THREAD_IMPLEMENTATION
+	#include "thread.h"
+#endif
+
+#endif /* AUDIOSYS_RUN_BENCHMARK */
+
 /*
 ------------------------------------------------------------------------------
 
@@ -8,12 +8,33 @@ buffer.h - v0.1 - Memory buffer with read/write operations, for C/C++.
 Do this:
     #define BUFFER_IMPLEMENTATION
 before you include this file in *one* C/C++ file to create the implementation.
+
+To compare buffer_map_file with buffer_load, and measure varint and bit packing throughput, on a given platform, build 
+and run the benchmark:
+    clang -O2 -DBUFFER_RUN_BENCHMARK -DBUFFER_IMPLEMENTATION -xc buffer.h -o benchmark.exe
 */
 
 #ifndef buffer_h
 #define buffer_h
 
+#ifdef BUFFER_RUN_BENCHMARK
+    // the benchmark is built on its own, so it includes what the header expects the includer to have included
+    #if !defined( _WIN32 ) && !defined( _POSIX_C_SOURCE )
+        #define _POSIX_C_SOURCE 200112L
+    #endif
+    #include <stddef.h>
+    #include <stdint.h>
+    #ifndef __cplusplus
+        #include <stdbool.h>
+    #endif
+#endif
+
 // If you want buffer to swap endianness on read/write, do this before include: #define BUFFER_BIG_ENDIAN
+// To disable the SSE2/NEON byte swapping code paths, do this before including the implementation: #define BUFFER_NO_SIMD
+// To enable streaming buffers, do this before including the implementation: #define BUFFER_STREAMING
+// On POSIX systems, the implementation defines _POSIX_C_SOURCE (unless already defined) while including the system
+// headers it needs, and undefines it again afterwards. With strict modes like -std=c99, the implementation must be
+// included before any other system header, or _POSIX_C_SOURCE defined to 200112L or later on the command line.
 
 #ifndef BUFFER_I8_T
     #define BUFFER_I8_T char
@@ -50,11 +71,34 @@ before you include this file in *one* C/C++ file to create the implementation.
 
 typedef struct buffer_t buffer_t;
 
+typedef enum buffer_map_mode_t {
+    BUFFER_MAP_READ_ONLY,
+    BUFFER_MAP_READ_WRITE,
+} buffer_map_mode_t;
+
+typedef enum buffer_access_t {
+    BUFFER_ACCESS_DEFAULT,
+    BUFFER_ACCESS_SEQUENTIAL,
+    BUFFER_ACCESS_RANDOM,
+} buffer_access_t;
+
 buffer_t* buffer_create( void );
 buffer_t* buffer_load( const char* filename );
 buffer_t* buffer_map( void* data, size_t size );
+buffer_t* buffer_map_file( char const* filename, buffer_map_mode_t mode, buffer_access_t access );
 void buffer_destroy( buffer_t* buffer );
 bool buffer_save( buffer_t* buffer, char const* filename );
+bool buffer_sync( buffer_t* buffer );
+
+// Streaming buffers keep only a window of the file in memory, and are read or written sequentially. A background
+// thread (from thread.h) reads the next window ahead of time, or writes out the previous one, so that once warmed up
+// buffer_read_*/buffer_write_* calls don't wait for I/O. Requires BUFFER_STREAMING to be defined where the
+// implementation is included, and thread.h to be available. buffer_stream_close destroys a streaming buffer like
+// buffer_destroy does, but also returns false if any of the data written to it didn't make it to the file, including
+// the last window, which is only written when the buffer is closed. buffer_destroy ignores write errors.
+buffer_t* buffer_stream_open( char const* filename, size_t window_size );
+buffer_t* buffer_stream_create( char const* filename, size_t window_size );
+bool buffer_stream_close( buffer_t* buffer );
 void buffer_resize( buffer_t* buffer, size_t size );
 size_t buffer_position( buffer_t* buffer );
 size_t buffer_position_set( buffer_t* buffer, size_t position );
@@ -74,6 +118,41 @@ int buffer_read_float( buffer_t* buffer, float* value, int count );
 int buffer_read_double( buffer_t* buffer, double* value, int count );
 int buffer_read_bool( buffer_t* buffer, bool* value, int count );
 
+// Explicit byte order reads: the data in the buffer is big/little endian regardless of BUFFER_BIG_ENDIAN, and is
+// converted to host order. Bulk counts are byte-swapped with SSE2/NEON where available.
+int buffer_read_i16_be( buffer_t* buffer, BUFFER_I16_T* value, int count );
+int buffer_read_i32_be( buffer_t* buffer, BUFFER_I32_T* value, int count );
+int buffer_read_i64_be( buffer_t* buffer, BUFFER_I64_T* value, int count );
+int buffer_read_u16_be( buffer_t* buffer, BUFFER_U16_T* value, int count );
+int buffer_read_u32_be( buffer_t* buffer, BUFFER_U32_T* value, int count );
+int buffer_read_u64_be( buffer_t* buffer, BUFFER_U64_T* value, int count );
+int buffer_read_float_be( buffer_t* buffer, float* value, int count );
+int buffer_read_double_be( buffer_t* buffer, double* value, int count );
+int buffer_read_i16_le( buffer_t* buffer, BUFFER_I16_T* value, int count );
+int buffer_read_i32_le( buffer_t* buffer, BUFFER_I32_T* value, int count );
+int buffer_read_i64_le( buffer_t* buffer, BUFFER_I64_T* value, int count );
+int buffer_read_u16_le( buffer_t* buffer, BUFFER_U16_T* value, int count );
+int buffer_read_u32_le( buffer_t* buffer, BUFFER_U32_T* value, int count );
+int buffer_read_u64_le( buffer_t* buffer, BUFFER_U64_T* value, int count );
+int buffer_read_float_le( buffer_t* buffer, float* value, int count );
+int buffer_read_double_le( buffer_t* buffer, double* value, int count );
+
+// Zero-copy reads: returns a pointer to `count` values at the current position and advances past them, or NULL (with
+// the position unchanged) if there are not enough bytes left, the position is not aligned for the type, or the values
+// would need byte swapping (BUFFER_BIG_ENDIAN). On NULL, fall back to the corresponding buffer_read_* function. The
+// pointer is valid until the buffer is written to, resized or destroyed.
+char const* buffer_view_char( buffer_t* buffer, int count );
+BUFFER_I8_T const* buffer_view_i8( buffer_t* buffer, int count );
+BUFFER_I16_T const* buffer_view_i16( buffer_t* buffer, int count );
+BUFFER_I32_T const* buffer_view_i32( buffer_t* buffer, int count );
+BUFFER_I64_T const* buffer_view_i64( buffer_t* buffer, int count );
+BUFFER_U8_T const* buffer_view_u8( buffer_t* buffer, int count );
+BUFFER_U16_T const* buffer_view_u16( buffer_t* buffer, int count );
+BUFFER_U32_T const* buffer_view_u32( buffer_t* buffer, int count );
+BUFFER_U64_T const* buffer_view_u64( buffer_t* buffer, int count );
+float const* buffer_view_float( buffer_t* buffer, int count );
+double const* buffer_view_double( buffer_t* buffer, int count );
+
 int buffer_write_char( buffer_t* buffer, char const* value, int count );
 int buffer_write_i8( buffer_t* buffer, BUFFER_I8_T const* value, int count );
 int buffer_write_i16( buffer_t* buffer, BUFFER_I16_T const* value, int count );
@@ -87,16 +166,90 @@ int buffer_write_float( buffer_t* buffer, float const* value, int count );
 int buffer_write_double( buffer_t* buffer, double const* value, int count );
 int buffer_write_bool( buffer_t* buffer, bool const* value, int count );
 
+// Variable length integers: LEB128, 7 bits per byte, so small values take fewer bytes. The zigzag variants map signed
+// values to unsigned ones first (0, -1, 1, -2, ... becomes 0, 1, 2, 3, ...) so small negative values stay small too.
+// Reads stop at a truncated or malformed (longer than 10 bytes) value, leaving the position at its first byte.
+int buffer_read_varint( buffer_t* buffer, BUFFER_U64_T* value, int count );
+int buffer_read_zigzag( buffer_t* buffer, BUFFER_I64_T* value, int count );
+int buffer_write_varint( buffer_t* buffer, BUFFER_U64_T const* value, int count );
+int buffer_write_zigzag( buffer_t* buffer, BUFFER_I64_T const* value, int count );
+
+// Bit packing: values of 1 to 32 bits are packed LSB first through a 64-bit accumulator. A buffer_bits_t is used for
+// either reading or writing, not both. When writing, call buffer_bits_flush when done, to write out the last partial
+// byte. buffer_bits_read returns false, and consumes nothing, if fewer than `bit_count` bits are left. The reader fills
+// its accumulator up to 8 bytes at a time, so it may have read ahead of the last bit returned; call buffer_bits_align
+// when done, to discard the rest of the current byte and move the buffer back to the first byte not yet returned, so
+// the buffer can be read normally after it.
+typedef struct buffer_bits_t {
+    buffer_t* buffer;
+    BUFFER_U64_T accumulator;
+    int count;
+} buffer_bits_t;
+
+void buffer_bits_init( buffer_bits_t* bits, buffer_t* buffer );
+bool buffer_bits_write( buffer_bits_t* bits, BUFFER_U32_T value, int bit_count );
+bool buffer_bits_flush( buffer_bits_t* bits );
+bool buffer_bits_read( buffer_bits_t* bits, BUFFER_U32_T* value, int bit_count );
+void buffer_bits_align( buffer_bits_t* bits );
+
 #endif /* buffer_h */
 
 
 #ifdef BUFFER_IMPLEMENTATION
 #undef BUFFER_IMPLEMENTATION
 
+#if defined( _WIN32 )
+    #define _CRT_NONSTDC_NO_DEPRECATE
+    #define _CRT_SECURE_NO_WARNINGS
+#elif !defined( _POSIX_C_SOURCE )
+    // for posix_madvise in strict modes like -std=c99, and only for the includes below
+    #define _POSIX_C_SOURCE 200112L
+    #define BUFFER_INTERNAL_POSIX_C_SOURCE
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 
+#if defined( _WIN32 )
+    #if !defined( _WIN32_WINNT ) || _WIN32_WINNT < 0x0501
+        #undef _WIN32_WINNT
+        #define _WIN32_WINNT 0x0501 // requires Windows XP minimum
+    #endif
+    #define _WINSOCKAPI_
+    #pragma warning( push )
+    #pragma warning( disable: 4619 )
+    #pragma warning( disable: 4668 ) // 'symbol' is not defined as a preprocessor macro, replacing with '0' for 'directives'
+    #pragma warning( disable: 4768 ) // __declspec attributes before linkage specification are ignored
+    #pragma warning( disable: 4255 ) // 'function' : no function prototype given: converting '()' to '(void)'
+    #include <windows.h>
+    #pragma warning( pop )
+#else
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#ifdef BUFFER_INTERNAL_POSIX_C_SOURCE
+    #undef _POSIX_C_SOURCE
+    #undef BUFFER_INTERNAL_POSIX_C_SOURCE
+#endif
+
+#ifdef BUFFER_STREAMING
+    #include "thread.h"
+#endif
+
+#ifndef BUFFER_NO_SIMD
+    #if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+        #include <emmintrin.h>
+        #define BUFFER_SIMD_SSE2
+    #elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+        #include <arm_neon.h>
+        #define BUFFER_SIMD_NEON
+    #endif
+#endif
+
 static BUFFER_U32_T buffer_pow2ceil( BUFFER_U32_T v ) {
     --v;
     v |= v >> 1;
@@ -116,9 +269,245 @@ struct buffer_t {
     size_t position;
     void* data;
     int is_mapped;
+    int is_file_mapped;
+    int is_read_only;
+    #if defined( _WIN32 )
+        HANDLE file;
+        HANDLE mapping;
+    #endif
+    struct buffer_internal_stream_t* stream;
+};
+
+
+#ifdef BUFFER_STREAMING
+
+// Room in front of each read window, so the few bytes left at the end of one window can be moved in front of the next
+// and a value straddling the two can still be read with a single memcpy.
+#define BUFFER_STREAM_CARRY 16
+
+struct buffer_internal_stream_t {
+    FILE* fp;
+    int writing;
+    size_t window_size;
+    BUFFER_U8_T* windows[ 2 ];
+    int current;
+    size_t offset; // file offset of buffer->data[ 0 ]
+    size_t file_size;
+    int eof;
+    int failed;
+
+    thread_ptr_t thread;
+    thread_signal_t request;
+    thread_signal_t done;
+    thread_atomic_int_t exit_flag;
+    int pending;
+    void* job_data;
+    size_t job_size;
+    size_t job_result;
 };
 
 
+static int buffer_internal_stream_thread( void* user_data ) {
+    struct buffer_internal_stream_t* stream = (struct buffer_internal_stream_t*) user_data;
+    for( ; ; ) {
+        thread_signal_wait( &stream->request, THREAD_SIGNAL_WAIT_INFINITE );
+        if( thread_atomic_int_load( &stream->exit_flag ) ) {
+            break;
+        }
+        if( stream->writing ) {
+            stream->job_result = fwrite( stream->job_data, 1, stream->job_size, stream->fp );
+        } else {
+            stream->job_result = fread( stream->job_data, 1, stream->job_size, stream->fp );
+        }
+        thread_signal_raise( &stream->done );
+    }
+    return 0;
+}
+
+
+static void buffer_internal_stream_submit( struct buffer_internal_stream_t* stream, void* data, size_t size ) {
+    stream->job_data = data;
+    stream->job_size = size;
+    stream->pending = 1;
+    thread_signal_raise( &stream->request );
+}
+
+
+static size_t buffer_internal_stream_wait( struct buffer_internal_stream_t* stream ) {
+    if( !stream->pending ) {
+        return 0;
+    }
+    thread_signal_wait( &stream->done, THREAD_SIGNAL_WAIT_INFINITE );
+    stream->pending = 0;
+    if( stream->job_result != stream->job_size && stream->writing ) {
+        stream->failed = 1;
+    }
+    return stream->job_result;
+}
+
+
+static buffer_t* buffer_internal_stream_init( char const* filename, size_t window_size, int writing ) {
+    FILE* fp = fopen( filename, writing ? "wb" : "rb" );
+    if( !fp ) {
+        return NULL;
+    }
+    if( window_size < 4096 ) {
+        window_size = 4096;
+    }
+    struct buffer_internal_stream_t* stream = (struct buffer_internal_stream_t*) malloc(
+        sizeof( struct buffer_internal_stream_t ) );
+    memset( stream, 0, sizeof( *stream ) );
+    stream->fp = fp;
+    stream->writing = writing;
+    stream->window_size = window_size;
+    if( !writing ) {
+        #if defined( _WIN32 )
+            _fseeki64( fp, 0, SEEK_END );
+            stream->file_size = (size_t) _ftelli64( fp );
+            _fseeki64( fp, 0, SEEK_SET );
+        #else
+            struct stat st; // stat rather than fseeko/ftello, which strict modes like -std=c99 don't declare
+            stream->file_size = stat( filename, &st ) == 0 ? (size_t) st.st_size : 0;
+        #endif
+    }
+    for( int i = 0; i < 2; ++i ) {
+        stream->windows[ i ] = (BUFFER_U8_T*) malloc( BUFFER_STREAM_CARRY + window_size );
+    }
+    thread_signal_init( &stream->request );
+    thread_signal_init( &stream->done );
+    thread_atomic_int_store( &stream->exit_flag, 0 );
+    stream->thread = thread_create( buffer_internal_stream_thread, stream, THREAD_STACK_SIZE_DEFAULT );
+
+    buffer_t* buffer = (buffer_t*) malloc( sizeof( buffer_t) );
+    buffer->capacity = window_size;
+    buffer->position = 0;
+    buffer->is_mapped = 1;
+    buffer->is_file_mapped = 0;
+    buffer->is_read_only = !writing;
+    buffer->stream = stream;
+    if( writing ) {
+        buffer->data = stream->windows[ 0 ];
+        buffer->size = window_size;
+    } else {
+        // Fill the first window before returning, and immediately start reading ahead into the second one
+        buffer->data = stream->windows[ 0 ] + BUFFER_STREAM_CARRY;
+        buffer_internal_stream_submit( stream, buffer->data, window_size );
+        buffer->size = buffer_internal_stream_wait( stream );
+        stream->eof = buffer->size < window_size;
+        if( !stream->eof ) {
+            buffer_internal_stream_submit( stream, stream->windows[ 1 ] + BUFFER_STREAM_CARRY, window_size );
+        }
+    }
+    return buffer;
+}
+
+
+// Called when a read runs past the end of the current window. Moves the unread tail in front of the read-ahead window,
+// swaps to it and starts reading ahead into the window just released. Returns non-zero if `needed` bytes are available.
+static int buffer_internal_stream_refill( buffer_t* buffer, size_t needed ) {
+    struct buffer_internal_stream_t* stream = buffer->stream;
+    if( !stream || stream->writing || stream->eof ) {
+        return 0;
+    }
+    size_t position = buffer->position > buffer->size ? buffer->size : buffer->position;
+    size_t tail = buffer->size - position;
+    if( tail > BUFFER_STREAM_CARRY ) {
+        return 1; // caller hasn't consumed the window yet, so leave the read-ahead pending
+    }
+    size_t filled = buffer_internal_stream_wait( stream );
+    BUFFER_U8_T* next = stream->windows[ 1 - stream->current ] + BUFFER_STREAM_CARRY - tail;
+    memmove( next, (void*)( ( (uintptr_t) buffer->data ) + position ), tail );
+    stream->offset += position;
+    buffer->data = next;
+    buffer->size = tail + filled;
+    buffer->position = 0;
+    stream->current = 1 - stream->current;
+    stream->eof = filled < stream->window_size;
+    if( !stream->eof ) {
+        buffer_internal_stream_submit( stream, stream->windows[ 1 - stream->current ] + BUFFER_STREAM_CARRY,
+            stream->window_size );
+    }
+    return buffer->size >= needed;
+}
+
+
+// Called when a write runs past the end of the current window. Hands the window to the background thread to be
+// written, and continues in the other window once its previous write has completed.
+static int buffer_internal_stream_flush( buffer_t* buffer ) {
+    struct buffer_internal_stream_t* stream = buffer->stream;
+    buffer_internal_stream_wait( stream );
+    if( stream->failed ) {
+        return 0;
+    }
+    buffer_internal_stream_submit( stream, buffer->data, buffer->position );
+    stream->offset += buffer->position;
+    stream->current = 1 - stream->current;
+    buffer->data = stream->windows[ stream->current ];
+    buffer->position = 0;
+    return 1;
+}
+
+
+// Returns 0 if any write failed, including the flush of the last window and the fclose
+static int buffer_internal_stream_close( buffer_t* buffer ) {
+    struct buffer_internal_stream_t* stream = buffer->stream;
+    if( stream->writing && buffer->position > 0 ) {
+        buffer_internal_stream_flush( buffer );
+    }
+    buffer_internal_stream_wait( stream );
+    thread_atomic_int_store( &stream->exit_flag, 1 );
+    thread_signal_raise( &stream->request );
+    thread_join( stream->thread );
+    thread_destroy( stream->thread );
+    thread_signal_term( &stream->request );
+    thread_signal_term( &stream->done );
+    int failed = stream->failed;
+    if( fclose( stream->fp ) != 0 && stream->writing ) {
+        failed = 1;
+    }
+    free( stream->windows[ 0 ] );
+    free( stream->windows[ 1 ] );
+    free( stream );
+    return !failed;
+}
+
+
+buffer_t* buffer_stream_open( char const* filename, size_t window_size ) {
+    return buffer_internal_stream_init( filename, window_size, 0 );
+}
+
+
+buffer_t* buffer_stream_create( char const* filename, size_t window_size ) {
+    return buffer_internal_stream_init( filename, window_size, 1 );
+}
+
+
+bool buffer_stream_close( buffer_t* buffer ) {
+    if( !buffer->stream ) {
+        buffer_destroy( buffer );
+        return true;
+    }
+    int result = buffer_internal_stream_close( buffer );
+    free( buffer );
+    return result ? true : false;
+}
+
+#else
+
+static int buffer_internal_stream_refill( buffer_t* buffer, size_t needed ) {
+    (void) buffer, (void) needed;
+    return 0;
+}
+
+
+static int buffer_internal_stream_flush( buffer_t* buffer ) {
+    (void) buffer;
+    return 0;
+}
+
+#endif /* BUFFER_STREAMING */
+
+
 buffer_t* buffer_create( void ) {
     buffer_t* buffer = (buffer_t*) malloc( sizeof( buffer_t) );
     buffer->capacity = 4096;
@@ -126,6 +515,9 @@ buffer_t* buffer_create( void ) {
     buffer->position = 0;
     buffer->data = malloc( buffer->capacity );
     buffer->is_mapped = 0;
+    buffer->is_file_mapped = 0;
+    buffer->is_read_only = 0;
+    buffer->stream = NULL;
     return buffer;
 }
 
@@ -158,6 +550,9 @@ buffer_t* buffer_load( const char* filename ) {
     buffer->position = 0;
     buffer->data = data;
     buffer->is_mapped = 0;
+    buffer->is_file_mapped = 0;
+    buffer->is_read_only = 0;
+    buffer->stream = NULL;
     return buffer;
 }
 
@@ -172,18 +567,124 @@ buffer_t* buffer_map( void* data, size_t size ) {
     buffer->position = 0;
     buffer->data = data;
     buffer->is_mapped = 1;
+    buffer->is_file_mapped = 0;
+    buffer->is_read_only = 0;
+    buffer->stream = NULL;
+    return buffer;
+}
+
+
+// Maps the file into memory instead of reading it, so pages are only brought in when touched and no copy is made. The
+// buffer can't grow; writes to a BUFFER_MAP_READ_WRITE mapping go straight to the file (call buffer_sync to flush them)
+// and writes to a BUFFER_MAP_READ_ONLY mapping are rejected. The access hint is passed on to the OS read-ahead.
+buffer_t* buffer_map_file( char const* filename, buffer_map_mode_t mode, buffer_access_t access ) {
+    int writable = mode == BUFFER_MAP_READ_WRITE;
+    #if defined( _WIN32 )
+        DWORD flags = FILE_ATTRIBUTE_NORMAL;
+        if( access == BUFFER_ACCESS_SEQUENTIAL ) flags |= FILE_FLAG_SEQUENTIAL_SCAN;
+        if( access == BUFFER_ACCESS_RANDOM ) flags |= FILE_FLAG_RANDOM_ACCESS;
+        HANDLE file = CreateFileA( filename, writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ,
+            NULL, OPEN_EXISTING, flags, NULL );
+        if( file == INVALID_HANDLE_VALUE ) {
+            return NULL;
+        }
+        LARGE_INTEGER file_size;
+        if( !GetFileSizeEx( file, &file_size ) || file_size.QuadPart == 0 ) {
+            CloseHandle( file );
+            return NULL;
+        }
+        HANDLE mapping = CreateFileMappingA( file, NULL, writable ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL );
+        if( !mapping ) {
+            CloseHandle( file );
+            return NULL;
+        }
+        void* data = MapViewOfFile( mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0 );
+        if( !data ) {
+            CloseHandle( mapping );
+            CloseHandle( file );
+            return NULL;
+        }
+        size_t size = (size_t) file_size.QuadPart;
+    #else
+        int fd = open( filename, writable ? O_RDWR : O_RDONLY );
+        if( fd < 0 ) {
+            return NULL;
+        }
+        struct stat st;
+        if( fstat( fd, &st ) != 0 || st.st_size == 0 ) {
+            close( fd );
+            return NULL;
+        }
+        size_t size = (size_t) st.st_size;
+        void* data = mmap( NULL, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0 );
+        close( fd ); // the mapping keeps its own reference to the file
+        if( data == MAP_FAILED ) {
+            return NULL;
+        }
+        #ifdef POSIX_MADV_SEQUENTIAL // not declared if a system header was included before _POSIX_C_SOURCE was defined
+            if( access == BUFFER_ACCESS_SEQUENTIAL ) {
+                posix_madvise( data, size, POSIX_MADV_SEQUENTIAL );
+            } else if( access == BUFFER_ACCESS_RANDOM ) {
+                posix_madvise( data, size, POSIX_MADV_RANDOM );
+            }
+        #else
+            (void) access;
+        #endif
+    #endif
+
+    buffer_t* buffer = (buffer_t*) malloc( sizeof( buffer_t) );
+    buffer->capacity = size;
+    buffer->size = size;
+    buffer->position = 0;
+    buffer->data = data;
+    buffer->is_mapped = 1;
+    buffer->is_file_mapped = 1;
+    buffer->is_read_only = !writable;
+    buffer->stream = NULL;
+    #if defined( _WIN32 )
+        buffer->file = file;
+        buffer->mapping = mapping;
+    #endif
     return buffer;
 }
 
 
 void buffer_destroy( buffer_t* buffer ) {
-    if( !buffer->is_mapped ) {
+    #ifdef BUFFER_STREAMING
+        if( buffer->stream ) {
+            buffer_internal_stream_close( buffer );
+            free( buffer );
+            return;
+        }
+    #endif
+    if( buffer->is_file_mapped ) {
+        #if defined( _WIN32 )
+            UnmapViewOfFile( buffer->data );
+            CloseHandle( buffer->mapping );
+            CloseHandle( buffer->file );
+        #else
+            munmap( buffer->data, buffer->size );
+        #endif
+    } else if( !buffer->is_mapped ) {
         free( buffer->data );
     }
     free( buffer );
 }
 
 
+// Flushes modified pages of a BUFFER_MAP_READ_WRITE file mapping back to disk. Does nothing for other buffers.
+bool buffer_sync( buffer_t* buffer ) {
+    if( !buffer->is_file_mapped || buffer->is_read_only ) {
+        return true;
+    }
+    #if defined( _WIN32 )
+        return FlushViewOfFile( buffer->data, 0 ) && FlushFileBuffers( buffer->file );
+    #else
+        return msync( buffer->data, buffer->size, MS_SYNC ) == 0;
+    #endif
+}
+
+
 bool buffer_save( buffer_t* buffer, char const* filename ) {
     FILE* fp = fopen( filename, "wb" );
     if( !fp ) {
@@ -214,11 +715,26 @@ void buffer_resize( buffer_t* buffer, size_t size ) {
 
 size_t buffer_position( buffer_t* buffer ) {
     size_t result = buffer->position;
+    #ifdef BUFFER_STREAMING
+        if( buffer->stream ) {
+            result += buffer->stream->offset;
+        }
+    #endif
     return result;
 }
 
 
 size_t buffer_position_set( buffer_t* buffer, size_t position ) {
+    #ifdef BUFFER_STREAMING
+        // Streams can only be repositioned within the current window when reading, and not at all when writing
+        if( buffer->stream ) {
+            struct buffer_internal_stream_t* stream = buffer->stream;
+            if( !stream->writing && position >= stream->offset && position - stream->offset <= buffer->size ) {
+                buffer->position = position - stream->offset;
+            }
+            return stream->offset + buffer->position;
+        }
+    #endif
     buffer->position = position > buffer->size ? buffer->size : position;
     size_t result = buffer->position;
     return result;
@@ -227,6 +743,12 @@ size_t buffer_position_set( buffer_t* buffer, size_t position ) {
 
 size_t buffer_size( buffer_t* buffer ) {
     size_t result = buffer->size;
+    #ifdef BUFFER_STREAMING
+        if( buffer->stream ) {
+            struct buffer_internal_stream_t* stream = buffer->stream;
+            result = stream->writing ? stream->offset + buffer->position : stream->file_size;
+        }
+    #endif
     return result;
 }
 
@@ -241,7 +763,7 @@ void* buffer_data( buffer_t* buffer ) {
             int result = 0; \
             for( int i = 0; i < count; ++i ) { \
                 if( buffer->position + sizeof( *value ) > buffer->size ) { \
-                    return result; \
+                    if( !buffer->stream || !buffer_internal_stream_refill( buffer, sizeof( *value ) ) ) return result; \
                 } \
                 memcpy( &value[ i ], (void*)( ( (uintptr_t) buffer->data ) + buffer->position ), sizeof( *value ) ); \
                 buffer->position += sizeof( *value ); \
@@ -255,7 +777,7 @@ void* buffer_data( buffer_t* buffer ) {
             int result = 0; \
             for( int i = 0; i < count; ++i ) { \
                 if( buffer->position + sizeof( *value ) > buffer->size ) { \
-                    return result; \
+                    if( !buffer->stream || !buffer_internal_stream_refill( buffer, sizeof( *value ) ) ) return result; \
                 } \
                 void* x = &value[ i ]; \
                 memcpy( x, (void*)( ( (uintptr_t) buffer->data ) + buffer->position ), sizeof( *value ) ); \
@@ -302,18 +824,138 @@ int buffer_read_bool( buffer_t* buffer, bool* value, int count ) BUFFER_READ_IMP
 #undef BUFFER_READ_IMPL
 
 
+static int buffer_internal_host_is_big_endian( void ) {
+    BUFFER_U16_T value = 0x0102;
+    BUFFER_U8_T bytes[ 2 ];
+    memcpy( bytes, &value, sizeof( bytes ) );
+    return bytes[ 0 ] == 0x01;
+}
+
+
+// In-place byte swap of `count` elements of `size` bytes (2, 4 or 8). The SIMD paths handle 16 bytes at a time and the
+// remainder is done one element at a time.
+static void buffer_internal_swap( void* data, size_t size, int count ) {
+    BUFFER_U8_T* bytes = (BUFFER_U8_T*) data;
+    size_t total = size * (size_t) count;
+    size_t offset = 0;
+    #if defined( BUFFER_SIMD_SSE2 )
+        for( ; offset + 16 <= total; offset += 16 ) {
+            __m128i v = _mm_loadu_si128( (__m128i const*)( bytes + offset ) );
+            v = _mm_or_si128( _mm_slli_epi16( v, 8 ), _mm_srli_epi16( v, 8 ) );
+            if( size == 4 ) {
+                v = _mm_shufflehi_epi16( _mm_shufflelo_epi16( v, _MM_SHUFFLE( 2, 3, 0, 1 ) ), _MM_SHUFFLE( 2, 3, 0, 1 ) );
+            } else if( size == 8 ) {
+                v = _mm_shufflehi_epi16( _mm_shufflelo_epi16( v, _MM_SHUFFLE( 0, 1, 2, 3 ) ), _MM_SHUFFLE( 0, 1, 2, 3 ) );
+            }
+            _mm_storeu_si128( (__m128i*)( bytes + offset ), v );
+        }
+    #elif defined( BUFFER_SIMD_NEON )
+        for( ; offset + 16 <= total; offset += 16 ) {
+            uint8x16_t v = vld1q_u8( bytes + offset );
+            v = size == 2 ? vrev16q_u8( v ) : size == 4 ? vrev32q_u8( v ) : vrev64q_u8( v );
+            vst1q_u8( bytes + offset, v );
+        }
+    #endif
+    for( ; offset < total; offset += size ) {
+        for( size_t i = 0; i < size / 2; ++i ) {
+            BUFFER_U8_T t = bytes[ offset + i ];
+            bytes[ offset + i ] = bytes[ offset + size - 1 - i ];
+            bytes[ offset + size - 1 - i ] = t;
+        }
+    }
+}
+
+
+static int buffer_internal_read_ordered( buffer_t* buffer, void* value, size_t size, int count, int big_endian ) {
+    int result = 0;
+    while( result < count ) {
+        size_t available = buffer->position < buffer->size ? ( buffer->size - buffer->position ) / size : 0;
+        if( available == 0 ) {
+            if( !buffer->stream || !buffer_internal_stream_refill( buffer, size ) ) {
+                break;
+            }
+            continue;
+        }
+        int chunk = available < (size_t)( count - result ) ? (int) available : count - result;
+        memcpy( (void*)( ( (uintptr_t) value ) + size * (size_t) result ),
+            (void*)( ( (uintptr_t) buffer->data ) + buffer->position ), size * (size_t) chunk );
+        buffer->position += size * (size_t) chunk;
+        result += chunk;
+    }
+    if( result > 0 && big_endian != buffer_internal_host_is_big_endian() ) {
+        buffer_internal_swap( value, size, result );
+    }
+    return result;
+}
+
+
+int buffer_read_i16_be( buffer_t* buffer, BUFFER_I16_T* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 1 ); }
+int buffer_read_i32_be( buffer_t* buffer, BUFFER_I32_T* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 1 ); }
+int buffer_read_i64_be( buffer_t* buffer, BUFFER_I64_T* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 1 ); }
+int buffer_read_u16_be( buffer_t* buffer, BUFFER_U16_T* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 1 ); }
+int buffer_read_u32_be( buffer_t* buffer, BUFFER_U32_T* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 1 ); }
+int buffer_read_u64_be( buffer_t* buffer, BUFFER_U64_T* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 1 ); }
+int buffer_read_float_be( buffer_t* buffer, float* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 1 ); }
+int buffer_read_double_be( buffer_t* buffer, double* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 1 ); }
+int buffer_read_i16_le( buffer_t* buffer, BUFFER_I16_T* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 0 ); }
+int buffer_read_i32_le( buffer_t* buffer, BUFFER_I32_T* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 0 ); }
+int buffer_read_i64_le( buffer_t* buffer, BUFFER_I64_T* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 0 ); }
+int buffer_read_u16_le( buffer_t* buffer, BUFFER_U16_T* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 0 ); }
+int buffer_read_u32_le( buffer_t* buffer, BUFFER_U32_T* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 0 ); }
+int buffer_read_u64_le( buffer_t* buffer, BUFFER_U64_T* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 0 ); }
+int buffer_read_float_le( buffer_t* buffer, float* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 0 ); }
+int buffer_read_double_le( buffer_t* buffer, double* value, int count ) { return buffer_internal_read_ordered( buffer, value, sizeof( *value ), count, 0 ); }
+
+
+static void const* buffer_internal_view( buffer_t* buffer, size_t size, int count ) {
+    #ifdef BUFFER_BIG_ENDIAN
+        if( size > 1 ) {
+            return NULL;
+        }
+    #endif
+    if( count < 0 || buffer->position > buffer->size || ( buffer->size - buffer->position ) / size < (size_t) count ) {
+        return NULL;
+    }
+    uintptr_t address = ( (uintptr_t) buffer->data ) + buffer->position;
+    if( address % size != 0 ) {
+        return NULL;
+    }
+    buffer->position += size * (size_t) count;
+    return (void const*) address;
+}
+
+
+char const* buffer_view_char( buffer_t* buffer, int count ) { return (char const*) buffer_internal_view( buffer, sizeof( char ), count ); }
+BUFFER_I8_T const* buffer_view_i8( buffer_t* buffer, int count ) { return (BUFFER_I8_T const*) buffer_internal_view( buffer, sizeof( BUFFER_I8_T ), count ); }
+BUFFER_I16_T const* buffer_view_i16( buffer_t* buffer, int count ) { return (BUFFER_I16_T const*) buffer_internal_view( buffer, sizeof( BUFFER_I16_T ), count ); }
+BUFFER_I32_T const* buffer_view_i32( buffer_t* buffer, int count ) { return (BUFFER_I32_T const*) buffer_internal_view( buffer, sizeof( BUFFER_I32_T ), count ); }
+BUFFER_I64_T const* buffer_view_i64( buffer_t* buffer, int count ) { return (BUFFER_I64_T const*) buffer_internal_view( buffer, sizeof( BUFFER_I64_T ), count ); }
+BUFFER_U8_T const* buffer_view_u8( buffer_t* buffer, int count ) { return (BUFFER_U8_T const*) buffer_internal_view( buffer, sizeof( BUFFER_U8_T ), count ); }
+BUFFER_U16_T const* buffer_view_u16( buffer_t* buffer, int count ) { return (BUFFER_U16_T const*) buffer_internal_view( buffer, sizeof( BUFFER_U16_T ), count ); }
+BUFFER_U32_T const* buffer_view_u32( buffer_t* buffer, int count ) { return (BUFFER_U32_T const*) buffer_internal_view( buffer, sizeof( BUFFER_U32_T ), count ); }
+BUFFER_U64_T const* buffer_view_u64( buffer_t* buffer, int count ) { return (BUFFER_U64_T const*) buffer_internal_view( buffer, sizeof( BUFFER_U64_T ), count ); }
+float const* buffer_view_float( buffer_t* buffer, int count ) { return (float const*) buffer_internal_view( buffer, sizeof( float ), count ); }
+double const* buffer_view_double( buffer_t* buffer, int count ) { return (double const*) buffer_internal_view( buffer, sizeof( double ), count ); }
+
+
+
 #ifndef BUFFER_BIG_ENDIAN
     #define BUFFER_WRITE_IMPL \
         { \
             int result = 0; \
+            if( buffer->is_read_only ) return 0; \
             for( int i = 0; i < count; ++i ) { \
                 if( buffer->position + sizeof( *value ) > buffer->size ) { \
-                    if( buffer->is_mapped ) break; \
-                    buffer->size = buffer->position + sizeof( *value ); \
-                    while( buffer->size > buffer->capacity ) { \
-                        buffer->capacity *= 2; \
+                    if( buffer->stream ) { \
+                        if( !buffer_internal_stream_flush( buffer ) ) break; \
+                    } else { \
+                        if( buffer->is_mapped ) break; \
+                        buffer->size = buffer->position + sizeof( *value ); \
+                        while( buffer->size > buffer->capacity ) { \
+                            buffer->capacity *= 2; \
+                        } \
+                        buffer->data = realloc( buffer->data, buffer->capacity ); \
                     } \
-                    buffer->data = realloc( buffer->data, buffer->capacity ); \
                 } \
                 memcpy( (void*)( ( (uintptr_t) buffer->data ) + buffer->position ), &value[ i ], sizeof( *value ) ); \
                 buffer->position += sizeof( *value ); \
@@ -325,14 +967,19 @@ int buffer_read_bool( buffer_t* buffer, bool* value, int count ) BUFFER_READ_IMP
     #define BUFFER_WRITE_IMPL \
         { \
             int result = 0; \
+            if( buffer->is_read_only ) return 0; \
             for( int i = 0; i < count; ++i ) { \
                 if( buffer->position + sizeof( *value ) > buffer->size ) { \
-                    if( buffer->is_mapped ) break; \
-                    buffer->size = buffer->position + sizeof( *value ); \
-                    while( buffer->size > buffer->capacity ) { \
-                        buffer->capacity *= 2; \
+                    if( buffer->stream ) { \
+                        if( !buffer_internal_stream_flush( buffer ) ) break; \
+                    } else { \
+                        if( buffer->is_mapped ) break; \
+                        buffer->size = buffer->position + sizeof( *value ); \
+                        while( buffer->size > buffer->capacity ) { \
+                            buffer->capacity *= 2; \
+                        } \
+                        buffer->data = realloc( buffer->data, buffer->capacity ); \
                     } \
-                    buffer->data = realloc( buffer->data, buffer->capacity ); \
                 } \
                 void* x = (void*)( ( (uintptr_t) buffer->data ) + buffer->position ); \
                 memcpy( x, &value[ i ], sizeof( *value ) ); \
@@ -378,8 +1025,381 @@ int buffer_write_bool( buffer_t* buffer, bool const* value, int count ) BUFFER_W
 
 #undef BUFFER_WRITE_IMPL
 
+
+int buffer_read_varint( buffer_t* buffer, BUFFER_U64_T* value, int count ) {
+    for( int i = 0; i < count; ++i ) {
+        // On malformed or truncated input, leave the position at the start of the value that couldn't be read
+        size_t position = buffer_position( buffer );
+        BUFFER_U64_T result = 0;
+        if( buffer->position + 10 <= buffer->size ) {
+            // Fast path: a full-length varint fits in what's left, so decode without per-byte bounds checks
+            BUFFER_U8_T const* bytes = (BUFFER_U8_T const*)( ( (uintptr_t) buffer->data ) + buffer->position );
+            int length = 0;
+            int shift = 0;
+            BUFFER_U8_T byte;
+            do {
+                byte = bytes[ length++ ];
+                result |= ( (BUFFER_U64_T)( byte & 0x7f ) ) << shift;
+                shift += 7;
+            } while( ( byte & 0x80 ) && length < 10 );
+            if( byte & 0x80 ) {
+                buffer_position_set( buffer, position );
+                return i; // malformed, longer than 10 bytes
+            }
+            buffer->position += length;
+        } else {
+            int shift = 0;
+            BUFFER_U8_T byte = 0x80;
+            while( ( byte & 0x80 ) && shift < 70 ) {
+                if( buffer_read_u8( buffer, &byte, 1 ) != 1 ) {
+                    buffer_position_set( buffer, position );
+                    return i;
+                }
+                result |= ( (BUFFER_U64_T)( byte & 0x7f ) ) << shift;
+                shift += 7;
+            }
+            if( byte & 0x80 ) {
+                buffer_position_set( buffer, position );
+                return i; // malformed, longer than 10 bytes
+            }
+        }
+        value[ i ] = result;
+    }
+    return count;
+}
+
+
+int buffer_read_zigzag( buffer_t* buffer, BUFFER_I64_T* value, int count ) {
+    for( int i = 0; i < count; ++i ) {
+        BUFFER_U64_T x;
+        if( buffer_read_varint( buffer, &x, 1 ) != 1 ) {
+            return i;
+        }
+        value[ i ] = (BUFFER_I64_T)( ( x >> 1 ) ^ ( ~( x & 1 ) + 1 ) );
+    }
+    return count;
+}
+
+
+int buffer_write_varint( buffer_t* buffer, BUFFER_U64_T const* value, int count ) {
+    for( int i = 0; i < count; ++i ) {
+        BUFFER_U8_T bytes[ 10 ];
+        int length = 0;
+        BUFFER_U64_T x = value[ i ];
+        while( x >= 0x80 ) {
+            bytes[ length++ ] = (BUFFER_U8_T)( x | 0x80 );
+            x >>= 7;
+        }
+        bytes[ length++ ] = (BUFFER_U8_T) x;
+        if( buffer_write_u8( buffer, bytes, length ) != length ) {
+            return i;
+        }
+    }
+    return count;
+}
+
+
+int buffer_write_zigzag( buffer_t* buffer, BUFFER_I64_T const* value, int count ) {
+    for( int i = 0; i < count; ++i ) {
+        BUFFER_U64_T x = ( ( (BUFFER_U64_T) value[ i ] ) << 1 ) ^ ( value[ i ] < 0 ? ~(BUFFER_U64_T) 0 : 0 );
+        if( buffer_write_varint( buffer, &x, 1 ) != 1 ) {
+            return i;
+        }
+    }
+    return count;
+}
+
+
+void buffer_bits_init( buffer_bits_t* bits, buffer_t* buffer ) {
+    bits->buffer = buffer;
+    bits->accumulator = 0;
+    bits->count = 0;
+}
+
+
+bool buffer_bits_write( buffer_bits_t* bits, BUFFER_U32_T value, int bit_count ) {
+    if( bit_count <= 0 || bit_count > 32 ) {
+        return false;
+    }
+    BUFFER_U64_T mask = ( ( (BUFFER_U64_T) 1 ) << bit_count ) - 1;
+    bits->accumulator |= ( value & mask ) << bits->count;
+    bits->count += bit_count;
+    if( bits->count >= 32 ) {
+        BUFFER_U8_T bytes[ 4 ];
+        for( int i = 0; i < 4; ++i ) {
+            bytes[ i ] = (BUFFER_U8_T)( bits->accumulator >> ( i * 8 ) );
+        }
+        bits->accumulator >>= 32;
+        bits->count -= 32;
+        return buffer_write_u8( bits->buffer, bytes, 4 ) == 4;
+    }
+    return true;
+}
+
+
+bool buffer_bits_flush( buffer_bits_t* bits ) {
+    BUFFER_U8_T bytes[ 4 ];
+    int length = ( bits->count + 7 ) / 8;
+    for( int i = 0; i < length; ++i ) {
+        bytes[ i ] = (BUFFER_U8_T)( bits->accumulator >> ( i * 8 ) );
+    }
+    bits->accumulator = 0;
+    bits->count = 0;
+    return buffer_write_u8( bits->buffer, bytes, length ) == length;
+}
+
+
+bool buffer_bits_read( buffer_bits_t* bits, BUFFER_U32_T* value, int bit_count ) {
+    if( bit_count <= 0 || bit_count > 32 ) {
+        return false;
+    }
+    if( bits->count < bit_count ) {
+        buffer_t* buffer = bits->buffer;
+        if( buffer->position + 8 <= buffer->size ) {
+            // Fast path: top the accumulator up with as many whole bytes as fit, in one 8 byte load
+            BUFFER_U8_T const* bytes = (BUFFER_U8_T const*)( ( (uintptr_t) buffer->data ) + buffer->position );
+            BUFFER_U64_T word = 0;
+            for( int i = 0; i < 8; ++i ) {
+                word |= ( (BUFFER_U64_T) bytes[ i ] ) << ( i * 8 );
+            }
+            int length = ( 64 - bits->count ) / 8;
+            bits->accumulator |= word << bits->count;
+            if( bits->count + length * 8 < 64 ) {
+                bits->accumulator &= ( ( (BUFFER_U64_T) 1 ) << ( bits->count + length * 8 ) ) - 1;
+            }
+            bits->count += length * 8;
+            buffer->position += length;
+        } else {
+            // Near the end of the data (or of a stream window), only read the bytes needed
+            BUFFER_U8_T bytes[ 4 ];
+            int length = ( bit_count - bits->count + 7 ) / 8;
+            int read = buffer_read_u8( buffer, bytes, length );
+            for( int i = 0; i < read; ++i ) {
+                bits->accumulator |= ( (BUFFER_U64_T) bytes[ i ] ) << bits->count;
+                bits->count += 8;
+            }
+            if( bits->count < bit_count ) {
+                return false;
+            }
+        }
+    }
+    *value = (BUFFER_U32_T)( bits->accumulator & ( ( ( (BUFFER_U64_T) 1 ) << bit_count ) - 1 ) );
+    bits->accumulator >>= bit_count;
+    bits->count -= bit_count;
+    return true;
+}
+
+
+void buffer_bits_align( buffer_bits_t* bits ) {
+    // Whole bytes still in the accumulator were read ahead from the current window, so they can be given back
+    bits->buffer->position -= (size_t)( bits->count / 8 );
+    bits->accumulator = 0;
+    bits->count = 0;
+}
+
 #endif /* BUFFER_IMPLEMENTATION */
 
+
+/*
+----------------------
+    BENCHMARK
+----------------------
+*/
+
+#ifdef BUFFER_RUN_BENCHMARK
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+    #include <psapi.h>
+    #pragma comment( lib, "psapi.lib" )
+#else
+    #include <time.h>
+    #include <unistd.h>
+    #include <sys/resource.h>
+#endif
+
+
+static double benchmark_buffer_seconds( void ) {
+    #ifdef _WIN32
+        LARGE_INTEGER count, frequency;
+        QueryPerformanceCounter( &count );
+        QueryPerformanceFrequency( &frequency );
+        return (double) count.QuadPart / (double) frequency.QuadPart;
+    #else
+        struct timespec t;
+        clock_gettime( CLOCK_MONOTONIC, &t );
+        return (double) t.tv_sec + (double) t.tv_nsec * 1e-9;
+    #endif
+}
+
+
+// Resident set size in bytes. Where the current size can't be queried, the peak is returned instead, which only
+// shows growth, so buffer_map_file is measured before buffer_load.
+static double benchmark_buffer_rss( void ) {
+    #if defined( _WIN32 )
+        PROCESS_MEMORY_COUNTERS counters;
+        GetProcessMemoryInfo( GetCurrentProcess(), &counters, sizeof( counters ) );
+        return (double) counters.WorkingSetSize;
+    #else
+        FILE* fp = fopen( "/proc/self/statm", "r" );
+        if( fp ) {
+            long pages = 0, resident = 0;
+            int fields = fscanf( fp, "%ld %ld", &pages, &resident );
+            fclose( fp );
+            if( fields == 2 ) {
+                return (double) resident * (double) sysconf( _SC_PAGESIZE );
+            }
+        }
+        struct rusage usage;
+        getrusage( RUSAGE_SELF, &usage );
+        #ifdef __APPLE__
+            return (double) usage.ru_maxrss;
+        #else
+            return (double) usage.ru_maxrss * 1024.0;
+        #endif
+    #endif
+}
+
+
+#define BENCHMARK_BUFFER_FILENAME "buffer_benchmark.bin"
+#define BENCHMARK_BUFFER_FILE_SIZE ( 128 * 1024 * 1024 )
+
+static volatile unsigned int benchmark_buffer_sink;
+
+
+static void benchmark_buffer_open( char const* name, int mapped ) {
+    double rss = benchmark_buffer_rss();
+    double start = benchmark_buffer_seconds();
+    buffer_t* buffer = mapped ? buffer_map_file( BENCHMARK_BUFFER_FILENAME, BUFFER_MAP_READ_ONLY, 
+        BUFFER_ACCESS_SEQUENTIAL ) : buffer_load( BENCHMARK_BUFFER_FILENAME );
+    if( !buffer ) {
+        printf( "%-16s failed to open " BENCHMARK_BUFFER_FILENAME "\n", name );
+        return;
+    }
+    BUFFER_U8_T first = 0;
+    buffer_read_u8( buffer, &first, 1 );
+    double first_byte = benchmark_buffer_seconds() - start;
+    double first_byte_rss = benchmark_buffer_rss() - rss;
+
+    BUFFER_U8_T const* data = (BUFFER_U8_T const*) buffer_data( buffer );
+    size_t size = buffer_size( buffer );
+    unsigned int sum = first;
+    for( size_t i = 0; i < size; i += 64 ) {
+        sum += data[ i ];
+    }
+    benchmark_buffer_sink = sum;
+    double all_bytes = benchmark_buffer_seconds() - start;
+    double all_bytes_rss = benchmark_buffer_rss() - rss;
+    buffer_destroy( buffer );
+
+    printf( "%-16s first byte: %9.3f ms, %8.1f MB resident    whole file: %9.3f ms, %8.1f MB resident\n", name, 
+        first_byte * 1000.0, first_byte_rss / ( 1024.0 * 1024.0 ), all_bytes * 1000.0, 
+        all_bytes_rss / ( 1024.0 * 1024.0 ) );
+}
+
+
+#define BENCHMARK_BUFFER_VALUE_COUNT ( 4 * 1024 * 1024 )
+
+static void benchmark_buffer_rate( char const* name, double seconds, buffer_t* buffer ) {
+    printf( "%-16s %8.1f M values/s, %8.1f MB/s (%.2f bytes per value)\n", name, 
+        BENCHMARK_BUFFER_VALUE_COUNT / seconds * 1e-6, (double) buffer_size( buffer ) / seconds / ( 1024.0 * 1024.0 ), 
+        (double) buffer_size( buffer ) / BENCHMARK_BUFFER_VALUE_COUNT );
+}
+
+
+// Encodes and decodes values of mixed magnitude, mostly small, as is typical for lengths, deltas and indices
+static void benchmark_buffer_encoding( void ) {
+    BUFFER_U64_T* values = (BUFFER_U64_T*) malloc( sizeof( BUFFER_U64_T ) * BENCHMARK_BUFFER_VALUE_COUNT );
+    BUFFER_U64_T* decoded = (BUFFER_U64_T*) malloc( sizeof( BUFFER_U64_T ) * BENCHMARK_BUFFER_VALUE_COUNT );
+    BUFFER_U32_T seed = 0x2545f491;
+    for( int i = 0; i < BENCHMARK_BUFFER_VALUE_COUNT; ++i ) {
+        seed ^= seed << 13; seed ^= seed >> 17; seed ^= seed << 5;
+        int bits = ( seed & 3 ) == 0 ? 32 : ( seed & 3 ) == 1 ? 16 : 7;
+        values[ i ] = ( (BUFFER_U64_T) seed >> 2 ) & ( ( (BUFFER_U64_T) 1 << bits ) - 1 );
+    }
+
+    buffer_t* buffer = buffer_create();
+    double start = benchmark_buffer_seconds();
+    buffer_write_varint( buffer, values, BENCHMARK_BUFFER_VALUE_COUNT );
+    benchmark_buffer_rate( "varint write", benchmark_buffer_seconds() - start, buffer );
+    buffer_position_set( buffer, 0 );
+    start = benchmark_buffer_seconds();
+    int read = buffer_read_varint( buffer, decoded, BENCHMARK_BUFFER_VALUE_COUNT );
+    benchmark_buffer_rate( "varint read", benchmark_buffer_seconds() - start, buffer );
+    int matches = read == BENCHMARK_BUFFER_VALUE_COUNT && 
+        memcmp( values, decoded, sizeof( BUFFER_U64_T ) * BENCHMARK_BUFFER_VALUE_COUNT ) == 0;
+    buffer_destroy( buffer );
+
+    // Bit packing with the width each value needs, in a 5-bit length prefix
+    buffer = buffer_create();
+    buffer_bits_t bits;
+    buffer_bits_init( &bits, buffer );
+    start = benchmark_buffer_seconds();
+    for( int i = 0; i < BENCHMARK_BUFFER_VALUE_COUNT; ++i ) {
+        int width = 1;
+        while( width < 32 && ( values[ i ] >> width ) != 0 ) {
+            ++width;
+        }
+        buffer_bits_write( &bits, (BUFFER_U32_T)( width - 1 ), 5 );
+        buffer_bits_write( &bits, (BUFFER_U32_T) values[ i ], width );
+    }
+    buffer_bits_flush( &bits );
+    benchmark_buffer_rate( "bits write", benchmark_buffer_seconds() - start, buffer );
+    buffer_position_set( buffer, 0 );
+    buffer_bits_init( &bits, buffer );
+    start = benchmark_buffer_seconds();
+    for( int i = 0; i < BENCHMARK_BUFFER_VALUE_COUNT; ++i ) {
+        BUFFER_U32_T width = 0, value = 0;
+        buffer_bits_read( &bits, &width, 5 );
+        buffer_bits_read( &bits, &value, (int) width + 1 );
+        decoded[ i ] = value;
+    }
+    benchmark_buffer_rate( "bits read", benchmark_buffer_seconds() - start, buffer );
+    matches = matches && memcmp( values, decoded, sizeof( BUFFER_U64_T ) * BENCHMARK_BUFFER_VALUE_COUNT ) == 0;
+    buffer_destroy( buffer );
+
+    printf( "decoded values match: %s\n", matches ? "yes" : "NO" );
+    free( decoded );
+    free( values );
+}
+
+
+int main( int argc, char** argv ) {
+    (void) argc, (void) argv;
+
+    FILE* fp = fopen( BENCHMARK_BUFFER_FILENAME, "wb" );
+    if( !fp ) {
+        printf( "failed to create " BENCHMARK_BUFFER_FILENAME "\n" );
+        return EXIT_FAILURE;
+    }
+    static BUFFER_U8_T chunk[ 64 * 1024 ];
+    for( int i = 0; i < (int) sizeof( chunk ); ++i ) {
+        chunk[ i ] = (BUFFER_U8_T)( i * 31 + ( i >> 8 ) );
+    }
+    for( int i = 0; i < BENCHMARK_BUFFER_FILE_SIZE / (int) sizeof( chunk ); ++i ) {
+        fwrite( chunk, 1, sizeof( chunk ), fp );
+    }
+    fclose( fp );
+
+    printf( "buffer benchmark, %d MB file (in the page cache, as it was just written)\n", 
+        BENCHMARK_BUFFER_FILE_SIZE / ( 1024 * 1024 ) );
+    benchmark_buffer_open( "buffer_map_file", 1 );
+    benchmark_buffer_open( "buffer_load", 0 );
+
+    remove( BENCHMARK_BUFFER_FILENAME );
+
+    printf( "\nbuffer benchmark, encoding %d values\n", BENCHMARK_BUFFER_VALUE_COUNT );
+    benchmark_buffer_encoding();
+    return EXIT_SUCCESS;
+}
+
+#endif /* BUFFER_RUN_BENCHMARK */
+
 /*
 ------------------------------------------------------------------------------
 
@@ -42,6 +42,7 @@ void strpool_term( strpool_t* pool );
 void strpool_defrag( strpool_t* pool );
 
 STRPOOL_U64 strpool_inject( strpool_t* pool, char const* string, int length );
+STRPOOL_U64 strpool_find( strpool_t const* pool, char const* string, int length );
 void strpool_discard( strpool_t* pool, STRPOOL_U64 handle );
 
 int strpool_incref( strpool_t* pool, STRPOOL_U64 handle );
@@ -264,6 +265,16 @@ pool, it will be. If `string` is NULL or length is 0, a handle with a value of 0
 string.
 
 
+strpool_find
+------------
+
+    STRPOOL_U64 strpool_find( strpool_t const* pool, char const* string, int length )
+
+Returns a handle for the string if it is already in the pool, or a handle with a value of 0 if it is not. Unlike 
+`strpool_inject`, the pool is never modified, so `strpool_find` can be used to look strings up without having to add 
+and then discard them, and can be called from several threads at once as long as no other thread is modifying the pool.
+
+
 strpool_discard
 ---------------
 
@@ -1063,6 +1074,46 @@ STRPOOL_U64 strpool_inject( strpool_t* pool, char const* string, int length )
     }
 
 
+STRPOOL_U64 strpool_find( strpool_t const* pool, char const* string, int length )
+    {
+    if( !string || length <= 0 ) return 0;
+
+    STRPOOL_U32 hash = strpool_internal_find_in_blocks( pool, string, length );
+    if( !hash ) hash = strpool_internal_calculate_hash( string, length, pool->ignore_case ); 
+
+    int base_slot = (int)( hash & (STRPOOL_U32)( pool->hash_capacity - 1 ) );
+    int base_count = pool->hash_table[ base_slot ].base_count;
+    int slot = base_slot;
+    while( base_count > 0 )
+        {
+        STRPOOL_U32 slot_hash = pool->hash_table[ slot ].hash_key;
+        int slot_base = (int)( slot_hash & (STRPOOL_U32)( pool->hash_capacity - 1 ) );
+        if( slot_hash != 0 && slot_base == base_slot ) 
+            {
+            --base_count;
+            if( slot_hash == hash )
+                {
+                strpool_internal_entry_t const* entry = &pool->entries[ pool->hash_table[ slot ].entry_index ];
+                if( entry->length == length && 
+                    ( 
+                       ( !pool->ignore_case &&   STRPOOL_MEMCMP( entry->data + 2 * sizeof( STRPOOL_U32 ), string, (size_t)length ) == 0 )
+                    || (  pool->ignore_case && STRPOOL_STRNICMP( entry->data + 2 * sizeof( STRPOOL_U32 ), string, (size_t)length ) == 0 ) 
+                    ) 
+                  )
+                    {
+                    int handle_index = entry->handle_index;
+                    return strpool_internal_make_handle( handle_index, pool->handles[ handle_index ].counter, 
+                        pool->index_mask, pool->counter_shift, pool->counter_mask );
+                    }
+                }
+            }
+        slot = ( slot + 1 ) & ( pool->hash_capacity - 1 );
+        }   
+
+    return 0;
+    }
+
+
 void strpool_discard( strpool_t* pool, STRPOOL_U64 handle )
     {   
     strpool_internal_entry_t* entry = strpool_internal_get_entry( pool, handle );
@@ -18,6 +18,27 @@ separate .c files, or they can be built directly from videocodec.h like this:
 
     cl -O2 -DVIDEOCODEC_BUILD_ENCODER -DVIDEOCODEC_IMPLEMENTATION -Tc videocodec.h -Fe:encoder.exe
     cl -O2 -DVIDEOCODEC_BUILD_PLAYER -DVIDEOCODEC_IMPLEMENTATION -Tc videocodec.h -Fe:player.exe
+
+To let the encoder use several threads (see `videocodec_enc_set_threads`), and the decoder decode queued frames in the
+background (see `videocodec_dec_push_frame`), do this before including the implementation:
+    #define VIDEOCODEC_THREADS
+This requires thread.h, with THREAD_IMPLEMENTATION defined somewhere. For the example apps, add -DVIDEOCODEC_THREADS
+to the command lines above, and for the encoder app, pass the number of threads as the last argument.
+
+The transforms, motion search, deblocking and color conversion use SSE2 or NEON when the compiler targets them, and give
+exactly the same output as the plain C loops. To use the plain C loops instead, do this before including the 
+implementation:
+    #define VIDEOCODEC_NO_SIMD
+
+To check that the SIMD code gives the same output as the plain C loops for a given compiler and platform, and that 
+frames decode the same whatever the number of encoder threads and whether they are pushed and pulled or not, build and
+run the tests (this requires testfw.h, and thread.h when building with VIDEOCODEC_THREADS):
+    clang -O2 -DVIDEOCODEC_RUN_TESTS -DVIDEOCODEC_IMPLEMENTATION -xc videocodec.h -o tests.exe
+
+To measure how fast the encoder is, with one thread and, when built with VIDEOCODEC_THREADS, with 2 to 16 threads and
+the speedup over one thread, and how fast the SIMD kernels and the conversions between XBGR and YUV 4:2:0 are compared
+to a VIDEOCODEC_NO_SIMD build, build and run the benchmark:
+    clang -O2 -DVIDEOCODEC_RUN_BENCHMARK -DVIDEOCODEC_IMPLEMENTATION -xc videocodec.h -o benchmark.exe
 */
 
 #ifndef videocodec_h
@@ -37,6 +58,7 @@ typedef struct videocodec_enc_t videocodec_enc_t;
 videocodec_enc_t* videocodec_enc_create( int width, int height, int fps_n, int fps_d, int sar_n, int sar_d, 
     enum videocodec_quality_t quality, videocodec_enc_stats_t* out_stats );
 void videocodec_enc_destroy( videocodec_enc_t* enc );
+void videocodec_enc_set_threads( videocodec_enc_t* enc, int thread_count );
 
 typedef struct videocodec_enc_frame_t { size_t size; void* data; } videocodec_enc_frame_t; 
 videocodec_enc_frame_t videocodec_enc_encode_yuv420( videocodec_enc_t* enc, void const* yuv420 );
@@ -56,6 +78,13 @@ void videocodec_dec_fps( videocodec_dec_t* dec, int* fps_n, int* fps_d );
 void videocodec_dec_ar ( videocodec_dec_t* dec, int* ar_n,  int* ar_d  );
 
 size_t videocodec_dec_next_frame( videocodec_dec_t* dec, void const* data, size_t size, uint32_t* out_xbgr );
+int videocodec_dec_push_frame( videocodec_dec_t* dec, void const* data, size_t size );
+int videocodec_dec_pull_frame( videocodec_dec_t* dec, uint32_t* out_xbgr, int wait );
+
+size_t videocodec_dec_next_frame_yuv420( videocodec_dec_t* dec, void const* data, size_t size, uint8_t const** out_y, 
+    uint8_t const** out_u, uint8_t const** out_v );
+int videocodec_dec_pull_frame_yuv420( videocodec_dec_t* dec, uint8_t const** out_y, uint8_t const** out_u, 
+    uint8_t const** out_v, int wait );
 
 
 #endif // videocodec_h
@@ -97,6 +126,21 @@ Releases the resources held by an encoder instance previously created with `vide
 function, the `enc` pointer is no longer valid and must not be used in further API calls.
 
 
+videocodec_enc_set_threads
+--------------------------
+
+    void videocodec_enc_set_threads( videocodec_enc_t* enc, int thread_count )
+
+Splits every frame into `thread_count` slices, each a band of whole 16x16 macroblock rows, which are encoded and 
+compressed independently of each other. When VIDEOCODEC_THREADS is defined, the slices are encoded in parallel, on 
+`thread_count - 1` worker threads and the calling thread. Without it, they are encoded one after the other. The output 
+depends only on the number of slices, not on the number of threads used to encode them.
+
+Must be called before the first frame is encoded, and only once. The number of slices is clamped to the number of 
+macroblock rows (and to 64). A `thread_count` of 1 gives the same stream as not calling this function. Streams with more
+than one slice can only be played by decoders which support slices.
+
+
 videocodec_enc_encode_yuv420
 ----------------------------
 
@@ -204,6 +248,72 @@ bytes needed without supplying data, pass `NULL` for `data`, zero for `size`, an
 
 A return value of 0 indicates either end-of-stream or that the provided input was insufficient/invalid; in both cases, 
 no frame was produced, and the stream can be considered ended.
+
+Don't mix calls to this function with calls to `videocodec_dec_push_frame` and `videocodec_dec_pull_frame` on the same 
+decoder.
+
+
+videocodec_dec_push_frame
+-------------------------
+
+    int videocodec_dec_push_frame( videocodec_dec_t* dec, void const* data, size_t size )
+
+Queues the next frame from the compressed bitstream for decoding, and returns right away. The `data` and `size` are the
+same as for `videocodec_dec_next_frame`, and the data is copied, so the buffer can be reused as soon as the function 
+returns. Afterwards, `videocodec_dec_next_frame( dec, NULL, 0, NULL )` returns the number of bytes needed for the frame 
+after it, or 0 at the end of the stream.
+
+Returns 1 if the frame was queued. Returns 0 if it wasn't, either because the stream has ended or the input is invalid,
+or because four frames are already queued which haven't been pulled with `videocodec_dec_pull_frame` yet. In the latter 
+case, pull a frame and push the same data again. A frame pulled with `videocodec_dec_pull_frame_yuv420` keeps its place
+in the queue until the next pull, so only three more can be queued while it is held.
+
+When VIDEOCODEC_THREADS is defined, queued frames are decoded on two threads, which the decoder starts on the first call
+to this function: one unpacks the next frame while the other reconstructs the frame before it, and the caller converts 
+the frame before that to XBGR when it pulls it. This lets the decoder keep up with higher resolutions than it can on a 
+single thread. Without VIDEOCODEC_THREADS, the whole frame is decoded when it is pulled.
+
+
+videocodec_dec_pull_frame
+-------------------------
+
+    int videocodec_dec_pull_frame( videocodec_dec_t* dec, uint32_t* out_xbgr, int wait )
+
+Takes the oldest frame queued with `videocodec_dec_push_frame` off the queue, and writes it to `out_xbgr` in 32-bit XBGR 
+format. If the frame has not finished decoding yet, the function waits for it when `wait` is non-zero, and otherwise 
+returns 0 without taking it off the queue.
+
+Returns 1 if a frame was written to `out_xbgr`, and 0 if not: no frames were queued, the oldest one isn't decoded yet 
+and `wait` is 0, or the frame could not be decoded. If a frame could not be decoded, the stream can be considered ended,
+and `videocodec_dec_next_frame( dec, NULL, 0, NULL )` returns 0 from then on.
+
+
+videocodec_dec_next_frame_yuv420
+--------------------------------
+
+    size_t videocodec_dec_next_frame_yuv420( videocodec_dec_t* dec, void const* data, size_t size, uint8_t const** out_y, 
+        uint8_t const** out_u, uint8_t const** out_v )
+
+Works like `videocodec_dec_next_frame`, but instead of converting the frame to XBGR, it sets `out_y`, `out_u` and `out_v`
+to point at the decoder's own Y, U and V planes for it, without copying them. This suits callers which upload YUV 
+textures or scale the frame themselves. The Y plane is `width` x `height` bytes, and the U and V planes are 
+`width / 2` x `height / 2` bytes, each row following right after the one before it. This is the same layout that
+`videocodec_enc_encode_yuv420` takes, with the three planes after each other.
+
+The planes stay valid until the next call to a `videocodec_dec_next_frame*` or `videocodec_dec_pull_frame*` function, or
+until the decoder is destroyed, and must not be written to. To query the number of bytes needed, pass `NULL` for `data`
+and the three plane pointers, and zero for `size`.
+
+
+videocodec_dec_pull_frame_yuv420
+--------------------------------
+
+    int videocodec_dec_pull_frame_yuv420( videocodec_dec_t* dec, uint8_t const** out_y, uint8_t const** out_u, 
+        uint8_t const** out_v, int wait )
+
+Works like `videocodec_dec_pull_frame`, but returns the frame as pointers to its Y, U and V planes, in the same way as
+`videocodec_dec_next_frame_yuv420`. The planes stay valid until the next pull, so the frame keeps its place in the queue
+until then.
 */
 
 #ifdef VIDEOCODEC_IMPLEMENTATION
@@ -213,6 +323,20 @@ no frame was produced, and the stream can be considered ended.
 #include <stdio.h>
 #include <limits.h>
 
+#ifdef VIDEOCODEC_THREADS
+    #include "thread.h"
+#endif
+
+#ifndef VIDEOCODEC_NO_SIMD
+    #if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+        #include <emmintrin.h>
+        #define INTERNAL_VIDEOCODEC_SIMD_SSE2
+    #elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+        #include <arm_neon.h>
+        #define INTERNAL_VIDEOCODEC_SIMD_NEON
+    #endif
+#endif
+
 
 #if defined( VIDEOCODEC_PACK ) || defined( VIDEOCODEC_UNPACK ) || defined( VIDEOCODEC_PACK_ARENA_SIZE )
     #if !defined( VIDEOCODEC_PACK ) || !defined( VIDEOCODEC_UNPACK ) || !defined( VIDEOCODEC_PACK_ARENA_SIZE )
@@ -515,6 +639,9 @@ no frame was produced, and the stream can be considered ended.
 
 
 static const uint8_t INTERNAL_VIDEOCODEC_VERSION = 0;
+static const uint8_t INTERNAL_VIDEOCODEC_VERSION_SLICES = 1;
+
+#define INTERNAL_VIDEOCODEC_MAX_SLICES 64
 
 
 typedef struct internal_videocodec_quality_params_t {
@@ -653,6 +780,28 @@ static const int16_t internal_videocodec_C8[ 8 ][ 8 ] = {
 };
 
 
+#if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+
+// internal_videocodec_C8 as pairs of neighbouring coefficients, for _mm_madd_epi16. [ t ][ k ] holds K[ j ][ 2k ] and 
+// K[ j ][ 2k + 1 ] for j = 0..7, where K is internal_videocodec_C8 for t = 0, and its transpose for t = 1
+static const int16_t internal_videocodec_C8_pairs[ 2 ][ 4 ][ 16 ] = {
+    {
+        { 5793, 5793, 8035, 6811, 7568, 3135, 6811, -1598, 5793, -5793, 4551, -8035, 3135, -7568, 1598, -4551 },
+        { 5793, 5793, 4551, 1598, -3135, -7568, -8035, -4551, -5793, 5793, 1598, 6811, 7568, -3135, 6811, -8035 },
+        { 5793, 5793, -1598, -4551, -7568, -3135, 4551, 8035, 5793, -5793, -6811, -1598, -3135, 7568, 8035, -6811 },
+        { 5793, 5793, -6811, -8035, 3135, 7568, 1598, -6811, -5793, 5793, 8035, -4551, -7568, 3135, 4551, -1598 },
+    },
+    {
+        { 5793, 8035, 5793, 6811, 5793, 4551, 5793, 1598, 5793, -1598, 5793, -4551, 5793, -6811, 5793, -8035 },
+        { 7568, 6811, 3135, -1598, -3135, -8035, -7568, -4551, -7568, 4551, -3135, 8035, 3135, 1598, 7568, -6811 },
+        { 5793, 4551, -5793, -8035, -5793, 1598, 5793, 6811, 5793, -6811, -5793, -1598, -5793, 8035, 5793, -4551 },
+        { 3135, 1598, -7568, -4551, 7568, 6811, -3135, -8035, -3135, 8035, 7568, -6811, -7568, 4551, 3135, -1598 },
+    },
+};
+
+#endif
+
+
 static inline int internal_videocodec_abs( int a ) { return a < 0 ? -a : a; }
 static inline int internal_videocodec_imax( int a, int b ) {return a > b ? a : b; }
 static inline int internal_videocodec_imin( int a, int b ) {return a < b ? a : b; }
@@ -762,28 +911,241 @@ static inline int16_t internal_videocodec_quant_ac_deadzone( int32_t F, int16_t
 }
 
 
-static void internal_videocodec_fdct8x8_u8( uint8_t const* src, int stride, int32_t F[ 64 ] ) {
-    int32_t tmp[ 64 ];
-    for( int y = 0; y < 8; y++ ) {
-        int32_t r[ 8 ];
-        for( int x = 0; x < 8; x++ ) r[ x ] = (int32_t) src[ y * stride + x ] - 128;
-        for( int u = 0; u < 8; u++ ) {
-            int64_t s = 0;
-            for( int x = 0; x < 8; x++ ) s += (int64_t) internal_videocodec_C8[ u ][ x ] * (int64_t) r[ x ];
-            tmp[ y * 8 + u ] = (int32_t) ( ( s + ( (int64_t) 1 << ( INTERNAL_VIDEOCODEC_COS_SHIFT - 1 ) ) ) >> INTERNAL_VIDEOCODEC_COS_SHIFT );
+// The SIMD transforms keep the intermediate rows in 16 bits, which gives the same result as the 64-bit scalar loops as 
+// long as the input stays within INTERNAL_VIDEOCODEC_SIMD_FDCT_LIMIT, and the dequantized coefficients within 
+// INTERNAL_VIDEOCODEC_SIMD_IDCT_LIMIT (the largest sum of coefficient magnitudes in a row of C8 is 46344). Blocks outside
+// those limits, which valid streams never produce, take the scalar path.
+#define INTERNAL_VIDEOCODEC_SIMD_FDCT_LIMIT 11000
+#define INTERNAL_VIDEOCODEC_SIMD_IDCT_LIMIT 4095
+
+#if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+
+// out[ y ][ j ] = sum of K[ j ][ i ] * in[ y ][ i ] over i, rounded, with K given as pairs from internal_videocodec_C8_pairs. 
+// out[ y * 2 ] holds j = 0..3 and out[ y * 2 + 1 ] holds j = 4..7
+static inline void internal_videocodec_dct_rows_sse2( __m128i const in[ 8 ], int16_t const pairs[ 4 ][ 16 ], __m128i out[ 16 ] ) {
+    __m128i round = _mm_set1_epi32( 1 << ( INTERNAL_VIDEOCODEC_COS_SHIFT - 1 ) );
+    __m128i lo[ 4 ], hi[ 4 ];
+    for( int k = 0; k < 4; ++k ) {
+        lo[ k ] = _mm_loadu_si128( (__m128i const*) pairs[ k ] );
+        hi[ k ] = _mm_loadu_si128( (__m128i const*)( pairs[ k ] + 8 ) );
+    }
+    for( int y = 0; y < 8; ++y ) {
+        __m128i r0 = _mm_shuffle_epi32( in[ y ], 0x00 ), r1 = _mm_shuffle_epi32( in[ y ], 0x55 );
+        __m128i r2 = _mm_shuffle_epi32( in[ y ], 0xaa ), r3 = _mm_shuffle_epi32( in[ y ], 0xff );
+        __m128i s_lo = _mm_add_epi32( _mm_add_epi32( _mm_madd_epi16( r0, lo[ 0 ] ), _mm_madd_epi16( r1, lo[ 1 ] ) ), 
+            _mm_add_epi32( _mm_madd_epi16( r2, lo[ 2 ] ), _mm_madd_epi16( r3, lo[ 3 ] ) ) );
+        __m128i s_hi = _mm_add_epi32( _mm_add_epi32( _mm_madd_epi16( r0, hi[ 0 ] ), _mm_madd_epi16( r1, hi[ 1 ] ) ), 
+            _mm_add_epi32( _mm_madd_epi16( r2, hi[ 2 ] ), _mm_madd_epi16( r3, hi[ 3 ] ) ) );
+        out[ y * 2 + 0 ] = _mm_srai_epi32( _mm_add_epi32( s_lo, round ), INTERNAL_VIDEOCODEC_COS_SHIFT );
+        out[ y * 2 + 1 ] = _mm_srai_epi32( _mm_add_epi32( s_hi, round ), INTERNAL_VIDEOCODEC_COS_SHIFT );
+    }
+}
+
+
+// out[ j ][ c ] = sum of K[ j ][ i ] * in[ i ][ c ] over i, rounded. out[ j * 2 ] holds c = 0..3 and out[ j * 2 + 1 ] c = 4..7
+static inline void internal_videocodec_dct_cols_sse2( __m128i const in[ 8 ], int16_t const pairs[ 4 ][ 16 ], __m128i out[ 16 ] ) {
+    __m128i round = _mm_set1_epi32( 1 << ( INTERNAL_VIDEOCODEC_COS_SHIFT - 1 ) );
+    __m128i lo[ 4 ], hi[ 4 ];
+    for( int k = 0; k < 4; ++k ) {
+        lo[ k ] = _mm_unpacklo_epi16( in[ k * 2 ], in[ k * 2 + 1 ] );
+        hi[ k ] = _mm_unpackhi_epi16( in[ k * 2 ], in[ k * 2 + 1 ] );
+    }
+    for( int j = 0; j < 8; ++j ) {
+        __m128i s_lo = round, s_hi = round;
+        for( int k = 0; k < 4; ++k ) {
+            int32_t pair;
+            memcpy( &pair, pairs[ k ] + j * 2, 4 );
+            __m128i c = _mm_set1_epi32( pair );
+            s_lo = _mm_add_epi32( s_lo, _mm_madd_epi16( lo[ k ], c ) );
+            s_hi = _mm_add_epi32( s_hi, _mm_madd_epi16( hi[ k ], c ) );
         }
+        out[ j * 2 + 0 ] = _mm_srai_epi32( s_lo, INTERNAL_VIDEOCODEC_COS_SHIFT );
+        out[ j * 2 + 1 ] = _mm_srai_epi32( s_hi, INTERNAL_VIDEOCODEC_COS_SHIFT );
     }
-    for( int u = 0; u < 8; u++ ) {
-        for( int v = 0; v < 8; v++ ) {
-            int64_t s = 0;
-            for( int y = 0; y < 8; y++ ) s += (int64_t) internal_videocodec_C8[ v ][ y ] * (int64_t) tmp[ y * 8 + u ];
-            F[ v * 8 + u ] = (int32_t) ( ( s + ( (int64_t) 1 << ( INTERNAL_VIDEOCODEC_COS_SHIFT - 1 ) ) ) >> INTERNAL_VIDEOCODEC_COS_SHIFT );
+}
+
+
+static inline void internal_videocodec_fdct8x8_sse2( __m128i const r[ 8 ], int32_t F[ 64 ] ) {
+    __m128i t[ 16 ], tmp[ 8 ];
+    internal_videocodec_dct_rows_sse2( r, internal_videocodec_C8_pairs[ 0 ], t );
+    for( int y = 0; y < 8; y++ ) tmp[ y ] = _mm_packs_epi32( t[ y * 2 ], t[ y * 2 + 1 ] );
+    internal_videocodec_dct_cols_sse2( tmp, internal_videocodec_C8_pairs[ 0 ], t );
+    for( int v = 0; v < 8; v++ ) {
+        _mm_storeu_si128( (__m128i*)( F + v * 8 ), t[ v * 2 ] );
+        _mm_storeu_si128( (__m128i*)( F + v * 8 + 4 ), t[ v * 2 + 1 ] );
+    }
+}
+
+
+// Dequantizes, weights and inverse transforms `qcoef`, into 32-bit rows laid out as for internal_videocodec_dct_rows_sse2.
+// Returns 0 if a dequantized coefficient is outside INTERNAL_VIDEOCODEC_SIMD_IDCT_LIMIT
+static inline int internal_videocodec_idct8x8_dequant_sse2( int16_t const* qcoef, uint8_t const* Q, uint16_t const* W8, __m128i out[ 16 ] ) {
+    __m128i zero = _mm_setzero_si128(), half = _mm_set1_epi32( 128 );
+    __m128i limit = _mm_set1_epi32( INTERNAL_VIDEOCODEC_SIMD_IDCT_LIMIT ), neg_limit = _mm_set1_epi32( -INTERNAL_VIDEOCODEC_SIMD_IDCT_LIMIT );
+    __m128i outside = zero;
+    __m128i F[ 8 ], t[ 16 ];
+    for( int v = 0; v < 8; ++v ) {
+        __m128i q = _mm_loadu_si128( (__m128i const*)( qcoef + v * 8 ) );
+        __m128i s = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( Q + v * 8 ) ), zero );
+        __m128i w = _mm_loadu_si128( (__m128i const*)( W8 + v * 8 ) );
+        __m128i f_lo = _mm_madd_epi16( _mm_unpacklo_epi16( q, zero ), _mm_unpacklo_epi16( s, zero ) );
+        __m128i f_hi = _mm_madd_epi16( _mm_unpackhi_epi16( q, zero ), _mm_unpackhi_epi16( s, zero ) );
+        outside = _mm_or_si128( outside, _mm_or_si128( _mm_cmpgt_epi32( f_lo, limit ), _mm_cmplt_epi32( f_lo, neg_limit ) ) );
+        outside = _mm_or_si128( outside, _mm_or_si128( _mm_cmpgt_epi32( f_hi, limit ), _mm_cmplt_epi32( f_hi, neg_limit ) ) );
+        __m128i f = _mm_packs_epi32( f_lo, f_hi );
+        f_lo = _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( _mm_unpacklo_epi16( f, zero ), _mm_unpacklo_epi16( w, zero ) ), half ), 8 );
+        f_hi = _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( _mm_unpackhi_epi16( f, zero ), _mm_unpackhi_epi16( w, zero ) ), half ), 8 );
+        F[ v ] = _mm_packs_epi32( f_lo, f_hi );
+    }
+    if( _mm_movemask_epi8( outside ) ) return 0;
+    internal_videocodec_dct_cols_sse2( F, internal_videocodec_C8_pairs[ 1 ], t );
+    for( int y = 0; y < 8; y++ ) F[ y ] = _mm_packs_epi32( t[ y * 2 ], t[ y * 2 + 1 ] );
+    internal_videocodec_dct_rows_sse2( F, internal_videocodec_C8_pairs[ 1 ], out );
+    return 1;
+}
+
+#elif defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+
+static inline void internal_videocodec_transpose8x8_s16_neon( int16x8_t m[ 8 ] ) {
+    int16x8x2_t a0 = vtrnq_s16( m[ 0 ], m[ 1 ] ), a1 = vtrnq_s16( m[ 2 ], m[ 3 ] );
+    int16x8x2_t a2 = vtrnq_s16( m[ 4 ], m[ 5 ] ), a3 = vtrnq_s16( m[ 6 ], m[ 7 ] );
+    int32x4x2_t b0 = vtrnq_s32( vreinterpretq_s32_s16( a0.val[ 0 ] ), vreinterpretq_s32_s16( a1.val[ 0 ] ) );
+    int32x4x2_t b1 = vtrnq_s32( vreinterpretq_s32_s16( a0.val[ 1 ] ), vreinterpretq_s32_s16( a1.val[ 1 ] ) );
+    int32x4x2_t b2 = vtrnq_s32( vreinterpretq_s32_s16( a2.val[ 0 ] ), vreinterpretq_s32_s16( a3.val[ 0 ] ) );
+    int32x4x2_t b3 = vtrnq_s32( vreinterpretq_s32_s16( a2.val[ 1 ] ), vreinterpretq_s32_s16( a3.val[ 1 ] ) );
+    m[ 0 ] = vreinterpretq_s16_s32( vcombine_s32( vget_low_s32( b0.val[ 0 ] ), vget_low_s32( b2.val[ 0 ] ) ) );
+    m[ 1 ] = vreinterpretq_s16_s32( vcombine_s32( vget_low_s32( b1.val[ 0 ] ), vget_low_s32( b3.val[ 0 ] ) ) );
+    m[ 2 ] = vreinterpretq_s16_s32( vcombine_s32( vget_low_s32( b0.val[ 1 ] ), vget_low_s32( b2.val[ 1 ] ) ) );
+    m[ 3 ] = vreinterpretq_s16_s32( vcombine_s32( vget_low_s32( b1.val[ 1 ] ), vget_low_s32( b3.val[ 1 ] ) ) );
+    m[ 4 ] = vreinterpretq_s16_s32( vcombine_s32( vget_high_s32( b0.val[ 0 ] ), vget_high_s32( b2.val[ 0 ] ) ) );
+    m[ 5 ] = vreinterpretq_s16_s32( vcombine_s32( vget_high_s32( b1.val[ 0 ] ), vget_high_s32( b3.val[ 0 ] ) ) );
+    m[ 6 ] = vreinterpretq_s16_s32( vcombine_s32( vget_high_s32( b0.val[ 1 ] ), vget_high_s32( b2.val[ 1 ] ) ) );
+    m[ 7 ] = vreinterpretq_s16_s32( vcombine_s32( vget_high_s32( b1.val[ 1 ] ), vget_high_s32( b3.val[ 1 ] ) ) );
+}
+
+
+// m[ j ] = sum of K[ j ][ i ] * m[ i ] over i, rounded, where K is internal_videocodec_C8, or its transpose
+static inline void internal_videocodec_dct_cols_neon( int16x8_t m[ 8 ], int transposed ) {
+    int16x8_t out[ 8 ];
+    for( int j = 0; j < 8; ++j ) {
+        int32x4_t lo = vdupq_n_s32( 0 ), hi = vdupq_n_s32( 0 );
+        for( int i = 0; i < 8; ++i ) {
+            int16_t k = transposed ? internal_videocodec_C8[ i ][ j ] : internal_videocodec_C8[ j ][ i ];
+            lo = vmlal_n_s16( lo, vget_low_s16( m[ i ] ), k );
+            hi = vmlal_n_s16( hi, vget_high_s16( m[ i ] ), k );
         }
+        out[ j ] = vcombine_s16( vmovn_s32( vrshrq_n_s32( lo, INTERNAL_VIDEOCODEC_COS_SHIFT ) ), 
+            vmovn_s32( vrshrq_n_s32( hi, INTERNAL_VIDEOCODEC_COS_SHIFT ) ) );
     }
+    for( int j = 0; j < 8; ++j ) m[ j ] = out[ j ];
+}
+
+
+static inline void internal_videocodec_fdct8x8_neon( int16x8_t r[ 8 ], int32_t F[ 64 ] ) {
+    internal_videocodec_transpose8x8_s16_neon( r );
+    internal_videocodec_dct_cols_neon( r, 0 );
+    internal_videocodec_transpose8x8_s16_neon( r );
+    for( int v = 0; v < 8; ++v ) {
+        int32x4_t lo = vdupq_n_s32( 0 ), hi = vdupq_n_s32( 0 );
+        for( int y = 0; y < 8; ++y ) {
+            lo = vmlal_n_s16( lo, vget_low_s16( r[ y ] ), internal_videocodec_C8[ v ][ y ] );
+            hi = vmlal_n_s16( hi, vget_high_s16( r[ y ] ), internal_videocodec_C8[ v ][ y ] );
+        }
+        vst1q_s32( F + v * 8, vrshrq_n_s32( lo, INTERNAL_VIDEOCODEC_COS_SHIFT ) );
+        vst1q_s32( F + v * 8 + 4, vrshrq_n_s32( hi, INTERNAL_VIDEOCODEC_COS_SHIFT ) );
+    }
+}
+
+
+// Dequantizes, weights and inverse transforms `qcoef` into `out`. Returns 0 if a dequantized coefficient is outside 
+// INTERNAL_VIDEOCODEC_SIMD_IDCT_LIMIT
+static inline int internal_videocodec_idct8x8_dequant_neon( int16_t const* qcoef, uint8_t const* Q, uint16_t const* W8, int16x8_t out[ 8 ] ) {
+    int32x4_t peak = vdupq_n_s32( 0 );
+    for( int v = 0; v < 8; ++v ) {
+        int16x8_t q = vld1q_s16( qcoef + v * 8 );
+        int16x8_t s = vreinterpretq_s16_u16( vmovl_u8( vld1_u8( Q + v * 8 ) ) );
+        int16x8_t w = vreinterpretq_s16_u16( vld1q_u16( W8 + v * 8 ) );
+        int32x4_t lo = vmull_s16( vget_low_s16( q ), vget_low_s16( s ) );
+        int32x4_t hi = vmull_s16( vget_high_s16( q ), vget_high_s16( s ) );
+        peak = vmaxq_s32( peak, vmaxq_s32( vabsq_s32( lo ), vabsq_s32( hi ) ) );
+        int16x8_t f = vcombine_s16( vmovn_s32( lo ), vmovn_s32( hi ) );
+        lo = vrshrq_n_s32( vmull_s16( vget_low_s16( f ), vget_low_s16( w ) ), 8 );
+        hi = vrshrq_n_s32( vmull_s16( vget_high_s16( f ), vget_high_s16( w ) ), 8 );
+        out[ v ] = vcombine_s16( vmovn_s32( lo ), vmovn_s32( hi ) );
+    }
+    int32x2_t p = vpmax_s32( vget_low_s32( peak ), vget_high_s32( peak ) );
+    p = vpmax_s32( p, p );
+    if( vget_lane_s32( p, 0 ) > INTERNAL_VIDEOCODEC_SIMD_IDCT_LIMIT ) return 0;
+    internal_videocodec_dct_cols_neon( out, 1 );
+    internal_videocodec_transpose8x8_s16_neon( out );
+    internal_videocodec_dct_cols_neon( out, 1 );
+    internal_videocodec_transpose8x8_s16_neon( out );
+    return 1;
+}
+
+#endif
+
+
+static void internal_videocodec_fdct8x8_u8( uint8_t const* src, int stride, int32_t F[ 64 ] ) {
+    #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+        __m128i r[ 8 ];
+        for( int y = 0; y < 8; y++ ) {
+            __m128i row = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( src + y * stride ) ), _mm_setzero_si128() );
+            r[ y ] = _mm_sub_epi16( row, _mm_set1_epi16( 128 ) );
+        }
+        internal_videocodec_fdct8x8_sse2( r, F );
+    #elif defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+        int16x8_t r[ 8 ];
+        for( int y = 0; y < 8; y++ ) r[ y ] = vreinterpretq_s16_u16( vsubl_u8( vld1_u8( src + y * stride ), vdup_n_u8( 128 ) ) );
+        internal_videocodec_fdct8x8_neon( r, F );
+    #else
+        int32_t tmp[ 64 ];
+        for( int y = 0; y < 8; y++ ) {
+            int32_t r[ 8 ];
+            for( int x = 0; x < 8; x++ ) r[ x ] = (int32_t) src[ y * stride + x ] - 128;
+            for( int u = 0; u < 8; u++ ) {
+                int64_t s = 0;
+                for( int x = 0; x < 8; x++ ) s += (int64_t) internal_videocodec_C8[ u ][ x ] * (int64_t) r[ x ];
+                tmp[ y * 8 + u ] = (int32_t) ( ( s + ( (int64_t) 1 << ( INTERNAL_VIDEOCODEC_COS_SHIFT - 1 ) ) ) >> INTERNAL_VIDEOCODEC_COS_SHIFT );
+            }
+        }
+        for( int u = 0; u < 8; u++ ) {
+            for( int v = 0; v < 8; v++ ) {
+                int64_t s = 0;
+                for( int y = 0; y < 8; y++ ) s += (int64_t) internal_videocodec_C8[ v ][ y ] * (int64_t) tmp[ y * 8 + u ];
+                F[ v * 8 + u ] = (int32_t) ( ( s + ( (int64_t) 1 << ( INTERNAL_VIDEOCODEC_COS_SHIFT - 1 ) ) ) >> INTERNAL_VIDEOCODEC_COS_SHIFT );
+            }
+        }
+    #endif
 }
 
 
 static void internal_videocodec_fdct8x8_s16( int16_t const* src, int stride, int32_t F[ 64 ] ) {
+    #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+        __m128i r[ 8 ], outside = _mm_setzero_si128();
+        __m128i limit = _mm_set1_epi16( INTERNAL_VIDEOCODEC_SIMD_FDCT_LIMIT ), neg_limit = _mm_set1_epi16( -INTERNAL_VIDEOCODEC_SIMD_FDCT_LIMIT );
+        for( int y = 0; y < 8; y++ ) {
+            r[ y ] = _mm_loadu_si128( (__m128i const*)( src + y * stride ) );
+            outside = _mm_or_si128( outside, _mm_or_si128( _mm_cmpgt_epi16( r[ y ], limit ), _mm_cmplt_epi16( r[ y ], neg_limit ) ) );
+        }
+        if( !_mm_movemask_epi8( outside ) ) {
+            internal_videocodec_fdct8x8_sse2( r, F );
+            return;
+        }
+    #elif defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+        int16x8_t r[ 8 ], peak = vdupq_n_s16( 0 );
+        for( int y = 0; y < 8; y++ ) {
+            r[ y ] = vld1q_s16( src + y * stride );
+            peak = vmaxq_s16( peak, vqabsq_s16( r[ y ] ) );
+        }
+        int16x4_t p = vpmax_s16( vget_low_s16( peak ), vget_high_s16( peak ) );
+        p = vpmax_s16( p, p );
+        p = vpmax_s16( p, p );
+        if( vget_lane_s16( p, 0 ) <= INTERNAL_VIDEOCODEC_SIMD_FDCT_LIMIT ) {
+            internal_videocodec_fdct8x8_neon( r, F );
+            return;
+        }
+    #endif
     int32_t tmp[ 64 ];
     for( int y = 0; y < 8; y++ ) {
         int32_t r[ 8 ];
@@ -921,7 +1283,129 @@ static inline int internal_videocodec_hadamard4_abs_sum( const int r[ 16 ] ) {
 }
 
 
+#if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+
+// Sums of the absolute values of the 4x4 Hadamard transforms of two 4x4 blocks, side by side in rows `d[ 0..3 ]`. The 
+// rows are transformed first and then the columns, the opposite order to internal_videocodec_hadamard4_abs_sum, which
+// gives the same sums
+static inline void internal_videocodec_satd4x4_pair_sse2( __m128i const d[ 4 ], int sums[ 2 ] ) {
+    __m128i s0 = _mm_add_epi16( d[ 0 ], d[ 1 ] ), d0 = _mm_sub_epi16( d[ 0 ], d[ 1 ] );
+    __m128i s1 = _mm_add_epi16( d[ 2 ], d[ 3 ] ), d1 = _mm_sub_epi16( d[ 2 ], d[ 3 ] );
+    __m128i w0 = _mm_add_epi16( s0, s1 ), w1 = _mm_add_epi16( d0, d1 ), w2 = _mm_sub_epi16( s0, s1 ), w3 = _mm_sub_epi16( d0, d1 );
+    __m128i t0 = _mm_unpacklo_epi16( w0, w1 ), t1 = _mm_unpackhi_epi16( w0, w1 );
+    __m128i t2 = _mm_unpacklo_epi16( w2, w3 ), t3 = _mm_unpackhi_epi16( w2, w3 );
+    __m128i u0 = _mm_unpacklo_epi32( t0, t2 ), u1 = _mm_unpackhi_epi32( t0, t2 );
+    __m128i u2 = _mm_unpacklo_epi32( t1, t3 ), u3 = _mm_unpackhi_epi32( t1, t3 );
+    __m128i x0 = _mm_unpacklo_epi64( u0, u2 ), x1 = _mm_unpackhi_epi64( u0, u2 );
+    __m128i x2 = _mm_unpacklo_epi64( u1, u3 ), x3 = _mm_unpackhi_epi64( u1, u3 );
+    s0 = _mm_add_epi16( x0, x1 ); d0 = _mm_sub_epi16( x0, x1 );
+    s1 = _mm_add_epi16( x2, x3 ); d1 = _mm_sub_epi16( x2, x3 );
+    __m128i zero = _mm_setzero_si128();
+    __m128i c0 = _mm_add_epi16( s0, s1 ), c1 = _mm_add_epi16( d0, d1 ), c2 = _mm_sub_epi16( s0, s1 ), c3 = _mm_sub_epi16( d0, d1 );
+    c0 = _mm_max_epi16( c0, _mm_sub_epi16( zero, c0 ) );
+    c1 = _mm_max_epi16( c1, _mm_sub_epi16( zero, c1 ) );
+    c2 = _mm_max_epi16( c2, _mm_sub_epi16( zero, c2 ) );
+    c3 = _mm_max_epi16( c3, _mm_sub_epi16( zero, c3 ) );
+    __m128i total = _mm_madd_epi16( _mm_add_epi16( _mm_add_epi16( c0, c1 ), _mm_add_epi16( c2, c3 ) ), _mm_set1_epi16( 1 ) );
+    int32_t t[ 4 ];
+    _mm_storeu_si128( (__m128i*) t, total );
+    sums[ 0 ] = t[ 0 ] + t[ 1 ];
+    sums[ 1 ] = t[ 2 ] + t[ 3 ];
+}
+
+#elif defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+
+// Sums of the absolute values of the 4x4 Hadamard transforms of two 4x4 blocks, side by side in rows `d[ 0..3 ]`. The 
+// rows are transformed first and then the columns, the opposite order to internal_videocodec_hadamard4_abs_sum, which
+// gives the same sums
+static inline void internal_videocodec_satd4x4_pair_neon( int16x8_t const d[ 4 ], int sums[ 2 ] ) {
+    int16x8_t s0 = vaddq_s16( d[ 0 ], d[ 1 ] ), d0 = vsubq_s16( d[ 0 ], d[ 1 ] );
+    int16x8_t s1 = vaddq_s16( d[ 2 ], d[ 3 ] ), d1 = vsubq_s16( d[ 2 ], d[ 3 ] );
+    int16x8x2_t a = vtrnq_s16( vaddq_s16( s0, s1 ), vaddq_s16( d0, d1 ) );
+    int16x8x2_t b = vtrnq_s16( vsubq_s16( s0, s1 ), vsubq_s16( d0, d1 ) );
+    int32x4x2_t c = vtrnq_s32( vreinterpretq_s32_s16( a.val[ 0 ] ), vreinterpretq_s32_s16( b.val[ 0 ] ) );
+    int32x4x2_t e = vtrnq_s32( vreinterpretq_s32_s16( a.val[ 1 ] ), vreinterpretq_s32_s16( b.val[ 1 ] ) );
+    int16x8_t x0 = vreinterpretq_s16_s32( c.val[ 0 ] ), x1 = vreinterpretq_s16_s32( e.val[ 0 ] );
+    int16x8_t x2 = vreinterpretq_s16_s32( c.val[ 1 ] ), x3 = vreinterpretq_s16_s32( e.val[ 1 ] );
+    s0 = vaddq_s16( x0, x1 ); d0 = vsubq_s16( x0, x1 );
+    s1 = vaddq_s16( x2, x3 ); d1 = vsubq_s16( x2, x3 );
+    int16x8_t total = vaddq_s16( vaddq_s16( vabsq_s16( vaddq_s16( s0, s1 ) ), vabsq_s16( vaddq_s16( d0, d1 ) ) ), 
+        vaddq_s16( vabsq_s16( vsubq_s16( s0, s1 ) ), vabsq_s16( vsubq_s16( d0, d1 ) ) ) );
+    int32x4_t t = vpaddlq_s16( total );
+    sums[ 0 ] = vgetq_lane_s32( t, 0 ) + vgetq_lane_s32( t, 1 );
+    sums[ 1 ] = vgetq_lane_s32( t, 2 ) + vgetq_lane_s32( t, 3 );
+}
+
+#endif
+
+
 static int internal_videocodec_satd16x16_luma_hpel( uint8_t const* cur, int w, int h, int x, int y, uint8_t const* ref, int dxh, int dyh, int cutoff ) {
+    #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 ) || defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+        // Without clamping, a row of the prediction is one load (or two or four, averaged, for half pixel positions)
+        int fx = dxh & 1, fy = dyh & 1;
+        int rx = x + internal_videocodec_floor_div2( dxh ), ry = y + internal_videocodec_floor_div2( dyh );
+        if( x >= 0 && y >= 0 && x + 16 <= w && y + 16 <= h && rx >= 0 && ry >= 0 && rx + 16 + fx <= w && ry + 16 + fy <= h ) {
+            int total = 0;
+            for( int ty = 0; ty < 16; ty += 4 ) {
+                int tiles[ 4 ];
+                #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+                    __m128i zero = _mm_setzero_si128();
+                    __m128i d_lo[ 4 ], d_hi[ 4 ];
+                    for( int j = 0; j < 4; j++ ) {
+                        uint8_t const* r = ref + (size_t) ( ry + ty + j ) * w + rx;
+                        __m128i p = _mm_loadu_si128( (__m128i const*) r );
+                        if( fx && fy ) {
+                            __m128i p10 = _mm_loadu_si128( (__m128i const*)( r + 1 ) );
+                            __m128i p01 = _mm_loadu_si128( (__m128i const*)( r + w ) );
+                            __m128i p11 = _mm_loadu_si128( (__m128i const*)( r + w + 1 ) );
+                            __m128i lo = _mm_add_epi16( _mm_add_epi16( _mm_unpacklo_epi8( p, zero ), _mm_unpacklo_epi8( p10, zero ) ),
+                                _mm_add_epi16( _mm_unpacklo_epi8( p01, zero ), _mm_unpacklo_epi8( p11, zero ) ) );
+                            __m128i hi = _mm_add_epi16( _mm_add_epi16( _mm_unpackhi_epi8( p, zero ), _mm_unpackhi_epi8( p10, zero ) ),
+                                _mm_add_epi16( _mm_unpackhi_epi8( p01, zero ), _mm_unpackhi_epi8( p11, zero ) ) );
+                            lo = _mm_srli_epi16( _mm_add_epi16( lo, _mm_set1_epi16( 2 ) ), 2 );
+                            hi = _mm_srli_epi16( _mm_add_epi16( hi, _mm_set1_epi16( 2 ) ), 2 );
+                            p = _mm_packus_epi16( lo, hi );
+                        } else if( fx ) {
+                            p = _mm_avg_epu8( p, _mm_loadu_si128( (__m128i const*)( r + 1 ) ) );
+                        } else if( fy ) {
+                            p = _mm_avg_epu8( p, _mm_loadu_si128( (__m128i const*)( r + w ) ) );
+                        }
+                        __m128i c = _mm_loadu_si128( (__m128i const*)( cur + (size_t) ( y + ty + j ) * w + x ) );
+                        d_lo[ j ] = _mm_sub_epi16( _mm_unpacklo_epi8( c, zero ), _mm_unpacklo_epi8( p, zero ) );
+                        d_hi[ j ] = _mm_sub_epi16( _mm_unpackhi_epi8( c, zero ), _mm_unpackhi_epi8( p, zero ) );
+                    }
+                    internal_videocodec_satd4x4_pair_sse2( d_lo, tiles );
+                    internal_videocodec_satd4x4_pair_sse2( d_hi, tiles + 2 );
+                #else
+                    int16x8_t d_lo[ 4 ], d_hi[ 4 ];
+                    for( int j = 0; j < 4; j++ ) {
+                        uint8_t const* r = ref + (size_t) ( ry + ty + j ) * w + rx;
+                        uint8x16_t p = vld1q_u8( r );
+                        if( fx && fy ) {
+                            uint8x16_t p10 = vld1q_u8( r + 1 ), p01 = vld1q_u8( r + w ), p11 = vld1q_u8( r + w + 1 );
+                            uint16x8_t lo = vaddq_u16( vaddl_u8( vget_low_u8( p ), vget_low_u8( p10 ) ), vaddl_u8( vget_low_u8( p01 ), vget_low_u8( p11 ) ) );
+                            uint16x8_t hi = vaddq_u16( vaddl_u8( vget_high_u8( p ), vget_high_u8( p10 ) ), vaddl_u8( vget_high_u8( p01 ), vget_high_u8( p11 ) ) );
+                            p = vcombine_u8( vrshrn_n_u16( lo, 2 ), vrshrn_n_u16( hi, 2 ) );
+                        } else if( fx ) {
+                            p = vrhaddq_u8( p, vld1q_u8( r + 1 ) );
+                        } else if( fy ) {
+                            p = vrhaddq_u8( p, vld1q_u8( r + w ) );
+                        }
+                        uint8x16_t c = vld1q_u8( cur + (size_t) ( y + ty + j ) * w + x );
+                        d_lo[ j ] = vreinterpretq_s16_u16( vsubl_u8( vget_low_u8( c ), vget_low_u8( p ) ) );
+                        d_hi[ j ] = vreinterpretq_s16_u16( vsubl_u8( vget_high_u8( c ), vget_high_u8( p ) ) );
+                    }
+                    internal_videocodec_satd4x4_pair_neon( d_lo, tiles );
+                    internal_videocodec_satd4x4_pair_neon( d_hi, tiles + 2 );
+                #endif
+                for( int tx = 0; tx < 4; tx++ ) {
+                    total += tiles[ tx ];
+                    if( total >= cutoff ) return total;
+                }
+            }
+            return total;
+        }
+    #endif
     int sum = 0;
     int r[ 16 ];
     for( int ty = 0; ty < 16; ty += 4 ) {
@@ -966,6 +1450,195 @@ static inline void internal_videocodec_buffer_put_i16( internal_videocodec_buffe
 }
 
 
+#if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+
+// Filters 8 positions along an edge at once, as the scalar loops in internal_videocodec_deblock_plane do, with the 
+// pixels across the edge, p2 p1 p0 | q0 q1 q2, widened to 16 bits. p0n and q0n can not leave 0..255, as they move 
+// towards a value within it, and the same goes for p1n and q1n, so there is no clamping
+static inline void internal_videocodec_deblock_edge_sse2( __m128i p2, __m128i* p1, __m128i* p0, __m128i* q0, __m128i* q1, __m128i q2, int is_chroma ) {
+    #define INTERNAL_VIDEOCODEC_ABSDIFF( a, b ) _mm_max_epi16( _mm_sub_epi16( a, b ), _mm_sub_epi16( b, a ) )
+    #define INTERNAL_VIDEOCODEC_SELECT( m, a, b ) _mm_or_si128( _mm_and_si128( m, a ), _mm_andnot_si128( m, b ) )
+    __m128i P1 = *p1, P0 = *p0, Q0 = *q0, Q1 = *q1;
+    __m128i g = INTERNAL_VIDEOCODEC_ABSDIFF( P0, Q0 );
+    __m128i flat = _mm_max_epi16( _mm_max_epi16( INTERNAL_VIDEOCODEC_ABSDIFF( p2, P1 ), INTERNAL_VIDEOCODEC_ABSDIFF( P1, P0 ) ),
+        _mm_max_epi16( INTERNAL_VIDEOCODEC_ABSDIFF( q2, Q1 ), INTERNAL_VIDEOCODEC_ABSDIFF( Q1, Q0 ) ) );
+    __m128i mask = _mm_and_si128( _mm_cmpgt_epi16( g, _mm_set1_epi16( is_chroma ? 2 : 1 ) ), _mm_cmpgt_epi16( g, flat ) );
+    if( !_mm_movemask_epi8( mask ) ) return;
+
+    __m128i one = _mm_set1_epi16( 1 );
+    __m128i a = _mm_srai_epi16( _mm_add_epi16( _mm_add_epi16( P1, Q1 ), _mm_add_epi16( _mm_mullo_epi16( _mm_add_epi16( P0, Q0 ), 
+        _mm_set1_epi16( 3 ) ), _mm_set1_epi16( 4 ) ) ), 3 );
+    __m128i wgt = _mm_min_epi16( _mm_sub_epi16( g, flat ), _mm_set1_epi16( 12 ) );
+    __m128i step = _mm_min_epi16( _mm_srai_epi16( _mm_add_epi16( wgt, one ), 1 ), _mm_set1_epi16( is_chroma ? 3 : 6 ) );
+    __m128i neg_step = _mm_sub_epi16( _mm_setzero_si128(), step );
+    __m128i p0n = _mm_add_epi16( P0, _mm_min_epi16( _mm_max_epi16( _mm_sub_epi16( a, P0 ), neg_step ), step ) );
+    __m128i q0n = _mm_add_epi16( Q0, _mm_min_epi16( _mm_max_epi16( _mm_sub_epi16( a, Q0 ), neg_step ), step ) );
+    *p0 = INTERNAL_VIDEOCODEC_SELECT( mask, p0n, P0 );
+    *q0 = INTERNAL_VIDEOCODEC_SELECT( mask, q0n, Q0 );
+
+    if( !is_chroma ) {
+        __m128i flat2 = _mm_max_epi16( INTERNAL_VIDEOCODEC_ABSDIFF( p2, P1 ), INTERNAL_VIDEOCODEC_ABSDIFF( q2, Q1 ) );
+        __m128i mask2 = _mm_and_si128( mask, _mm_cmplt_epi16( flat2, _mm_set1_epi16( 4 ) ) );
+        __m128i adj = _mm_srai_epi16( _mm_add_epi16( step, one ), 1 );
+        __m128i neg_adj = _mm_sub_epi16( _mm_setzero_si128(), adj );
+        __m128i tL = _mm_sub_epi16( _mm_srai_epi16( _mm_add_epi16( p2, p0n ), 1 ), P1 );
+        __m128i tR = _mm_sub_epi16( _mm_srai_epi16( _mm_add_epi16( q2, q0n ), 1 ), Q1 );
+        __m128i p1n = _mm_add_epi16( P1, _mm_min_epi16( _mm_max_epi16( tL, neg_adj ), adj ) );
+        __m128i q1n = _mm_add_epi16( Q1, _mm_min_epi16( _mm_max_epi16( tR, neg_adj ), adj ) );
+        *p1 = INTERNAL_VIDEOCODEC_SELECT( mask2, p1n, P1 );
+        *q1 = INTERNAL_VIDEOCODEC_SELECT( mask2, q1n, Q1 );
+    }
+    #undef INTERNAL_VIDEOCODEC_ABSDIFF
+    #undef INTERNAL_VIDEOCODEC_SELECT
+}
+
+
+// Transposes the 8x8 bytes in the low halves of `rows`, into `cols`, two columns in each (the even one in the low half)
+static inline void internal_videocodec_transpose8x8_u8_sse2( __m128i const rows[ 8 ], __m128i cols[ 4 ] ) {
+    __m128i a0 = _mm_unpacklo_epi8( rows[ 0 ], rows[ 1 ] ), a1 = _mm_unpacklo_epi8( rows[ 2 ], rows[ 3 ] );
+    __m128i a2 = _mm_unpacklo_epi8( rows[ 4 ], rows[ 5 ] ), a3 = _mm_unpacklo_epi8( rows[ 6 ], rows[ 7 ] );
+    __m128i b0 = _mm_unpacklo_epi16( a0, a1 ), b1 = _mm_unpackhi_epi16( a0, a1 );
+    __m128i b2 = _mm_unpacklo_epi16( a2, a3 ), b3 = _mm_unpackhi_epi16( a2, a3 );
+    cols[ 0 ] = _mm_unpacklo_epi32( b0, b2 );
+    cols[ 1 ] = _mm_unpackhi_epi32( b0, b2 );
+    cols[ 2 ] = _mm_unpacklo_epi32( b1, b3 );
+    cols[ 3 ] = _mm_unpackhi_epi32( b1, b3 );
+}
+
+
+// Filters the vertical edge between columns i and i + 1, for rows y to y + 7, by transposing the 8x8 pixels around it
+static inline void internal_videocodec_deblock_vertical_edge_sse2( uint8_t* img, int w, int i, int y, int is_chroma ) {
+    uint8_t* base = img + (size_t) y * w + i - 3;
+    __m128i rows[ 8 ], cols[ 4 ], zero = _mm_setzero_si128();
+    for( int r = 0; r < 8; r++ ) rows[ r ] = _mm_loadl_epi64( (__m128i const*)( base + (size_t) r * w ) );
+    internal_videocodec_transpose8x8_u8_sse2( rows, cols );
+    __m128i p2 = _mm_unpackhi_epi8( cols[ 0 ], zero ), p1 = _mm_unpacklo_epi8( cols[ 1 ], zero ), p0 = _mm_unpackhi_epi8( cols[ 1 ], zero );
+    __m128i q0 = _mm_unpacklo_epi8( cols[ 2 ], zero ), q1 = _mm_unpackhi_epi8( cols[ 2 ], zero ), q2 = _mm_unpacklo_epi8( cols[ 3 ], zero );
+    internal_videocodec_deblock_edge_sse2( p2, &p1, &p0, &q0, &q1, q2, is_chroma );
+    cols[ 1 ] = _mm_packus_epi16( p1, p0 );
+    cols[ 2 ] = _mm_packus_epi16( q0, q1 );
+    for( int c = 0; c < 4; c++ ) {
+        rows[ c * 2 + 0 ] = cols[ c ];
+        rows[ c * 2 + 1 ] = _mm_srli_si128( cols[ c ], 8 );
+    }
+    internal_videocodec_transpose8x8_u8_sse2( rows, cols );
+    for( int r = 0; r < 4; r++ ) {
+        _mm_storel_epi64( (__m128i*)( base + (size_t) ( r * 2 + 0 ) * w ), cols[ r ] );
+        _mm_storel_epi64( (__m128i*)( base + (size_t) ( r * 2 + 1 ) * w ), _mm_srli_si128( cols[ r ], 8 ) );
+    }
+}
+
+
+// Filters the horizontal edge above row yb, for columns x to x + 7
+static inline void internal_videocodec_deblock_horizontal_edge_sse2( uint8_t* img, int w, int yb, int x, int is_chroma ) {
+    uint8_t* q = img + (size_t) yb * w + x;
+    __m128i zero = _mm_setzero_si128();
+    __m128i p2 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( q - 3 * (size_t) w ) ), zero );
+    __m128i p1 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( q - 2 * (size_t) w ) ), zero );
+    __m128i p0 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( q - 1 * (size_t) w ) ), zero );
+    __m128i q0 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( q ) ), zero );
+    __m128i q1 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( q + 1 * (size_t) w ) ), zero );
+    __m128i q2 = _mm_unpacklo_epi8( _mm_loadl_epi64( (__m128i const*)( q + 2 * (size_t) w ) ), zero );
+    internal_videocodec_deblock_edge_sse2( p2, &p1, &p0, &q0, &q1, q2, is_chroma );
+    _mm_storel_epi64( (__m128i*)( q - 2 * (size_t) w ), _mm_packus_epi16( p1, p1 ) );
+    _mm_storel_epi64( (__m128i*)( q - 1 * (size_t) w ), _mm_packus_epi16( p0, p0 ) );
+    _mm_storel_epi64( (__m128i*)( q ), _mm_packus_epi16( q0, q0 ) );
+    _mm_storel_epi64( (__m128i*)( q + 1 * (size_t) w ), _mm_packus_epi16( q1, q1 ) );
+}
+
+#elif defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+
+// Filters 8 positions along an edge at once, as the scalar loops in internal_videocodec_deblock_plane do, with the 
+// pixels across the edge, p2 p1 p0 | q0 q1 q2, widened to 16 bits. p0n and q0n can not leave 0..255, as they move 
+// towards a value within it, and the same goes for p1n and q1n, so there is no clamping
+static inline void internal_videocodec_deblock_edge_neon( int16x8_t p2, int16x8_t* p1, int16x8_t* p0, int16x8_t* q0, int16x8_t* q1, int16x8_t q2, int is_chroma ) {
+    int16x8_t P1 = *p1, P0 = *p0, Q0 = *q0, Q1 = *q1;
+    int16x8_t g = vabdq_s16( P0, Q0 );
+    int16x8_t flat = vmaxq_s16( vmaxq_s16( vabdq_s16( p2, P1 ), vabdq_s16( P1, P0 ) ), vmaxq_s16( vabdq_s16( q2, Q1 ), vabdq_s16( Q1, Q0 ) ) );
+    uint16x8_t mask = vandq_u16( vcgtq_s16( g, vdupq_n_s16( is_chroma ? 2 : 1 ) ), vcgtq_s16( g, flat ) );
+
+    int16x8_t a = vshrq_n_s16( vaddq_s16( vaddq_s16( P1, Q1 ), vaddq_s16( vmulq_n_s16( vaddq_s16( P0, Q0 ), 3 ), vdupq_n_s16( 4 ) ) ), 3 );
+    int16x8_t wgt = vminq_s16( vsubq_s16( g, flat ), vdupq_n_s16( 12 ) );
+    int16x8_t step = vminq_s16( vshrq_n_s16( vaddq_s16( wgt, vdupq_n_s16( 1 ) ), 1 ), vdupq_n_s16( is_chroma ? 3 : 6 ) );
+    int16x8_t neg_step = vnegq_s16( step );
+    int16x8_t p0n = vaddq_s16( P0, vminq_s16( vmaxq_s16( vsubq_s16( a, P0 ), neg_step ), step ) );
+    int16x8_t q0n = vaddq_s16( Q0, vminq_s16( vmaxq_s16( vsubq_s16( a, Q0 ), neg_step ), step ) );
+    *p0 = vbslq_s16( mask, p0n, P0 );
+    *q0 = vbslq_s16( mask, q0n, Q0 );
+
+    if( !is_chroma ) {
+        int16x8_t flat2 = vmaxq_s16( vabdq_s16( p2, P1 ), vabdq_s16( q2, Q1 ) );
+        uint16x8_t mask2 = vandq_u16( mask, vcltq_s16( flat2, vdupq_n_s16( 4 ) ) );
+        int16x8_t adj = vshrq_n_s16( vaddq_s16( step, vdupq_n_s16( 1 ) ), 1 );
+        int16x8_t neg_adj = vnegq_s16( adj );
+        int16x8_t tL = vsubq_s16( vshrq_n_s16( vaddq_s16( p2, p0n ), 1 ), P1 );
+        int16x8_t tR = vsubq_s16( vshrq_n_s16( vaddq_s16( q2, q0n ), 1 ), Q1 );
+        *p1 = vbslq_s16( mask2, vaddq_s16( P1, vminq_s16( vmaxq_s16( tL, neg_adj ), adj ) ), P1 );
+        *q1 = vbslq_s16( mask2, vaddq_s16( Q1, vminq_s16( vmaxq_s16( tR, neg_adj ), adj ) ), Q1 );
+    }
+}
+
+
+static inline void internal_videocodec_transpose8x8_u8_neon( uint8x8_t m[ 8 ] ) {
+    uint8x8x2_t a0 = vtrn_u8( m[ 0 ], m[ 1 ] ), a1 = vtrn_u8( m[ 2 ], m[ 3 ] );
+    uint8x8x2_t a2 = vtrn_u8( m[ 4 ], m[ 5 ] ), a3 = vtrn_u8( m[ 6 ], m[ 7 ] );
+    uint16x4x2_t b0 = vtrn_u16( vreinterpret_u16_u8( a0.val[ 0 ] ), vreinterpret_u16_u8( a1.val[ 0 ] ) );
+    uint16x4x2_t b1 = vtrn_u16( vreinterpret_u16_u8( a0.val[ 1 ] ), vreinterpret_u16_u8( a1.val[ 1 ] ) );
+    uint16x4x2_t b2 = vtrn_u16( vreinterpret_u16_u8( a2.val[ 0 ] ), vreinterpret_u16_u8( a3.val[ 0 ] ) );
+    uint16x4x2_t b3 = vtrn_u16( vreinterpret_u16_u8( a2.val[ 1 ] ), vreinterpret_u16_u8( a3.val[ 1 ] ) );
+    uint32x2x2_t c0 = vtrn_u32( vreinterpret_u32_u16( b0.val[ 0 ] ), vreinterpret_u32_u16( b2.val[ 0 ] ) );
+    uint32x2x2_t c1 = vtrn_u32( vreinterpret_u32_u16( b1.val[ 0 ] ), vreinterpret_u32_u16( b3.val[ 0 ] ) );
+    uint32x2x2_t c2 = vtrn_u32( vreinterpret_u32_u16( b0.val[ 1 ] ), vreinterpret_u32_u16( b2.val[ 1 ] ) );
+    uint32x2x2_t c3 = vtrn_u32( vreinterpret_u32_u16( b1.val[ 1 ] ), vreinterpret_u32_u16( b3.val[ 1 ] ) );
+    m[ 0 ] = vreinterpret_u8_u32( c0.val[ 0 ] );
+    m[ 1 ] = vreinterpret_u8_u32( c1.val[ 0 ] );
+    m[ 2 ] = vreinterpret_u8_u32( c2.val[ 0 ] );
+    m[ 3 ] = vreinterpret_u8_u32( c3.val[ 0 ] );
+    m[ 4 ] = vreinterpret_u8_u32( c0.val[ 1 ] );
+    m[ 5 ] = vreinterpret_u8_u32( c1.val[ 1 ] );
+    m[ 6 ] = vreinterpret_u8_u32( c2.val[ 1 ] );
+    m[ 7 ] = vreinterpret_u8_u32( c3.val[ 1 ] );
+}
+
+
+// Filters the vertical edge between columns i and i + 1, for rows y to y + 7, by transposing the 8x8 pixels around it
+static inline void internal_videocodec_deblock_vertical_edge_neon( uint8_t* img, int w, int i, int y, int is_chroma ) {
+    uint8_t* base = img + (size_t) y * w + i - 3;
+    uint8x8_t m[ 8 ];
+    for( int r = 0; r < 8; r++ ) m[ r ] = vld1_u8( base + (size_t) r * w );
+    internal_videocodec_transpose8x8_u8_neon( m );
+    int16x8_t p1 = vreinterpretq_s16_u16( vmovl_u8( m[ 2 ] ) ), p0 = vreinterpretq_s16_u16( vmovl_u8( m[ 3 ] ) );
+    int16x8_t q0 = vreinterpretq_s16_u16( vmovl_u8( m[ 4 ] ) ), q1 = vreinterpretq_s16_u16( vmovl_u8( m[ 5 ] ) );
+    internal_videocodec_deblock_edge_neon( vreinterpretq_s16_u16( vmovl_u8( m[ 1 ] ) ), &p1, &p0, &q0, &q1, 
+        vreinterpretq_s16_u16( vmovl_u8( m[ 6 ] ) ), is_chroma );
+    m[ 2 ] = vqmovun_s16( p1 );
+    m[ 3 ] = vqmovun_s16( p0 );
+    m[ 4 ] = vqmovun_s16( q0 );
+    m[ 5 ] = vqmovun_s16( q1 );
+    internal_videocodec_transpose8x8_u8_neon( m );
+    for( int r = 0; r < 8; r++ ) vst1_u8( base + (size_t) r * w, m[ r ] );
+}
+
+
+// Filters the horizontal edge above row yb, for columns x to x + 7
+static inline void internal_videocodec_deblock_horizontal_edge_neon( uint8_t* img, int w, int yb, int x, int is_chroma ) {
+    uint8_t* q = img + (size_t) yb * w + x;
+    int16x8_t p2 = vreinterpretq_s16_u16( vmovl_u8( vld1_u8( q - 3 * (size_t) w ) ) );
+    int16x8_t p1 = vreinterpretq_s16_u16( vmovl_u8( vld1_u8( q - 2 * (size_t) w ) ) );
+    int16x8_t p0 = vreinterpretq_s16_u16( vmovl_u8( vld1_u8( q - 1 * (size_t) w ) ) );
+    int16x8_t q0 = vreinterpretq_s16_u16( vmovl_u8( vld1_u8( q ) ) );
+    int16x8_t q1 = vreinterpretq_s16_u16( vmovl_u8( vld1_u8( q + 1 * (size_t) w ) ) );
+    int16x8_t q2 = vreinterpretq_s16_u16( vmovl_u8( vld1_u8( q + 2 * (size_t) w ) ) );
+    internal_videocodec_deblock_edge_neon( p2, &p1, &p0, &q0, &q1, q2, is_chroma );
+    vst1_u8( q - 2 * (size_t) w, vqmovun_s16( p1 ) );
+    vst1_u8( q - 1 * (size_t) w, vqmovun_s16( p0 ) );
+    vst1_u8( q, vqmovun_s16( q0 ) );
+    vst1_u8( q + 1 * (size_t) w, vqmovun_s16( q1 ) );
+}
+
+#endif
+
+
 static void internal_videocodec_deblock_plane( uint8_t* img, int w, int h, int is_chroma ) {
     if( w < 16 || h < 16 ) return;
 
@@ -974,11 +1647,18 @@ static void internal_videocodec_deblock_plane( uint8_t* img, int w, int h, int i
 
     for( int x = 8; x < w; x += 8 ) {
         const int i = x - 1;
-        for( int y = 0; y < h; ++y ) {
+        int y = 0;
+        // The edges do not overlap, so all rows of one can be filtered before the next
+        #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+            if( i + 4 < w ) for( ; y + 8 <= h; y += 8 ) internal_videocodec_deblock_vertical_edge_sse2( img, w, i, y, is_chroma );
+        #elif defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+            if( i + 4 < w ) for( ; y + 8 <= h; y += 8 ) internal_videocodec_deblock_vertical_edge_neon( img, w, i, y, is_chroma );
+        #endif
+        for( ; y < h; ++y ) {
             uint8_t* row = img + (size_t)y * w;
 
             int p2 = row[ i - 2 ], p1 = row[ i - 1 ], p0 = row[ i ];
-            int q0 = row[ i + 1 ], q1 = row[ i + 2 ], q2 = ( i + 3 < w ) ? row[ i + 3 ] : row[ i + 2 ];
+            int q0 = row[ i + 1 ], q1 = row[ internal_videocodec_imin( i + 2, w - 1 ) ], q2 = row[ internal_videocodec_imin( i + 3, w - 1 ) ];
 
             int g  = internal_videocodec_abs( p0 - q0 );
             int rL = internal_videocodec_imax( internal_videocodec_abs( p2 - p1 ), internal_videocodec_abs( p1 - p0 ) );
@@ -1015,7 +1695,7 @@ static void internal_videocodec_deblock_plane( uint8_t* img, int w, int h, int i
                     if( tL >  adj ) tL =  adj; else if( tL < -adj ) tL = -adj;
                     if( tR >  adj ) tR =  adj; else if( tR < -adj ) tR = -adj;
                     row[ i - 1 ] = (uint8_t)internal_videocodec_clampi( p1 + tL );
-                    row[ i + 2 ] = (uint8_t)internal_videocodec_clampi( q1 + tR );
+                    row[ internal_videocodec_imin( i + 2, w - 1 ) ] = (uint8_t)internal_videocodec_clampi( q1 + tR );
                 }
             }
         }
@@ -1023,7 +1703,13 @@ static void internal_videocodec_deblock_plane( uint8_t* img, int w, int h, int i
 
     for( int yb = 8; yb < h; yb += 8 ) {
         const int rP0 = yb - 1, rQ0 = yb, rP1 = yb - 2, rP2 = yb - 3, rQ1 = yb + 1, rQ2 = yb + 2;
-        for( int x = 0; x < w; ++x ) {
+        int x = 0;
+        #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+            if( rQ2 < h ) for( ; x + 8 <= w; x += 8 ) internal_videocodec_deblock_horizontal_edge_sse2( img, w, yb, x, is_chroma );
+        #elif defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+            if( rQ2 < h ) for( ; x + 8 <= w; x += 8 ) internal_videocodec_deblock_horizontal_edge_neon( img, w, yb, x, is_chroma );
+        #endif
+        for( ; x < w; ++x ) {
             int p2 = img[ (size_t)internal_videocodec_imax( rP2, 0 ) * w + x ];
             int p1 = img[ (size_t)rP1 * w + x ];
             int p0 = img[ (size_t)rP0 * w + x ];
@@ -1176,6 +1862,45 @@ static void internal_videocodec_down2_box( const uint8_t* src, int w, int h, uin
 
 
 static inline int internal_videocodec_sad_block_clamped_early( const uint8_t* a, int w, int h, int ax, int ay, const uint8_t* b, int bx, int by, int B, int cutoff ) {
+    #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 ) || defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+        if( ( B == 4 || B == 8 ) && ax >= 0 && ay >= 0 && bx >= 0 && by >= 0 && ax + B <= w && ay + B <= h && bx + B <= w && by + B <= h ) {
+            int sum = 0;
+            for( int yy = 0; yy < B; ++yy ) {
+                const uint8_t* ra = a + (size_t) ( ay + yy ) * w + ax;
+                const uint8_t* rb = b + (size_t) ( by + yy ) * w + bx;
+                #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+                    __m128i va, vb;
+                    if( B == 8 ) {
+                        va = _mm_loadl_epi64( (__m128i const*) ra );
+                        vb = _mm_loadl_epi64( (__m128i const*) rb );
+                    } else {
+                        int32_t wa, wb;
+                        memcpy( &wa, ra, 4 );
+                        memcpy( &wb, rb, 4 );
+                        va = _mm_cvtsi32_si128( wa );
+                        vb = _mm_cvtsi32_si128( wb );
+                    }
+                    sum += _mm_cvtsi128_si32( _mm_sad_epu8( va, vb ) );
+                #else
+                    uint8x8_t va, vb;
+                    if( B == 8 ) {
+                        va = vld1_u8( ra );
+                        vb = vld1_u8( rb );
+                    } else {
+                        uint32_t wa, wb;
+                        memcpy( &wa, ra, 4 );
+                        memcpy( &wb, rb, 4 );
+                        va = vcreate_u8( wa );
+                        vb = vcreate_u8( wb );
+                    }
+                    uint32x2_t d = vpaddl_u16( vpaddl_u8( vabd_u8( va, vb ) ) );
+                    sum += (int) ( vget_lane_u32( d, 0 ) + vget_lane_u32( d, 1 ) );
+                #endif
+                if( sum >= cutoff ) return sum;
+            }
+            return sum;
+        }
+    #endif
     int s = 0;
     for( int yy = 0; yy < B; ++yy ) {
         int ya = ay + yy;
@@ -1211,6 +1936,22 @@ static inline uint8_t internal_videocodec_neutral_for_plane( int plane ) {
 
 
 static void internal_videocodec_idct8x8_dequant_to_u8( int16_t const* qcoef, uint8_t const* Q, uint16_t const* W8, uint8_t* dst, int stride ) {
+    #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+        __m128i out[ 16 ];
+        if( internal_videocodec_idct8x8_dequant_sse2( qcoef, Q, W8, out ) ) {
+            for( int y = 0; y < 8; y++ ) {
+                __m128i v = _mm_add_epi16( _mm_packs_epi32( out[ y * 2 ], out[ y * 2 + 1 ] ), _mm_set1_epi16( 128 ) );
+                _mm_storel_epi64( (__m128i*)( dst + y * stride ), _mm_packus_epi16( v, v ) );
+            }
+            return;
+        }
+    #elif defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+        int16x8_t out[ 8 ];
+        if( internal_videocodec_idct8x8_dequant_neon( qcoef, Q, W8, out ) ) {
+            for( int y = 0; y < 8; y++ ) vst1_u8( dst + y * stride, vqmovun_s16( vaddq_s16( out[ y ], vdupq_n_s16( 128 ) ) ) );
+            return;
+        }
+    #endif
     int32_t F[ 64 ], tmp[ 64 ];
     for( int i = 0; i < 64; i++ ) F[ i ] = (int32_t) qcoef[ i ] * (int32_t) Q[ i ];
     internal_videocodec_post_weight_F_ctx( F, W8 );
@@ -1233,6 +1974,19 @@ static void internal_videocodec_idct8x8_dequant_to_u8( int16_t const* qcoef, uin
 
 
 static void internal_videocodec_idct8x8_dequant_to_s16( int16_t const* qcoef, uint8_t const* Q, uint16_t const* W8, int16_t* dst, int dstride ) {
+    #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+        __m128i out[ 16 ];
+        if( internal_videocodec_idct8x8_dequant_sse2( qcoef, Q, W8, out ) ) {
+            for( int y = 0; y < 8; y++ ) _mm_storeu_si128( (__m128i*)( dst + y * dstride ), _mm_packs_epi32( out[ y * 2 ], out[ y * 2 + 1 ] ) );
+            return;
+        }
+    #elif defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+        int16x8_t out[ 8 ];
+        if( internal_videocodec_idct8x8_dequant_neon( qcoef, Q, W8, out ) ) {
+            for( int y = 0; y < 8; y++ ) vst1q_s16( dst + y * dstride, out[ y ] );
+            return;
+        }
+    #endif
     int32_t F[ 64 ], tmp[ 64 ];
     for( int i = 0; i < 64; i++ ) F[ i ] = (int32_t) qcoef[ i ] * (int32_t) Q[ i ];
     internal_videocodec_post_weight_F_ctx( F, W8 );
@@ -1271,6 +2025,28 @@ static inline uint8_t internal_videocodec_make_cbp6( const int16_t Y[ 4 ][ 64 ],
 }
 
 
+// A band of macroblock rows, encoded and packed on its own, into its own buffers
+typedef struct internal_videocodec_slice_t {
+    int mb_row_begin, mb_row_end;
+    internal_videocodec_buffer_t buffer;
+    uint8_t* packed;
+    int packed_len;
+    uint8_t* pack_arena;
+} internal_videocodec_slice_t;
+
+
+#ifdef VIDEOCODEC_THREADS
+
+typedef struct internal_videocodec_worker_t {
+    videocodec_enc_t* e;
+    thread_ptr_t thread;
+    thread_signal_t start;
+    thread_signal_t done;
+} internal_videocodec_worker_t;
+
+#endif
+
+
 struct videocodec_enc_t {
     int w, h, fps_n, fps_d;
     int sar_n, sar_d;
@@ -1296,6 +2072,18 @@ struct videocodec_enc_t {
     int last_cut_hist_l1_mmp;
     videocodec_enc_stats_t stats;
     videocodec_enc_stats_t* user_stats;
+    int slice_count;
+    internal_videocodec_slice_t slices[ INTERNAL_VIDEOCODEC_MAX_SLICES ];
+    uint8_t* slices_memory;
+    int slice_ftype, slice_group;
+    uint8_t const *slice_Y, *slice_U, *slice_V;
+    #ifdef VIDEOCODEC_THREADS
+        internal_videocodec_worker_t workers[ INTERNAL_VIDEOCODEC_MAX_SLICES - 1 ];
+        int workers_count;
+        int workers_exit;
+        thread_atomic_int_t next_slice;
+        int slices_base;
+    #endif
     uint8_t pack_arena[ VIDEOCODEC_PACK_ARENA_SIZE ];
 };
 
@@ -1354,8 +2142,8 @@ static void internal_videocodec_encode_block_I( internal_videocodec_buffer_t* bu
 }
 
 
-static void internal_videocodec_encode_plane_I( internal_videocodec_buffer_t* buffer, uint8_t const* src, int w, int h, uint8_t const* Q, uint16_t const* W8, uint8_t* recon, internal_videocodec_quality_params_t const* qp, int plane ) {
-    for( int y = 0; y < h; y += 8 ) {
+static void internal_videocodec_encode_plane_I( internal_videocodec_buffer_t* buffer, uint8_t const* src, int w, int h, int y_begin, int y_end, uint8_t const* Q, uint16_t const* W8, uint8_t* recon, internal_videocodec_quality_params_t const* qp, int plane ) {
+    for( int y = y_begin; y < y_end; y += 8 ) {
         for( int x = 0; x < w; x += 8 ) {
             int bwid = ( x + 8 <= w ) ? 8 : ( w - x );
             int bhgt = ( y + 8 <= h ) ? 8 : ( h - y );
@@ -1466,18 +2254,33 @@ static void internal_videocodec_trial_P_block( const uint8_t* cur, int cstride,
 }
 
 
+static void internal_videocodec_filter_recon( uint8_t* Y, uint8_t* U, uint8_t* V, int w, int h ) {
+    internal_videocodec_deblock_plane( Y, w, h, 0 );
+    internal_videocodec_deblock_plane( U, w / 2, h / 2, 1 );
+    internal_videocodec_deblock_plane( V, w / 2, h / 2, 1 );
+    internal_videocodec_dering_luma( Y, w, h );
+}
+
+
+// Encodes the blocks of macroblock rows `mb_row_begin` to `mb_row_end`, the Y blocks first, then U and V
+static void internal_videocodec_encode_iframe_rows( uint8_t const* Y, uint8_t const* U, uint8_t const* V, int w, int h, internal_videocodec_buffer_t* buffer, 
+	uint8_t* rY, uint8_t* rU, uint8_t* rV, uint8_t const* QY, uint8_t const* QC, uint16_t const* W8, internal_videocodec_quality_params_t const* qp, int mb_row_begin, int mb_row_end ) {
+
+    int y_begin = internal_videocodec_imin( mb_row_begin * 16, h ), y_end = internal_videocodec_imin( mb_row_end * 16, h );
+    int c_begin = internal_videocodec_imin( mb_row_begin * 8, h / 2 ), c_end = internal_videocodec_imin( mb_row_end * 8, h / 2 );
+    internal_videocodec_encode_plane_I( buffer, Y, w, h, y_begin, y_end, QY, W8, rY, qp, 0 );
+    internal_videocodec_encode_plane_I( buffer, U, w / 2, h / 2, c_begin, c_end, QC, W8, rU, qp, 1 );
+    internal_videocodec_encode_plane_I( buffer, V, w / 2, h / 2, c_begin, c_end, QC, W8, rV, qp, 1 );
+}
+
+
 static void internal_videocodec_encode_iframe( uint8_t const* Y, uint8_t const* U, uint8_t const* V, int w, int h, internal_videocodec_buffer_t* buffer, 
 	uint8_t* rY, uint8_t* rU, uint8_t* rV, uint8_t const* QY, uint8_t const* QC, uint16_t const* W8, internal_videocodec_quality_params_t const* qp ) {
 		
     internal_videocodec_buffer_reset( buffer );
     internal_videocodec_buffer_put_u8( buffer, (uint8_t) INTERNAL_VIDEOCODEC_FT_I );
-    internal_videocodec_encode_plane_I( buffer, Y, w, h, QY, W8, rY, qp, 0 );
-    internal_videocodec_encode_plane_I( buffer, U, w / 2, h / 2, QC, W8, rU, qp, 1 );
-    internal_videocodec_encode_plane_I( buffer, V, w / 2, h / 2, QC, W8, rV, qp, 1 );
-    internal_videocodec_deblock_plane( rY, w, h, 0 );
-    internal_videocodec_deblock_plane( rU, w / 2, h / 2, 1 );
-    internal_videocodec_deblock_plane( rV, w / 2, h / 2, 1 );
-    internal_videocodec_dering_luma( rY, w, h );
+    internal_videocodec_encode_iframe_rows( Y, U, V, w, h, buffer, rY, rU, rV, QY, QC, W8, qp, 0, ( h + 15 ) >> 4 );
+    internal_videocodec_filter_recon( rY, rU, rV, w, h );
 }
 
 
@@ -1564,24 +2367,32 @@ static void internal_videocodec_search_best_mv16x16( const uint8_t* Y, int w, in
 }
 
 
-static void internal_videocodec_encode_pframe( uint8_t const* Y, uint8_t const* U, uint8_t const* V, int w, int h, internal_videocodec_buffer_t* buffer, 
-	uint8_t* rY, uint8_t* rU, uint8_t* rV, uint8_t* refY, uint8_t* refU, uint8_t* refV, uint8_t* Y2, uint8_t* R2, uint8_t* Y4, uint8_t* R4, uint16_t const* cir_gid, int cir_group, int mb_w, 
-	uint8_t const* QY, uint8_t const* QC, uint16_t const* W8, internal_videocodec_quality_params_t const* qp ) {
-		
+// Makes the previous reconstruction the reference, and the downscaled planes used by the motion search
+static void internal_videocodec_encode_pframe_begin( uint8_t const* Y, int w, int h, uint8_t const* rY, uint8_t const* rU, uint8_t const* rV, 
+	uint8_t* refY, uint8_t* refU, uint8_t* refV, uint8_t* Y2, uint8_t* R2, uint8_t* Y4, uint8_t* R4 ) {
+
     size_t ysz = (size_t) w * h, csz = (size_t) ( w / 2 ) * ( h / 2 );
     memcpy( refY, rY, ysz );
     memcpy( refU, rU, csz );
     memcpy( refV, rV, csz );
-    int w2 = w >> 1, h2 = h >> 1, w4 = w >> 2, h4 = h >> 2;
+    int w2 = w >> 1, h2 = h >> 1;
     internal_videocodec_down2_box( Y, w, h, Y2 );
     internal_videocodec_down2_box( refY, w, h, R2 );
     internal_videocodec_down2_box( Y2, w2, h2, Y4 );
     internal_videocodec_down2_box( R2, w2, h2, R4 );
-    internal_videocodec_buffer_reset( buffer );
-    internal_videocodec_buffer_put_u8( buffer, (uint8_t) INTERNAL_VIDEOCODEC_FT_P );
+}
+
+
+// Encodes the macroblocks of rows `mb_row_begin` to `mb_row_end`. Only reads the reference planes, and only writes the
+// reconstruction of its own rows, so separate row ranges can be encoded at the same time.
+static void internal_videocodec_encode_pframe_rows( uint8_t const* Y, uint8_t const* U, uint8_t const* V, int w, int h, internal_videocodec_buffer_t* buffer, 
+	uint8_t* rY, uint8_t* rU, uint8_t* rV, uint8_t const* refY, uint8_t const* refU, uint8_t const* refV, uint8_t const* Y2, uint8_t const* R2, uint8_t const* Y4, uint8_t const* R4, uint16_t const* cir_gid, int cir_group, int mb_w, 
+	uint8_t const* QY, uint8_t const* QC, uint16_t const* W8, internal_videocodec_quality_params_t const* qp, int mb_row_begin, int mb_row_end ) {
+
+    int w2 = w >> 1, h2 = h >> 1, w4 = w >> 2, h4 = h >> 2;
     const int RD_LAMBDA_BUMP = (int) ( ( qp->rd_lambda * 11 + 5 ) / 10 );
     const int SEARCH_RAD = 96;
-    for( int yb = 0; yb < h; yb += 16 ) {
+    for( int yb = mb_row_begin * 16; yb < h && yb < mb_row_end * 16; yb += 16 ) {
         for( int xb = 0; xb < w; xb += 16 ) {
             int mbx = xb >> 4, mby = yb >> 4;
             int mbi = mby * mb_w + mbx;
@@ -1890,10 +2701,18 @@ static void internal_videocodec_encode_pframe( uint8_t const* Y, uint8_t const*
             }
         }
     }
-    internal_videocodec_deblock_plane( rY, w, h, 0 );
-    internal_videocodec_deblock_plane( rU, w / 2, h / 2, 1 );
-    internal_videocodec_deblock_plane( rV, w / 2, h / 2, 1 );
-    internal_videocodec_dering_luma( rY, w, h );
+}
+
+
+static void internal_videocodec_encode_pframe( uint8_t const* Y, uint8_t const* U, uint8_t const* V, int w, int h, internal_videocodec_buffer_t* buffer, 
+	uint8_t* rY, uint8_t* rU, uint8_t* rV, uint8_t* refY, uint8_t* refU, uint8_t* refV, uint8_t* Y2, uint8_t* R2, uint8_t* Y4, uint8_t* R4, uint16_t const* cir_gid, int cir_group, int mb_w, 
+	uint8_t const* QY, uint8_t const* QC, uint16_t const* W8, internal_videocodec_quality_params_t const* qp ) {
+		
+    internal_videocodec_encode_pframe_begin( Y, w, h, rY, rU, rV, refY, refU, refV, Y2, R2, Y4, R4 );
+    internal_videocodec_buffer_reset( buffer );
+    internal_videocodec_buffer_put_u8( buffer, (uint8_t) INTERNAL_VIDEOCODEC_FT_P );
+    internal_videocodec_encode_pframe_rows( Y, U, V, w, h, buffer, rY, rU, rV, refY, refU, refV, Y2, R2, Y4, R4, cir_gid, cir_group, mb_w, QY, QC, W8, qp, 0, ( h + 15 ) >> 4 );
+    internal_videocodec_filter_recon( rY, rU, rV, w, h );
 }
 
 
@@ -1988,7 +2807,7 @@ static void internal_videocodec_append( videocodec_enc_t* e, const void* src, si
 
 static void internal_videocodec_write_header( videocodec_enc_t* e ) {
     if( e->wrote_header ) return;
-    uint8_t signature[ ] = { 'F', 'M', 'V', INTERNAL_VIDEOCODEC_VERSION };
+    uint8_t signature[ ] = { 'F', 'M', 'V', e->slice_count > 1 ? INTERNAL_VIDEOCODEC_VERSION_SLICES : INTERNAL_VIDEOCODEC_VERSION };
     internal_videocodec_append( e, signature, 4 );
     int32_t hw[ 22 ];
     hw[ 0 ] = e->w;
@@ -2018,7 +2837,123 @@ static void internal_videocodec_write_header( videocodec_enc_t* e ) {
 }
 
 
+static void internal_videocodec_encode_slice( videocodec_enc_t* e, int index ) {
+    internal_videocodec_slice_t* s = &e->slices[ index ];
+    internal_videocodec_buffer_reset( &s->buffer );
+    internal_videocodec_buffer_put_u8( &s->buffer, (uint8_t) e->slice_ftype );
+    if( e->slice_ftype == INTERNAL_VIDEOCODEC_FT_I ) {
+        internal_videocodec_encode_iframe_rows( e->slice_Y, e->slice_U, e->slice_V, e->w, e->h, &s->buffer, e->rY, e->rU, e->rV, e->QYx, e->QCx, e->W8, &e->q, 
+            s->mb_row_begin, s->mb_row_end );
+    } else {
+        internal_videocodec_encode_pframe_rows( e->slice_Y, e->slice_U, e->slice_V, e->w, e->h, &s->buffer, e->rY, e->rU, e->rV, e->refY, e->refU, e->refV, 
+            e->Y2, e->R2, e->Y4, e->R4, e->cir_gid, e->slice_group, e->mb_w, e->QYx, e->QCx, e->W8, &e->q, s->mb_row_begin, s->mb_row_end );
+    }
+    s->packed_len = VIDEOCODEC_PACK( s->packed, s->buffer.buf, (int) s->buffer.len, s->pack_arena );
+}
+
+
+#ifdef VIDEOCODEC_THREADS
+
+static void internal_videocodec_take_slices( videocodec_enc_t* e ) {
+    for( ; ; ) {
+        unsigned int index = (unsigned int) thread_atomic_int_inc( &e->next_slice ) - (unsigned int) e->slices_base;
+        if( index >= (unsigned int) e->slice_count ) {
+            return;
+        }
+        internal_videocodec_encode_slice( e, (int) index );
+    }
+}
+
+
+static int internal_videocodec_worker_proc( void* user_data ) {
+    internal_videocodec_worker_t* worker = (internal_videocodec_worker_t*) user_data;
+    videocodec_enc_t* e = worker->e;
+    for( ; ; ) {
+        thread_signal_wait( &worker->start, THREAD_SIGNAL_WAIT_INFINITE );
+        if( e->workers_exit ) {
+            return 0;
+        }
+        internal_videocodec_take_slices( e );
+        thread_signal_raise( &worker->done );
+    }
+}
+
+#endif
+
+
+// Encodes a frame into `e->buffer`, or, with slices, into the buffers of each slice (in parallel, with worker threads)
+static void internal_videocodec_encode_frame( videocodec_enc_t* e, uint8_t const* Y, uint8_t const* U, uint8_t const* V, int ftype, int cir_group ) {
+    if( e->slice_count <= 1 ) {
+        if( ftype == INTERNAL_VIDEOCODEC_FT_I ) {
+            internal_videocodec_encode_iframe( Y, U, V, e->w, e->h, &e->buffer, e->rY, e->rU, e->rV, e->QYx, e->QCx, e->W8, &e->q );
+        } else {
+            internal_videocodec_encode_pframe( Y, U, V, e->w, e->h, &e->buffer, e->rY, e->rU, e->rV, e->refY, e->refU, e->refV, e->Y2, e->R2, e->Y4, e->R4, e->cir_gid, cir_group, e->mb_w, e->QYx, e->QCx, e->W8, &e->q );
+        }
+        return;
+    }
+
+    if( ftype == INTERNAL_VIDEOCODEC_FT_P ) {
+        internal_videocodec_encode_pframe_begin( Y, e->w, e->h, e->rY, e->rU, e->rV, e->refY, e->refU, e->refV, e->Y2, e->R2, e->Y4, e->R4 );
+    }
+    e->slice_ftype = ftype;
+    e->slice_group = cir_group;
+    e->slice_Y = Y;
+    e->slice_U = U;
+    e->slice_V = V;
+    #ifdef VIDEOCODEC_THREADS
+        if( e->workers_count > 0 ) {
+            e->slices_base = thread_atomic_int_load( &e->next_slice );
+            for( int i = 0; i < e->workers_count; ++i ) {
+                thread_signal_raise( &e->workers[ i ].start );
+            }
+            internal_videocodec_take_slices( e );
+            for( int i = 0; i < e->workers_count; ++i ) {
+                thread_signal_wait( &e->workers[ i ].done, THREAD_SIGNAL_WAIT_INFINITE );
+            }
+        } else
+    #endif
+    for( int i = 0; i < e->slice_count; ++i ) {
+        internal_videocodec_encode_slice( e, i );
+    }
+    internal_videocodec_filter_recon( e->rY, e->rU, e->rV, e->w, e->h );
+}
+
+
+// With slices, the frame is the total size of the slices before packing, the number of slices, the size of each slice 
+// before and after packing, and then the packed slices
+static void internal_videocodec_append_slices( videocodec_enc_t* e ) {
+    size_t size_pos = e->out_len;
+    uint32_t placeholder = 0;
+    internal_videocodec_append( e, &placeholder, 4 );
+    uint32_t raw = 0, packed = 0;
+    for( int i = 0; i < e->slice_count; ++i ) {
+        raw += (uint32_t) e->slices[ i ].buffer.len;
+        packed += (uint32_t) e->slices[ i ].packed_len;
+    }
+    uint32_t count = (uint32_t) e->slice_count;
+    internal_videocodec_append( e, &raw, 4 );
+    internal_videocodec_append( e, &count, 4 );
+    for( int i = 0; i < e->slice_count; ++i ) {
+        uint32_t sizes[ 2 ] = { (uint32_t) e->slices[ i ].buffer.len, (uint32_t) e->slices[ i ].packed_len };
+        internal_videocodec_append( e, sizes, 8 );
+    }
+    for( int i = 0; i < e->slice_count; ++i ) {
+        internal_videocodec_append( e, e->slices[ i ].packed, (size_t) e->slices[ i ].packed_len );
+    }
+    uint32_t actual_size = (uint32_t) ( e->out_len - size_pos - 4 );
+    memcpy( e->out + size_pos, &actual_size, 4 );
+    e->stats.frames_total++;
+    e->stats.bytes_raw_total += (uint64_t) raw;
+    e->stats.bytes_compressed_total += (uint64_t) ( actual_size - 4 );
+    if( e->user_stats ) *e->user_stats = e->stats;
+}
+
+
 static inline void internal_videocodec_compress_and_append_frame( videocodec_enc_t* e ) {
+    if( e->slice_count > 1 ) {
+        internal_videocodec_append_slices( e );
+        return;
+    }
     int raw = (int) e->buffer.len;
     size_t size_pos = e->out_len;
     uint32_t placeholder = 0;
@@ -2043,7 +2978,7 @@ static videocodec_enc_frame_t internal_videocodec_encode_from_planes( videocodec
     internal_videocodec_write_header( e );
     if( e->fidx == 0 ) {
         internal_videocodec_buffer_reset( &e->buffer );
-        internal_videocodec_encode_iframe( Y, U, V, e->w, e->h, &e->buffer, e->rY, e->rU, e->rV, e->QYx, e->QCx, e->W8, &e->q );
+        internal_videocodec_encode_frame( e, Y, U, V, INTERNAL_VIDEOCODEC_FT_I, 0 );
         e->fidx++;
         e->stats.frames_i++;
         internal_videocodec_compress_and_append_frame( e );
@@ -2054,12 +2989,12 @@ static videocodec_enc_frame_t internal_videocodec_encode_from_planes( videocodec
     int choose_I = internal_videocodec_should_emit_iframe( e, Y );
     if( choose_I ) {
         internal_videocodec_buffer_reset( &e->buffer );
-        internal_videocodec_encode_iframe( Y, U, V, e->w, e->h, &e->buffer, e->rY, e->rU, e->rV, e->QYx, e->QCx, e->W8, &e->q );
+        internal_videocodec_encode_frame( e, Y, U, V, INTERNAL_VIDEOCODEC_FT_I, 0 );
         e->stats.frames_i++;
         e->frames_since_last_i = 0;
     } else {
         int group = ( e->cir_K > 0 ) ? ( e->cir_frame % e->cir_K ) : 0;
-        internal_videocodec_encode_pframe( Y, U, V, e->w, e->h, &e->buffer, e->rY, e->rU, e->rV, e->refY, e->refU, e->refV, e->Y2, e->R2, e->Y4, e->R4, e->cir_gid, group, e->mb_w, e->QYx, e->QCx, e->W8, &e->q );
+        internal_videocodec_encode_frame( e, Y, U, V, INTERNAL_VIDEOCODEC_FT_P, group );
         e->stats.frames_p++;
         e->frames_since_last_i++;
         if( e->cir_K > 0 ) e->cir_frame = ( e->cir_frame + 1 ) % e->cir_K;
@@ -2090,9 +3025,95 @@ static inline uint8_t internal_videocodec_rgb_to_v_601( int r, int g, int b ) {
 }
 
 
-videocodec_enc_t* videocodec_enc_create( int width, int height, int fps_n, int fps_d, int sar_n, int sar_d, enum videocodec_quality_t quality, videocodec_enc_stats_t* out_stats ) {
-    if( ( width & 7 ) || ( height & 7 ) || width <= 0 || height <= 0 || fps_d == 0 ) {
-        return NULL;
+// The vector versions below convert 8 pixels from each of two rows, giving 8+8 luma and 4 U and 4 V samples. They 
+// match the scalar functions exactly: luma never exceeds 235 and per-pixel chroma stays within 16..240, so none of 
+// the clamps can trigger, and the 2x2 average ( u00 + u01 + u10 + u11 + 2 ) >> 2 becomes ( sum + 4 * 128 + 2 ) >> 2 
+// over the unbiased values.
+
+#if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+
+// Broadcasts the 16-bit pair ( a, b ) to all lanes, for use with _mm_madd_epi16
+static inline __m128i internal_videocodec_pair_sse2( int a, int b ) {
+    return _mm_set1_epi32( (int)( ( (uint32_t) b << 16 ) | (uint16_t) a ) );
+}
+
+
+static inline void internal_videocodec_xbgr_to_yuv8x2_sse2( uint8_t const* row0, uint8_t const* row1, uint8_t* y0, 
+    uint8_t* y1, uint8_t* u, uint8_t* v ) {
+    
+    __m128i const mask = _mm_set1_epi32( 0x00ff00ff );
+    __m128i const round = _mm_set1_epi32( 128 );
+    __m128i const y_rb = internal_videocodec_pair_sse2( 66, 25 ), y_gx = internal_videocodec_pair_sse2( 129, 0 );
+    __m128i const u_rb = internal_videocodec_pair_sse2( -38, 112 ), u_gx = internal_videocodec_pair_sse2( -74, 0 );
+    __m128i const v_rb = internal_videocodec_pair_sse2( 112, -18 ), v_gx = internal_videocodec_pair_sse2( -94, 0 );
+    uint8_t const* rows[ 2 ] = { row0, row1 };
+    uint8_t* outs[ 2 ] = { y0, y1 };
+    __m128i us[ 2 ] = { _mm_setzero_si128(), _mm_setzero_si128() };
+    __m128i vs[ 2 ] = { _mm_setzero_si128(), _mm_setzero_si128() };
+    for( int r = 0; r < 2; ++r ) {
+        __m128i yq[ 2 ];
+        for( int i = 0; i < 2; ++i ) {
+            __m128i p = _mm_loadu_si128( (__m128i const*)( rows[ r ] + i * 16 ) );
+            __m128i rb = _mm_and_si128( p, mask ); // r in the low half of each pixel, b in the high
+            __m128i gx = _mm_and_si128( _mm_srli_epi32( p, 8 ), mask ); // g and the unused x byte
+            yq[ i ] = _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( _mm_madd_epi16( rb, y_rb ), _mm_madd_epi16( gx, y_gx ) ), round ), 8 );
+            us[ i ] = _mm_add_epi32( us[ i ], _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( _mm_madd_epi16( rb, u_rb ), 
+                _mm_madd_epi16( gx, u_gx ) ), round ), 8 ) );
+            vs[ i ] = _mm_add_epi32( vs[ i ], _mm_srai_epi32( _mm_add_epi32( _mm_add_epi32( _mm_madd_epi16( rb, v_rb ), 
+                _mm_madd_epi16( gx, v_gx ) ), round ), 8 ) );
+        }
+        __m128i yw = _mm_add_epi16( _mm_packs_epi32( yq[ 0 ], yq[ 1 ] ), _mm_set1_epi16( 16 ) );
+        _mm_storel_epi64( (__m128i*) outs[ r ], _mm_packus_epi16( yw, yw ) );
+    }
+    __m128i const ones = _mm_set1_epi16( 1 ), bias = _mm_set1_epi32( 4 * 128 + 2 );
+    __m128i U = _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( _mm_packs_epi32( us[ 0 ], us[ 1 ] ), ones ), bias ), 2 );
+    __m128i V = _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( _mm_packs_epi32( vs[ 0 ], vs[ 1 ] ), ones ), bias ), 2 );
+    __m128i uv = _mm_packus_epi16( _mm_packs_epi32( U, V ), _mm_setzero_si128() );
+    uint32_t u4 = (uint32_t) _mm_cvtsi128_si32( uv ), v4 = (uint32_t) _mm_cvtsi128_si32( _mm_srli_si128( uv, 4 ) );
+    memcpy( u, &u4, 4 );
+    memcpy( v, &v4, 4 );
+}
+
+#elif defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+
+static inline void internal_videocodec_xbgr_to_yuv8x2_neon( uint8_t const* row0, uint8_t const* row1, uint8_t* y0, 
+    uint8_t* y1, uint8_t* u, uint8_t* v ) {
+    
+    uint8_t const* rows[ 2 ] = { row0, row1 };
+    uint8_t* outs[ 2 ] = { y0, y1 };
+    int32x4_t us[ 2 ] = { vdupq_n_s32( 0 ), vdupq_n_s32( 0 ) };
+    int32x4_t vs[ 2 ] = { vdupq_n_s32( 0 ), vdupq_n_s32( 0 ) };
+    for( int r = 0; r < 2; ++r ) {
+        uint8x8x4_t px = vld4_u8( rows[ r ] );
+        int16x8_t R = vreinterpretq_s16_u16( vmovl_u8( px.val[ 0 ] ) );
+        int16x8_t G = vreinterpretq_s16_u16( vmovl_u8( px.val[ 1 ] ) );
+        int16x8_t B = vreinterpretq_s16_u16( vmovl_u8( px.val[ 2 ] ) );
+        int16x4_t yh[ 2 ];
+        for( int i = 0; i < 2; ++i ) {
+            int16x4_t r4 = i ? vget_high_s16( R ) : vget_low_s16( R );
+            int16x4_t g4 = i ? vget_high_s16( G ) : vget_low_s16( G );
+            int16x4_t b4 = i ? vget_high_s16( B ) : vget_low_s16( B );
+            yh[ i ] = vqmovn_s32( vrshrq_n_s32( vmlal_n_s16( vmlal_n_s16( vmull_n_s16( r4, 66 ), g4, 129 ), b4, 25 ), 8 ) );
+            us[ i ] = vaddq_s32( us[ i ], vrshrq_n_s32( vmlal_n_s16( vmlal_n_s16( vmull_n_s16( r4, -38 ), g4, -74 ), b4, 112 ), 8 ) );
+            vs[ i ] = vaddq_s32( vs[ i ], vrshrq_n_s32( vmlal_n_s16( vmlal_n_s16( vmull_n_s16( r4, 112 ), g4, -94 ), b4, -18 ), 8 ) );
+        }
+        vst1_u8( outs[ r ], vqmovun_s16( vaddq_s16( vcombine_s16( yh[ 0 ], yh[ 1 ] ), vdupq_n_s16( 16 ) ) ) );
+    }
+    int32x4_t const bias = vdupq_n_s32( 4 * 128 + 2 );
+    int32x4_t U = vshrq_n_s32( vaddq_s32( vpaddlq_s16( vcombine_s16( vmovn_s32( us[ 0 ] ), vmovn_s32( us[ 1 ] ) ) ), bias ), 2 );
+    int32x4_t V = vshrq_n_s32( vaddq_s32( vpaddlq_s16( vcombine_s16( vmovn_s32( vs[ 0 ] ), vmovn_s32( vs[ 1 ] ) ) ), bias ), 2 );
+    uint8_t uv[ 8 ];
+    vst1_u8( uv, vqmovun_s16( vcombine_s16( vqmovn_s32( U ), vqmovn_s32( V ) ) ) );
+    memcpy( u, uv, 4 );
+    memcpy( v, uv + 4, 4 );
+}
+
+#endif
+
+
+videocodec_enc_t* videocodec_enc_create( int width, int height, int fps_n, int fps_d, int sar_n, int sar_d, enum videocodec_quality_t quality, videocodec_enc_stats_t* out_stats ) {
+    if( ( width & 7 ) || ( height & 7 ) || width <= 0 || height <= 0 || fps_d == 0 ) {
+        return NULL;
     }
     
     size_t ysz = (size_t) width * height, csz = (size_t) ( width / 2 ) * ( height / 2 );
@@ -2160,15 +3181,74 @@ videocodec_enc_t* videocodec_enc_create( int width, int height, int fps_n, int f
     e->frames_since_last_i = 0;
     e->last_cut_sad_perpx = 0;
     e->last_cut_hist_l1_mmp = 0;
+    e->slice_count = 1;
     return e;
 }
 
 
 void videocodec_enc_destroy( videocodec_enc_t* e ) {
+    #ifdef VIDEOCODEC_THREADS
+        e->workers_exit = 1;
+        for( int i = 0; i < e->workers_count; ++i ) {
+            thread_signal_raise( &e->workers[ i ].start );
+            thread_join( e->workers[ i ].thread );
+            thread_destroy( e->workers[ i ].thread );
+            thread_signal_term( &e->workers[ i ].start );
+            thread_signal_term( &e->workers[ i ].done );
+        }
+    #endif
+    free( e->slices_memory );
     free( e );
 }
 
 
+void videocodec_enc_set_threads( videocodec_enc_t* e, int thread_count ) {
+    if( e->wrote_header || e->slice_count > 1 ) return;
+    int count = internal_videocodec_imin( thread_count, internal_videocodec_imin( e->mb_h, INTERNAL_VIDEOCODEC_MAX_SLICES ) );
+    if( count <= 1 ) return;
+
+    size_t bytes_per_mb = 6 * 194 + 4; // 4Y + 1U + 1V blocks, mode, motion vector and cbp
+    size_t raw_caps[ INTERNAL_VIDEOCODEC_MAX_SLICES ], packed_caps[ INTERNAL_VIDEOCODEC_MAX_SLICES ];
+    size_t out_cap = 92 + 12 + 8 * (size_t) count + 4;
+    size_t total = 0;
+    for( int i = 0; i < count; ++i ) {
+        int mb_row_begin = ( e->mb_h * i ) / count, mb_row_end = ( e->mb_h * ( i + 1 ) ) / count;
+        raw_caps[ i ] = ( 1 + (size_t) ( mb_row_end - mb_row_begin ) * e->mb_w * bytes_per_mb + 15 ) & ~(size_t) 15; // keeps the arenas aligned
+        packed_caps[ i ] = ( (size_t) VIDEOCODEC_PACK( NULL, NULL, (int) raw_caps[ i ], NULL ) + 15 ) & ~(size_t) 15;
+        total += VIDEOCODEC_PACK_ARENA_SIZE + raw_caps[ i ] + packed_caps[ i ];
+        out_cap += packed_caps[ i ];
+    }
+    uint8_t* arena = (uint8_t*) malloc( total + out_cap );
+    if( !arena ) return;
+    e->slices_memory = arena;
+    for( int i = 0; i < count; ++i ) {
+        internal_videocodec_slice_t* s = &e->slices[ i ];
+        s->mb_row_begin = ( e->mb_h * i ) / count;
+        s->mb_row_end = ( e->mb_h * ( i + 1 ) ) / count;
+        s->pack_arena = arena; arena += VIDEOCODEC_PACK_ARENA_SIZE;
+        s->buffer.buf = arena; arena += raw_caps[ i ];
+        s->buffer.cap = raw_caps[ i ];
+        s->buffer.len = 0;
+        s->packed = arena; arena += packed_caps[ i ];
+        s->packed_len = 0;
+    }
+    e->out = arena;
+    e->out_cap = out_cap;
+    e->slice_count = count;
+
+    #ifdef VIDEOCODEC_THREADS
+        e->workers_count = count - 1;
+        for( int i = 0; i < e->workers_count; ++i ) {
+            internal_videocodec_worker_t* worker = &e->workers[ i ];
+            worker->e = e;
+            thread_signal_init( &worker->start );
+            thread_signal_init( &worker->done );
+            worker->thread = thread_create( internal_videocodec_worker_proc, worker, THREAD_STACK_SIZE_DEFAULT );
+        }
+    #endif
+}
+
+
 videocodec_enc_frame_t videocodec_enc_encode_yuv420( videocodec_enc_t* e, void const* yuv420 ) {
     const uint8_t* base = (const uint8_t*) yuv420;
     size_t ysz = (size_t) e->w * e->h, csz = (size_t) ( e->w / 2 ) * ( e->h / 2 );
@@ -2179,38 +3259,60 @@ videocodec_enc_frame_t videocodec_enc_encode_yuv420( videocodec_enc_t* e, void c
 }
 
 
-videocodec_enc_frame_t videocodec_enc_encode_xbgr( videocodec_enc_t* e, uint32_t const* xbgr ) {
-    const int W = e->w, H = e->h;
+static void internal_videocodec_enc_to_yuv( int w, int h, uint32_t const* xbgr, uint8_t* Y, uint8_t* U, uint8_t* V ) {
+    const int W = w, H = h;
     uint8_t const* px = (uint8_t const*) xbgr;
-    uint8_t *Y = e->tY, *U = e->tU, *V = e->tV;
-    for( int y = 0; y < H; ++y ) {
-        const uint8_t* row = px + (size_t) y * W * 4;
-        uint8_t* yrow = Y + (size_t) y * W;
-        for( int x = 0; x < W; ++x ) {
-            int r = row[ x * 4 + 0 ], g = row[ x * 4 + 1 ], b = row[ x * 4 + 2 ];
-            yrow[ x ] = internal_videocodec_rgb_to_y_601( r, g, b );
-        }
-    }
-    for( int y = 0; y < H; y += 2 ) {
-        const uint8_t* r0 = px + (size_t) y * W * 4;
-        const uint8_t* r1 = px + (size_t) internal_videocodec_imin( y + 1, H - 1 ) * W * 4;
-        uint8_t* urow = U + (size_t) ( y >> 1 ) * ( W / 2 );
-        uint8_t* vrow = V + (size_t) ( y >> 1 ) * ( W / 2 );
-        for( int x = 0; x < W; x += 2 ) {
-            int x1 = internal_videocodec_imin( x + 1, W - 1 );
-            int r00 = r0[ x * 4 + 0 ], g00 = r0[ x * 4 + 1 ], b00 = r0[ x * 4 + 2 ];
-            int r01 = r0[ x1 * 4 + 0 ], g01 = r0[ x1 * 4 + 1 ], b01 = r0[ x1 * 4 + 2 ];
-            int r10 = r1[ x * 4 + 0 ], g10 = r1[ x * 4 + 1 ], b10 = r1[ x * 4 + 2 ];
-            int r11 = r1[ x1 * 4 + 0 ], g11 = r1[ x1 * 4 + 1 ], b11 = r1[ x1 * 4 + 2 ];
-            int u = internal_videocodec_rgb_to_u_601( r00, g00, b00 ) + internal_videocodec_rgb_to_u_601( r01, g01, b01 ) + 
-				internal_videocodec_rgb_to_u_601( r10, g10, b10 ) + internal_videocodec_rgb_to_u_601( r11, g11, b11 );
-            int v = internal_videocodec_rgb_to_v_601( r00, g00, b00 ) + internal_videocodec_rgb_to_v_601( r01, g01, b01 ) + 
-				internal_videocodec_rgb_to_v_601( r10, g10, b10 ) + internal_videocodec_rgb_to_v_601( r11, g11, b11 );
-            urow[ x >> 1 ] = (uint8_t) internal_videocodec_clampi( ( u + 2 ) >> 2 );
-            vrow[ x >> 1 ] = (uint8_t) internal_videocodec_clampi( ( v + 2 ) >> 2 );
+    #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 ) || defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+        // width and height are multiples of 8, so the rows pair up and split into whole groups of 8 pixels
+        for( int y = 0; y < H; y += 2 ) {
+            const uint8_t* r0 = px + (size_t) y * W * 4;
+            const uint8_t* r1 = r0 + (size_t) W * 4;
+            uint8_t* y0 = Y + (size_t) y * W;
+            uint8_t* urow = U + (size_t) ( y >> 1 ) * ( W / 2 );
+            uint8_t* vrow = V + (size_t) ( y >> 1 ) * ( W / 2 );
+            for( int x = 0; x < W; x += 8 ) {
+                #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+                    internal_videocodec_xbgr_to_yuv8x2_sse2( r0 + x * 4, r1 + x * 4, y0 + x, y0 + W + x, urow + ( x >> 1 ), vrow + ( x >> 1 ) );
+                #else
+                    internal_videocodec_xbgr_to_yuv8x2_neon( r0 + x * 4, r1 + x * 4, y0 + x, y0 + W + x, urow + ( x >> 1 ), vrow + ( x >> 1 ) );
+                #endif
+            }
         }
-    }
-    return internal_videocodec_encode_from_planes( e, Y, U, V );
+    #else
+        for( int y = 0; y < H; ++y ) {
+            const uint8_t* row = px + (size_t) y * W * 4;
+            uint8_t* yrow = Y + (size_t) y * W;
+            for( int x = 0; x < W; ++x ) {
+                int r = row[ x * 4 + 0 ], g = row[ x * 4 + 1 ], b = row[ x * 4 + 2 ];
+                yrow[ x ] = internal_videocodec_rgb_to_y_601( r, g, b );
+            }
+        }
+        for( int y = 0; y < H; y += 2 ) {
+            const uint8_t* r0 = px + (size_t) y * W * 4;
+            const uint8_t* r1 = px + (size_t) internal_videocodec_imin( y + 1, H - 1 ) * W * 4;
+            uint8_t* urow = U + (size_t) ( y >> 1 ) * ( W / 2 );
+            uint8_t* vrow = V + (size_t) ( y >> 1 ) * ( W / 2 );
+            for( int x = 0; x < W; x += 2 ) {
+                int x1 = internal_videocodec_imin( x + 1, W - 1 );
+                int r00 = r0[ x * 4 + 0 ], g00 = r0[ x * 4 + 1 ], b00 = r0[ x * 4 + 2 ];
+                int r01 = r0[ x1 * 4 + 0 ], g01 = r0[ x1 * 4 + 1 ], b01 = r0[ x1 * 4 + 2 ];
+                int r10 = r1[ x * 4 + 0 ], g10 = r1[ x * 4 + 1 ], b10 = r1[ x * 4 + 2 ];
+                int r11 = r1[ x1 * 4 + 0 ], g11 = r1[ x1 * 4 + 1 ], b11 = r1[ x1 * 4 + 2 ];
+                int u = internal_videocodec_rgb_to_u_601( r00, g00, b00 ) + internal_videocodec_rgb_to_u_601( r01, g01, b01 ) + 
+					internal_videocodec_rgb_to_u_601( r10, g10, b10 ) + internal_videocodec_rgb_to_u_601( r11, g11, b11 );
+                int v = internal_videocodec_rgb_to_v_601( r00, g00, b00 ) + internal_videocodec_rgb_to_v_601( r01, g01, b01 ) + 
+					internal_videocodec_rgb_to_v_601( r10, g10, b10 ) + internal_videocodec_rgb_to_v_601( r11, g11, b11 );
+                urow[ x >> 1 ] = (uint8_t) internal_videocodec_clampi( ( u + 2 ) >> 2 );
+                vrow[ x >> 1 ] = (uint8_t) internal_videocodec_clampi( ( v + 2 ) >> 2 );
+            }
+        }
+    #endif
+}
+
+
+videocodec_enc_frame_t videocodec_enc_encode_xbgr( videocodec_enc_t* e, uint32_t const* xbgr ) {
+    internal_videocodec_enc_to_yuv( e->w, e->h, xbgr, e->tY, e->tU, e->tV );
+    return internal_videocodec_encode_from_planes( e, e->tY, e->tU, e->tV );
 }
 
 
@@ -2228,6 +3330,38 @@ videocodec_enc_frame_t videocodec_enc_finalize( videocodec_enc_t* e ) {
 }
 
 
+// Frames are decoded in three stages: the packed frame is inflated, its planes are reconstructed and filtered, and they
+// are converted to XBGR when the frame is pulled. Each frame in the queue has planes of its own, and a P frame is 
+// predicted straight from the planes of the frame before it. With VIDEOCODEC_THREADS, the first two stages run on a 
+// thread each, so one frame can be inflated while the one before it is reconstructed and the one before that converted
+#define INTERNAL_VIDEOCODEC_DEC_QUEUE_SIZE 4 // must be a power of two
+
+enum { INTERNAL_VIDEOCODEC_DEC_PUSHED, INTERNAL_VIDEOCODEC_DEC_INFLATED, INTERNAL_VIDEOCODEC_DEC_DECODED, 
+    INTERNAL_VIDEOCODEC_DEC_PULLED, INTERNAL_VIDEOCODEC_DEC_STAGE_COUNT };
+
+
+typedef struct internal_videocodec_dec_frame_t {
+    uint8_t* data;
+    size_t size, cap;
+    uint8_t* zbuf;
+    size_t zcap;
+    uint8_t *Y, *U, *V;
+    int failed;
+} internal_videocodec_dec_frame_t;
+
+
+#ifdef VIDEOCODEC_THREADS
+
+typedef struct internal_videocodec_dec_worker_t {
+    videocodec_dec_t* d;
+    int stage;
+    thread_ptr_t thread;
+    thread_signal_t start;
+} internal_videocodec_dec_worker_t;
+
+#endif
+
+
 struct videocodec_dec_t {
     int w, h;
     uint32_t fps_n, fps_d;
@@ -2235,18 +3369,53 @@ struct videocodec_dec_t {
     internal_videocodec_quality_params_t q;
     uint8_t QYx[ 64 ], QCx[ 64 ];
     uint16_t W8[ 64 ];
-    uint8_t *Y, *U, *V;
-    uint8_t *refY, *refU, *refV;
-    uint8_t* zbuf;
-    size_t zcap;
+    uint8_t *Y, *U, *V; // the planes of the frame being reconstructed
+    uint8_t *refY, *refU, *refV; // and of the frame before it
     int bytes_needed;
+    int sliced;
+    int broken;
+    int held; // the last pulled frame was returned as planes, and its slot is still in use by the caller
+    internal_videocodec_dec_frame_t queue[ INTERNAL_VIDEOCODEC_DEC_QUEUE_SIZE ];
+    #ifdef VIDEOCODEC_THREADS
+        thread_atomic_int_t frames[ INTERNAL_VIDEOCODEC_DEC_STAGE_COUNT ];
+        internal_videocodec_dec_worker_t workers[ 2 ];
+        int workers_count;
+        thread_atomic_int_t workers_exit;
+        thread_signal_t decoded;
+    #else
+        int frames[ INTERNAL_VIDEOCODEC_DEC_STAGE_COUNT ];
+    #endif
 };
 
 
-static inline const uint8_t* internal_videocodec_dec_plane_I( const uint8_t* p, int w, int h, uint8_t* out, const uint8_t* Q, const uint16_t* W8 ) {
+// The number of frames which have been through `stage`
+static inline int internal_videocodec_dec_frames( videocodec_dec_t* d, int stage ) {
+    #ifdef VIDEOCODEC_THREADS
+        return thread_atomic_int_load( &d->frames[ stage ] );
+    #else
+        return d->frames[ stage ];
+    #endif
+}
+
+
+static inline void internal_videocodec_dec_frames_inc( videocodec_dec_t* d, int stage ) {
+    #ifdef VIDEOCODEC_THREADS
+        thread_atomic_int_inc( &d->frames[ stage ] );
+    #else
+        ++d->frames[ stage ];
+    #endif
+}
+
+
+static inline internal_videocodec_dec_frame_t* internal_videocodec_dec_queued( videocodec_dec_t* d, int index ) {
+    return &d->queue[ (unsigned int) index & ( INTERNAL_VIDEOCODEC_DEC_QUEUE_SIZE - 1 ) ];
+}
+
+
+static inline const uint8_t* internal_videocodec_dec_plane_I( const uint8_t* p, int w, int h, int y_begin, int y_end, uint8_t* out, const uint8_t* Q, const uint16_t* W8 ) {
     int16_t zzq[ 64 ], rq[ 64 ];
     uint8_t blk[ 64 ];
-    for( int y = 0; y < h; y += 8 ) {
+    for( int y = y_begin; y < y_end; y += 8 ) {
         for( int x = 0; x < w; x += 8 ) {
             int bwid = ( x + 8 <= w ) ? 8 : ( w - x );
             int bhgt = ( y + 8 <= h ) ? 8 : ( h - y );
@@ -2266,12 +3435,397 @@ static inline const uint8_t* internal_videocodec_dec_plane_I( const uint8_t* p,
 }
 
 
+// Decodes macroblock rows `mb_row_begin` to `mb_row_end` of a frame of type `ftype`, before filtering. For P frames, the 
+// reference frame must already be in `refY`, `refU` and `refV`. Returns the end of the data read, or NULL if it is invalid
+static const uint8_t* internal_videocodec_dec_rows( videocodec_dec_t* d, const uint8_t* z, int ftype, int mb_row_begin, int mb_row_end ) {
+    if( ftype == INTERNAL_VIDEOCODEC_FT_I ) {
+        int y_begin = internal_videocodec_imin( mb_row_begin * 16, d->h ), y_end = internal_videocodec_imin( mb_row_end * 16, d->h );
+        int c_begin = internal_videocodec_imin( mb_row_begin * 8, d->h / 2 ), c_end = internal_videocodec_imin( mb_row_end * 8, d->h / 2 );
+        z = internal_videocodec_dec_plane_I( z, d->w, d->h, y_begin, y_end, d->Y, d->QYx, d->W8 );
+        z = internal_videocodec_dec_plane_I( z, d->w / 2, d->h / 2, c_begin, c_end, d->U, d->QCx, d->W8 );
+        z = internal_videocodec_dec_plane_I( z, d->w / 2, d->h / 2, c_begin, c_end, d->V, d->QCx, d->W8 );
+        return z;
+    } else if( ftype == INTERNAL_VIDEOCODEC_FT_P ) {
+    for( int yb = mb_row_begin * 16; yb < d->h && yb < mb_row_end * 16; yb += 16 ) {
+        for( int xb = 0; xb < d->w; xb += 16 ) {
+            uint8_t mode = *z++;
+            if( mode == 0 ) {
+                for( int by = 0; by < 2; ++by )
+                    for( int bx = 0; bx < 2; ++bx ) {
+                        int x = xb + bx * 8, y = yb + by * 8;
+                        uint8_t blk[ 64 ];
+                        internal_videocodec_copy_block_from( d->refY, d->w, d->h, x, y, blk );
+                        internal_videocodec_store_block( d->Y, d->w, d->h, x, y, blk );
+                    }
+                int cw = d->w >> 1, ch = d->h >> 1, cx = xb >> 1, cy = yb >> 1;
+                {
+                    uint8_t blk[ 64 ];
+                    internal_videocodec_copy_block_from( d->refU, cw, ch, cx, cy, blk );
+                    internal_videocodec_store_block( d->U, cw, ch, cx, cy, blk );
+                }
+                {
+                    uint8_t blk[ 64 ];
+                    internal_videocodec_copy_block_from( d->refV, cw, ch, cx, cy, blk );
+                    internal_videocodec_store_block( d->V, cw, ch, cx, cy, blk );
+                }
+            } else if( mode == 1 || mode == 3 ) {
+                int8_t dx8 = 0, dy8 = 0;
+                if( mode == 1 ) {
+                    dx8 = (int8_t) ( *z++ );
+                    dy8 = (int8_t) ( *z++ );
+                }
+                uint8_t cbp = *z++;
+                int16_t zzq[ 64 ], rq[ 64 ], add16[ 64 ];
+                uint8_t pred[ 64 ], out8[ 64 ];
+                for( int by = 0; by < 2; ++by ) {
+                    for( int bx = 0; bx < 2; ++bx ) {
+                        int x = xb + bx * 8, y = yb + by * 8;
+                        int idx = by * 2 + bx;
+                        if( cbp & ( 1u << idx ) ) {
+                            z = internal_videocodec_rle_read_block( z, zzq );
+                            for( int i = 0; i < 64; i++ ) rq[ internal_videocodec_zz[ i ] ] = zzq[ i ];
+                            internal_videocodec_idct8x8_dequant_to_s16( rq, d->QYx, d->W8, add16, 8 );
+                        } else {
+                            for( int i = 0; i < 64; i++ ) add16[ i ] = 0;
+                        }
+                        internal_videocodec_copy_block_from_frac_luma( d->refY, d->w, d->h, x, y, dx8, dy8, pred );
+                        for( int i = 0; i < 64; i++ ) {
+                            int v = (int) pred[ i ] + (int) add16[ i ];
+                            out8[ i ] = (uint8_t) internal_videocodec_clampi( v );
+                        }
+                        internal_videocodec_store_block( d->Y, d->w, d->h, x, y, out8 );
+                    }
+                }
+                int cw = d->w >> 1, ch = d->h >> 1, cx = xb >> 1, cy = yb >> 1;
+                if( cbp & ( 1u << 4 ) ) {
+                    z = internal_videocodec_rle_read_block( z, zzq );
+                    for( int i = 0; i < 64; i++ ) rq[ internal_videocodec_zz[ i ] ] = zzq[ i ];
+                    internal_videocodec_idct8x8_dequant_to_s16( rq, d->QCx, d->W8, add16, 8 );
+                } else {
+                    for( int i = 0; i < 64; i++ ) add16[ i ] = 0;
+                }
+                internal_videocodec_copy_block_from_frac_chroma( d->refU, cw, ch, cx, cy, dx8, dy8, pred );
+                for( int i = 0; i < 64; i++ ) {
+                    int v = (int) pred[ i ] + (int) add16[ i ];
+                    out8[ i ] = (uint8_t) internal_videocodec_clampi( v );
+                }
+                internal_videocodec_store_block( d->U, cw, ch, cx, cy, out8 );
+                if( cbp & ( 1u << 5 ) ) {
+                    z = internal_videocodec_rle_read_block( z, zzq );
+                    for( int i = 0; i < 64; i++ ) rq[ internal_videocodec_zz[ i ] ] = zzq[ i ];
+                    internal_videocodec_idct8x8_dequant_to_s16( rq, d->QCx, d->W8, add16, 8 );
+                } else {
+                    for( int i = 0; i < 64; i++ ) add16[ i ] = 0;
+                }
+                internal_videocodec_copy_block_from_frac_chroma( d->refV, cw, ch, cx, cy, dx8, dy8, pred );
+                for( int i = 0; i < 64; i++ ) {
+                    int v = (int) pred[ i ] + (int) add16[ i ];
+                    out8[ i ] = (uint8_t) internal_videocodec_clampi( v );
+                }
+                internal_videocodec_store_block( d->V, cw, ch, cx, cy, out8 );
+            } else if( mode == 2 ) {
+                uint8_t cbp = *z++;
+                int16_t zzq[ 64 ], rq[ 64 ];
+                uint8_t blk[ 64 ];
+                for( int by = 0; by < 2; ++by ) {
+                    for( int bx = 0; bx < 2; ++bx ) {
+                        int x = xb + bx * 8, y = yb + by * 8;
+                        int idx = by * 2 + bx;
+                        if( cbp & ( 1u << idx ) ) {
+                            z = internal_videocodec_rle_read_block( z, zzq );
+                            for( int i = 0; i < 64; i++ ) rq[ internal_videocodec_zz[ i ] ] = zzq[ i ];
+                            internal_videocodec_idct8x8_dequant_to_u8( rq, d->QYx, d->W8, blk, 8 );
+                        } else {
+                            for( int i = 0; i < 64; i++ ) blk[ i ] = 128;
+                        }
+                        internal_videocodec_store_block( d->Y, d->w, d->h, x, y, blk );
+                    }
+                }
+                int cw = d->w >> 1, ch = d->h >> 1, cx = xb >> 1, cy = yb >> 1;
+                if( cbp & ( 1u << 4 ) ) {
+                    z = internal_videocodec_rle_read_block( z, zzq );
+                    for( int i = 0; i < 64; i++ ) rq[ internal_videocodec_zz[ i ] ] = zzq[ i ];
+                    internal_videocodec_idct8x8_dequant_to_u8( rq, d->QCx, d->W8, blk, 8 );
+                } else {
+                    for( int i = 0; i < 64; i++ ) blk[ i ] = 128;
+                }
+                internal_videocodec_store_block( d->U, cw, ch, cx, cy, blk );
+                if( cbp & ( 1u << 5 ) ) {
+                    z = internal_videocodec_rle_read_block( z, zzq );
+                    for( int i = 0; i < 64; i++ ) rq[ internal_videocodec_zz[ i ] ] = zzq[ i ];
+                    internal_videocodec_idct8x8_dequant_to_u8( rq, d->QCx, d->W8, blk, 8 );
+                } else {
+                    for( int i = 0; i < 64; i++ ) blk[ i ] = 128;
+                }
+                internal_videocodec_store_block( d->V, cw, ch, cx, cy, blk );
+            } else {
+                return NULL;
+            }
+        }
+    }
+        return z;
+    }
+    return NULL;
+}
+
+
+static int internal_videocodec_dec_reserve( internal_videocodec_dec_frame_t* f, size_t size ) {
+    if( size > f->zcap ) {
+        free( f->zbuf );
+        f->zbuf = (uint8_t*) malloc( size );
+        f->zcap = f->zbuf ? size : 0;
+    }
+    return f->zbuf != NULL;
+}
+
+
+// A frame with slices is the total size of the slices before packing, the number of slices, the size of each slice 
+// before and after packing, and then the packed slices. They are unpacked one after the other into `zbuf`
+static int internal_videocodec_dec_inflate( videocodec_dec_t* d, internal_videocodec_dec_frame_t* f ) {
+    uint8_t const* p = f->data;
+    size_t size = f->size;
+    if( !d->sliced ) {
+        uint32_t raw = *(uint32_t const*) p;
+        if( !internal_videocodec_dec_reserve( f, (size_t) raw ) ) return 0;
+        return VIDEOCODEC_UNPACK( f->zbuf, (int) raw, p + 4, (int)( size - 8 ) ) == (int) raw;
+    }
+
+    int mb_h = ( d->h + 15 ) >> 4;
+    if( size < 12 ) return 0;
+    uint32_t count = *(uint32_t const*)( p + 4 );
+    if( count < 1 || count > (uint32_t) internal_videocodec_imin( mb_h, INTERNAL_VIDEOCODEC_MAX_SLICES ) ) return 0;
+    uint32_t const* sizes = (uint32_t const*)( p + 8 );
+    size_t table_end = 8 + 8 * (size_t) count;
+    if( table_end > size - 4 ) return 0; // the size of the next frame follows the frame
+    size_t total = 0;
+    for( uint32_t i = 0; i < count; ++i ) {
+        if( sizes[ i * 2 + 0 ] == 0 ) return 0;
+        total += sizes[ i * 2 + 0 ];
+    }
+    if( !internal_videocodec_dec_reserve( f, total ) ) return 0;
+
+    uint8_t const* comp = p + table_end;
+    size_t available = size - 4 - table_end;
+    uint8_t* z = f->zbuf;
+    for( uint32_t i = 0; i < count; ++i ) {
+        uint32_t raw = sizes[ i * 2 + 0 ], clen = sizes[ i * 2 + 1 ];
+        if( clen > available ) return 0;
+        if( VIDEOCODEC_UNPACK( z, (int) raw, comp, (int) clen ) != (int) raw ) return 0;
+        z += raw;
+        comp += clen;
+        available -= clen;
+    }
+    return 1;
+}
+
+
+// Reconstructs and filters the planes of an inflated frame. A P frame is predicted from the planes of `ref`, the frame 
+// before it, as they are
+static int internal_videocodec_dec_reconstruct( videocodec_dec_t* d, internal_videocodec_dec_frame_t* f, internal_videocodec_dec_frame_t const* ref ) {
+    d->Y = f->Y; d->U = f->U; d->V = f->V;
+    d->refY = ref->Y; d->refU = ref->U; d->refV = ref->V;
+    int mb_h = ( d->h + 15 ) >> 4;
+    uint8_t const* z = f->zbuf;
+    int ftype = *z;
+    if( !d->sliced ) {
+        if( !internal_videocodec_dec_rows( d, z + 1, ftype, 0, mb_h ) ) return 0;
+    } else {
+        uint32_t count = *(uint32_t const*)( f->data + 4 );
+        uint32_t const* sizes = (uint32_t const*)( f->data + 8 );
+        for( uint32_t i = 0; i < count; ++i ) {
+            if( *z != ftype ) return 0;
+            int mb_row_begin = (int)( ( (uint32_t) mb_h * i ) / count ), mb_row_end = (int)( ( (uint32_t) mb_h * ( i + 1 ) ) / count );
+            if( !internal_videocodec_dec_rows( d, z + 1, ftype, mb_row_begin, mb_row_end ) ) return 0;
+            z += sizes[ i * 2 + 0 ];
+        }
+    }
+    internal_videocodec_filter_recon( f->Y, f->U, f->V, d->w, d->h );
+    return 1;
+}
+
+
+// Inflates or reconstructs the next frame waiting for `stage`. A frame which fails to decode can't be used as a 
+// reference, so every frame after it fails too
+static void internal_videocodec_dec_run_stage( videocodec_dec_t* d, int stage ) {
+    int index = internal_videocodec_dec_frames( d, stage );
+    internal_videocodec_dec_frame_t* f = internal_videocodec_dec_queued( d, index );
+    if( stage == INTERNAL_VIDEOCODEC_DEC_INFLATED ) {
+        f->failed = !internal_videocodec_dec_inflate( d, f );
+    } else {
+        if( !f->failed && !d->broken ) {
+            f->failed = !internal_videocodec_dec_reconstruct( d, f, internal_videocodec_dec_queued( d, index - 1 ) );
+        }
+        d->broken = d->broken || f->failed;
+        f->failed = d->broken;
+    }
+    internal_videocodec_dec_frames_inc( d, stage );
+}
+
+
+#ifdef VIDEOCODEC_THREADS
+
+static int internal_videocodec_dec_worker_proc( void* user_data ) {
+    internal_videocodec_dec_worker_t* worker = (internal_videocodec_dec_worker_t*) user_data;
+    videocodec_dec_t* d = worker->d;
+    for( ; ; ) {
+        while( internal_videocodec_dec_frames( d, worker->stage ) != internal_videocodec_dec_frames( d, worker->stage - 1 ) ) {
+            internal_videocodec_dec_run_stage( d, worker->stage );
+            if( worker->stage == INTERNAL_VIDEOCODEC_DEC_INFLATED ) {
+                thread_signal_raise( &d->workers[ 1 ].start );
+            } else {
+                thread_signal_raise( &d->decoded );
+            }
+        }
+        thread_signal_wait( &worker->start, THREAD_SIGNAL_WAIT_INFINITE );
+        if( thread_atomic_int_load( &d->workers_exit ) ) {
+            return 0;
+        }
+    }
+}
+
+#endif
+
+
+static int internal_videocodec_dec_push( videocodec_dec_t* d, void const* data, size_t size ) {
+    if( !d || !data || size < 8 || d->bytes_needed == 0 ) return 0;
+    if( *(uint32_t const*) data == 0 ) return 0;
+    int index = internal_videocodec_dec_frames( d, INTERNAL_VIDEOCODEC_DEC_PUSHED );
+    int pulled = internal_videocodec_dec_frames( d, INTERNAL_VIDEOCODEC_DEC_PULLED );
+    if( (unsigned int)( index - pulled ) + d->held >= INTERNAL_VIDEOCODEC_DEC_QUEUE_SIZE ) return 0;
+
+    internal_videocodec_dec_frame_t* f = internal_videocodec_dec_queued( d, index );
+    if( size > f->cap ) {
+        free( f->data );
+        f->data = (uint8_t*) malloc( size );
+        f->cap = f->data ? size : 0;
+        if( !f->data ) return 0;
+    }
+    memcpy( f->data, data, size );
+    f->size = size;
+    f->failed = 0;
+
+    uint32_t next_zsz = *(const uint32_t*)( f->data + size - 4 );
+    d->bytes_needed = (int)( next_zsz + ( next_zsz > 0 ? 4 : 0 ) );
+    internal_videocodec_dec_frames_inc( d, INTERNAL_VIDEOCODEC_DEC_PUSHED );
+    return 1;
+}
+
+
+#if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+
+// Converts 8 pixels, with Y, U and V as 16-bit values, to R, G and B, before clamping
+static inline void internal_videocodec_yuv_to_rgb8_sse2( __m128i y, __m128i u, __m128i v, __m128i rgb[ 3 ] ) {
+    __m128i const round = _mm_set1_epi32( 128 );
+    y = _mm_max_epi16( _mm_sub_epi16( y, _mm_set1_epi16( 16 ) ), _mm_setzero_si128() );
+    u = _mm_sub_epi16( u, _mm_set1_epi16( 128 ) );
+    v = _mm_sub_epi16( v, _mm_set1_epi16( 128 ) );
+    __m128i yv_lo = _mm_unpacklo_epi16( y, v ), yv_hi = _mm_unpackhi_epi16( y, v );
+    __m128i yu_lo = _mm_unpacklo_epi16( y, u ), yu_hi = _mm_unpackhi_epi16( y, u );
+    __m128i v1_lo = _mm_unpacklo_epi16( v, _mm_set1_epi16( 1 ) ), v1_hi = _mm_unpackhi_epi16( v, _mm_set1_epi16( 1 ) );
+    __m128i r_yv = internal_videocodec_pair_sse2( 298, 409 );
+    __m128i g_yu = internal_videocodec_pair_sse2( 298, -100 ), g_v1 = internal_videocodec_pair_sse2( -208, 128 );
+    __m128i b_yu = internal_videocodec_pair_sse2( 298, 516 );
+    rgb[ 0 ] = _mm_packs_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( yv_lo, r_yv ), round ), 8 ), 
+        _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( yv_hi, r_yv ), round ), 8 ) );
+    rgb[ 1 ] = _mm_packs_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( yu_lo, g_yu ), _mm_madd_epi16( v1_lo, g_v1 ) ), 8 ), 
+        _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( yu_hi, g_yu ), _mm_madd_epi16( v1_hi, g_v1 ) ), 8 ) );
+    rgb[ 2 ] = _mm_packs_epi32( _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( yu_lo, b_yu ), round ), 8 ), 
+        _mm_srai_epi32( _mm_add_epi32( _mm_madd_epi16( yu_hi, b_yu ), round ), 8 ) );
+}
+
+
+// Converts 16 pixels of a row to XBGR, giving exactly the same result as the plain C loop
+static inline void internal_videocodec_yuv_to_xbgr16_sse2( uint8_t const* y, uint8_t const* u, uint8_t const* v, uint8_t* out ) {
+    __m128i const zero = _mm_setzero_si128();
+    __m128i Y = _mm_loadu_si128( (__m128i const*) y );
+    __m128i U = _mm_loadl_epi64( (__m128i const*) u );
+    __m128i V = _mm_loadl_epi64( (__m128i const*) v );
+    U = _mm_unpacklo_epi8( U, U );
+    V = _mm_unpacklo_epi8( V, V );
+    __m128i lo[ 3 ], hi[ 3 ];
+    internal_videocodec_yuv_to_rgb8_sse2( _mm_unpacklo_epi8( Y, zero ), _mm_unpacklo_epi8( U, zero ), _mm_unpacklo_epi8( V, zero ), lo );
+    internal_videocodec_yuv_to_rgb8_sse2( _mm_unpackhi_epi8( Y, zero ), _mm_unpackhi_epi8( U, zero ), _mm_unpackhi_epi8( V, zero ), hi );
+    __m128i R = _mm_packus_epi16( lo[ 0 ], hi[ 0 ] ), G = _mm_packus_epi16( lo[ 1 ], hi[ 1 ] ), B = _mm_packus_epi16( lo[ 2 ], hi[ 2 ] );
+    __m128i X = _mm_set1_epi8( (char) 0xff );
+    __m128i rg_lo = _mm_unpacklo_epi8( R, G ), rg_hi = _mm_unpackhi_epi8( R, G );
+    __m128i bx_lo = _mm_unpacklo_epi8( B, X ), bx_hi = _mm_unpackhi_epi8( B, X );
+    _mm_storeu_si128( (__m128i*)( out + 0 ), _mm_unpacklo_epi16( rg_lo, bx_lo ) );
+    _mm_storeu_si128( (__m128i*)( out + 16 ), _mm_unpackhi_epi16( rg_lo, bx_lo ) );
+    _mm_storeu_si128( (__m128i*)( out + 32 ), _mm_unpacklo_epi16( rg_hi, bx_hi ) );
+    _mm_storeu_si128( (__m128i*)( out + 48 ), _mm_unpackhi_epi16( rg_hi, bx_hi ) );
+}
+
+#elif defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+
+// Converts 16 pixels of a row to XBGR, giving exactly the same result as the plain C loop
+static inline void internal_videocodec_yuv_to_xbgr16_neon( uint8_t const* y, uint8_t const* u, uint8_t const* v, uint8_t* out ) {
+    uint8x16_t Y = vld1q_u8( y );
+    uint8x8x2_t U = vzip_u8( vld1_u8( u ), vld1_u8( u ) );
+    uint8x8x2_t V = vzip_u8( vld1_u8( v ), vld1_u8( v ) );
+    for( int i = 0; i < 2; ++i ) {
+        int16x8_t yv = vreinterpretq_s16_u16( vmovl_u8( i ? vget_high_u8( Y ) : vget_low_u8( Y ) ) );
+        yv = vmaxq_s16( vsubq_s16( yv, vdupq_n_s16( 16 ) ), vdupq_n_s16( 0 ) );
+        int16x8_t uv = vsubq_s16( vreinterpretq_s16_u16( vmovl_u8( U.val[ i ] ) ), vdupq_n_s16( 128 ) );
+        int16x8_t vv = vsubq_s16( vreinterpretq_s16_u16( vmovl_u8( V.val[ i ] ) ), vdupq_n_s16( 128 ) );
+        int32x4_t c_lo = vmull_n_s16( vget_low_s16( yv ), 298 ), c_hi = vmull_n_s16( vget_high_s16( yv ), 298 );
+        int32x4_t r_lo = vmlal_n_s16( c_lo, vget_low_s16( vv ), 409 ), r_hi = vmlal_n_s16( c_hi, vget_high_s16( vv ), 409 );
+        int32x4_t g_lo = vmlal_n_s16( vmlal_n_s16( c_lo, vget_low_s16( uv ), -100 ), vget_low_s16( vv ), -208 );
+        int32x4_t g_hi = vmlal_n_s16( vmlal_n_s16( c_hi, vget_high_s16( uv ), -100 ), vget_high_s16( vv ), -208 );
+        int32x4_t b_lo = vmlal_n_s16( c_lo, vget_low_s16( uv ), 516 ), b_hi = vmlal_n_s16( c_hi, vget_high_s16( uv ), 516 );
+        uint8x8x4_t px;
+        px.val[ 0 ] = vqmovun_s16( vcombine_s16( vqmovn_s32( vrshrq_n_s32( r_lo, 8 ) ), vqmovn_s32( vrshrq_n_s32( r_hi, 8 ) ) ) );
+        px.val[ 1 ] = vqmovun_s16( vcombine_s16( vqmovn_s32( vrshrq_n_s32( g_lo, 8 ) ), vqmovn_s32( vrshrq_n_s32( g_hi, 8 ) ) ) );
+        px.val[ 2 ] = vqmovun_s16( vcombine_s16( vqmovn_s32( vrshrq_n_s32( b_lo, 8 ) ), vqmovn_s32( vrshrq_n_s32( b_hi, 8 ) ) ) );
+        px.val[ 3 ] = vdup_n_u8( 255 );
+        vst4_u8( out + i * 32, px );
+    }
+}
+
+#endif
+
+
+static void internal_videocodec_dec_to_xbgr( int w, int h, uint8_t const* Y, uint8_t const* U, uint8_t const* V, uint32_t* out_xbgr ) {
+    const int W = w, H = h, CW = W >> 1;
+    for( int y = 0; y < H; ++y ) {
+        uint8_t* out = (uint8_t*) out_xbgr + (size_t) y * (size_t) W * 4u;
+        const uint8_t* yrow = Y + (size_t) y * (size_t) W;
+        const uint8_t* urow = U + (size_t)( y >> 1 ) * (size_t) CW;
+        const uint8_t* vrow = V + (size_t)( y >> 1 ) * (size_t) CW;
+        int x = 0;
+        #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+            for( ; x + 16 <= W; x += 16 ) {
+                internal_videocodec_yuv_to_xbgr16_sse2( yrow + x, urow + ( x >> 1 ), vrow + ( x >> 1 ), out + x * 4 );
+            }
+        #elif defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+            for( ; x + 16 <= W; x += 16 ) {
+                internal_videocodec_yuv_to_xbgr16_neon( yrow + x, urow + ( x >> 1 ), vrow + ( x >> 1 ), out + x * 4 );
+            }
+        #endif
+        for( ; x < W; ++x ) {
+            int Yv = (int) yrow[ x ] - 16; if( Yv < 0 ) Yv = 0;
+            int Uv = (int) urow[ x >> 1 ] - 128;
+            int Vv = (int) vrow[ x >> 1 ] - 128;
+            int C = 298 * Yv;
+            int R = ( C + 409 * Vv + 128 ) >> 8; if( R < 0 ) R = 0; else if( R > 255 ) R = 255;
+            int G = ( C - 100 * Uv - 208 * Vv + 128 ) >> 8; if( G < 0 ) G = 0; else if( G > 255 ) G = 255;
+            int B = ( C + 516 * Uv + 128 ) >> 8; if( B < 0 ) B = 0; else if( B > 255 ) B = 255;
+            out[ x * 4 + 0 ] = (uint8_t) R;
+            out[ x * 4 + 1 ] = (uint8_t) G;
+            out[ x * 4 + 2 ] = (uint8_t) B;
+            out[ x * 4 + 3 ] = 255;
+        }
+    }
+}
+
+
 videocodec_dec_t* videocodec_dec_create( uint8_t const data[ VIDEOCODEC_DEC_HEADER_SIZE ] ) {
     if( !data ) return NULL;
 
     uint8_t signature[ ] = { 'F', 'M', 'V', INTERNAL_VIDEOCODEC_VERSION };
+    uint8_t signature_slices[ ] = { 'F', 'M', 'V', INTERNAL_VIDEOCODEC_VERSION_SLICES };
     int32_t const* header = (int32_t const*) data;
-    if( *header++ != *(int32_t*)signature ) return NULL;
+    int sliced = ( *header == *(int32_t*)signature_slices );
+    if( *header++ != *(int32_t*)signature && !sliced ) return NULL;
 
     int w = *header++;
     int h = *header++;
@@ -2283,13 +3837,14 @@ videocodec_dec_t* videocodec_dec_create( uint8_t const data[ VIDEOCODEC_DEC_HEAD
 
     size_t ysz = (size_t)w * (size_t)h;
     size_t csz = ((size_t)w >> 1) * ((size_t)h >> 1);
-    size_t total = sizeof(videocodec_dec_t) + ysz + csz + csz + ysz + csz + csz;
+    size_t total = sizeof(videocodec_dec_t) + ( ysz + csz + csz ) * INTERNAL_VIDEOCODEC_DEC_QUEUE_SIZE;
 
     videocodec_dec_t* d = (videocodec_dec_t*) malloc( total );
     if( !d ) return NULL;
     memset( d, 0, sizeof(*d) );
 
     d->w = w; d->h = h;
+    d->sliced = sliced;
     d->fps_n = fn; d->fps_d = fd;
     d->sar_n = sn; d->sar_d = sd;
 
@@ -2306,34 +3861,40 @@ videocodec_dec_t* videocodec_dec_create( uint8_t const data[ VIDEOCODEC_DEC_HEAD
     d->bytes_needed += d->bytes_needed ? 4 : 0;
 
     uint8_t* arena = (uint8_t*)( d + 1 );
-    d->Y = arena; arena += ysz;
-    d->U = arena; arena += csz;
-    d->V = arena; arena += csz;
-    d->refY = arena; arena += ysz;
-    d->refU = arena; arena += csz;
-    d->refV = arena; arena += csz;
-
-    size_t initial_zbuf_size = ysz + csz + csz;  // YUV420 raw frame size
-    d->zbuf = (uint8_t*) malloc( initial_zbuf_size );
-    if( !d->zbuf ) {
-        free( d );
-        return NULL;
+    for( int i = 0; i < INTERNAL_VIDEOCODEC_DEC_QUEUE_SIZE; ++i ) {
+        internal_videocodec_dec_frame_t* f = &d->queue[ i ];
+        f->Y = arena; arena += ysz;
+        f->U = arena; arena += csz;
+        f->V = arena; arena += csz;
+        memset( f->Y, 0, ysz );
+        memset( f->U, 128, csz );
+        memset( f->V, 128, csz );
     }
-    d->zcap = initial_zbuf_size;
 
     internal_videocodec_build_quants( d->QYx, d->QCx, &d->q );
     internal_videocodec_build_window( d->W8 );
 
-    memset( d->Y, 0, ysz );
-    memset( d->U, 128, csz );
-    memset( d->V, 128, csz );
-
     return d;
 }
 
 
 void videocodec_dec_destroy( videocodec_dec_t* d ) {
-    free( d->zbuf );
+    #ifdef VIDEOCODEC_THREADS
+        thread_atomic_int_store( &d->workers_exit, 1 );
+        for( int i = 0; i < d->workers_count; ++i ) {
+            thread_signal_raise( &d->workers[ i ].start );
+            thread_join( d->workers[ i ].thread );
+            thread_destroy( d->workers[ i ].thread );
+            thread_signal_term( &d->workers[ i ].start );
+        }
+        if( d->workers_count > 0 ) {
+            thread_signal_term( &d->decoded );
+        }
+    #endif
+    for( int i = 0; i < INTERNAL_VIDEOCODEC_DEC_QUEUE_SIZE; ++i ) {
+        free( d->queue[ i ].data );
+        free( d->queue[ i ].zbuf );
+    }
     free( d );
 }
 
@@ -2363,192 +3924,783 @@ void videocodec_dec_ar( videocodec_dec_t* d, int* ar_n, int* ar_d ) {
 size_t videocodec_dec_next_frame( videocodec_dec_t* d, void const* data, size_t size, uint32_t* out_xbgr ) {
     if( data == NULL && size == 0 && out_xbgr == NULL ) return (size_t) d->bytes_needed;
     if( !d || !data || !out_xbgr ) return 0;
-    if( size < 8 ) return 0;
-
-    uint8_t const* p = (uint8_t const*) data;
-    uint32_t raw = *(uint32_t const*) p;
-    if( raw == 0 ) return 0;
-    uint8_t const* comp = p + 4;
-    unsigned clen = (unsigned)( size - 8 );
-    if( (size_t) raw > d->zcap ) {
-        free( d->zbuf );
-        d->zbuf = (uint8_t*) malloc( (size_t) raw );
-        if( !d->zbuf ) return 0;
-        d->zcap = (size_t) raw;
-    }
-    int n = VIDEOCODEC_UNPACK( d->zbuf, (int) raw, comp, (int) clen );
-    if( n != (int) raw ) return 0;
-
-    uint8_t const* z = d->zbuf;
-    uint8_t ftype = *z++;
-    if( ftype == INTERNAL_VIDEOCODEC_FT_I ) {
-        z = internal_videocodec_dec_plane_I( z, d->w, d->h, d->Y, d->QYx, d->W8 );
-        z = internal_videocodec_dec_plane_I( z, d->w / 2, d->h / 2, d->U, d->QCx, d->W8 );
-        z = internal_videocodec_dec_plane_I( z, d->w / 2, d->h / 2, d->V, d->QCx, d->W8 );
-        internal_videocodec_deblock_plane( d->Y, d->w, d->h, 0 );
-        internal_videocodec_deblock_plane( d->U, d->w / 2, d->h / 2, 1 );
-        internal_videocodec_deblock_plane( d->V, d->w / 2, d->h / 2, 1 );
-        internal_videocodec_dering_luma( d->Y, d->w, d->h );
-    } else if( ftype == INTERNAL_VIDEOCODEC_FT_P ) {
-        size_t ysz = (size_t) d->w * d->h, csz = (size_t) ( d->w / 2 ) * ( d->h / 2 );
-        memcpy( d->refY, d->Y, ysz );
-        memcpy( d->refU, d->U, csz );
-        memcpy( d->refV, d->V, csz );
-        for( int yb = 0; yb < d->h; yb += 16 ) {
-            for( int xb = 0; xb < d->w; xb += 16 ) {
-                uint8_t mode = *z++;
-                if( mode == 0 ) {
-                    for( int by = 0; by < 2; ++by )
-                        for( int bx = 0; bx < 2; ++bx ) {
-                            int x = xb + bx * 8, y = yb + by * 8;
-                            uint8_t blk[ 64 ];
-                            internal_videocodec_copy_block_from( d->refY, d->w, d->h, x, y, blk );
-                            internal_videocodec_store_block( d->Y, d->w, d->h, x, y, blk );
-                        }
-                    int cw = d->w >> 1, ch = d->h >> 1, cx = xb >> 1, cy = yb >> 1;
-                    {
-                        uint8_t blk[ 64 ];
-                        internal_videocodec_copy_block_from( d->refU, cw, ch, cx, cy, blk );
-                        internal_videocodec_store_block( d->U, cw, ch, cx, cy, blk );
-                    }
-                    {
-                        uint8_t blk[ 64 ];
-                        internal_videocodec_copy_block_from( d->refV, cw, ch, cx, cy, blk );
-                        internal_videocodec_store_block( d->V, cw, ch, cx, cy, blk );
-                    }
-                } else if( mode == 1 || mode == 3 ) {
-                    int8_t dx8 = 0, dy8 = 0;
-                    if( mode == 1 ) {
-                        dx8 = (int8_t) ( *z++ );
-                        dy8 = (int8_t) ( *z++ );
-                    }
-                    uint8_t cbp = *z++;
-                    int16_t zzq[ 64 ], rq[ 64 ], add16[ 64 ];
-                    uint8_t pred[ 64 ], out8[ 64 ];
-                    for( int by = 0; by < 2; ++by ) {
-                        for( int bx = 0; bx < 2; ++bx ) {
-                            int x = xb + bx * 8, y = yb + by * 8;
-                            int idx = by * 2 + bx;
-                            if( cbp & ( 1u << idx ) ) {
-                                z = internal_videocodec_rle_read_block( z, zzq );
-                                for( int i = 0; i < 64; i++ ) rq[ internal_videocodec_zz[ i ] ] = zzq[ i ];
-                                internal_videocodec_idct8x8_dequant_to_s16( rq, d->QYx, d->W8, add16, 8 );
-                            } else {
-                                for( int i = 0; i < 64; i++ ) add16[ i ] = 0;
-                            }
-                            internal_videocodec_copy_block_from_frac_luma( d->refY, d->w, d->h, x, y, dx8, dy8, pred );
-                            for( int i = 0; i < 64; i++ ) {
-                                int v = (int) pred[ i ] + (int) add16[ i ];
-                                out8[ i ] = (uint8_t) internal_videocodec_clampi( v );
-                            }
-                            internal_videocodec_store_block( d->Y, d->w, d->h, x, y, out8 );
-                        }
-                    }
-                    int cw = d->w >> 1, ch = d->h >> 1, cx = xb >> 1, cy = yb >> 1;
-                    if( cbp & ( 1u << 4 ) ) {
-                        z = internal_videocodec_rle_read_block( z, zzq );
-                        for( int i = 0; i < 64; i++ ) rq[ internal_videocodec_zz[ i ] ] = zzq[ i ];
-                        internal_videocodec_idct8x8_dequant_to_s16( rq, d->QCx, d->W8, add16, 8 );
-                    } else {
-                        for( int i = 0; i < 64; i++ ) add16[ i ] = 0;
-                    }
-                    internal_videocodec_copy_block_from_frac_chroma( d->refU, cw, ch, cx, cy, dx8, dy8, pred );
-                    for( int i = 0; i < 64; i++ ) {
-                        int v = (int) pred[ i ] + (int) add16[ i ];
-                        out8[ i ] = (uint8_t) internal_videocodec_clampi( v );
-                    }
-                    internal_videocodec_store_block( d->U, cw, ch, cx, cy, out8 );
-                    if( cbp & ( 1u << 5 ) ) {
-                        z = internal_videocodec_rle_read_block( z, zzq );
-                        for( int i = 0; i < 64; i++ ) rq[ internal_videocodec_zz[ i ] ] = zzq[ i ];
-                        internal_videocodec_idct8x8_dequant_to_s16( rq, d->QCx, d->W8, add16, 8 );
-                    } else {
-                        for( int i = 0; i < 64; i++ ) add16[ i ] = 0;
-                    }
-                    internal_videocodec_copy_block_from_frac_chroma( d->refV, cw, ch, cx, cy, dx8, dy8, pred );
-                    for( int i = 0; i < 64; i++ ) {
-                        int v = (int) pred[ i ] + (int) add16[ i ];
-                        out8[ i ] = (uint8_t) internal_videocodec_clampi( v );
-                    }
-                    internal_videocodec_store_block( d->V, cw, ch, cx, cy, out8 );
-                } else if( mode == 2 ) {
-                    uint8_t cbp = *z++;
-                    int16_t zzq[ 64 ], rq[ 64 ];
-                    uint8_t blk[ 64 ];
-                    for( int by = 0; by < 2; ++by ) {
-                        for( int bx = 0; bx < 2; ++bx ) {
-                            int x = xb + bx * 8, y = yb + by * 8;
-                            int idx = by * 2 + bx;
-                            if( cbp & ( 1u << idx ) ) {
-                                z = internal_videocodec_rle_read_block( z, zzq );
-                                for( int i = 0; i < 64; i++ ) rq[ internal_videocodec_zz[ i ] ] = zzq[ i ];
-                                internal_videocodec_idct8x8_dequant_to_u8( rq, d->QYx, d->W8, blk, 8 );
-                            } else {
-                                for( int i = 0; i < 64; i++ ) blk[ i ] = 128;
-                            }
-                            internal_videocodec_store_block( d->Y, d->w, d->h, x, y, blk );
-                        }
-                    }
-                    int cw = d->w >> 1, ch = d->h >> 1, cx = xb >> 1, cy = yb >> 1;
-                    if( cbp & ( 1u << 4 ) ) {
-                        z = internal_videocodec_rle_read_block( z, zzq );
-                        for( int i = 0; i < 64; i++ ) rq[ internal_videocodec_zz[ i ] ] = zzq[ i ];
-                        internal_videocodec_idct8x8_dequant_to_u8( rq, d->QCx, d->W8, blk, 8 );
-                    } else {
-                        for( int i = 0; i < 64; i++ ) blk[ i ] = 128;
-                    }
-                    internal_videocodec_store_block( d->U, cw, ch, cx, cy, blk );
-                    if( cbp & ( 1u << 5 ) ) {
-                        z = internal_videocodec_rle_read_block( z, zzq );
-                        for( int i = 0; i < 64; i++ ) rq[ internal_videocodec_zz[ i ] ] = zzq[ i ];
-                        internal_videocodec_idct8x8_dequant_to_u8( rq, d->QCx, d->W8, blk, 8 );
-                    } else {
-                        for( int i = 0; i < 64; i++ ) blk[ i ] = 128;
-                    }
-                    internal_videocodec_store_block( d->V, cw, ch, cx, cy, blk );
-                } else {
-                    return 0;
-                }
+    if( !internal_videocodec_dec_push( d, data, size ) ) return 0;
+    if( !videocodec_dec_pull_frame( d, out_xbgr, 1 ) ) return 0;
+    return (size_t) d->bytes_needed;
+}
+
+
+int videocodec_dec_push_frame( videocodec_dec_t* d, void const* data, size_t size ) {
+    if( !internal_videocodec_dec_push( d, data, size ) ) return 0;
+    #ifdef VIDEOCODEC_THREADS
+        if( d->workers_count == 0 ) {
+            thread_signal_init( &d->decoded );
+            for( int i = 0; i < 2; ++i ) {
+                d->workers[ i ].d = d;
+                d->workers[ i ].stage = INTERNAL_VIDEOCODEC_DEC_INFLATED + i;
+                thread_signal_init( &d->workers[ i ].start );
+            }
+            for( int i = 0; i < 2; ++i ) {
+                d->workers[ i ].thread = thread_create( internal_videocodec_dec_worker_proc, &d->workers[ i ], THREAD_STACK_SIZE_DEFAULT );
             }
+            d->workers_count = 2;
         }
-        internal_videocodec_deblock_plane( d->Y, d->w, d->h, 0 );
-        internal_videocodec_deblock_plane( d->U, d->w / 2, d->h / 2, 1 );
-        internal_videocodec_deblock_plane( d->V, d->w / 2, d->h / 2, 1 );
-        internal_videocodec_dering_luma( d->Y, d->w, d->h );
-    } else {
-        return 0;
-    }
+        thread_signal_raise( &d->workers[ 0 ].start );
+    #endif
+    return 1;
+}
 
-    const int W = d->w, H = d->h, CW = W >> 1;
-    for( int y = 0; y < H; ++y ) {
-        uint8_t* out = (uint8_t*) out_xbgr + (size_t) y * (size_t) W * 4u;
-        const uint8_t* yrow = d->Y + (size_t) y * (size_t) W;
-        const uint8_t* urow = d->U + (size_t)( y >> 1 ) * (size_t) CW;
-        const uint8_t* vrow = d->V + (size_t)( y >> 1 ) * (size_t) CW;
-        for( int x = 0; x < W; ++x ) {
-            int Yv = (int) yrow[ x ] - 16; if( Yv < 0 ) Yv = 0;
-            int Uv = (int) urow[ x >> 1 ] - 128;
-            int Vv = (int) vrow[ x >> 1 ] - 128;
-            int C = 298 * Yv;
-            int R = ( C + 409 * Vv + 128 ) >> 8; if( R < 0 ) R = 0; else if( R > 255 ) R = 255;
-            int G = ( C - 100 * Uv - 208 * Vv + 128 ) >> 8; if( G < 0 ) G = 0; else if( G > 255 ) G = 255;
-            int B = ( C + 516 * Uv + 128 ) >> 8; if( B < 0 ) B = 0; else if( B > 255 ) B = 255;
-            out[ x * 4 + 0 ] = (uint8_t) R;
-            out[ x * 4 + 1 ] = (uint8_t) G;
-            out[ x * 4 + 2 ] = (uint8_t) B;
-            out[ x * 4 + 3 ] = 255;
+
+// Returns the oldest queued frame once it is decoded, or NULL if there is none, it isn't ready, or it failed to decode
+static internal_videocodec_dec_frame_t* internal_videocodec_dec_pull( videocodec_dec_t* d, int wait ) {
+    d->held = 0;
+    int index = internal_videocodec_dec_frames( d, INTERNAL_VIDEOCODEC_DEC_PULLED );
+    if( index == internal_videocodec_dec_frames( d, INTERNAL_VIDEOCODEC_DEC_PUSHED ) ) return NULL;
+
+    #ifdef VIDEOCODEC_THREADS
+        if( d->workers_count > 0 ) {
+            while( internal_videocodec_dec_frames( d, INTERNAL_VIDEOCODEC_DEC_DECODED ) == index ) {
+                if( !wait ) return NULL;
+                thread_signal_wait( &d->decoded, THREAD_SIGNAL_WAIT_INFINITE );
+            }
+        } else
+    #else
+        (void) wait; // frames are decoded when they are pulled, so there's nothing to wait for
+    #endif
+    {
+        if( internal_videocodec_dec_frames( d, INTERNAL_VIDEOCODEC_DEC_INFLATED ) == index ) {
+            internal_videocodec_dec_run_stage( d, INTERNAL_VIDEOCODEC_DEC_INFLATED );
+        }
+        if( internal_videocodec_dec_frames( d, INTERNAL_VIDEOCODEC_DEC_DECODED ) == index ) {
+            internal_videocodec_dec_run_stage( d, INTERNAL_VIDEOCODEC_DEC_DECODED );
         }
     }
 
-    uint32_t next_zsz = *(const uint32_t*)( p + size - 4 );
-    d->bytes_needed = (int)( next_zsz + ( next_zsz > 0 ? 4 : 0 ) );
+    internal_videocodec_dec_frame_t* f = internal_videocodec_dec_queued( d, index );
+    internal_videocodec_dec_frames_inc( d, INTERNAL_VIDEOCODEC_DEC_PULLED );
+    if( f->failed ) {
+        d->bytes_needed = 0;
+        return NULL;
+    }
+    return f;
+}
+
+
+int videocodec_dec_pull_frame( videocodec_dec_t* d, uint32_t* out_xbgr, int wait ) {
+    if( !d || !out_xbgr ) return 0;
+    internal_videocodec_dec_frame_t* f = internal_videocodec_dec_pull( d, wait );
+    if( !f ) return 0;
+    internal_videocodec_dec_to_xbgr( d->w, d->h, f->Y, f->U, f->V, out_xbgr );
+    return 1;
+}
+
+
+size_t videocodec_dec_next_frame_yuv420( videocodec_dec_t* d, void const* data, size_t size, uint8_t const** out_y, 
+    uint8_t const** out_u, uint8_t const** out_v ) {
+    
+    if( data == NULL && size == 0 && out_y == NULL && out_u == NULL && out_v == NULL ) return (size_t) d->bytes_needed;
+    if( !d || !data || !out_y || !out_u || !out_v ) return 0;
+    if( !internal_videocodec_dec_push( d, data, size ) ) return 0;
+    if( !videocodec_dec_pull_frame_yuv420( d, out_y, out_u, out_v, 1 ) ) return 0;
     return (size_t) d->bytes_needed;
 }
 
+
+int videocodec_dec_pull_frame_yuv420( videocodec_dec_t* d, uint8_t const** out_y, uint8_t const** out_u, 
+    uint8_t const** out_v, int wait ) {
+    
+    if( !d || !out_y || !out_u || !out_v ) return 0;
+    internal_videocodec_dec_frame_t* f = internal_videocodec_dec_pull( d, wait );
+    if( !f ) return 0;
+    d->held = 1;
+    *out_y = f->Y;
+    *out_u = f->U;
+    *out_v = f->V;
+    return 1;
+}
+
 #endif // VIDEOCODEC_IMPLEMENTATION
 
 
 
+#ifdef VIDEOCODEC_RUN_TESTS
+
+#include "testfw.h"
+
+// The SSE2 and NEON kernels must give exactly the same output as the plain C loops, so each test runs a kernel on a
+// fixed sequence of pseudo random inputs, hashes everything it outputs, and compares the hash against the one given by
+// a VIDEOCODEC_NO_SIMD build. Inputs include the edge cases where the SIMD paths fall back to the C loops.
+
+static uint32_t test_videocodec_rng_state = 12345;
+
+static void test_videocodec_seed( uint32_t seed ) {
+    test_videocodec_rng_state = seed;
+}
+
+static uint32_t test_videocodec_rnd( void ) {
+    test_videocodec_rng_state ^= test_videocodec_rng_state << 13;
+    test_videocodec_rng_state ^= test_videocodec_rng_state >> 17;
+    test_videocodec_rng_state ^= test_videocodec_rng_state << 5;
+    return test_videocodec_rng_state;
+}
+
+static int test_videocodec_irange( int lo, int hi ) {
+    return lo + (int)( test_videocodec_rnd() % (uint32_t)( hi - lo + 1 ) );
+}
+
+// FNV-1a over the value's bytes in little endian order, so the hash doesn't depend on the platform's byte order
+static uint64_t test_videocodec_hash( uint64_t hash, int32_t value ) {
+    for( int i = 0; i < 4; ++i ) {
+        hash ^= (uint64_t)( ( (uint32_t) value >> ( i * 8 ) ) & 0xff );
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+#define TEST_VIDEOCODEC_HASH_INIT 0xcbf29ce484222325ull
+
+
+#define TEST_VIDEOCODEC_WIDTH 160
+#define TEST_VIDEOCODEC_HEIGHT 96
+#define TEST_VIDEOCODEC_FRAMES 8
+
+// A gradient and a checkerboard scrolling at different speeds, so both intra and motion compensated blocks get coded
+static void test_videocodec_frame( uint32_t* xbgr, int w, int h, int frame ) {
+    for( int y = 0; y < h; ++y ) {
+        for( int x = 0; x < w; ++x ) {
+            int r = x + frame * 3;
+            int g = ( ( ( x + frame * 2 ) >> 4 ) ^ ( ( y + frame ) >> 4 ) ) & 1 ? 200 : 40;
+            int b = y * 2 + frame;
+            xbgr[ y * w + x ] = (uint32_t) r | ( (uint32_t) g << 8 ) | ( (uint32_t) b << 16 );
+        }
+    }
+}
+
+
+// Encodes TEST_VIDEOCODEC_FRAMES frames with the given number of threads, and returns the whole stream, which the
+// caller frees
+static uint8_t* test_videocodec_encode( int threads, size_t* out_size ) {
+    int w = TEST_VIDEOCODEC_WIDTH, h = TEST_VIDEOCODEC_HEIGHT;
+    uint32_t* xbgr = (uint32_t*) malloc( sizeof( uint32_t ) * w * h );
+    videocodec_enc_t* enc = videocodec_enc_create( w, h, 30, 1, 1, 1, VIDEOCODEC_QUALITY_DEFAULT, NULL );
+    videocodec_enc_set_threads( enc, threads );
+    size_t size = 0;
+    uint8_t* stream = NULL;
+    for( int frame = 0; frame <= TEST_VIDEOCODEC_FRAMES; ++frame ) {
+        if( frame < TEST_VIDEOCODEC_FRAMES ) test_videocodec_frame( xbgr, w, h, frame );
+        videocodec_enc_frame_t out = frame < TEST_VIDEOCODEC_FRAMES ?
+            videocodec_enc_encode_xbgr( enc, xbgr ) : videocodec_enc_finalize( enc );
+        stream = (uint8_t*) realloc( stream, size + out.size );
+        memcpy( stream + size, out.data, out.size );
+        size += out.size;
+    }
+    videocodec_enc_destroy( enc );
+    free( xbgr );
+    *out_size = size;
+    return stream;
+}
+
+
+// Decodes the stream with `videocodec_dec_next_frame`, and returns how many frames it had. The mean squared error of the
+// decoded frames against the source frames is stored in `out_mse`, and a hash of all decoded pixels in `out_hash`
+static int test_videocodec_decode( uint8_t const* stream, size_t size, double* out_mse, uint64_t* out_hash ) {
+    *out_mse = 0.0;
+    *out_hash = TEST_VIDEOCODEC_HASH_INIT;
+    videocodec_dec_t* dec = videocodec_dec_create( stream );
+    if( !dec ) return 0;
+    int w = videocodec_dec_width( dec ), h = videocodec_dec_height( dec );
+    uint32_t* xbgr = (uint32_t*) malloc( sizeof( uint32_t ) * w * h );
+    uint32_t* source = (uint32_t*) malloc( sizeof( uint32_t ) * w * h );
+    uint64_t hash = TEST_VIDEOCODEC_HASH_INIT;
+    double squared_error = 0.0;
+    int frames = 0;
+    size_t pos = VIDEOCODEC_DEC_HEADER_SIZE;
+    size_t need = videocodec_dec_next_frame( dec, NULL, 0, NULL );
+    while( need && pos + need <= size ) {
+        size_t next = videocodec_dec_next_frame( dec, stream + pos, need, xbgr );
+        pos += need;
+        need = next;
+        test_videocodec_frame( source, w, h, frames++ );
+        for( int i = 0; i < w * h; ++i ) {
+            hash = test_videocodec_hash( hash, (int32_t)( xbgr[ i ] & 0xffffff ) );
+            for( int c = 0; c < 24; c += 8 ) {
+                double diff = (double)( ( xbgr[ i ] >> c ) & 0xff ) - (double)( ( source[ i ] >> c ) & 0xff );
+                squared_error += diff * diff;
+            }
+        }
+    }
+    *out_mse = squared_error / ( (double) w * h * 3 * ( frames ? frames : 1 ) );
+    *out_hash = hash;
+    free( source );
+    free( xbgr );
+    videocodec_dec_destroy( dec );
+    return frames;
+}
+
+
+// Pushes the next frame of the stream, which starts `*pos` bytes in, and moves `*pos` past it. Returns the result of
+// `videocodec_dec_push_frame`, or 0 if the stream has no more frames
+static int test_videocodec_push( videocodec_dec_t* dec, uint8_t const* stream, size_t size, size_t* pos ) {
+    size_t need = videocodec_dec_next_frame( dec, NULL, 0, NULL );
+    if( !need || *pos + need > size || !videocodec_dec_push_frame( dec, stream + *pos, need ) ) return 0;
+    *pos += need;
+    return 1;
+}
+
+
+// Decodes the stream with `videocodec_dec_push_frame` and `videocodec_dec_pull_frame`, keeping the queue as full as it
+// can, and returns how many frames it had. A hash of all decoded pixels is stored in `out_hash`, the same way as for 
+// `test_videocodec_decode`
+static int test_videocodec_decode_pushed( uint8_t const* stream, size_t size, uint64_t* out_hash ) {
+    *out_hash = TEST_VIDEOCODEC_HASH_INIT;
+    videocodec_dec_t* dec = videocodec_dec_create( stream );
+    if( !dec ) return 0;
+    int w = videocodec_dec_width( dec ), h = videocodec_dec_height( dec );
+    uint32_t* xbgr = (uint32_t*) malloc( sizeof( uint32_t ) * w * h );
+    uint64_t hash = TEST_VIDEOCODEC_HASH_INIT;
+    int frames = 0;
+    size_t pos = VIDEOCODEC_DEC_HEADER_SIZE;
+    for( ; ; ) {
+        if( test_videocodec_push( dec, stream, size, &pos ) ) continue;
+        if( !videocodec_dec_pull_frame( dec, xbgr, 1 ) ) break;
+        ++frames;
+        for( int i = 0; i < w * h; ++i ) hash = test_videocodec_hash( hash, (int32_t)( xbgr[ i ] & 0xffffff ) );
+    }
+    *out_hash = hash;
+    free( xbgr );
+    videocodec_dec_destroy( dec );
+    return frames;
+}
+
+
+void test_videocodec( void ) {
+    uint16_t W8[ 64 ];
+    internal_videocodec_build_window( W8 );
+
+    TESTFW_TEST_BEGIN( "Test forward DCT output matches the C loops" );
+        {
+        test_videocodec_seed( 12345 );
+        uint64_t hash_u8 = TEST_VIDEOCODEC_HASH_INIT, hash_s16 = TEST_VIDEOCODEC_HASH_INIT;
+        for( int it = 0; it < 20000; ++it ) {
+            // random, black/white extremes and flat blocks, plus residuals outside the range the SIMD path handles
+            uint8_t src[ 16 * 8 ];
+            int16_t s16[ 16 * 8 ];
+            int mode = it % 4;
+            for( int i = 0; i < 16 * 8; ++i ) {
+                uint32_t r = test_videocodec_rnd();
+                src[ i ] = mode == 0 ? (uint8_t) r : mode == 1 ? ( r & 1 ? 255 : 0 ) : (uint8_t)( 100 + ( r & 15 ) );
+                r = test_videocodec_rnd();
+                s16[ i ] = mode == 3 ? (int16_t)( r & 0xffff ) : mode == 1 ? ( r & 1 ? 11000 : -11000 ) : 
+                    (int16_t)( (int)( r % 511 ) - 255 );
+            }
+            int32_t F[ 64 ];
+            internal_videocodec_fdct8x8_u8( src, 16, F );
+            for( int i = 0; i < 64; ++i ) hash_u8 = test_videocodec_hash( hash_u8, F[ i ] );
+            internal_videocodec_fdct8x8_s16( s16, 16, F );
+            for( int i = 0; i < 64; ++i ) hash_s16 = test_videocodec_hash( hash_s16, F[ i ] );
+        }
+        TESTFW_EXPECTED( hash_u8 == 0x78d7c2d51c473b16ull );
+        TESTFW_EXPECTED( hash_s16 == 0xb707e38dc6a10b90ull );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test inverse DCT output matches the C loops" );
+        {
+        test_videocodec_seed( 23456 );
+        uint64_t hash_u8 = TEST_VIDEOCODEC_HASH_INIT, hash_s16 = TEST_VIDEOCODEC_HASH_INIT;
+        for( int it = 0; it < 20000; ++it ) {
+            // sparse blocks, blocks at the edge of the range the SIMD path handles, and blocks just outside it
+            int16_t q[ 64 ];
+            uint8_t Q[ 64 ];
+            int mode = it % 4;
+            for( int i = 0; i < 64; ++i ) {
+                Q[ i ] = (uint8_t) test_videocodec_irange( 1, 255 );
+                int nz = ( test_videocodec_rnd() % 4 ) == 0 || i == 0;
+                q[ i ] = mode == 3 ? (int16_t)( test_videocodec_rnd() & 0xffff ) : 
+                    nz ? (int16_t)( test_videocodec_irange( -4095, 4095 ) / Q[ i ] ) : 0;
+                if( mode == 1 && i == 5 ) { Q[ i ] = 1; q[ i ] = ( test_videocodec_rnd() & 1 ) ? 4095 : -4095; }
+                if( mode == 2 && i == 7 ) { Q[ i ] = 1; q[ i ] = ( test_videocodec_rnd() & 1 ) ? 4096 : -4096; }
+            }
+            uint8_t d[ 8 * 16 ];
+            int16_t e[ 8 * 16 ];
+            memset( d, 7, sizeof( d ) );
+            memset( e, 7, sizeof( e ) );
+            internal_videocodec_idct8x8_dequant_to_u8( q, Q, W8, d, 16 );
+            internal_videocodec_idct8x8_dequant_to_s16( q, Q, W8, e, 16 );
+            for( int i = 0; i < 8 * 16; ++i ) {
+                hash_u8 = test_videocodec_hash( hash_u8, d[ i ] );
+                hash_s16 = test_videocodec_hash( hash_s16, e[ i ] );
+            }
+        }
+        TESTFW_EXPECTED( hash_u8 == 0x27f9a301fefb6a1bull );
+        TESTFW_EXPECTED( hash_s16 == 0x22f97f81edb98d96ull );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test SAD and SATD output matches the C loops" );
+        {
+        test_videocodec_seed( 34567 );
+        enum { PW = 72, PH = 56 };
+        static uint8_t a[ PW * PH ], b[ PW * PH ];
+        uint64_t hash_sad = TEST_VIDEOCODEC_HASH_INIT, hash_satd = TEST_VIDEOCODEC_HASH_INIT;
+        for( int it = 0; it < 20000; ++it ) {
+            // alternate between unrelated planes and near matches, so early outs happen at different rows
+            if( it % 64 == 0 ) {
+                for( int i = 0; i < PW * PH; ++i ) {
+                    a[ i ] = (uint8_t) test_videocodec_rnd();
+                    b[ i ] = ( it & 128 ) ? (uint8_t)( a[ i ] + ( test_videocodec_rnd() & 7 ) ) : (uint8_t) test_videocodec_rnd();
+                }
+            }
+            // blocks partly outside the plane use the clamped C loop in all builds
+            int B = ( it & 1 ) ? 8 : 4;
+            int ax = test_videocodec_irange( -10, PW ), ay = test_videocodec_irange( -10, PH );
+            int bx = test_videocodec_irange( -10, PW ), by = test_videocodec_irange( -10, PH );
+            int cutoff = ( it % 3 == 0 ) ? INT_MAX : test_videocodec_irange( 0, 4000 );
+            hash_sad = test_videocodec_hash( hash_sad, 
+                internal_videocodec_sad_block_clamped_early( a, PW, PH, ax, ay, b, bx, by, B, cutoff ) );
+            int x = test_videocodec_irange( -4, PW - 12 ), y = test_videocodec_irange( -4, PH - 12 );
+            int dxh = test_videocodec_irange( -9, 9 ), dyh = test_videocodec_irange( -9, 9 );
+            cutoff = ( it % 3 == 0 ) ? INT_MAX : test_videocodec_irange( 0, 30000 );
+            hash_satd = test_videocodec_hash( hash_satd, 
+                internal_videocodec_satd16x16_luma_hpel( a, PW, PH, x, y, b, dxh, dyh, cutoff ) );
+        }
+        TESTFW_EXPECTED( hash_sad == 0x840d7c78b7719a0eull );
+        TESTFW_EXPECTED( hash_satd == 0x5c3aa288954b436dull );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test deblocking output matches the C loops" );
+        {
+        test_videocodec_seed( 45678 );
+        uint64_t hash = TEST_VIDEOCODEC_HASH_INIT;
+        for( int it = 0; it < 200; ++it ) {
+            // blocky and noisy planes, luma and chroma, including sizes that are not a multiple of 8
+            int w = 4 * test_videocodec_irange( 4, 30 ), h = 4 * test_videocodec_irange( 4, 30 ), is_chroma = it & 1;
+            if( it % 5 == 0 ) {
+                w = test_videocodec_irange( 16, 90 );
+                h = test_videocodec_irange( 16, 90 );
+            }
+            uint8_t* img = (uint8_t*) malloc( (size_t) w * h );
+            for( int i = 0; i < w * h; ++i ) {
+                int bx = ( i % w ) / 8, by = ( i / w ) / 8;
+                img[ i ] = (uint8_t)( ( it & 2 ) ? test_videocodec_rnd() : ( bx * 37 + by * 91 + ( test_videocodec_rnd() % 5 ) ) );
+            }
+            internal_videocodec_deblock_plane( img, w, h, is_chroma );
+            for( int i = 0; i < w * h; ++i ) hash = test_videocodec_hash( hash, img[ i ] );
+            free( img );
+        }
+        TESTFW_EXPECTED( hash == 0x1e5852b4c7da367full );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test XBGR to YUV conversion output matches the C loops" );
+        {
+        test_videocodec_seed( 56789 );
+        uint64_t hash = TEST_VIDEOCODEC_HASH_INIT;
+        for( int it = 0; it < 40; ++it ) {
+            // random, saturated and grey pixels, at sizes that do and don't fill whole 16 pixel groups
+            int w = 8 * test_videocodec_irange( 2, 12 ), h = 8 * test_videocodec_irange( 2, 6 ), mode = it % 3;
+            uint32_t* xbgr = (uint32_t*) malloc( sizeof( uint32_t ) * w * h );
+            for( int i = 0; i < w * h; ++i ) {
+                uint32_t r = test_videocodec_rnd();
+                xbgr[ i ] = mode == 0 ? r : mode == 1 ? ( r & 0x01010101u ) * 0xff : ( r & 0xff ) * 0x010101u;
+            }
+            videocodec_enc_t* enc = videocodec_enc_create( w, h, 30, 1, 1, 1, VIDEOCODEC_QUALITY_DEFAULT, NULL );
+            videocodec_enc_encode_xbgr( enc, xbgr );
+            for( int i = 0; i < w * h; ++i ) hash = test_videocodec_hash( hash, enc->tY[ i ] );
+            for( int i = 0; i < ( w / 2 ) * ( h / 2 ); ++i ) {
+                hash = test_videocodec_hash( hash, enc->tU[ i ] );
+                hash = test_videocodec_hash( hash, enc->tV[ i ] );
+            }
+            videocodec_enc_destroy( enc );
+            free( xbgr );
+        }
+        TESTFW_EXPECTED( hash == 0xb4a704aaa782e782ull );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test YUV to XBGR conversion output matches the C loops" );
+        {
+        test_videocodec_seed( 67890 );
+        uint64_t hash = TEST_VIDEOCODEC_HASH_INIT;
+        for( int it = 0; it < 200; ++it ) {
+            // full range and video range planes, so the clamping to 0 and 255 gets exercised
+            int w = 8 * test_videocodec_irange( 2, 12 ), h = 8 * test_videocodec_irange( 2, 6 ), mode = it & 1;
+            uint8_t* Y = (uint8_t*) malloc( (size_t) w * h + (size_t)( w / 2 ) * ( h / 2 ) * 2 );
+            uint8_t* U = Y + w * h;
+            uint8_t* V = U + ( w / 2 ) * ( h / 2 );
+            for( int i = 0; i < w * h + ( w / 2 ) * ( h / 2 ) * 2; ++i ) {
+                Y[ i ] = (uint8_t)( mode ? test_videocodec_rnd() : (uint32_t) test_videocodec_irange( 16, 235 ) );
+            }
+            uint32_t* xbgr = (uint32_t*) malloc( sizeof( uint32_t ) * w * h );
+            internal_videocodec_dec_to_xbgr( w, h, Y, U, V, xbgr );
+            for( int i = 0; i < w * h; ++i ) hash = test_videocodec_hash( hash, (int32_t) xbgr[ i ] );
+            free( xbgr );
+            free( Y );
+        }
+        TESTFW_EXPECTED( hash == 0x6b3036fcef2856fcull );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test streams encoded with 1 and N threads decode to the same frames" );
+        {
+        // slices are coded independently, but every block is still coded the same way, so the decoded frames must be
+        // identical whatever the number of slices. 16 threads is more than the 6 macroblock rows, so it gets clamped
+        size_t size;
+        uint8_t* stream = test_videocodec_encode( 1, &size );
+        double mse;
+        uint64_t hash;
+        TESTFW_EXPECTED( test_videocodec_decode( stream, size, &mse, &hash ) == TEST_VIDEOCODEC_FRAMES );
+        TESTFW_EXPECTED( mse < 255.0 * 255.0 / 316.2 ); // PSNR above 25 dB
+        free( stream );
+        int threads[] = { 2, 4, 6, 16 };
+        for( int i = 0; i < (int)( sizeof( threads ) / sizeof( *threads ) ); ++i ) {
+            uint8_t* sliced = test_videocodec_encode( threads[ i ], &size );
+            TESTFW_EXPECTED( sliced[ 3 ] == INTERNAL_VIDEOCODEC_VERSION_SLICES );
+            double sliced_mse;
+            uint64_t sliced_hash;
+            TESTFW_EXPECTED( test_videocodec_decode( sliced, size, &sliced_mse, &sliced_hash ) == TEST_VIDEOCODEC_FRAMES );
+            TESTFW_EXPECTED( sliced_mse == mse );
+            TESTFW_EXPECTED( sliced_hash == hash );
+            free( sliced );
+        }
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test pushed and pulled frames match the ones from videocodec_dec_next_frame" );
+        {
+        for( int threads = 1; threads <= 4; threads *= 4 ) {
+            size_t size;
+            uint8_t* stream = test_videocodec_encode( threads, &size );
+            double mse;
+            uint64_t hash, pushed_hash;
+            TESTFW_EXPECTED( test_videocodec_decode( stream, size, &mse, &hash ) == TEST_VIDEOCODEC_FRAMES );
+            TESTFW_EXPECTED( test_videocodec_decode_pushed( stream, size, &pushed_hash ) == TEST_VIDEOCODEC_FRAMES );
+            TESTFW_EXPECTED( pushed_hash == hash );
+            free( stream );
+        }
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test pushing to a full queue returns 0" );
+        {
+        size_t size;
+        uint8_t* stream = test_videocodec_encode( 1, &size );
+        uint32_t* xbgr = (uint32_t*) malloc( sizeof( uint32_t ) * TEST_VIDEOCODEC_WIDTH * TEST_VIDEOCODEC_HEIGHT );
+        uint8_t const *y, *u, *v;
+
+        // four frames fit in the queue, and pulling one makes room for one more
+        videocodec_dec_t* dec = videocodec_dec_create( stream );
+        size_t pos = VIDEOCODEC_DEC_HEADER_SIZE;
+        for( int i = 0; i < 4; ++i ) TESTFW_EXPECTED( test_videocodec_push( dec, stream, size, &pos ) == 1 );
+        TESTFW_EXPECTED( test_videocodec_push( dec, stream, size, &pos ) == 0 );
+        TESTFW_EXPECTED( videocodec_dec_pull_frame( dec, xbgr, 1 ) == 1 );
+        TESTFW_EXPECTED( test_videocodec_push( dec, stream, size, &pos ) == 1 );
+        TESTFW_EXPECTED( test_videocodec_push( dec, stream, size, &pos ) == 0 );
+        videocodec_dec_destroy( dec );
+
+        // a frame pulled as YUV 4:2:0 keeps its place until the next pull, so only three more fit
+        dec = videocodec_dec_create( stream );
+        pos = VIDEOCODEC_DEC_HEADER_SIZE;
+        TESTFW_EXPECTED( test_videocodec_push( dec, stream, size, &pos ) == 1 );
+        TESTFW_EXPECTED( videocodec_dec_pull_frame_yuv420( dec, &y, &u, &v, 1 ) == 1 );
+        for( int i = 0; i < 3; ++i ) TESTFW_EXPECTED( test_videocodec_push( dec, stream, size, &pos ) == 1 );
+        TESTFW_EXPECTED( test_videocodec_push( dec, stream, size, &pos ) == 0 );
+        // the next pull lets go of the held frame as well as taking one off the queue, which makes room for two
+        TESTFW_EXPECTED( videocodec_dec_pull_frame( dec, xbgr, 1 ) == 1 );
+        for( int i = 0; i < 2; ++i ) TESTFW_EXPECTED( test_videocodec_push( dec, stream, size, &pos ) == 1 );
+        TESTFW_EXPECTED( test_videocodec_push( dec, stream, size, &pos ) == 0 );
+        videocodec_dec_destroy( dec );
+
+        free( xbgr );
+        free( stream );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test YUV 4:2:0 frames convert to the same pixels as the XBGR frames" );
+        {
+        // decodes the stream to XBGR, and in lockstep to planes with videocodec_dec_next_frame_yuv420 and with 
+        // videocodec_dec_pull_frame_yuv420, and converts the planes to XBGR the way the decoder does
+        size_t size;
+        uint8_t* stream = test_videocodec_encode( 4, &size );
+        int w = TEST_VIDEOCODEC_WIDTH, h = TEST_VIDEOCODEC_HEIGHT;
+        uint32_t* xbgr = (uint32_t*) malloc( sizeof( uint32_t ) * w * h );
+        uint32_t* converted = (uint32_t*) malloc( sizeof( uint32_t ) * w * h );
+        videocodec_dec_t* dec = videocodec_dec_create( stream );
+        videocodec_dec_t* dec_next = videocodec_dec_create( stream );
+        videocodec_dec_t* dec_pull = videocodec_dec_create( stream );
+        int frames = 0, next_matches = 0, pull_matches = 0;
+        size_t pos = VIDEOCODEC_DEC_HEADER_SIZE;
+        size_t need = videocodec_dec_next_frame( dec, NULL, 0, NULL );
+        while( need && pos + need <= size ) {
+            size_t next = videocodec_dec_next_frame( dec, stream + pos, need, xbgr );
+            uint8_t const *y = NULL, *u = NULL, *v = NULL;
+            videocodec_dec_next_frame_yuv420( dec_next, stream + pos, need, &y, &u, &v );
+            if( y && u && v ) {
+                internal_videocodec_dec_to_xbgr( w, h, y, u, v, converted );
+                next_matches += memcmp( converted, xbgr, sizeof( uint32_t ) * w * h ) == 0;
+            }
+            if( videocodec_dec_push_frame( dec_pull, stream + pos, need ) && 
+                videocodec_dec_pull_frame_yuv420( dec_pull, &y, &u, &v, 1 ) ) {
+                internal_videocodec_dec_to_xbgr( w, h, y, u, v, converted );
+                pull_matches += memcmp( converted, xbgr, sizeof( uint32_t ) * w * h ) == 0;
+            }
+            pos += need;
+            need = next;
+            ++frames;
+        }
+        TESTFW_EXPECTED( frames == TEST_VIDEOCODEC_FRAMES );
+        TESTFW_EXPECTED( next_matches == frames );
+        TESTFW_EXPECTED( pull_matches == frames );
+        videocodec_dec_destroy( dec_pull );
+        videocodec_dec_destroy( dec_next );
+        videocodec_dec_destroy( dec );
+        free( converted );
+        free( xbgr );
+        free( stream );
+        }
+    TESTFW_TEST_END();
+
+    TESTFW_TEST_BEGIN( "Test destroying a decoder with frames still queued" );
+        {
+        // with VIDEOCODEC_THREADS, the workers are still decoding the queued frames when the decoder is destroyed. Build 
+        // with -fsanitize=address or -fsanitize=thread to check that nothing leaks or is used after it is freed
+        size_t size;
+        uint8_t* stream = test_videocodec_encode( 4, &size );
+        uint32_t* xbgr = (uint32_t*) malloc( sizeof( uint32_t ) * TEST_VIDEOCODEC_WIDTH * TEST_VIDEOCODEC_HEIGHT );
+        for( int pulls = 0; pulls < 3; ++pulls ) {
+            videocodec_dec_t* dec = videocodec_dec_create( stream );
+            size_t pos = VIDEOCODEC_DEC_HEADER_SIZE;
+            int pushed = 0;
+            while( test_videocodec_push( dec, stream, size, &pos ) ) ++pushed;
+            TESTFW_EXPECTED( pushed == 4 );
+            for( int i = 0; i < pulls; ++i ) videocodec_dec_pull_frame( dec, xbgr, i & 1 );
+            videocodec_dec_destroy( dec );
+        }
+        free( xbgr );
+        free( stream );
+        }
+    TESTFW_TEST_END();
+}
+
+
+int main( int argc, char** argv ) {
+    (void) argc, (void) argv;
+
+    TESTFW_INIT();
+
+    test_videocodec();
+
+    return TESTFW_SUMMARY();
+}
+
+
+#define TESTFW_IMPLEMENTATION
+#include "testfw.h"
+
+#ifdef VIDEOCODEC_THREADS
+    #define THREAD_IMPLEMENTATION
+    #include "thread.h"
+#endif
+
+#endif // VIDEOCODEC_RUN_TESTS
+
+
+
+#ifdef VIDEOCODEC_RUN_BENCHMARK
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #include <windows.h>
+#else
+    #include <time.h>
+#endif
+
+
+static double benchmark_videocodec_seconds( void ) {
+    #ifdef _WIN32
+        LARGE_INTEGER count, frequency;
+        QueryPerformanceCounter( &count );
+        QueryPerformanceFrequency( &frequency );
+        return (double) count.QuadPart / (double) frequency.QuadPart;
+    #else
+        struct timespec t;
+        clock_gettime( CLOCK_MONOTONIC, &t );
+        return (double) t.tv_sec + (double) t.tv_nsec * 1e-9;
+    #endif
+}
+
+
+#define BENCHMARK_VIDEOCODEC_WIDTH 640
+#define BENCHMARK_VIDEOCODEC_HEIGHT 360
+#define BENCHMARK_VIDEOCODEC_FRAMES 60
+
+static volatile int benchmark_videocodec_sink;
+
+
+// Gradients and a checkerboard scrolling at different speeds, with some noise, so motion search has work to do
+static void benchmark_videocodec_frame( uint32_t* xbgr, int w, int h, int frame ) {
+    uint32_t seed = (uint32_t) frame * 2654435761u + 1u;
+    for( int y = 0; y < h; ++y ) {
+        for( int x = 0; x < w; ++x ) {
+            seed = seed * 1664525u + 1013904223u;
+            int noise = (int)( seed >> 29 ) - 4;
+            int r = internal_videocodec_clampi( ( ( x + frame * 3 ) & 255 ) + noise );
+            int g = internal_videocodec_clampi( ( ( ( ( x + frame * 2 ) >> 4 ) ^ ( ( y + frame ) >> 4 ) ) & 1 ? 200 : 40 ) + noise );
+            int b = internal_videocodec_clampi( ( ( y * 2 - frame ) & 255 ) + noise );
+            xbgr[ y * w + x ] = (uint32_t) r | ( (uint32_t) g << 8 ) | ( (uint32_t) b << 16 );
+        }
+    }
+}
+
+
+// Encodes BENCHMARK_VIDEOCODEC_FRAMES frames with the given number of threads, and prints how fast it was, and the
+// speedup over `single_thread_fps` (pass 0 when encoding with one thread). Only the calls to the encoder are timed, not
+// generating the frames. Returns the number of frames encoded per second.
+static double benchmark_videocodec_encode( int threads, double single_thread_fps ) {
+    int w = BENCHMARK_VIDEOCODEC_WIDTH, h = BENCHMARK_VIDEOCODEC_HEIGHT;
+    uint32_t* xbgr = (uint32_t*) malloc( sizeof( uint32_t ) * w * h );
+    videocodec_enc_t* enc = videocodec_enc_create( w, h, 30, 1, 1, 1, VIDEOCODEC_QUALITY_DEFAULT, NULL );
+    videocodec_enc_set_threads( enc, threads );
+    size_t bytes = 0;
+    double elapsed = 0.0;
+    for( int frame = 0; frame <= BENCHMARK_VIDEOCODEC_FRAMES; ++frame ) {
+        if( frame < BENCHMARK_VIDEOCODEC_FRAMES ) benchmark_videocodec_frame( xbgr, w, h, frame );
+        double start = benchmark_videocodec_seconds();
+        videocodec_enc_frame_t out = frame < BENCHMARK_VIDEOCODEC_FRAMES ? 
+            videocodec_enc_encode_xbgr( enc, xbgr ) : videocodec_enc_finalize( enc );
+        elapsed += benchmark_videocodec_seconds() - start;
+        bytes += out.size;
+    }
+    double fps = BENCHMARK_VIDEOCODEC_FRAMES / elapsed;
+    printf( "encode %dx%d, %2d thread(s): %7.1f fps, %5.2fx, %zu bytes\n", w, h, threads, fps, 
+        single_thread_fps > 0.0 ? fps / single_thread_fps : 1.0, bytes );
+    videocodec_enc_destroy( enc );
+    free( xbgr );
+    return fps;
+}
+
+
+// Times the color conversions on their own: XBGR to YUV 4:2:0, which the encoder does for every frame passed to 
+// `videocodec_enc_encode_xbgr`, and YUV 4:2:0 to XBGR, which the decoder does for every frame it returns as XBGR, and 
+// prints how many megapixels per second each converts
+static void benchmark_videocodec_conversion( void ) {
+    int w = BENCHMARK_VIDEOCODEC_WIDTH, h = BENCHMARK_VIDEOCODEC_HEIGHT, n = 500;
+    uint32_t* xbgr = (uint32_t*) malloc( sizeof( uint32_t ) * w * h );
+    uint8_t* Y = (uint8_t*) malloc( (size_t) w * h + (size_t)( w / 2 ) * ( h / 2 ) * 2 );
+    uint8_t* U = Y + w * h;
+    uint8_t* V = U + ( w / 2 ) * ( h / 2 );
+    benchmark_videocodec_frame( xbgr, w, h, 0 );
+
+    double start = benchmark_videocodec_seconds();
+    for( int i = 0; i < n; ++i ) {
+        internal_videocodec_enc_to_yuv( w, h, xbgr, Y, U, V );
+        benchmark_videocodec_sink += Y[ i ];
+    }
+    double elapsed = benchmark_videocodec_seconds() - start;
+    printf( "convert %dx%d xbgr to yuv420: %7.1f MP/s\n", w, h, (double) w * h * n / elapsed * 1e-6 );
+
+    start = benchmark_videocodec_seconds();
+    for( int i = 0; i < n; ++i ) {
+        internal_videocodec_dec_to_xbgr( w, h, Y, U, V, xbgr );
+        benchmark_videocodec_sink += (int) xbgr[ i ];
+    }
+    elapsed = benchmark_videocodec_seconds() - start;
+    printf( "convert %dx%d yuv420 to xbgr: %7.1f MP/s\n", w, h, (double) w * h * n / elapsed * 1e-6 );
+
+    free( Y );
+    free( xbgr );
+}
+
+
+#define BENCHMARK_VIDEOCODEC_TIME( name, count, call ) \
+    { \
+        double start = benchmark_videocodec_seconds(); \
+        for( int i = 0; i < ( count ); ++i ) { call; } \
+        double elapsed = benchmark_videocodec_seconds() - start; \
+        printf( "%-24s %10.1f ns per call\n", name, elapsed * 1e9 / ( count ) ); \
+    }
+
+// Times the transform, motion search and deblocking kernels on their own. Build with and without VIDEOCODEC_NO_SIMD to
+// compare the SIMD code with the plain C loops.
+static void benchmark_videocodec_kernels( void ) {
+    enum { W = BENCHMARK_VIDEOCODEC_WIDTH, H = BENCHMARK_VIDEOCODEC_HEIGHT };
+    uint8_t* a = (uint8_t*) malloc( W * H );
+    uint8_t* b = (uint8_t*) malloc( W * H );
+    uint32_t seed = 1;
+    for( int i = 0; i < W * H; ++i ) {
+        seed = seed * 1664525u + 1013904223u;
+        a[ i ] = (uint8_t)( ( ( i % W ) / 8 ) * 3 + ( ( i / W ) / 8 ) * 5 + ( seed >> 30 ) );
+        b[ i ] = (uint8_t)( a[ i ] + ( ( seed >> 24 ) & 7 ) );
+    }
+    uint16_t W8[ 64 ];
+    internal_videocodec_build_window( W8 );
+    int16_t s16[ 64 ], q[ 64 ], e[ 64 ];
+    uint8_t Q[ 64 ], d[ 64 ];
+    int32_t F[ 64 ];
+    for( int i = 0; i < 64; ++i ) {
+        s16[ i ] = (int16_t)( a[ i ] - b[ i + W ] );
+        Q[ i ] = (uint8_t)( 4 + i );
+        q[ i ] = i < 10 ? (int16_t)( ( i * 7 ) % 41 - 20 ) : 0;
+    }
+
+    int n = 2000000;
+    BENCHMARK_VIDEOCODEC_TIME( "fdct 8x8 u8", n, 
+        internal_videocodec_fdct8x8_u8( a + ( i & 63 ), W, F ); benchmark_videocodec_sink += F[ 3 ] )
+    BENCHMARK_VIDEOCODEC_TIME( "fdct 8x8 s16", n, 
+        s16[ 0 ] = (int16_t)( i & 63 ); internal_videocodec_fdct8x8_s16( s16, 8, F ); benchmark_videocodec_sink += F[ 3 ] )
+    BENCHMARK_VIDEOCODEC_TIME( "idct 8x8 dequant u8", n, 
+        q[ 0 ] = (int16_t)( i & 63 ); internal_videocodec_idct8x8_dequant_to_u8( q, Q, W8, d, 8 ); 
+        benchmark_videocodec_sink += d[ 3 ] )
+    BENCHMARK_VIDEOCODEC_TIME( "idct 8x8 dequant s16", n, 
+        q[ 0 ] = (int16_t)( i & 63 ); internal_videocodec_idct8x8_dequant_to_s16( q, Q, W8, e, 8 ); 
+        benchmark_videocodec_sink += e[ 3 ] )
+    BENCHMARK_VIDEOCODEC_TIME( "sad 8x8", n, benchmark_videocodec_sink += internal_videocodec_sad_block_clamped_early( 
+        a, W, H, 64 + ( i & 15 ), 64, b, 65, 64 + ( i & 7 ), 8, INT_MAX ) )
+    BENCHMARK_VIDEOCODEC_TIME( "sad 4x4", n, benchmark_videocodec_sink += internal_videocodec_sad_block_clamped_early( 
+        a, W, H, 64 + ( i & 15 ), 64, b, 65, 64 + ( i & 7 ), 4, INT_MAX ) )
+    BENCHMARK_VIDEOCODEC_TIME( "satd 16x16 half pel", n / 10, benchmark_videocodec_sink += 
+        internal_videocodec_satd16x16_luma_hpel( a, W, H, 64, 64, b, ( i & 7 ) - 3, ( ( i >> 3 ) & 7 ) - 3, INT_MAX ) )
+    BENCHMARK_VIDEOCODEC_TIME( "deblock 640x360 luma", 400, internal_videocodec_deblock_plane( a, W, H, 0 ) )
+
+    free( a );
+    free( b );
+}
+
+int main( int argc, char** argv ) {
+    (void) argc, (void) argv;
+
+    #if defined( INTERNAL_VIDEOCODEC_SIMD_SSE2 )
+        printf( "videocodec benchmark, SSE2\n" );
+    #elif defined( INTERNAL_VIDEOCODEC_SIMD_NEON )
+        printf( "videocodec benchmark, NEON\n" );
+    #else
+        printf( "videocodec benchmark, plain C\n" );
+    #endif
+
+    double single_thread_fps = benchmark_videocodec_encode( 1, 0.0 );
+    #ifdef VIDEOCODEC_THREADS
+        for( int threads = 2; threads <= 16; threads *= 2 ) benchmark_videocodec_encode( threads, single_thread_fps );
+    #else
+        (void) single_thread_fps;
+    #endif
+
+    benchmark_videocodec_kernels();
+    benchmark_videocodec_conversion();
+
+    return EXIT_SUCCESS;
+}
+
+
+#ifdef VIDEOCODEC_THREADS
+    #define THREAD_IMPLEMENTATION
+    #include "thread.h"
+#endif
+
+#endif // VIDEOCODEC_RUN_BENCHMARK
+
+
+
 #ifdef VIDEOCODEC_BUILD_ENCODER
 
 #define _CRT_SECURE_NO_WARNINGS
@@ -2879,7 +5031,7 @@ static int parse_quality_arg( const char* s, enum videocodec_quality_t* out ) {
 }
 
 
-static int process_y4m( const char* in_path, enum videocodec_quality_t qlevel ) {
+static int process_y4m( const char* in_path, enum videocodec_quality_t qlevel, int threads ) {
     FILE* in = NULL;
     FILE* out = NULL;
     char* out_path = NULL;
@@ -2919,6 +5071,7 @@ static int process_y4m( const char* in_path, enum videocodec_quality_t qlevel )
         fprintf( stderr, "Failed to initialize encoder\n" );
         exit( EXIT_FAILURE );
     }
+    videocodec_enc_set_threads( enc, threads );
 
     const size_t ysz = (size_t) w * h, csz = (size_t) ( w / 2 ) * ( h / 2 ), fsz = ysz + csz + csz;
     framebuf = (uint8_t*) malloc( fsz );
@@ -3014,7 +5167,7 @@ static void free_name_list( char** names, size_t cnt ) {
 }
 
 
-static int process_png_dir( const char* dir_path, int fps_n, int fps_d, enum videocodec_quality_t qlevel ) {
+static int process_png_dir( const char* dir_path, int fps_n, int fps_d, enum videocodec_quality_t qlevel, int threads ) {
     dir_t* d = NULL;
     char** names = NULL;
     size_t cnt = 0, cap = 0;
@@ -3114,6 +5267,7 @@ static int process_png_dir( const char* dir_path, int fps_n, int fps_d, enum vid
                 stbi_image_free( img );
                 exit( EXIT_FAILURE );
             }
+            videocodec_enc_set_threads( enc, threads );
         } else {
             if( !( w == enc_w && h == enc_h ) ) {
                 fprintf( stderr, "Size mismatch in '%s' (got %dx%d, expected %dx%d)\n", names[i], w, h, enc_w, enc_h );
@@ -3174,10 +5328,11 @@ static int process_png_dir( const char* dir_path, int fps_n, int fps_d, enum vid
 
 int main( int argc, char** argv ) {
     if( argc < 2 ) {
-        printf( "Usage:\n  %s input.y4m [quality:1..5]\n  %s <png_folder> <fps_n[:fps_d]> [quality:1..5]\n", argv[0], argv[0] );
+        printf( "Usage:\n  %s input.y4m [quality:1..5] [threads]\n  %s <png_folder> <fps_n[:fps_d]> [quality:1..5] [threads]\n", argv[0], argv[0] );
         return EXIT_FAILURE;
     }
     enum videocodec_quality_t qlevel = VIDEOCODEC_QUALITY_DEFAULT;
+    int threads = 1;
     const char* in = argv[1];
     const char* ext = path_extname( in );
     int is_y4m = strcmp( ext, ".y4m" ) == 0;
@@ -3192,10 +5347,14 @@ int main( int argc, char** argv ) {
             }
             qlevel = qtmp;
         }
-        return process_y4m( in, qlevel );
+        if( argc >= 4 && ( threads = atoi( argv[3] ) ) <= 0 ) {
+            fprintf( stderr, "Invalid thread count '%s'\n", argv[3] );
+            exit( EXIT_FAILURE );
+        }
+        return process_y4m( in, qlevel, threads );
     } else if( !has_ext ) {
         if( argc < 3 ) {
-            fprintf( stderr, "PNG mode requires framerate\nUsage: %s <png_folder> <fps_n[:fps_d]> [quality]\n", argv[0] );
+            fprintf( stderr, "PNG mode requires framerate\nUsage: %s <png_folder> <fps_n[:fps_d]> [quality] [threads]\n", argv[0] );
             exit( EXIT_FAILURE );
         }
         int fps_n = 0, fps_d = 1;
@@ -3211,7 +5370,11 @@ int main( int argc, char** argv ) {
             }
             qlevel = qtmp;
         }
-        return process_png_dir( in, fps_n, fps_d, qlevel );
+        if( argc >= 5 && ( threads = atoi( argv[4] ) ) <= 0 ) {
+            fprintf( stderr, "Invalid thread count '%s'\n", argv[4] );
+            exit( EXIT_FAILURE );
+        }
+        return process_png_dir( in, fps_n, fps_d, qlevel, threads );
     } else {
         fprintf( stderr, "Unknown input type '%s' (expected .y4m file or folder without extension)\n", in );
         exit( EXIT_FAILURE );
@@ -3230,6 +5393,11 @@ int main( int argc, char** argv ) {
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#ifdef VIDEOCODEC_THREADS
+    #define THREAD_IMPLEMENTATION
+    #include "thread.h"
+#endif
+
 #endif // VIDEOCODEC_BUILD_ENCODER
 
 
@@ -3322,6 +5490,7 @@ typedef struct {
     FILE* dec_fp;
     uint8_t* in_buf;
     size_t in_cap;
+    size_t in_len;
     uint32_t* frame;
     stb_vorbis* ogg;
     int have_audio;
@@ -3376,27 +5545,43 @@ static int audio_open( player_t* p, const char* path ) {
 }
 
 
-static int videocodec_decode_one( player_t* p ) {
-    size_t need = videocodec_dec_next_frame( p->dec, NULL, 0, NULL );
-    if( need == 0 ) {
-        return 0;
-    }
-    if( need > p->in_cap ) {
-        void* nb = realloc( p->in_buf, need );
-        if( !nb ) {
-            return 0;
+// Reads frames from the file and queues them, until the decoder's queue is full. A frame which didn't fit is kept in 
+// `in_buf`, and queued on the next call
+static void videocodec_queue_frames( player_t* p ) {
+    for( ; ; ) {
+        if( p->in_len == 0 ) {
+            size_t need = videocodec_dec_next_frame( p->dec, NULL, 0, NULL );
+            if( need == 0 ) {
+                return;
+            }
+            if( need > p->in_cap ) {
+                void* nb = realloc( p->in_buf, need );
+                if( !nb ) {
+                    return;
+                }
+                p->in_buf = (uint8_t*) nb;
+                p->in_cap = need;
+            }
+            size_t rd = fread( p->in_buf, 1, need, p->dec_fp );
+            if( rd != need ) {
+                return;
+            }
+            p->in_len = need;
         }
-        p->in_buf = (uint8_t*) nb;
-        p->in_cap = need;
-    }
-    size_t rd = fread( p->in_buf, 1, need, p->dec_fp );
-    if( rd != need ) {
-        return 0;
+        if( !videocodec_dec_push_frame( p->dec, p->in_buf, p->in_len ) ) {
+            return;
+        }
+        p->in_len = 0;
     }
-    size_t next = videocodec_dec_next_frame( p->dec, p->in_buf, need, p->frame );
-    if( next == 0 ) {
+}
+
+
+static int videocodec_decode_one( player_t* p ) {
+    videocodec_queue_frames( p );
+    if( !videocodec_dec_pull_frame( p->dec, p->frame, 1 ) ) {
         return 0;
     }
+    videocodec_queue_frames( p ); // so the next frames decode while this one is shown
     return 1;
 }
 
@@ -3413,6 +5598,7 @@ static int videocodec_restart( player_t* p ) {
     if( p->dec ) {
         videocodec_dec_destroy( p->dec );
     }
+    p->in_len = 0;
     p->dec = videocodec_dec_create( hdr );
     if( !p->dec ) {
         return 0;
@@ -3689,6 +5875,11 @@ int main( int argc, char** argv ) {
 #undef STB_VORBIS_HEADER_ONLY
 #include "stb_vorbis.c"
 
+#ifdef VIDEOCODEC_THREADS
+    #define THREAD_IMPLEMENTATION
+    #include "thread.h"
+#endif
+
 #endif // VIDEOCODEC_BUILD_PLAYER
 
 